@@ -1,4 +1,5 @@
 #include "client.h"
+#include "core/hashtable.h"
 #include "networking/networking.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,6 +26,7 @@ client_t *init_client(const int client_fd, const struct sockaddr_storage ss,
     }
     client->buf_used = 0;
     client->wbuf_used = 0;
+    client->wbuf_sent = 0;
     client->write_failed = false;
     client->write_registered = false;
     client->frame_need = -1;
@@ -63,6 +65,18 @@ void free_client(client_t *client)
     if (!client)
         return;
 
+    for (size_t i = 0; i < client->wbuf_values_count; i++) {
+        value_entry_t *value =
+            client->wbuf_values[client->wbuf_values_head + i].value;
+        if (value) // not a deferred reply still due
+            value_entry_unpin(value);
+    }
+    free(client->wbuf_values);
+    for (unsigned i = 0; i < client->zerocopy_inflight; i++)
+        value_entry_unpin(client->zerocopy_sends[i].value);
+    free(client->wbuf_retired);
+    free(client->stream_value);
+    free(client->large);
     free(client->wbuf);
     free(client);
 }
@@ -5,13 +5,38 @@
 
 #include <arpa/inet.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+struct value_entry_t;
+
 #define FKVS_CLIENT_READ_BUFFER_SIZE 65536
 #define FKVS_CLIENT_WRITE_BUFFER_INITIAL_CAPACITY 65536
 #define FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY (1024U * 1024U)
+// Reply values at least this long are sent from the stored entry instead of
+// being copied into wbuf (see send_value_reply()).
+#define FKVS_ZERO_COPY_REPLY_MIN (16U * 1024U)
 #define BUFFER_SIZE FKVS_CLIENT_READ_BUFFER_SIZE
+// Most zero-copy sends a client may have awaiting the kernel's completion.
+#define FKVS_ZEROCOPY_MAX_INFLIGHT 8
+
+// A value queued for sending in place, between wbuf bytes [0, at) and
+// [at, wbuf_used). The client holds a pin on it until it is sent. A NULL
+// value is a deferred reply (see wbuf_defer_reply()): nothing after it goes
+// out until the reply numbered `ticket` fills it.
+typedef struct wbuf_value_t {
+    size_t at;
+    struct value_entry_t *value;
+    uint32_t ticket;
+} wbuf_value_t;
+
+// A MSG_ZEROCOPY send the kernel may still be reading; the client holds an
+// extra pin on the value until the completion with this id arrives.
+typedef struct zerocopy_send_t {
+    uint32_t id;
+    struct value_entry_t *value;
+} zerocopy_send_t;
 
 typedef struct client_t {
     char *command_type;
@@ -28,9 +53,47 @@ typedef struct client_t {
         socket_domain; // The socket domain we are using (Unix Domain or TCP/IP)
 
     unsigned char buffer[FKVS_CLIENT_READ_BUFFER_SIZE];
+    // A frame too big for `buffer` is assembled here, sized once from its
+    // header; reads land in place until it is complete (see networking.h).
+    unsigned char *large;
+    size_t large_len;              // full frame size
+    size_t large_used;             // bytes received so far
+    // A long SET's value is received straight into the entry it will be
+    // stored as; `large` then holds the frame with the value cut out.
+    struct value_entry_t *stream_value; // malloc'd; release with free()
+    size_t stream_at;                   // value's offset in the frame
+    size_t stream_used;                 // value bytes received so far
     unsigned char *wbuf;           // queued response bytes
     size_t wbuf_capacity;          // allocated response queue capacity
     size_t wbuf_used;              // bytes currently in response queue
+    size_t wbuf_sent;              // leading bytes of wbuf already sent
+    wbuf_value_t *wbuf_values;     // pinned values, in send order
+    size_t wbuf_values_head;       // first unsent entry
+    size_t wbuf_values_count;      // unsent entries
+    size_t wbuf_values_capacity;
+    size_t wbuf_value_sent;  // bytes of the first unsent value already sent
+    size_t wbuf_pinned;      // unsent value bytes, counted against the cap
+    uint32_t wbuf_next_ticket; // numbers deferred replies
+    // Frames forwarded to the shard that owns their key (see shard.h).
+    uint32_t shard_inflight;   // forwarded frames whose reply is not back
+    bool shard_orphaned;       // dropped meanwhile; the last reply frees it
+    // Completion-based event loops (io_uring) submit sends themselves; see
+    // wbuf_send_begin().
+    bool write_async;              // wbuf_flush() leaves the queue alone
+    bool send_inflight;            // the kernel is reading queued bytes
+    uint64_t send_op;              // io_uring user_data of that send
+    unsigned char *wbuf_retired;   // old wbuf block a send still reads from
+    bool fd_fixed;                 // fd is an io_uring registered-file slot
+    bool recv_armed;               // io_uring multishot recv outstanding
+    bool close_pending;            // dropped; freed once its ops complete
+    // Zero-copy sends awaiting completion (see wbuf_zerocopy_value()). The
+    // epoll loop tracks them here by MSG_ZEROCOPY id; io_uring tracks each
+    // request itself and only counts them here.
+    zerocopy_send_t zerocopy_sends[FKVS_ZEROCOPY_MAX_INFLIGHT];
+    unsigned zerocopy_inflight;
+    uint32_t zerocopy_next_id;     // the kernel numbers sends from 0
+    bool zerocopy_armed;           // SO_ZEROCOPY is set on the socket
+    bool zerocopy_refused;         // the socket copies or cannot zero-copy
     char ip_str[INET6_ADDRSTRLEN]; // TODO: Remove this in the future
     bool write_failed;             // close client after unrecoverable send error
     bool write_registered;         // event loop is watching write readiness
@@ -39,6 +102,13 @@ typedef struct client_t {
     bool verbose; // print additional information during runtime
 } client_t __attribute__((aligned(64)));
 
+// Whether responses are queued but not yet fully sent.
+static inline bool client_write_pending(const client_t *client)
+{
+    return client->wbuf_used > client->wbuf_sent ||
+           client->wbuf_values_count > 0;
+}
+
 client_t *init_client(int client_fd, struct sockaddr_storage ss,
                       enum socket_domain socket_domain);
 // Releases client-owned memory. The caller owns closing client->fd.
@@ -0,0 +1,41 @@
+#include "clock.h"
+
+#include <time.h>
+
+_Thread_local fkvs_clock_t fkvs_clock = {.source = FKVS_CLOCK_REALTIME};
+
+static inline int64_t read_ms(const clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void fkvs_clock_init(const fkvs_clock_source source, const bool cached)
+{
+    fkvs_clock.source = source;
+    fkvs_clock.offset_ms = source == FKVS_CLOCK_MONOTONIC
+                               ? read_ms(CLOCK_REALTIME) -
+                                     read_ms(CLOCK_MONOTONIC)
+                               : 0;
+    fkvs_clock.cached = cached;
+    fkvs_clock_update();
+}
+
+int64_t fkvs_clock_read(void)
+{
+    if (fkvs_clock.source == FKVS_CLOCK_MONOTONIC)
+        return read_ms(CLOCK_MONOTONIC) + fkvs_clock.offset_ms;
+    return read_ms(CLOCK_REALTIME);
+}
+
+int64_t fkvs_clock_update(void)
+{
+    fkvs_clock.now_ms = fkvs_clock_read();
+    return fkvs_clock.now_ms;
+}
+
+const char *fkvs_clock_source_to_string(const fkvs_clock_source source)
+{
+    return source == FKVS_CLOCK_MONOTONIC ? "monotonic" : "realtime";
+}
@@ -0,0 +1,48 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Server clock, in milliseconds since the Unix epoch, used for key
+ * deadlines.
+ *
+ * The event loop calls fkvs_clock_update() once per wakeup. With caching on,
+ * every fkvs_now_ms() in that pass returns the same value: one clock read
+ * serves a whole batch of pipelined frames, and all commands in the batch see
+ * the same time. With caching off (the default, and what tests and tools get),
+ * fkvs_now_ms() reads the clock each call.
+ *
+ * FKVS_CLOCK_MONOTONIC reads CLOCK_MONOTONIC plus the wall-clock offset
+ * sampled at fkvs_clock_init(). It does not jump when NTP steps the wall
+ * clock, so TTLs keep their length, at the cost of drifting from wall time
+ * over a long uptime. Deadlines never leave the process, so that drift is
+ * harmless.
+ */
+typedef enum {
+    FKVS_CLOCK_REALTIME = 0,
+    FKVS_CLOCK_MONOTONIC,
+} fkvs_clock_source;
+
+typedef struct fkvs_clock {
+    int64_t now_ms; // last value read by fkvs_clock_update()
+    int64_t offset_ms; // realtime - monotonic at init (monotonic source)
+    fkvs_clock_source source;
+    bool cached;
+} fkvs_clock_t;
+
+// Per thread: every reactor thread caches its own reading.
+extern _Thread_local fkvs_clock_t fkvs_clock;
+
+void fkvs_clock_init(fkvs_clock_source source, bool cached);
+int64_t fkvs_clock_read(void);
+int64_t fkvs_clock_update(void);
+const char *fkvs_clock_source_to_string(fkvs_clock_source source);
+
+static inline int64_t fkvs_now_ms(void)
+{
+    return fkvs_clock.cached ? fkvs_clock.now_ms : fkvs_clock_read();
+}
+
+#endif // CLOCK_H
@@ -3,6 +3,7 @@
 #include "../../commands/common/command_defs.h"
 #include "../../commands/common/command_parser.h"
 #include "../../commands/common/command_tokenizer.h"
+#include "../../commands/common/frame.h"
 #include "../../response_defs.h"
 #include "../../keygen.h"
 #include "../../utils.h"
@@ -426,6 +427,102 @@ void cmd_keys(const command_args_t args, void (*response_cb)(client_t *client))
     response_cb(args.client);
 }
 
+void cmd_object(const command_args_t args, void (*response_cb)(client_t *client))
+{
+    if (strncasecmp(args.cmd, "OBJECT ", 7) != 0) {
+        return;
+    }
+
+    command_tokens_t tokens;
+    command_tokenize(args.cmd, &tokens);
+    if (tokens.argc != 3 || strcasecmp(tokens.argv[1], "FREQ") != 0) {
+        printf("(error) ERR unknown subcommand or wrong number of arguments "
+               "for 'object' command\n");
+        printf("(info) Usage: OBJECT FREQ <key>\n");
+        return;
+    }
+    const char *key = tokens.argv[2];
+
+    size_t cmd_len;
+    unsigned char *binary_cmd = construct_object_freq_command(key, &cmd_len);
+    if (binary_cmd == NULL) {
+        fprintf(stderr, "Failed to construct OBJECT FREQ command\n");
+        return;
+    }
+
+    assert(cmd_len > 0);
+    assert(args.client->fd > 0);
+
+    send(args.client->fd, binary_cmd, cmd_len, 0);
+    free(binary_cmd);
+    response_cb(args.client);
+}
+
+void cmd_unlink(const command_args_t args, void (*response_cb)(client_t *client))
+{
+    if (strncasecmp(args.cmd, "UNLINK ", 7) != 0) {
+        return;
+    }
+
+    command_tokens_t tokens;
+    command_tokenize(args.cmd, &tokens);
+    if (tokens.argc != 2) {
+        printf("(error) ERR wrong number of arguments for 'unlink' command\n");
+        printf("(info) Usage: UNLINK <key>\n");
+        return;
+    }
+    const char *key = tokens.argv[1];
+
+    size_t cmd_len;
+    unsigned char *binary_cmd = construct_unlink_command(key, &cmd_len);
+    if (binary_cmd == NULL) {
+        fprintf(stderr, "Failed to construct UNLINK command\n");
+        return;
+    }
+
+    assert(cmd_len > 0);
+    assert(args.client->fd > 0);
+
+    send(args.client->fd, binary_cmd, cmd_len, 0);
+    free(binary_cmd);
+    response_cb(args.client);
+}
+
+void cmd_flushall(const command_args_t args,
+                  void (*response_cb)(client_t *client))
+{
+    if (strncasecmp(args.cmd, "FLUSHALL", 8) != 0 ||
+        (args.cmd[8] != '\0' && args.cmd[8] != ' ')) {
+        return;
+    }
+
+    command_tokens_t tokens;
+    command_tokenize(args.cmd, &tokens);
+    const bool async =
+        tokens.argc == 2 && strcasecmp(tokens.argv[1], "ASYNC") == 0;
+    if (tokens.argc > 2 ||
+        (tokens.argc == 2 && !async &&
+         strcasecmp(tokens.argv[1], "SYNC") != 0)) {
+        printf("(error) ERR syntax error\n");
+        printf("(info) Usage: FLUSHALL [ASYNC|SYNC]\n");
+        return;
+    }
+
+    size_t cmd_len;
+    unsigned char *binary_cmd = construct_flushall_command(async, &cmd_len);
+    if (binary_cmd == NULL) {
+        fprintf(stderr, "Failed to construct FLUSHALL command\n");
+        return;
+    }
+
+    assert(cmd_len > 0);
+    assert(args.client->fd > 0);
+
+    send(args.client->fd, binary_cmd, cmd_len, 0);
+    free(binary_cmd);
+    response_cb(args.client);
+}
+
 /*
  * TODO: This approach works but is cumbersome to maintain. For future
  * reference, lets implement a solution that doesn't require us to have a
@@ -449,6 +546,9 @@ void cmd_unknown(const command_args_t args,
         strncmp(args.cmd, "TTL ", 4) &&
         strncmp(args.cmd, "PERSIST ", 8) &&
         strncmp(args.cmd, "INFO", 5) &&
+        strncasecmp(args.cmd, "OBJECT ", 7) &&
+        strncasecmp(args.cmd, "UNLINK ", 7) &&
+        strncasecmp(args.cmd, "FLUSHALL", 8) &&
         !command_equals(args.cmd, "KEYS")) {
         printf("Unknown command \n");
     }
@@ -463,7 +563,10 @@ const cmd_t command_table[] = {
     {"cmd_ttl", cmd_ttl},         {"cmd_persist", cmd_persist},
     {"cmd_unknown", cmd_unknown},
     {"cmd_info", cmd_info},
-    {"cmd_keys", cmd_keys}};
+    {"cmd_keys", cmd_keys},
+    {"cmd_object", cmd_object},
+    {"cmd_unlink", cmd_unlink},
+    {"cmd_flushall", cmd_flushall}};
 
 void execute_command(const char *cmd, client_t *client,
                      void (*response_cb)(client_t *client))
@@ -554,9 +657,12 @@ uint64_t recv_pipeline_responses(client_t *client, uint64_t count)
         // Try to parse complete frames from what we already have buffered
         while (received < count && client->buf_used >= 2) {
             if (client->frame_need < 0) {
-                uint16_t core_len =
-                    ((uint16_t)client->buffer[0] << 8) | client->buffer[1];
-                client->frame_need = 2 + (ssize_t)core_len;
+                size_t header_len;
+                size_t frame_len;
+                if (!frame_measure(client->buffer, client->buf_used,
+                                   &header_len, &frame_len))
+                    break; // need the rest of a long header
+                client->frame_need = (ssize_t)frame_len;
                 if ((size_t)client->frame_need > sizeof(client->buffer)) {
                     // Frame too large, reset and bail
                     client->buf_used = 0;
@@ -617,23 +723,24 @@ typedef struct {
     size_t payload_len;
 } client_response_t;
 
-static bool decode_value_response(const unsigned char *frame,
-                                  const size_t frame_len,
-                                  const uint16_t core_len,
+// `core` is [type][value_len][payload]; value_len is 4 bytes in long frames.
+static bool decode_value_response(const unsigned char *core,
+                                  const size_t core_len,
+                                  const size_t len_width,
                                   const client_response_kind_t kind,
                                   client_response_t *response)
 {
-    if (core_len < 3 || frame_len < 5)
+    if (core_len < 1 + len_width)
         return false;
 
-    const size_t payload_len = ((size_t)frame[3] << 8) | frame[4];
-    if (payload_len != (size_t)core_len - 3)
-        return false;
-    if (frame_len < 5 + payload_len)
+    const size_t payload_len = len_width == 4
+                                   ? frame_read_u32(&core[1])
+                                   : ((size_t)core[1] << 8) | core[2];
+    if (payload_len != core_len - 1 - len_width)
         return false;
 
     response->kind = kind;
-    response->payload = &frame[5];
+    response->payload = &core[1 + len_width];
     response->payload_len = payload_len;
     return true;
 }
@@ -642,15 +749,16 @@ static bool decode_response_frame(const unsigned char *frame,
                                   const size_t frame_len,
                                   client_response_t *response)
 {
-    if (frame_len < 3)
-        return false;
-
-    const uint16_t core_len = ((uint16_t)frame[0] << 8) | frame[1];
-    const size_t total_len = (size_t)core_len + 2;
-    if (frame_len < total_len)
+    size_t header_len;
+    size_t total_len;
+    if (!frame_measure(frame, frame_len, &header_len, &total_len) ||
+        total_len <= header_len || frame_len < total_len)
         return false;
 
-    const unsigned char response_type = frame[2];
+    const unsigned char *core = frame + header_len;
+    const size_t core_len = total_len - header_len;
+    const size_t len_width = header_len == FRAME_LONG_HEADER_LEN ? 4 : 2;
+    const unsigned char response_type = core[0];
     if (core_len == 1) {
         if (response_type == STATUS_FAILURE) {
             response->kind = CLIENT_RESPONSE_ERROR;
@@ -669,16 +777,16 @@ static bool decode_response_frame(const unsigned char *frame,
 
     switch (response_type) {
     case STATUS_SUCCESS:
-        return decode_value_response(frame, total_len, core_len,
+        return decode_value_response(core, core_len, len_width,
                                      CLIENT_RESPONSE_VALUE, response);
     case CMD_PING:
-        return decode_value_response(frame, total_len, core_len,
+        return decode_value_response(core, core_len, len_width,
                                      CLIENT_RESPONSE_PONG, response);
     case CMD_INFO:
-        return decode_value_response(frame, total_len, core_len,
+        return decode_value_response(core, core_len, len_width,
                                      CLIENT_RESPONSE_INFO, response);
     case CMD_KEYS:
-        return decode_value_response(frame, total_len, core_len,
+        return decode_value_response(core, core_len, len_width,
                                      CLIENT_RESPONSE_KEYS, response);
     default:
         return false;
@@ -701,21 +809,37 @@ static bool recv_exact(const int fd, unsigned char *buffer, const size_t len)
     return true;
 }
 
-static bool read_response(client_t *client, client_response_t *response)
+// Reads one response frame into client->buffer, or into a malloc'd block
+// returned through `*large` when a long frame does not fit (caller frees).
+static bool read_response(client_t *client, client_response_t *response,
+                          unsigned char **large)
 {
-    if (!recv_exact(client->fd, client->buffer, 2))
+    *large = NULL;
+    if (!recv_exact(client->fd, client->buffer, FRAME_SHORT_HEADER_LEN))
         return false;
-
-    const uint16_t core_len =
-        ((uint16_t)client->buffer[0] << 8) | client->buffer[1];
-    const size_t total_len = (size_t)core_len + 2;
-    if (total_len > BUFFER_SIZE)
+    if (frame_is_long(client->buffer) &&
+        !recv_exact(client->fd, client->buffer + FRAME_SHORT_HEADER_LEN,
+                    FRAME_LONG_HEADER_LEN - FRAME_SHORT_HEADER_LEN))
         return false;
 
-    if (!recv_exact(client->fd, client->buffer + 2, core_len))
+    size_t header_len;
+    size_t total_len;
+    (void)frame_measure(client->buffer, FRAME_LONG_HEADER_LEN, &header_len,
+                        &total_len);
+
+    unsigned char *frame = client->buffer;
+    if (total_len > BUFFER_SIZE) {
+        frame = malloc(total_len);
+        if (!frame)
+            return false;
+        memcpy(frame, client->buffer, header_len);
+        *large = frame;
+    }
+
+    if (!recv_exact(client->fd, frame + header_len, total_len - header_len))
         return false;
 
-    return decode_response_frame(client->buffer, total_len, response);
+    return decode_response_frame(frame, total_len, response);
 }
 
 static void print_quoted_payload(const unsigned char *payload,
@@ -776,8 +900,8 @@ static void print_response(const client_response_t *response,
 void command_response_handler(client_t *client)
 {
     client_response_t response;
-    if (!read_response(client, &response))
-        return;
-
-    print_response(&response, client->benchmark_mode);
+    unsigned char *large;
+    if (read_response(client, &response, &large))
+        print_response(&response, client->benchmark_mode);
+    free(large);
 }
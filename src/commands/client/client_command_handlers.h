@@ -56,6 +56,12 @@ void cmd_persist(command_args_t args, void (*response_cb)(client_t *client));
 
 void cmd_keys(command_args_t args, void (*response_cb)(client_t *client));
 
+void cmd_object(command_args_t args, void (*response_cb)(client_t *client));
+
+void cmd_unlink(command_args_t args, void (*response_cb)(client_t *client));
+
+void cmd_flushall(command_args_t args, void (*response_cb)(client_t *client));
+
 void command_response_handler(client_t *client);
 
 #endif // CLIENT_COMMAND_HANDLERS
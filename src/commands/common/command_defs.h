@@ -14,5 +14,11 @@
 #define CMD_TTL     0x0B
 #define CMD_PERSIST 0x0C
 #define CMD_KEYS    0x0D
+#define CMD_OBJECT_FREQ 0x0E
+#define CMD_UNLINK  0x0F
+#define CMD_FLUSHALL 0x10
+
+// Optional FLUSHALL argument byte.
+#define FLUSHALL_ASYNC 0x01
 
 #endif // COMMAND_DEFS_H
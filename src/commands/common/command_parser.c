@@ -1,76 +1,80 @@
 #include "../common/command_parser.h"
 #include "../../utils.h"
 #include "../common/command_defs.h"
+#include "../common/frame.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 
-unsigned char *construct_set_command(const char *key, const char *value,
-                                     size_t *command_len)
+// SET [EX]: [header][CMD_SET][2B key_len][key][value_len][value]
+// [2B sec_len][seconds]. Values too large for a short frame go in a long one,
+// where value_len is 4 bytes (see frame.h).
+static unsigned char *construct_set_frame(const char *key, const char *value,
+                                          const char *seconds,
+                                          size_t *command_len)
 {
-    size_t key_len = strlen(key);
-    size_t value_len = strlen(value);
-    const size_t core_cmd_len = 1 + 2 + key_len + 2 + value_len;
+    const size_t key_len = strlen(key);
+    const size_t value_len = strlen(value);
+    const size_t sec_len = seconds ? strlen(seconds) : 0;
+    const size_t ex_len = seconds ? 2 + sec_len : 0;
+
+    size_t value_len_width = 2;
+    size_t core_cmd_len = 1 + 2 + key_len + value_len_width + value_len + ex_len;
+    if (core_cmd_len > FRAME_SHORT_CORE_MAX) {
+        value_len_width = 4;
+        core_cmd_len += 2;
+        if (core_cmd_len > UINT32_MAX)
+            return NULL;
+    }
 
-    *command_len = 2 + core_cmd_len;
+    unsigned char header[FRAME_LONG_HEADER_LEN];
+    const size_t header_len = frame_write_header(header, core_cmd_len);
+    *command_len = header_len + core_cmd_len;
 
     unsigned char *binary_cmd = malloc(*command_len);
     if (!binary_cmd) {
         return NULL;
     }
 
-    binary_cmd[0] = core_cmd_len >> 8 & 0xFF;
-    binary_cmd[1] = core_cmd_len & 0xFF;
-
-    binary_cmd[2] = CMD_SET;
-    binary_cmd[3] = key_len >> 8 & 0xFF;
-    binary_cmd[4] = key_len & 0xFF;
-    memcpy(&binary_cmd[5], key, key_len);
-
-    const size_t pos = 5 + key_len;
-    binary_cmd[pos + 0] = value_len >> 8 & 0xFF;
-    binary_cmd[pos + 1] = value_len & 0xFF;
-    memcpy(&binary_cmd[pos + 2], value, value_len);
+    memcpy(binary_cmd, header, header_len);
+    size_t pos = header_len;
+    binary_cmd[pos++] = CMD_SET;
+    binary_cmd[pos++] = key_len >> 8 & 0xFF;
+    binary_cmd[pos++] = key_len & 0xFF;
+    memcpy(&binary_cmd[pos], key, key_len);
+    pos += key_len;
+
+    if (value_len_width == 4) {
+        frame_write_u32(&binary_cmd[pos], (uint32_t)value_len);
+    } else {
+        binary_cmd[pos + 0] = value_len >> 8 & 0xFF;
+        binary_cmd[pos + 1] = value_len & 0xFF;
+    }
+    pos += value_len_width;
+    memcpy(&binary_cmd[pos], value, value_len);
+    pos += value_len;
+
+    if (seconds) {
+        binary_cmd[pos + 0] = sec_len >> 8 & 0xFF;
+        binary_cmd[pos + 1] = sec_len & 0xFF;
+        memcpy(&binary_cmd[pos + 2], seconds, sec_len);
+    }
 
     return binary_cmd;
 }
 
+unsigned char *construct_set_command(const char *key, const char *value,
+                                     size_t *command_len)
+{
+    return construct_set_frame(key, value, NULL, command_len);
+}
+
 unsigned char *construct_set_ex_command(const char *key, const char *value,
                                         const char *seconds,
                                         size_t *command_len)
 {
-    size_t key_len = strlen(key);
-    size_t value_len = strlen(value);
-    size_t sec_len = strlen(seconds);
-    const size_t core_cmd_len = 1 + 2 + key_len + 2 + value_len + 2 + sec_len;
-
-    *command_len = 2 + core_cmd_len;
-
-    unsigned char *binary_cmd = malloc(*command_len);
-    if (!binary_cmd) {
-        return NULL;
-    }
-
-    binary_cmd[0] = core_cmd_len >> 8 & 0xFF;
-    binary_cmd[1] = core_cmd_len & 0xFF;
-
-    binary_cmd[2] = CMD_SET;
-    binary_cmd[3] = key_len >> 8 & 0xFF;
-    binary_cmd[4] = key_len & 0xFF;
-    memcpy(&binary_cmd[5], key, key_len);
-
-    size_t pos = 5 + key_len;
-    binary_cmd[pos + 0] = value_len >> 8 & 0xFF;
-    binary_cmd[pos + 1] = value_len & 0xFF;
-    memcpy(&binary_cmd[pos + 2], value, value_len);
-
-    pos = pos + 2 + value_len;
-    binary_cmd[pos + 0] = sec_len >> 8 & 0xFF;
-    binary_cmd[pos + 1] = sec_len & 0xFF;
-    memcpy(&binary_cmd[pos + 2], seconds, sec_len);
-
-    return binary_cmd;
+    return construct_set_frame(key, value, seconds, command_len);
 }
 
 unsigned char *construct_get_command(const char *key, size_t *command_len)
@@ -345,3 +349,66 @@ unsigned char *construct_keys_command(size_t *command_len)
 
     return binary_cmd;
 }
+
+unsigned char *construct_object_freq_command(const char *key,
+                                             size_t *command_len)
+{
+    size_t key_len = strlen(key);
+    const size_t core_cmd_len = 3 + key_len;
+    *command_len = 2 + core_cmd_len;
+
+    unsigned char *binary_cmd = malloc(*command_len);
+    if (!binary_cmd) {
+        return NULL;
+    }
+
+    binary_cmd[0] = core_cmd_len >> 8 & 0xFF;
+    binary_cmd[1] = core_cmd_len & 0xFF;
+    binary_cmd[2] = CMD_OBJECT_FREQ;
+    binary_cmd[3] = key_len >> 8 & 0xFF;
+    binary_cmd[4] = key_len & 0xFF;
+    memcpy(&binary_cmd[5], key, key_len);
+
+    return binary_cmd;
+}
+
+unsigned char *construct_unlink_command(const char *key, size_t *command_len)
+{
+    size_t key_len = strlen(key);
+    const size_t core_cmd_len = 3 + key_len;
+    *command_len = 2 + core_cmd_len;
+
+    unsigned char *binary_cmd = malloc(*command_len);
+    if (!binary_cmd) {
+        return NULL;
+    }
+
+    binary_cmd[0] = core_cmd_len >> 8 & 0xFF;
+    binary_cmd[1] = core_cmd_len & 0xFF;
+    binary_cmd[2] = CMD_UNLINK;
+    binary_cmd[3] = key_len >> 8 & 0xFF;
+    binary_cmd[4] = key_len & 0xFF;
+    memcpy(&binary_cmd[5], key, key_len);
+
+    return binary_cmd;
+}
+
+unsigned char *construct_flushall_command(const bool async,
+                                          size_t *command_len)
+{
+    const size_t core_cmd_len = async ? 2 : 1;
+    *command_len = 2 + core_cmd_len;
+
+    unsigned char *binary_cmd = malloc(*command_len);
+    if (!binary_cmd) {
+        return NULL;
+    }
+
+    binary_cmd[0] = core_cmd_len >> 8 & 0xFF;
+    binary_cmd[1] = core_cmd_len & 0xFF;
+    binary_cmd[2] = CMD_FLUSHALL;
+    if (async)
+        binary_cmd[3] = FLUSHALL_ASYNC;
+
+    return binary_cmd;
+}
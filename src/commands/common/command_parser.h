@@ -39,4 +39,11 @@ unsigned char *construct_persist_command(const char *key, size_t *command_len);
 
 unsigned char *construct_keys_command(size_t *command_len);
 
+unsigned char *construct_object_freq_command(const char *key,
+                                             size_t *command_len);
+
+unsigned char *construct_unlink_command(const char *key, size_t *command_len);
+
+unsigned char *construct_flushall_command(bool async, size_t *command_len);
+
 #endif // COMMAND_PARSER_H
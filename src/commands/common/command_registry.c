@@ -1,15 +1,24 @@
 #include "../common/command_registry.h"
+#include "../../core/hashtable.h"
 #include "../../response_defs.h"
 #include "../../utils.h"
 #include "../common/command_defs.h"
+#include "../common/frame.h"
 
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #define MAX_COMMANDS 256
+// iovecs per sendmsg() when draining wbuf with pinned values in between.
+#define WBUF_IOV_MAX 64
+
+// Only malloc'd values can be pinned; slab objects are recycled in place.
+_Static_assert(FKVS_ZERO_COPY_REPLY_MIN > HASHTABLE_LARGE_VALUE_MIN,
+               "zero-copy replies must only pin malloc'd values");
 
 #ifdef MSG_NOSIGNAL
 #define FKVS_SEND_FLAGS MSG_NOSIGNAL
@@ -17,13 +26,67 @@
 #define FKVS_SEND_FLAGS 0
 #endif
 
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+#define FKVS_HAVE_MSG_ZEROCOPY
+#include <asm/socket.h> // SO_ZEROCOPY
+#include <netinet/in.h>
+#include <time.h> // before linux/errqueue.h, which needs struct timespec
+#include <linux/errqueue.h>
+#endif
+
 static CommandHandler command_handlers[MAX_COMMANDS] = {0};
+// Commands whose handler parses long frames (see frame.h).
+static bool long_frame_commands[MAX_COMMANDS] = {0};
+// Smallest value sent zero-copy; 0 turns zero-copy sends off.
+static size_t zerocopy_send_min = 0;
+
+static bool zerocopy_wanted(const client_t *client,
+                            const value_entry_t *value)
+{
+    return zerocopy_send_min != 0 && !client->zerocopy_refused &&
+           value->value_len >= zerocopy_send_min;
+}
 
 void register_command(const uint8_t command_id, const CommandHandler handler)
 {
     command_handlers[command_id] = handler;
 }
 
+// Drop the already-sent prefix of the response queue.
+static void wbuf_compact(client_t *client)
+{
+    const size_t pending = client->wbuf_used - client->wbuf_sent;
+    if (pending > 0 && client->wbuf_sent > 0)
+        memmove(client->wbuf, client->wbuf + client->wbuf_sent, pending);
+    for (size_t i = 0; i < client->wbuf_values_count; i++)
+        client->wbuf_values[client->wbuf_values_head + i].at -=
+            client->wbuf_sent;
+    client->wbuf_used = pending;
+    client->wbuf_sent = 0;
+}
+
+// The cap bounds what may queue behind a slow reader, pinned values
+// included. One reply larger than the cap (a big value, bounded by
+// proto-max-bulk-len) still fits on top of it.
+static size_t wbuf_cap(const size_t len)
+{
+    return len > FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY
+               ? FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY + len
+               : FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY;
+}
+
+static bool wbuf_admit(client_t *client, const size_t len)
+{
+    const size_t max_capacity = wbuf_cap(len);
+    const size_t pending =
+        client->wbuf_used - client->wbuf_sent + client->wbuf_pinned;
+    if (pending > max_capacity || len > max_capacity - pending) {
+        client->write_failed = true;
+        return false;
+    }
+    return true;
+}
+
 static bool wbuf_reserve(client_t *client, const size_t len)
 {
     if (!client || client->write_failed)
@@ -32,10 +95,9 @@ static bool wbuf_reserve(client_t *client, const size_t len)
     if (len == 0)
         return true;
 
-    if (len > FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY - client->wbuf_used) {
-        client->write_failed = true;
+    if (!wbuf_admit(client, len))
         return false;
-    }
+    const size_t max_capacity = wbuf_cap(len);
 
     if (!client->wbuf || client->wbuf_capacity == 0) {
         client->write_failed = true;
@@ -52,15 +114,18 @@ static bool wbuf_reserve(client_t *client, const size_t len)
     if (client->write_failed)
         return false;
 
-    needed = client->wbuf_used + len;
-    if (needed <= client->wbuf_capacity)
-        return true;
+    // Bytes a send in flight reads from cannot move.
+    if (!client->send_inflight) {
+        wbuf_compact(client);
+        needed = client->wbuf_used + len;
+        if (needed <= client->wbuf_capacity)
+            return true;
+    }
 
     size_t new_capacity = client->wbuf_capacity;
-    while (new_capacity < needed &&
-           new_capacity < FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY) {
-        if (new_capacity > FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY / 2) {
-            new_capacity = FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY;
+    while (new_capacity < needed && new_capacity < max_capacity) {
+        if (new_capacity > max_capacity / 2) {
+            new_capacity = max_capacity;
         } else {
             new_capacity *= 2;
         }
@@ -71,7 +136,17 @@ static bool wbuf_reserve(client_t *client, const size_t len)
         return false;
     }
 
-    unsigned char *new_wbuf = realloc(client->wbuf, new_capacity);
+    unsigned char *new_wbuf;
+    if (client->send_inflight && !client->wbuf_retired) {
+        // Keep the block the kernel is reading until its send completes.
+        new_wbuf = malloc(new_capacity);
+        if (new_wbuf) {
+            memcpy(new_wbuf, client->wbuf, client->wbuf_used);
+            client->wbuf_retired = client->wbuf;
+        }
+    } else {
+        new_wbuf = realloc(client->wbuf, new_capacity);
+    }
     if (!new_wbuf) {
         client->write_failed = true;
         return false;
@@ -82,30 +157,292 @@ static bool wbuf_reserve(client_t *client, const size_t len)
     return true;
 }
 
+// Append without checks; the caller reserved room for it.
+static void wbuf_put(client_t *client, const unsigned char *data,
+                     const size_t len)
+{
+    memcpy(client->wbuf + client->wbuf_used, data, len);
+    client->wbuf_used += len;
+}
+
 static void wbuf_append(client_t *client, const unsigned char *data,
                         size_t len)
 {
     if (!wbuf_reserve(client, len))
         return;
 
-    memcpy(client->wbuf + client->wbuf_used, data, len);
-    client->wbuf_used += len;
+    wbuf_put(client, data, len);
+}
+
+// Whether the next thing to send is a deferred reply that has not arrived.
+static bool wbuf_blocked(const client_t *client)
+{
+    if (client->wbuf_values_count == 0)
+        return false;
+    const wbuf_value_t *head = &client->wbuf_values[client->wbuf_values_head];
+    return head->at == client->wbuf_sent && !head->value;
+}
+
+// Mark `n` more bytes sent, unpinning values that went out in full.
+static void wbuf_advance(client_t *client, size_t n)
+{
+    for (;;) {
+        if (client->wbuf_values_count > 0) {
+            wbuf_value_t *head = &client->wbuf_values[client->wbuf_values_head];
+            if (client->wbuf_sent == head->at) {
+                value_entry_t *value = head->value;
+                if (!value)
+                    return; // sends stop at a deferred reply
+                const size_t left = value->value_len - client->wbuf_value_sent;
+                if (n < left) {
+                    client->wbuf_value_sent += n;
+                    return;
+                }
+                n -= left;
+                client->wbuf_pinned -= value->value_len;
+                client->wbuf_value_sent = 0;
+                client->wbuf_values_head++;
+                if (--client->wbuf_values_count == 0)
+                    client->wbuf_values_head = 0;
+                value_entry_unpin(value);
+                continue;
+            }
+        }
+        const size_t end = client->wbuf_values_count > 0
+                               ? client->wbuf_values[client->wbuf_values_head].at
+                               : client->wbuf_used;
+        const size_t take = n < end - client->wbuf_sent
+                                ? n
+                                : end - client->wbuf_sent;
+        client->wbuf_sent += take;
+        n -= take;
+        if (n == 0)
+            return;
+    }
 }
 
+// Gather the unsent queue, wbuf ranges and pinned values in order, up to a
+// value that should go out zero-copy on its own or a deferred reply.
+static int wbuf_gather(const client_t *client, struct iovec *iov)
+{
+    int n = 0;
+    size_t pos = client->wbuf_sent;
+    size_t value_sent = client->wbuf_value_sent;
+    for (size_t i = 0; n < WBUF_IOV_MAX; i++) {
+        const bool more = i < client->wbuf_values_count;
+        const wbuf_value_t *queued =
+            more ? &client->wbuf_values[client->wbuf_values_head + i] : NULL;
+        const size_t end = more ? queued->at : client->wbuf_used;
+        if (pos < end) {
+            iov[n].iov_base = client->wbuf + pos;
+            iov[n].iov_len = end - pos;
+            n++;
+            pos = end;
+        }
+        if (!more || n == WBUF_IOV_MAX || !queued->value ||
+            (n > 0 && zerocopy_wanted(client, queued->value)))
+            break;
+        iov[n].iov_base = queued->value->data + value_sent;
+        iov[n].iov_len = queued->value->value_len - value_sent;
+        n++;
+        value_sent = 0;
+    }
+    return n;
+}
+
+// After sending: reset an empty queue, giving back the room a large reply
+// needed, or shift unsent bytes to the front once at least as many have been
+// sent, so draining one large reply over many sends copies each byte at most
+// once on average instead of once per send.
+static void wbuf_settle(client_t *client)
+{
+    const size_t sent = client->wbuf_sent;
+    const size_t remaining = client->wbuf_used - sent;
+    if (!client_write_pending(client)) {
+        client->wbuf_used = 0;
+        client->wbuf_sent = 0;
+        if (client->wbuf_capacity > FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY) {
+            unsigned char *shrunk =
+                realloc(client->wbuf, FKVS_CLIENT_WRITE_BUFFER_INITIAL_CAPACITY);
+            if (shrunk) {
+                client->wbuf = shrunk;
+                client->wbuf_capacity = FKVS_CLIENT_WRITE_BUFFER_INITIAL_CAPACITY;
+            }
+        }
+    } else if (sent >= remaining) {
+        wbuf_compact(client);
+    }
+}
+
+void set_zerocopy_send_min(const size_t min_len)
+{
+#ifdef FKVS_HAVE_MSG_ZEROCOPY
+    zerocopy_send_min = min_len;
+#else
+    (void)min_len; // no zero-copy sends on this platform
+#endif
+}
+
+value_entry_t *wbuf_zerocopy_value(const client_t *client)
+{
+    if (client->wbuf_values_count == 0)
+        return NULL;
+
+    const wbuf_value_t *head = &client->wbuf_values[client->wbuf_values_head];
+    if (head->at != client->wbuf_sent || !head->value ||
+        !zerocopy_wanted(client, head->value))
+        return NULL;
+    return head->value;
+}
+
+#ifdef FKVS_HAVE_MSG_ZEROCOPY
+// Unpin the sends numbered lo..hi; the range may wrap.
+static void zerocopy_release(client_t *client, const uint32_t lo,
+                             const uint32_t hi)
+{
+    unsigned kept = 0;
+    for (unsigned i = 0; i < client->zerocopy_inflight; i++) {
+        const zerocopy_send_t send = client->zerocopy_sends[i];
+        if (send.id - lo <= hi - lo)
+            value_entry_unpin(send.value);
+        else
+            client->zerocopy_sends[kept++] = send;
+    }
+    client->zerocopy_inflight = kept;
+}
+
+// Read completions off the socket's error queue until it is empty.
+static void zerocopy_drain(client_t *client)
+{
+    for (;;) {
+        union {
+            unsigned char buf[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                                         sizeof(struct sockaddr_in6))];
+            struct cmsghdr align;
+        } control;
+        struct msghdr msg = {0};
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        if (recvmsg(client->fd, &msg, MSG_ERRQUEUE) == -1) {
+            if (errno == EINTR)
+                continue;
+            return; // EAGAIN: nothing left
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == IPPROTO_IP &&
+                  cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == IPPROTO_IPV6 &&
+                  cm->cmsg_type == IPV6_RECVERR))
+                continue;
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            // The kernel copied the data after all (loopback does): from
+            // here on zero-copy would only add the completion overhead.
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                client->zerocopy_refused = true;
+            zerocopy_release(client, err.ee_info, err.ee_data);
+        }
+    }
+}
+
+// Send the rest of the head value with MSG_ZEROCOPY. False when that is not
+// possible right now and a copying send should go instead; otherwise `*n`
+// holds the sendmsg() result. The kernel reads the value after sendmsg()
+// returns, so each send keeps its own pin until its completion arrives.
+static bool wbuf_send_zerocopy(client_t *client, value_entry_t *value,
+                               ssize_t *n)
+{
+    if (!client->zerocopy_armed) {
+        const int one = 1;
+        if (setsockopt(client->fd, SOL_SOCKET, SO_ZEROCOPY, &one,
+                       sizeof(one)) == -1) {
+            client->zerocopy_refused = true; // e.g. a Unix domain socket
+            return false;
+        }
+        client->zerocopy_armed = true;
+    }
+    if (client->zerocopy_inflight == FKVS_ZEROCOPY_MAX_INFLIGHT) {
+        zerocopy_drain(client);
+        if (client->zerocopy_inflight == FKVS_ZEROCOPY_MAX_INFLIGHT ||
+            client->zerocopy_refused)
+            return false;
+    }
+
+    struct iovec iov = {.iov_base = value->data + client->wbuf_value_sent,
+                        .iov_len = value->value_len - client->wbuf_value_sent};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    *n = sendmsg(client->fd, &msg, FKVS_SEND_FLAGS | MSG_ZEROCOPY);
+    if (*n < 0 && errno == ENOBUFS)
+        return false; // over the socket's optmem limit
+    if (*n > 0) {
+        value_entry_pin(value);
+        client->zerocopy_sends[client->zerocopy_inflight++] =
+            (zerocopy_send_t){.id = client->zerocopy_next_id++,
+                              .value = value};
+    }
+    return true;
+}
+
+bool wbuf_zerocopy_reap(client_t *client)
+{
+    if (client->zerocopy_armed)
+        zerocopy_drain(client);
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+    return getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+           err == 0;
+}
+#else
+static bool wbuf_send_zerocopy(client_t *client, value_entry_t *value,
+                               ssize_t *n)
+{
+    (void)client;
+    (void)value;
+    (void)n;
+    return false;
+}
+
+bool wbuf_zerocopy_reap(client_t *client)
+{
+    (void)client;
+    return false;
+}
+#endif
+
 void wbuf_flush(client_t *client)
 {
-    if (!client || !client->wbuf || client->wbuf_used == 0 ||
-        client->write_failed)
+    if (!client || !client->wbuf || !client_write_pending(client) ||
+        client->write_failed || client->write_async)
         return;
 
     // Event loops may use edge-triggered write readiness, so drain until the
-    // socket would block or the response queue is empty.
-    size_t sent = 0;
-    while (sent < client->wbuf_used) {
-        ssize_t n = send(client->fd, client->wbuf + sent,
-                         client->wbuf_used - sent, FKVS_SEND_FLAGS);
+    // socket would block or the response queue is empty. Pinned values go
+    // out from the stored entry in the same sendmsg() as the wbuf bytes
+    // around them, or on their own with MSG_ZEROCOPY.
+    while (client_write_pending(client) && !wbuf_blocked(client)) {
+        ssize_t n;
+        value_entry_t *zerocopy = wbuf_zerocopy_value(client);
+        if (zerocopy && wbuf_send_zerocopy(client, zerocopy, &n)) {
+            // sent, or failed, zero-copy
+        } else if (client->wbuf_values_count == 0) {
+            n = send(client->fd, client->wbuf + client->wbuf_sent,
+                     client->wbuf_used - client->wbuf_sent, FKVS_SEND_FLAGS);
+        } else {
+            struct iovec iov[WBUF_IOV_MAX];
+            struct msghdr msg = {0};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = (size_t)wbuf_gather(client, iov);
+            n = sendmsg(client->fd, &msg, FKVS_SEND_FLAGS);
+        }
         if (n > 0) {
-            sent += (size_t)n;
+            wbuf_advance(client, (size_t)n);
         } else if (n == 0) {
             break;
         } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
@@ -115,18 +452,57 @@ void wbuf_flush(client_t *client)
         } else if (n < 0 && errno == EINTR) {
             continue;
         } else {
-            // Real error (e.g. EPIPE, ECONNRESET); discard buffer.
+            // Real error (e.g. EPIPE, ECONNRESET); discard buffer. Pinned
+            // values are released with the client.
             client->wbuf_used = 0;
+            client->wbuf_sent = 0;
             client->write_failed = true;
             return;
         }
     }
 
-    // Compact: shift unsent bytes to the front.
-    size_t remaining = client->wbuf_used - sent;
-    if (remaining > 0)
-        memmove(client->wbuf, client->wbuf + sent, remaining);
-    client->wbuf_used = remaining;
+    wbuf_settle(client);
+}
+
+const unsigned char *wbuf_send_begin(client_t *client, size_t *len)
+{
+    if (!client || client->send_inflight || client->write_failed ||
+        !client_write_pending(client) || wbuf_blocked(client))
+        return NULL;
+
+    const unsigned char *run;
+    if (client->wbuf_values_count > 0 &&
+        client->wbuf_values[client->wbuf_values_head].at ==
+            client->wbuf_sent) {
+        const value_entry_t *value =
+            client->wbuf_values[client->wbuf_values_head].value;
+        run = value->data + client->wbuf_value_sent;
+        *len = value->value_len - client->wbuf_value_sent;
+    } else {
+        const size_t end =
+            client->wbuf_values_count > 0
+                ? client->wbuf_values[client->wbuf_values_head].at
+                : client->wbuf_used;
+        run = client->wbuf + client->wbuf_sent;
+        *len = end - client->wbuf_sent;
+    }
+    client->send_inflight = true;
+    return run;
+}
+
+void wbuf_send_end(client_t *client, const size_t sent)
+{
+    client->send_inflight = false;
+    free(client->wbuf_retired);
+    client->wbuf_retired = NULL;
+    if (sent > 0)
+        wbuf_advance(client, sent);
+    wbuf_settle(client);
+}
+
+void accept_long_frames(const uint8_t command_id)
+{
+    long_frame_commands[command_id] = true;
 }
 
 void dispatch_command(client_t *client, unsigned char *buffer,
@@ -137,7 +513,21 @@ void dispatch_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    const uint8_t command_id = buffer[2];
+    uint8_t command_id = buffer[2];
+    if (frame_is_long(buffer)) {
+        if (bytes_read <= FRAME_LONG_HEADER_LEN) {
+            send_error(client);
+            return;
+        }
+        command_id = buffer[FRAME_LONG_HEADER_LEN];
+        if (!long_frame_commands[command_id]) {
+            fprintf(stderr, "Command ID %d does not take long frames\n",
+                    command_id);
+            send_error(client);
+            return;
+        }
+    }
+
     if (command_handlers[command_id] != NULL) {
         command_handlers[command_id](client, buffer, bytes_read);
     } else {
@@ -164,32 +554,201 @@ void send_error(client_t *client)
     wbuf_append(client, error, sizeof error);
 }
 
+// [header][STATUS_SUCCESS][value_len] for a `value_len`-byte value; a long
+// frame when the value does not fit a short one, with a 4-byte value_len.
+// Returns the header length, or 0 if the value is too long for any frame.
+static size_t value_reply_header(unsigned char *header, const size_t value_len)
+{
+    const bool long_frame = value_len + 3 > FRAME_SHORT_CORE_MAX;
+    const size_t core_cmd_len = 1 + (long_frame ? 4 : 2) + value_len;
+    if (core_cmd_len > UINT32_MAX)
+        return 0;
+
+    size_t header_len = frame_write_header(header, core_cmd_len);
+    header[header_len++] = STATUS_SUCCESS;
+    if (long_frame) {
+        frame_write_u32(&header[header_len], (uint32_t)value_len);
+        header_len += 4;
+    } else {
+        header[header_len++] = (value_len >> 8) & 0xFF;
+        header[header_len++] = value_len & 0xFF;
+    }
+    return header_len;
+}
+
 void send_reply(client_t *client, const unsigned char *buffer,
                 size_t bytes_read)
 {
     if (client->fd < 0)
         return;
 
-    const size_t core_cmd_len = bytes_read + 3;
-    const size_t full_frame_length = core_cmd_len + 2;
+    unsigned char header[FRAME_LONG_HEADER_LEN + 5];
+    const size_t header_len = value_reply_header(header, bytes_read);
+    if (header_len == 0) {
+        send_error(client);
+        return;
+    }
+
+    if (!wbuf_reserve(client, header_len + bytes_read))
+        return;
 
-    if (core_cmd_len > UINT16_MAX) {
+    wbuf_put(client, header, header_len);
+    wbuf_put(client, buffer, bytes_read);
+}
+
+// Room for one more pinned value at the tail of the queue.
+static bool wbuf_values_reserve(client_t *client)
+{
+    const size_t end = client->wbuf_values_head + client->wbuf_values_count;
+    if (end < client->wbuf_values_capacity)
+        return true;
+    if (client->wbuf_values_head > 0) {
+        memmove(client->wbuf_values,
+                client->wbuf_values + client->wbuf_values_head,
+                client->wbuf_values_count * sizeof(*client->wbuf_values));
+        client->wbuf_values_head = 0;
+        return true;
+    }
+    const size_t capacity =
+        client->wbuf_values_capacity ? client->wbuf_values_capacity * 2 : 8;
+    wbuf_value_t *values =
+        realloc(client->wbuf_values, capacity * sizeof(*values));
+    if (!values)
+        return false;
+    client->wbuf_values = values;
+    client->wbuf_values_capacity = capacity;
+    return true;
+}
+
+void send_value_reply(client_t *client, value_entry_t *value)
+{
+    if (client->fd < 0)
+        return;
+
+    // Small values are cheaper to copy and coalesce than to send from a
+    // separate iovec.
+    if (value->value_len < FKVS_ZERO_COPY_REPLY_MIN || value->shared ||
+        !wbuf_values_reserve(client)) {
+        send_reply(client, value->data, value->value_len);
+        return;
+    }
+
+    unsigned char header[FRAME_LONG_HEADER_LEN + 5];
+    const size_t header_len = value_reply_header(header, value->value_len);
+    if (header_len == 0) {
         send_error(client);
         return;
     }
 
-    if (!wbuf_reserve(client, full_frame_length))
+    if (client->write_failed || !wbuf_admit(client, value->value_len) ||
+        !wbuf_reserve(client, header_len))
         return;
 
-    const unsigned char header[] = {
-        (core_cmd_len >> 8) & 0xFF,
-        core_cmd_len & 0xFF,
-        STATUS_SUCCESS,
-        (bytes_read >> 8) & 0xFF,
-        bytes_read & 0xFF,
-    };
-    wbuf_append(client, header, sizeof(header));
-    wbuf_append(client, buffer, bytes_read);
+    wbuf_put(client, header, header_len);
+    value_entry_pin(value);
+    client->wbuf_values[client->wbuf_values_head +
+                        client->wbuf_values_count++] =
+        (wbuf_value_t){.at = client->wbuf_used, .value = value};
+    client->wbuf_pinned += value->value_len;
+}
+
+bool wbuf_defer_reply(client_t *client, uint32_t *ticket)
+{
+    if (client->write_failed || !wbuf_values_reserve(client))
+        return false;
+
+    *ticket = client->wbuf_next_ticket++;
+    client->wbuf_values[client->wbuf_values_head +
+                        client->wbuf_values_count++] =
+        (wbuf_value_t){.at = client->wbuf_used, .ticket = *ticket};
+    return true;
+}
+
+void wbuf_complete_reply(client_t *client, const uint32_t ticket,
+                         value_entry_t *reply)
+{
+    // Replies mostly come back in order, so the slot is near the head.
+    size_t i = 0;
+    wbuf_value_t *slot = NULL;
+    for (; i < client->wbuf_values_count; i++) {
+        slot = &client->wbuf_values[client->wbuf_values_head + i];
+        if (!slot->value && slot->ticket == ticket)
+            break;
+    }
+    if (i == client->wbuf_values_count) {
+        if (reply)
+            value_entry_unpin(reply);
+        return;
+    }
+
+    if (reply && !client->write_failed && wbuf_admit(client, reply->value_len)) {
+        slot->value = reply;
+        client->wbuf_pinned += reply->value_len;
+        return;
+    }
+
+    // Nothing goes out in its place: drop the slot.
+    if (reply)
+        value_entry_unpin(reply);
+    memmove(slot, slot + 1,
+            (client->wbuf_values_count - i - 1) * sizeof(*slot));
+    if (--client->wbuf_values_count == 0)
+        client->wbuf_values_head = 0;
+}
+
+value_entry_t *wbuf_take_replies(client_t *client, bool *failed)
+{
+    const size_t len = client->wbuf_used - client->wbuf_sent +
+                       client->wbuf_pinned - client->wbuf_value_sent;
+    value_entry_t *reply = NULL;
+    if (len > 0 && !client->write_failed) {
+        reply = malloc(sizeof(*reply) + len + 1);
+        if (!reply)
+            client->write_failed = true;
+    }
+    if (reply) {
+        reply->value_len = len;
+        reply->type = 0;
+        reply->encoding = VALUE_ENTRY_TYPE_RAW;
+        reply->shared = 0;
+        atomic_init(&reply->refs, 1);
+        reply->data[len] = '\0';
+    }
+
+    // Copy the queue out in send order, releasing values as it goes.
+    size_t out = 0;
+    size_t pos = client->wbuf_sent;
+    size_t value_sent = client->wbuf_value_sent;
+    for (size_t i = 0; i < client->wbuf_values_count; i++) {
+        const wbuf_value_t *queued =
+            &client->wbuf_values[client->wbuf_values_head + i];
+        if (reply) {
+            memcpy(reply->data + out, client->wbuf + pos, queued->at - pos);
+            out += queued->at - pos;
+        }
+        pos = queued->at;
+        if (!queued->value)
+            continue;
+        if (reply) {
+            memcpy(reply->data + out, queued->value->data + value_sent,
+                   queued->value->value_len - value_sent);
+            out += queued->value->value_len - value_sent;
+        }
+        value_sent = 0;
+        value_entry_unpin(queued->value);
+    }
+    if (reply)
+        memcpy(reply->data + out, client->wbuf + pos, client->wbuf_used - pos);
+
+    client->wbuf_used = 0;
+    client->wbuf_sent = 0;
+    client->wbuf_values_head = 0;
+    client->wbuf_values_count = 0;
+    client->wbuf_value_sent = 0;
+    client->wbuf_pinned = 0;
+    *failed = client->write_failed;
+    client->write_failed = false;
+    return reply;
 }
 
 void send_keys_reply(client_t *client, const unsigned char *data,
@@ -10,13 +10,58 @@ typedef void (*CommandHandler)(client_t *client, unsigned char *buffer,
                                size_t bytes_read);
 
 void register_command(uint8_t command_id, CommandHandler handler);
+// Let `command_id` arrive in long frames (see frame.h). Other commands get an
+// error reply for one.
+void accept_long_frames(uint8_t command_id);
 void dispatch_command(client_t *client, unsigned char *buffer, size_t bytes_read);
 
 void wbuf_flush(client_t *client);
+/*
+ * Completion-based event loops send the queue themselves instead of calling
+ * wbuf_flush(). wbuf_send_begin() returns the next contiguous run of queued
+ * bytes (NULL when nothing is queued) and keeps it in place until
+ * wbuf_send_end() reports how many were sent. Replies may still be queued in
+ * between.
+ */
+const unsigned char *wbuf_send_begin(client_t *client, size_t *len);
+void wbuf_send_end(client_t *client, size_t sent);
+/*
+ * Zero-copy sends. A queued value of at least `min_len` bytes (0: never) is
+ * sent without the kernel copying it into the socket buffer: wbuf_flush()
+ * uses MSG_ZEROCOPY, completion-based loops IORING_OP_SEND_ZC. The kernel
+ * reads the value after the send returns, so every such send keeps a pin on
+ * it until the kernel reports completion.
+ */
+void set_zerocopy_send_min(size_t min_len);
+// The value the next queued run reads from, when it is due to go out
+// zero-copy; NULL otherwise.
+struct value_entry_t *wbuf_zerocopy_value(const client_t *client);
+// Release the MSG_ZEROCOPY sends the socket's error queue reports complete.
+// False if the socket also has a real error pending.
+bool wbuf_zerocopy_reap(client_t *client);
+
+/*
+ * Deferred replies, for frames another thread runs (see shard.h).
+ * wbuf_defer_reply() holds the reply's place in the queue: replies queued
+ * after it are not sent until wbuf_complete_reply() hands over its bytes (NULL:
+ * there are none) under the returned ticket. False if the slot cannot be
+ * queued. On the thread that runs such frames, wbuf_take_replies() empties a
+ * client's queue into one malloc'd entry (NULL if nothing was queued), and
+ * sets *failed if the client was to be dropped instead.
+ */
+bool wbuf_defer_reply(client_t *client, uint32_t *ticket);
+void wbuf_complete_reply(client_t *client, uint32_t ticket,
+                         struct value_entry_t *reply);
+struct value_entry_t *wbuf_take_replies(client_t *client, bool *failed);
 
 void send_ok(client_t *client);
 void send_error(client_t *client);
 void send_reply(client_t *client, const unsigned char *buffer, size_t bytes_read);
+// Like send_reply() for a stored value. Values of FKVS_ZERO_COPY_REPLY_MIN
+// bytes or more are not copied: the client pins the entry and sends it from
+// the table with sendmsg(), so an overwrite or delete before then cannot
+// free or change the bytes.
+void send_value_reply(client_t *client, struct value_entry_t *value);
 void send_keys_reply(client_t *client, const unsigned char *data,
                      size_t data_len);
 void send_info_reply(client_t *client, const unsigned char *data,
@@ -0,0 +1,79 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Frame headers.
+ *
+ * A short frame is [2B core_len][core] with core_len below 0xFFFF. A long
+ * frame carries more than 64 KiB: [FF FF][4B core_len][core]. Inside a long
+ * frame the SET value length and the reply payload length are 4 bytes
+ * instead of 2; everything else (command byte, 2-byte key length) is the
+ * same. All lengths are big-endian.
+ *
+ * 0xFFFF is free to mark long frames: a short frame that size (65537 bytes)
+ * never fit the 64 KiB read buffer, so no peer could have relied on it.
+ */
+#define FRAME_LONG_MARKER 0xFFFF
+#define FRAME_SHORT_HEADER_LEN 2
+#define FRAME_LONG_HEADER_LEN 6
+#define FRAME_SHORT_CORE_MAX (FRAME_LONG_MARKER - 1)
+
+static inline uint32_t frame_read_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+}
+
+static inline void frame_write_u32(unsigned char *p, const uint32_t v)
+{
+    p[0] = v >> 24 & 0xFF;
+    p[1] = v >> 16 & 0xFF;
+    p[2] = v >> 8 & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static inline bool frame_is_long(const unsigned char *frame)
+{
+    return frame[0] == 0xFF && frame[1] == 0xFF;
+}
+
+// Header and total length of the frame starting at `p`, given `avail` bytes
+// of it; false while the header itself is incomplete.
+static inline bool frame_measure(const unsigned char *p, const size_t avail,
+                                 size_t *header_len, size_t *frame_len)
+{
+    if (avail < FRAME_SHORT_HEADER_LEN)
+        return false;
+    if (!frame_is_long(p)) {
+        *header_len = FRAME_SHORT_HEADER_LEN;
+        *frame_len = FRAME_SHORT_HEADER_LEN + ((size_t)p[0] << 8 | p[1]);
+        return true;
+    }
+    if (avail < FRAME_LONG_HEADER_LEN)
+        return false;
+    *header_len = FRAME_LONG_HEADER_LEN;
+    *frame_len = FRAME_LONG_HEADER_LEN + (size_t)frame_read_u32(p + 2);
+    return true;
+}
+
+// Write the header for `core_len` bytes of core, short when it fits; returns
+// the header length. `core_len` must fit in 32 bits.
+static inline size_t frame_write_header(unsigned char *out,
+                                        const size_t core_len)
+{
+    if (core_len <= FRAME_SHORT_CORE_MAX) {
+        out[0] = core_len >> 8 & 0xFF;
+        out[1] = core_len & 0xFF;
+        return FRAME_SHORT_HEADER_LEN;
+    }
+    out[0] = 0xFF;
+    out[1] = 0xFF;
+    frame_write_u32(out + 2, (uint32_t)core_len);
+    return FRAME_LONG_HEADER_LEN;
+}
+
+#endif // FRAME_H
@@ -1,5 +1,7 @@
 #include "../../commands/server/server_command_handlers.h"
 #include "../../core/hashtable.h"
+#include "../../evict.h"
+#include "../../lazyfree.h"
 #include "../../memory.h"
 #include "../../numeric_parse.h"
 #include "../../response_defs.h"
@@ -7,6 +9,7 @@
 #include "../../utils.h"
 #include "../common/command_defs.h"
 #include "../common/command_registry.h"
+#include "../common/frame.h"
 
 #include <limits.h>
 #include <stdio.h>
@@ -14,24 +17,108 @@
 #include <sys/errno.h>
 #include <sys/socket.h>
 
-static hashtable_t *table = NULL;
-static hashtable_t *expires = NULL;
+// The calling thread's keyspace: each reactor thread binds its own shard.
+static _Thread_local hashtable_t *table = NULL;
+static _Thread_local expiry_index_t *expires = NULL;
+static _Thread_local eviction_t *eviction = NULL;
+static _Thread_local lazyfree_t *lazyfree = NULL;
 
-static bool check_and_expire(const unsigned char *key, size_t key_len)
+// Writes that can add data first get the data set under maxmemory, evicting
+// keys per the policy. False means nothing could be evicted: refuse the write.
+static bool make_room_for_write(void)
 {
-    if (is_expired(expires, key, key_len)) {
-        delete_value(expires, key, key_len);
-        delete_value(table, key, key_len);
+    if (evict_make_room(eviction, table, expires))
         return true;
-    }
+    fprintf(stderr, "OOM: maxmemory reached and no key can be evicted.\n");
     return false;
 }
 
-void init_command_handlers(db_t *db)
+// Delete a key whose deadline has passed, from the keyspace and the expiry
+// index. `entry` is freed.
+static void expire_entry(const hash_table_entry_t *entry)
+{
+    untrack_expiry(expires, entry->key, entry->key_len);
+    delete_value_hashed(table, entry->key, entry->key_len, entry->hash);
+    expires->expired_lazy++;
+}
+
+// Lazy expiry: the live entry for `key`, or NULL if it is absent or its
+// deadline has passed (in which case it is deleted now). One lookup either way.
+static const hash_table_entry_t *lookup_live(const unsigned char *key,
+                                             size_t key_len)
+{
+    const hash_table_entry_t *entry = lookup_entry(table, key, key_len);
+    if (entry && is_expired(entry)) {
+        expire_entry(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+static void check_and_expire(const unsigned char *key, size_t key_len)
+{
+    // Keyspaces without TTLs skip the extra probe entirely.
+    if (table->expirable_count > 0)
+        (void)lookup_live(key, key_len);
+}
+
+bool prefetch_frame_key(const unsigned char *frame, const size_t frame_len,
+                        uint64_t *hash)
+{
+    if (!table || frame_len < 5)
+        return false;
+
+    const size_t header_len =
+        frame_is_long(frame) ? FRAME_LONG_HEADER_LEN : FRAME_SHORT_HEADER_LEN;
+    if (frame_len < header_len + 3)
+        return false;
+    const unsigned char *core = frame + header_len;
+    const size_t core_len = frame_len - header_len;
+
+    switch (core[0]) {
+    case CMD_SET:
+    case CMD_GET:
+    case CMD_INCR:
+    case CMD_INCR_BY:
+    case CMD_DECR:
+    case CMD_DECR_BY:
+    case CMD_DEL:
+    case CMD_EXPIRE:
+    case CMD_TTL:
+    case CMD_PERSIST:
+    case CMD_OBJECT_FREQ:
+    case CMD_UNLINK:
+        break;
+    default:
+        return false;
+    }
+
+    const size_t key_len = ((size_t)core[1] << 8) | core[2];
+    if (3 + key_len > core_len)
+        return false;
+
+    *hash = hashtable_hash_key(table, &core[3], key_len);
+    hashtable_prefetch_group(table, *hash);
+    return true;
+}
+
+void prefetch_frame_entry(const uint64_t hash)
+{
+    hashtable_prefetch_entry(table, hash);
+}
+
+void bind_command_handlers(db_t *db)
 {
     table = db->store;
     expires = db->expires;
+    eviction = db->eviction;
+    lazyfree = db->lazyfree;
+}
+
+void register_command_handlers(void)
+{
     register_command(CMD_SET, handle_set_command);
+    accept_long_frames(CMD_SET);
     register_command(CMD_GET, handle_get_command);
     register_command(CMD_INCR, handle_incr_command);
     register_command(CMD_INCR_BY, handle_incr_by_command);
@@ -44,6 +131,190 @@ void init_command_handlers(db_t *db)
     register_command(CMD_TTL, handle_ttl_command);
     register_command(CMD_PERSIST, handle_persist_command);
     register_command(CMD_KEYS, handle_keys_command);
+    register_command(CMD_OBJECT_FREQ, handle_object_freq_command);
+    register_command(CMD_UNLINK, handle_unlink_command);
+    register_command(CMD_FLUSHALL, handle_flushall_command);
+}
+
+void init_command_handlers(db_t *db)
+{
+    bind_command_handlers(db);
+    register_command_handlers();
+}
+
+/*
+ * Shared body of INCR/DECR/INCRBY/DECRBY: add (or subtract) `amount` to the
+ * integer at `key`, creating it from 0 if absent. Natively encoded values are
+ * updated in place with a single probe; decimal-text integers (non-canonical
+ * input such as "+5" or "007") are parsed once and re-stored natively.
+ */
+static bool apply_integer_update(const unsigned char *key, size_t key_len,
+                                 int64_t amount, bool subtract,
+                                 int64_t *result)
+{
+    if (!make_room_for_write())
+        return false;
+
+    // Lazy expiry: if expired, treat as nonexistent
+    check_and_expire(key, key_len);
+
+    int64_t *native = lookup_int_value(table, key, key_len);
+    int64_t current = 0;
+    if (native) {
+        current = *native;
+    } else {
+        const value_entry_t *value = lookup_value(table, key, key_len);
+        if (value && value->encoding == VALUE_ENTRY_TYPE_INT64) {
+            current = value_entry_int64(value); // copy-on-write hit OOM
+        } else if (value &&
+                   (value->encoding != VALUE_ENTRY_TYPE_INT ||
+                    !fkvs_parse_i64_decimal(value->data, value->value_len,
+                                            INT64_MIN, INT64_MAX, &current))) {
+            fprintf(stderr, "Stored value is not an integer.\n");
+            return false;
+        }
+    }
+
+    const bool overflow =
+        subtract ? (amount > 0 && current < INT64_MIN + amount) ||
+                       (amount < 0 && current > INT64_MAX + amount)
+                 : (amount > 0 && current > INT64_MAX - amount) ||
+                       (amount < 0 && current < INT64_MIN - amount);
+    if (overflow) {
+        fprintf(stderr, "Integer update is out of range.\n");
+        return false;
+    }
+    *result = subtract ? current - amount : current + amount;
+
+    if (native) {
+        *native = *result;
+        return true;
+    }
+    if (!set_value(table, key, key_len, result, sizeof(*result),
+                   VALUE_ENTRY_TYPE_INT64)) {
+        fprintf(stderr, "Unable to store integer value.\n");
+        return false;
+    }
+    return true;
+}
+
+static void send_integer_reply(client_t *client, const int64_t n)
+{
+    unsigned char text[FKVS_I64_DECIMAL_MAX];
+    send_reply(client, text, fkvs_format_i64_decimal(n, text));
+}
+
+// SET's optional [ex_len:2][ex_str] after the value, in the `len` bytes of
+// core left there (none: no expiry). False, with the reason logged, if
+// malformed.
+static bool parse_set_expiry(const unsigned char *tail, const size_t len,
+                             bool *has_expiry, int64_t *deadline_ms)
+{
+    *has_expiry = false;
+    if (len == 0)
+        return true;
+
+    // Parse [ex_len:2][ex_str]
+    if (len < 2) {
+        fprintf(stderr, "Incomplete SET EX: missing ex_len\n");
+        return false;
+    }
+
+    const uint16_t ex_len = ((uint16_t)tail[0] << 8) | tail[1];
+    if ((size_t)2 + ex_len > len) {
+        fprintf(stderr, "Incomplete SET EX: ex bytes exceed bounds\n");
+        return false;
+    }
+
+    char sec_buf[32];
+    size_t copy_len =
+        ex_len < sizeof(sec_buf) - 1 ? ex_len : sizeof(sec_buf) - 1;
+    memcpy(sec_buf, &tail[2], copy_len);
+    sec_buf[copy_len] = '\0';
+
+    if (copy_len != ex_len ||
+        !fkvs_parse_deadline_ms((const unsigned char *)sec_buf, copy_len,
+                                fkvs_now_ms(), deadline_ms)) {
+        fprintf(stderr, "Invalid SET EX ttl value\n");
+        return false;
+    }
+    *has_expiry = true;
+    return true;
+}
+
+/*
+ * Store a parsed SET and reply: the value echoed back if `echo`, else OK.
+ * The value is copied from `value`, unless `adopted` (an entry from
+ * hashtable_alloc_large_value() holding those bytes) is given; that one is
+ * linked in as is and owned from here on.
+ */
+static void store_set(client_t *client, const unsigned char *key,
+                      const size_t key_len, const unsigned char *value,
+                      const size_t value_len, value_entry_t *adopted,
+                      const bool has_expiry, const int64_t deadline_ms,
+                      const bool echo)
+{
+    if (!make_room_for_write()) {
+        free(adopted);
+        send_error(client);
+        return;
+    }
+
+    // Integers whose text is canonical (what GET would render back) are
+    // stored as a native int64 so INCR-family updates never touch text; other
+    // parseable integers ("+5", "007") keep their exact bytes. Adopted values
+    // are far too long to be integers.
+    int64_t parsed_integer;
+    int value_encoding = VALUE_ENTRY_TYPE_RAW;
+    const void *stored_value = value;
+    size_t stored_len = value_len;
+    if (!adopted && fkvs_parse_i64_decimal(value, value_len, INT64_MIN,
+                                           INT64_MAX, &parsed_integer)) {
+        unsigned char canonical[FKVS_I64_DECIMAL_MAX];
+        const size_t canonical_len =
+            fkvs_format_i64_decimal(parsed_integer, canonical);
+        if (canonical_len == value_len &&
+            memcmp(canonical, value, value_len) == 0) {
+            value_encoding = VALUE_ENTRY_TYPE_INT64;
+            stored_value = &parsed_integer;
+            stored_len = sizeof(parsed_integer);
+        } else {
+            value_encoding = VALUE_ENTRY_TYPE_INT;
+        }
+    }
+
+    // The value and deadline are stored together; SET without EX clears any
+    // existing TTL (matching Redis behavior). A failed store leaves the key
+    // and its expiry untouched.
+    const int64_t deadline = has_expiry ? deadline_ms : HASHTABLE_NO_DEADLINE;
+    const bool stored =
+        adopted ? set_value_entry_with_deadline(table, key, key_len, adopted,
+                                                value_encoding, deadline)
+                : set_value_with_deadline(table, key, key_len, stored_value,
+                                          stored_len, value_encoding,
+                                          deadline);
+    if (!stored) {
+        send_error(client);
+        fprintf(stderr, "Unable to store SET value\n");
+        return;
+    }
+
+    // Track the deadline only once the key holds it. Without EX a previously
+    // tracked deadline stays in the timer wheel; the drain sees the key no
+    // longer expires and discards it. Tracking fails only for a key that had
+    // no item yet (OOM); the key is then dropped rather than left with a
+    // deadline active expiry would never see.
+    if (has_expiry && !track_expiry(expires, key, key_len, deadline_ms)) {
+        delete_value(table, key, key_len);
+        send_error(client);
+        fprintf(stderr, "Unable to store SET EX ttl\n");
+        return;
+    }
+
+    if (echo)
+        send_reply(client, value, value_len);
+    else
+        send_ok(client);
 }
 
 void handle_set_command(client_t *client, unsigned char *buffer,
@@ -62,28 +333,34 @@ void handle_set_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Total bytes expected = 2 + core_len
-    const uint16_t core_len = ((uint16_t)buffer[0] << 8) | buffer[1];
-    const size_t total_needed = (size_t)core_len + 2;
-    if (bytes_read < total_needed) {
+    // Total bytes expected = header + core_len. Long frames (see frame.h)
+    // have a 6-byte header and a 4-byte value_len.
+    size_t header_len;
+    size_t total_needed;
+    if (!frame_measure(buffer, bytes_read, &header_len, &total_needed) ||
+        bytes_read < total_needed) {
         send_error(client);
         fprintf(stderr,
                 "Incomplete SET: message shorter than advertised core_len\n");
         return;
     }
+    const bool long_frame = header_len == FRAME_LONG_HEADER_LEN;
+    const size_t core_len = total_needed - header_len;
+    const size_t value_len_width = long_frame ? 4 : 2;
 
-    if (buffer[2] != CMD_SET) {
+    if (core_len < 3 || buffer[header_len] != CMD_SET) {
         send_error(client);
         fprintf(stderr, "SET parse error: wrong command byte (%u)\n",
-                (unsigned)buffer[2]);
+                (unsigned)buffer[header_len]);
         return;
     }
 
     // Key length
-    const uint16_t key_len = ((uint16_t)buffer[3] << 8) | buffer[4];
+    const uint16_t key_len =
+        ((uint16_t)buffer[header_len + 1] << 8) | buffer[header_len + 2];
 
     // Offsets inside the full buffer
-    const size_t pos_key = 5;                   // start of key bytes
+    const size_t pos_key = header_len + 3;      // start of key bytes
     const size_t after_key = pos_key + key_len; // first byte after key
 
     // Ensure key bytes are present inside the advertised core
@@ -94,22 +371,24 @@ void handle_set_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Need the 2-byte value_len after the key
-    if ((after_key + 2) > bytes_read) {
+    // Need the value_len after the key
+    if ((after_key + value_len_width) > bytes_read) {
         send_error(client);
         fprintf(stderr, "Incomplete SET: missing value_len\n");
         return;
     }
 
     // Value length lives immediately after the key
-    uint16_t value_len =
-        ((uint16_t)buffer[after_key] << 8) | buffer[after_key + 1];
-    const size_t pos_value = after_key + 2; // start of value bytes
+    const size_t value_len =
+        long_frame ? frame_read_u32(&buffer[after_key])
+                   : ((size_t)buffer[after_key] << 8) | buffer[after_key + 1];
+    const size_t pos_value = after_key + value_len_width; // start of value
     const size_t end_value = pos_value + value_len;
 
     // Check that the whole value fits inside the core and the
     // received buffer
-    const size_t core_payload_size = (size_t)1 + 2 + key_len + 2 + value_len;
+    const size_t core_payload_size =
+        (size_t)1 + 2 + key_len + value_len_width + value_len;
     if (core_payload_size > core_len || (end_value + 0) > bytes_read) {
         send_error(client);
         fprintf(stderr, "Incomplete SET: value bytes exceed bounds\n");
@@ -119,104 +398,73 @@ void handle_set_command(client_t *client, unsigned char *buffer,
     if (server.verbose) {
         printf("Wrote value '%.*s' to database \n", (int)value_len,
                &buffer[pos_value]);
-        printf("Wrote %d bytes to database \n", value_len);
+        printf("Wrote %zu bytes to database \n", value_len);
     }
 
     // Check for optional inline EX (extra bytes after value in core)
     bool has_expiry = false;
     int64_t deadline_ms = 0;
-    if (core_payload_size < core_len) {
-        // Parse [ex_len:2][ex_str]
-        const size_t ex_offset = end_value;
-        if (ex_offset + 2 > bytes_read) {
-            send_error(client);
-            fprintf(stderr, "Incomplete SET EX: missing ex_len\n");
-            return;
-        }
-
-        const uint16_t ex_len =
-            ((uint16_t)buffer[ex_offset] << 8) | buffer[ex_offset + 1];
-        const size_t pos_ex = ex_offset + 2;
+    if (!parse_set_expiry(&buffer[end_value], core_len - core_payload_size,
+                          &has_expiry, &deadline_ms)) {
+        send_error(client);
+        return;
+    }
 
-        if (pos_ex + ex_len > bytes_read) {
-            send_error(client);
-            fprintf(stderr, "Incomplete SET EX: ex bytes exceed bounds\n");
-            return;
-        }
+    // Echoing a value that needed a long frame would send it straight back;
+    // those get a plain OK.
+    store_set(client, &buffer[pos_key], key_len, &buffer[pos_value],
+              value_len, NULL, has_expiry, deadline_ms, !long_frame);
+}
 
-        char sec_buf[32];
-        size_t copy_len =
-            ex_len < sizeof(sec_buf) - 1 ? ex_len : sizeof(sec_buf) - 1;
-        memcpy(sec_buf, &buffer[pos_ex], copy_len);
-        sec_buf[copy_len] = '\0';
+int measure_streamed_set(const unsigned char *frame, const size_t avail,
+                         const size_t frame_len, size_t *value_at,
+                         size_t *value_len)
+{
+    if (!frame_is_long(frame))
+        return -1;
+    if (avail < FRAME_LONG_HEADER_LEN + 3)
+        return 0;
+    if (frame[FRAME_LONG_HEADER_LEN] != CMD_SET)
+        return -1;
+
+    const size_t key_len = ((size_t)frame[FRAME_LONG_HEADER_LEN + 1] << 8) |
+                           frame[FRAME_LONG_HEADER_LEN + 2];
+    *value_at = FRAME_LONG_HEADER_LEN + 3 + key_len + 4;
+    if (*value_at > FKVS_CLIENT_READ_BUFFER_SIZE)
+        return -1; // the head could never sit in the client buffer
+    if (avail < *value_at)
+        return 0;
+
+    *value_len = frame_read_u32(&frame[*value_at - 4]);
+    // Malformed lengths go the normal way, to be rejected by SET.
+    if (*value_len <= HASHTABLE_LARGE_VALUE_MIN ||
+        *value_len > frame_len - *value_at)
+        return -1;
+    return 1;
+}
 
-        if (copy_len != ex_len ||
-            !fkvs_parse_deadline_ms((const unsigned char *)sec_buf, copy_len,
-                                    fkvs_now_ms(), &deadline_ms)) {
-            send_error(client);
-            fprintf(stderr, "Invalid SET EX ttl value\n");
-            return;
-        }
-        has_expiry = true;
+void handle_streamed_set(client_t *client, const unsigned char *frame,
+                         const size_t len, const size_t value_at,
+                         value_entry_t *value)
+{
+    const size_t key_len = ((size_t)frame[FRAME_LONG_HEADER_LEN + 1] << 8) |
+                           frame[FRAME_LONG_HEADER_LEN + 2];
+    if (server.verbose) {
+        printf("Server received a streamed SET of %zu bytes from client %d\n",
+               value->value_len, client->fd);
     }
 
-    int64_t parsed_integer;
-    const int value_encoding =
-        fkvs_parse_i64_decimal(&buffer[pos_value], value_len, INT64_MIN,
-                               INT64_MAX, &parsed_integer)
-            ? VALUE_ENTRY_TYPE_INT
-            : VALUE_ENTRY_TYPE_RAW;
-
-    value_entry_t *old_value = NULL;
-    value_entry_t *old_expiry = NULL;
-    size_t old_value_len = 0;
-    size_t old_expiry_len = 0;
-    const bool had_value =
-        has_expiry &&
-        get_value(table, &buffer[pos_key], key_len, &old_value, &old_value_len);
-    const bool had_expiry =
-        has_expiry && get_value(expires, &buffer[pos_key], key_len, &old_expiry,
-                                &old_expiry_len);
-
-    if (!set_value(table, &buffer[pos_key], key_len, &buffer[pos_value],
-                   value_len, value_encoding)) {
+    bool has_expiry = false;
+    int64_t deadline_ms = 0;
+    if (!parse_set_expiry(&frame[value_at], len - value_at, &has_expiry,
+                          &deadline_ms)) {
+        free(value);
         send_error(client);
-        fprintf(stderr, "Unable to store SET value\n");
-        free_value_entry(old_value);
-        free_value_entry(old_expiry);
         return;
     }
 
-    if (has_expiry) {
-        if (!set_expiry(expires, &buffer[pos_key], key_len, deadline_ms)) {
-            send_error(client);
-            fprintf(stderr, "Unable to store SET EX ttl\n");
-            if (had_value) {
-                (void)set_value(table, &buffer[pos_key], key_len,
-                                old_value->ptr, old_value->value_len,
-                                old_value->encoding);
-            } else {
-                delete_value(table, &buffer[pos_key], key_len);
-            }
-            if (had_expiry) {
-                (void)set_value(expires, &buffer[pos_key], key_len,
-                                old_expiry->ptr, old_expiry->value_len,
-                                old_expiry->encoding);
-            } else {
-                delete_value(expires, &buffer[pos_key], key_len);
-            }
-            free_value_entry(old_value);
-            free_value_entry(old_expiry);
-            return;
-        }
-    } else {
-        // SET clears any existing TTL (matching Redis behavior)
-        remove_expiry(expires, &buffer[pos_key], key_len);
-    }
-
-    send_reply(client, &buffer[pos_value], value_len);
-    free_value_entry(old_value);
-    free_value_entry(old_expiry);
+    store_set(client, &frame[FRAME_LONG_HEADER_LEN + 3], key_len, value->data,
+              value->value_len, value, has_expiry, deadline_ms, false);
 }
 
 void handle_get_command(client_t *client, unsigned char *buffer,
@@ -237,17 +485,15 @@ void handle_get_command(client_t *client, unsigned char *buffer,
     }
 
     if (bytes_read - 2 == command_len) {
-        // Lazy expiry check
-        if (check_and_expire(&buffer[5], key_len)) {
-            send_error(client);
-            return;
-        }
-
-        // Zero-copy read: borrow the live value and frame it straight into the
-        // write buffer. The only copy is the unavoidable one into wbuf.
-        const value_entry_t *value = lookup_value(table, &buffer[5], key_len);
-        if (value) {
-            send_reply(client, value->ptr, value->value_len);
+        // Zero-copy read: borrow the live value (lazy expiry and lookup in
+        // one probe). Small values are framed into the write buffer; large
+        // ones are pinned and sent from the entry itself.
+        const hash_table_entry_t *entry = lookup_live(&buffer[5], key_len);
+        value_entry_t *value = entry ? entry->value : NULL;
+        if (value && value->encoding == VALUE_ENTRY_TYPE_INT64) {
+            send_integer_reply(client, value_entry_int64(value));
+        } else if (value) {
+            send_value_reply(client, value);
         } else {
             send_error(client);
         }
@@ -284,67 +530,17 @@ void handle_incr_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Lazy expiry: if expired, treat as nonexistent
-    check_and_expire(&buffer[5], key_len);
-
-    // Borrow the live value; read the integer out before the rewrite below
-    // invalidates it.
-    const value_entry_t *value = lookup_value(table, &buffer[5], key_len);
-    if (!value) {
-        const char *default_value = "0";
-        const size_t default_value_len = strlen(default_value);
-        if (!set_value(table, &buffer[5], key_len,
-                       (unsigned char *)default_value, default_value_len,
-                       VALUE_ENTRY_TYPE_INT)) {
-            fprintf(stderr, "Unable to set default value.\n");
-            send_error(client);
-            return;
-        }
-        value = lookup_value(table, &buffer[5], key_len);
-        if (!value) {
-            send_error(client);
-            return;
-        }
-    }
-
-    if (value->encoding != VALUE_ENTRY_TYPE_INT) {
-        fprintf(stderr, "Stored value is not an integer.\n");
-        send_error(client);
-        return;
-    }
-
-    int64_t current;
-    if (!fkvs_parse_i64_decimal(value->ptr, value->value_len, INT64_MIN,
-                                INT64_MAX, &current) ||
-        current == INT64_MAX) {
-        fprintf(stderr, "Stored integer is out of range.\n");
+    int64_t sum;
+    if (!apply_integer_update(&buffer[5], key_len, 1, false, &sum)) {
         send_error(client);
         return;
     }
-    const int64_t sum = current + 1;
 
     if (server.verbose) {
         printf("Value incremented to %lld\n", (long long)sum);
     }
 
-    char *reply = int64_to_string(sum);
-    if (!reply) {
-        send_error(client);
-        return;
-    }
-    const size_t reply_len = strlen(reply);
-
-    // Rewrites the key; `value` is invalid from here on.
-    if (!set_value(table, &buffer[5], key_len, reply, reply_len,
-                   VALUE_ENTRY_TYPE_INT)) {
-        fprintf(stderr, "Unable to set incremented value.\n");
-        send_error(client);
-        free(reply);
-        return;
-    }
-
-    send_reply(client, (const unsigned char *)reply, reply_len);
-    free(reply);
+    send_integer_reply(client, sum);
 }
 
 void handle_incr_by_command(client_t *client, unsigned char *buffer,
@@ -395,78 +591,27 @@ void handle_incr_by_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Lazy expiry: if expired, treat as nonexistent
-    check_and_expire(&buffer[5], key_len);
-
-    // Borrow the live value; read the integer out before the rewrite below
-    // invalidates it.
-    const value_entry_t *old_value = lookup_value(table, &buffer[5], key_len);
-    if (!old_value) {
-        const char *default_value = "0";
-        const size_t default_value_len = strlen(default_value);
-        if (!set_value(table, &buffer[5], key_len,
-                       (unsigned char *)default_value, default_value_len,
-                       VALUE_ENTRY_TYPE_INT)) {
-            fprintf(stderr, "Unable to set default value.\n");
-            send_error(client);
-            free(incr_str);
-            return;
-        }
-        old_value = lookup_value(table, &buffer[5], key_len);
-        if (!old_value) {
-            send_error(client);
-            free(incr_str);
-            return;
-        }
-    }
-
-    if (old_value->encoding != VALUE_ENTRY_TYPE_INT) {
-        fprintf(stderr, "Stored value is not an integer.\n");
-        send_error(client);
-        free(incr_str);
-        return;
-    }
-
-    int64_t current;
     int64_t increment;
-    if (!fkvs_parse_i64_decimal(old_value->ptr, old_value->value_len, INT64_MIN,
-                                INT64_MAX, &current) ||
-        !fkvs_parse_i64_decimal(incr_str, value_length, INT64_MIN, INT64_MAX,
-                                &increment) ||
-        (increment > 0 && current > INT64_MAX - increment) ||
-        (increment < 0 && current < INT64_MIN - increment)) {
+    int64_t sum;
+    if (!fkvs_parse_i64_decimal(incr_str, value_length, INT64_MIN, INT64_MAX,
+                                &increment)) {
         fprintf(stderr, "Integer increment is out of range.\n");
         send_error(client);
         free(incr_str);
         return;
     }
+    free(incr_str);
 
-    const int64_t sum = current + increment;
-    if (server.verbose) {
-        printf("Value incremented to %lld\n", (long long)sum);
-    }
-
-    char *result = int64_to_string(sum);
-    if (!result) {
+    if (!apply_integer_update(&buffer[5], key_len, increment, false, &sum)) {
         send_error(client);
-        free(incr_str);
         return;
     }
-    const size_t result_len = strlen(result);
 
-    // Rewrites the key; `old_value` is invalid from here on.
-    if (!set_value(table, &buffer[5], key_len, (unsigned char *)result,
-                   result_len, VALUE_ENTRY_TYPE_INT)) {
-        fprintf(stderr, "Unable to set incremented value.\n");
-        send_error(client);
-        free(incr_str);
-        free(result);
-        return;
+    if (server.verbose) {
+        printf("Value incremented to %lld\n", (long long)sum);
     }
 
-    send_reply(client, (unsigned char *)result, result_len);
-    free(incr_str);
-    free(result);
+    send_integer_reply(client, sum);
 }
 
 void handle_decr_by_command(client_t *client, unsigned char *buffer,
@@ -517,79 +662,27 @@ void handle_decr_by_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Lazy expiry: if expired, treat as nonexistent
-    check_and_expire(&buffer[5], key_len);
-
-    // Borrow the live value; read the integer out before the rewrite below
-    // invalidates it.
-    const value_entry_t *old_value = lookup_value(table, &buffer[5], key_len);
-    if (!old_value) {
-        const char *default_value = "0";
-        const size_t default_value_len = strlen(default_value);
-        if (!set_value(table, &buffer[5], key_len,
-                       (unsigned char *)default_value, default_value_len,
-                       VALUE_ENTRY_TYPE_INT)) {
-            fprintf(stderr, "Unable to set default value.\n");
-            send_error(client);
-            free(decr_str);
-            return;
-        }
-
-        old_value = lookup_value(table, &buffer[5], key_len);
-        if (!old_value) {
-            send_error(client);
-            free(decr_str);
-            return;
-        }
-    }
-
-    if (old_value->encoding != VALUE_ENTRY_TYPE_INT) {
-        fprintf(stderr, "Stored value is not an integer.\n");
-        send_error(client);
-        free(decr_str);
-        return;
-    }
-
-    int64_t current;
     int64_t decrement;
-    if (!fkvs_parse_i64_decimal(old_value->ptr, old_value->value_len, INT64_MIN,
-                                INT64_MAX, &current) ||
-        !fkvs_parse_i64_decimal(decr_str, value_length, INT64_MIN, INT64_MAX,
-                                &decrement) ||
-        (decrement > 0 && current < INT64_MIN + decrement) ||
-        (decrement < 0 && current > INT64_MAX + decrement)) {
+    int64_t result;
+    if (!fkvs_parse_i64_decimal(decr_str, value_length, INT64_MIN, INT64_MAX,
+                                &decrement)) {
         fprintf(stderr, "Integer decrement is out of range.\n");
         send_error(client);
         free(decr_str);
         return;
     }
+    free(decr_str);
 
-    const int64_t result_val = current - decrement;
-    if (server.verbose) {
-        printf("Value decremented to %lld\n", (long long)result_val);
-    }
-
-    char *result = int64_to_string(result_val);
-    if (!result) {
+    if (!apply_integer_update(&buffer[5], key_len, decrement, true, &result)) {
         send_error(client);
-        free(decr_str);
         return;
     }
-    const size_t result_len = strlen(result);
 
-    // Rewrites the key; `old_value` is invalid from here on.
-    if (!set_value(table, &buffer[5], key_len, (unsigned char *)result,
-                   result_len, VALUE_ENTRY_TYPE_INT)) {
-        fprintf(stderr, "Unable to set decremented value.\n");
-        send_error(client);
-        free(decr_str);
-        free(result);
-        return;
+    if (server.verbose) {
+        printf("Value decremented to %lld\n", (long long)result);
     }
 
-    send_reply(client, (unsigned char *)result, result_len);
-    free(decr_str);
-    free(result);
+    send_integer_reply(client, result);
 }
 
 void handle_ping_command(client_t *client, unsigned char *buffer,
@@ -639,7 +732,32 @@ void handle_info_command(client_t *client, unsigned char *buffer,
     char formatted_uptime[50];
     format_uptime(&server.metrics, formatted_uptime, sizeof(formatted_uptime));
 
-    char metrics[768];
+    slab_stats_t slab = {0};
+    unsigned long long grows = 0;
+    unsigned long long shrinks = 0;
+    size_t slot_bytes = 0;
+    size_t expiring = 0;
+    if (table) {
+        expiring = table->expirable_count;
+        hashtable_memory_stats(table, &slab);
+        slot_bytes =
+            hashtable_slot_bytes(table) + hashtable_slot_bytes(expires->keys);
+        grows = table->grows + expires->keys->grows;
+        shrinks = table->shrinks + expires->keys->shrinks;
+    }
+    size_t used_memory = 0;
+    if (table)
+        used_memory = evict_used_memory(table, expires);
+    const eviction_t no_eviction = {0};
+    const eviction_t *ev = eviction ? eviction : &no_eviction;
+    const expiry_index_t no_expires = {0};
+    const expiry_index_t *ttl = expires ? expires : &no_expires;
+    const double lag_avg_ms =
+        ttl->expired_active
+            ? (double)ttl->lag_total_ms / (double)ttl->expired_active
+            : 0.0;
+
+    char metrics[2048];
     int n = snprintf(
         metrics, sizeof(metrics),
         "# Server \n"
@@ -649,6 +767,8 @@ void handle_info_command(client_t *client, unsigned char *buffer,
         "Uptime: %s \n"
         "event_loop_max_events: %d \n"
         "event_dispatcher_kind: %s \n"
+        "threads: %u \n"
+        "shard: %u \n"
         "\n"
         "# Clients \n"
         "connected clients: %d \n"
@@ -656,17 +776,61 @@ void handle_info_command(client_t *client, unsigned char *buffer,
         "\n"
         "#Stats \n"
         "commands executed: %lu \n"
+        "hashtable_grow_events: %llu \n"
+        "hashtable_shrink_events: %llu \n"
+        "keys_with_expiry: %zu \n"
+        "expired_keys_active: %llu \n"
+        "expired_keys_lazy: %llu \n"
+        "expiry_lag_avg_ms: %.3f \n"
+        "expiry_lag_max_ms: %lld \n"
+        "expiry_pending_keys: %zu \n"
+        "expire_cycles_slow: %llu \n"
+        "expire_cycles_fast: %llu \n"
+        "expire_cycle_time_us: %llu \n"
+        "expire_time_cap_reached: %llu \n"
+        "expire_backlog: %d \n"
         "\n"
         "# Memory \n"
         "Memory Usage: %lu bytes (%lu KiB)\n"
         "mem_allocator: %s \n"
+        "hashtable_slot_bytes: %zu \n"
+        "slab_reserved_bytes: %zu \n"
+        "slab_used_bytes: %zu \n"
+        "slab_large_bytes: %zu \n"
+        "slab_utilization: %.3f \n"
+        "slab_fragmentation_ratio: %.3f \n"
+        "used_memory_dataset: %zu \n"
+        "maxmemory: %zu \n"
+        "maxmemory_policy: %s \n"
+        "evicted_keys: %llu \n"
+        "eviction_time_us: %llu \n"
+        "oom_rejected_writes: %llu \n"
+        "lazyfree_pending_objects: %zu \n"
+        "lazyfreed_objects: %llu \n"
         "\n",
         server.pid, server.port, server.config_file_path, formatted_uptime,
         server.event_loop_max_events,
         event_loop_dispatcher_kind_to_string(server.event_dispatcher_kind),
-        server.num_clients, server.metrics.disconnected_clients,
-        server.metrics.num_executed_commands, server.metrics.memory_usage,
-        server.metrics.memory_usage / 1024, get_allocator_name());
+        server.threads, server.shard_id, server.num_clients,
+        server.metrics.disconnected_clients,
+        server.metrics.num_executed_commands, grows, shrinks, expiring,
+        (unsigned long long)ttl->expired_active,
+        (unsigned long long)ttl->expired_lazy, lag_avg_ms,
+        (long long)ttl->lag_max_ms, ttl->wheel.count,
+        (unsigned long long)ttl->slow_cycles,
+        (unsigned long long)ttl->fast_cycles,
+        (unsigned long long)ttl->cycle_time_us,
+        (unsigned long long)ttl->time_cap_hits, ttl->backlog ? 1 : 0,
+        server.metrics.memory_usage, server.metrics.memory_usage / 1024,
+        get_allocator_name(), slot_bytes,
+        slab.reserved_bytes, slab.used_bytes, slab.large_bytes,
+        slab.utilization, slab.fragmentation, used_memory, ev->maxmemory,
+        evict_policy_to_string(ev->policy),
+        (unsigned long long)ev->evicted_keys,
+        (unsigned long long)ev->eviction_time_us,
+        (unsigned long long)ev->oom_rejections,
+        lazyfree ? atomic_load(&lazyfree->pending) : 0,
+        lazyfree ? (unsigned long long)atomic_load(&lazyfree->freed) : 0ULL);
     if (n < 0 || (size_t)n >= sizeof(metrics)) {
         fprintf(stderr, "Formatting error or buffer overflow while preparing "
                         "metrics reply.\n");
@@ -700,63 +864,13 @@ void handle_decr_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Lazy expiry: if expired, treat as nonexistent
-    check_and_expire(&buffer[5], key_len);
-
-    // Borrow the live value; read the integer out before the rewrite below
-    // invalidates it.
-    const value_entry_t *value = lookup_value(table, &buffer[5], key_len);
-    if (!value) {
-        const char *default_value = "0";
-        const size_t default_value_len = strlen(default_value);
-        if (!set_value(table, &buffer[5], key_len,
-                       (unsigned char *)default_value, default_value_len,
-                       VALUE_ENTRY_TYPE_INT)) {
-            fprintf(stderr, "Unable to set default value.\n");
-            send_error(client);
-            return;
-        }
-        value = lookup_value(table, &buffer[5], key_len);
-        if (!value) {
-            send_error(client);
-            return;
-        }
-    }
-
-    if (value->encoding != VALUE_ENTRY_TYPE_INT) {
-        fprintf(stderr, "Stored value is not an integer.\n");
+    int64_t result;
+    if (!apply_integer_update(&buffer[5], key_len, 1, true, &result)) {
         send_error(client);
         return;
     }
 
-    int64_t current;
-    if (!fkvs_parse_i64_decimal(value->ptr, value->value_len, INT64_MIN,
-                                INT64_MAX, &current) ||
-        current == INT64_MIN) {
-        fprintf(stderr, "Stored integer is out of range.\n");
-        send_error(client);
-        return;
-    }
-    const int64_t decrement = current - 1;
-
-    char *result_str = int64_to_string(decrement);
-    if (!result_str) {
-        send_error(client);
-        return;
-    }
-    const size_t result_length = strlen(result_str);
-
-    // Rewrites the key; `value` is invalid from here on.
-    if (!set_value(table, &buffer[5], key_len, (unsigned char *)result_str,
-                   result_length, VALUE_ENTRY_TYPE_INT)) {
-        fprintf(stderr, "Unable to set decremented value.\n");
-        send_error(client);
-        free(result_str);
-        return;
-    }
-
-    send_reply(client, (unsigned char *)result_str, result_length);
-    free(result_str);
+    send_integer_reply(client, result);
 }
 
 void handle_del_command(client_t *client, unsigned char *buffer,
@@ -781,8 +895,14 @@ void handle_del_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    delete_value(table, &buffer[5], key_len);
-    delete_value(expires, &buffer[5], key_len);
+    // A deadline goes with the entry; untrack it so the wheel holds no
+    // dead timers.
+    const hash_table_entry_t *entry = lookup_entry(table, &buffer[5], key_len);
+    if (entry) {
+        if (entry->expirable)
+            untrack_expiry(expires, entry->key, entry->key_len);
+        delete_value_hashed(table, entry->key, entry->key_len, entry->hash);
+    }
 
     send_ok(client);
 }
@@ -825,8 +945,8 @@ void handle_expire_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Verify key exists in store (borrow; existence only)
-    if (!lookup_value(table, &buffer[pos_key], key_len)) {
+    // Verify key exists (and has not already expired)
+    if (!lookup_live(&buffer[pos_key], key_len)) {
         send_error(client);
         return;
     }
@@ -846,7 +966,7 @@ void handle_expire_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    if (!set_expiry(expires, &buffer[pos_key], key_len, deadline_ms)) {
+    if (!set_expiry(table, expires, &buffer[pos_key], key_len, deadline_ms)) {
         send_error(client);
         return;
     }
@@ -876,22 +996,9 @@ void handle_ttl_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    // Lazy expiry: if expired, clean up before reporting TTL
-    check_and_expire(&buffer[5], key_len);
-
-    // Check if key exists in store at all (borrow; existence only)
-    bool key_exists = lookup_value(table, &buffer[5], key_len) != NULL;
-
-    int64_t ttl;
-    if (!key_exists) {
-        ttl = -2;
-    } else {
-        ttl = get_ttl(expires, &buffer[5], key_len);
-        // get_ttl returns -2 if not in expires table; for existing key with
-        // no TTL, return -1.
-        if (ttl == -2)
-            ttl = -1;
-    }
+    // Lazy expiry: an expired key is cleaned up and reported as missing (-2);
+    // a live key without a deadline reports -1.
+    const int64_t ttl = get_ttl(lookup_live(&buffer[5], key_len));
 
     char ttl_str[32];
     int n = snprintf(ttl_str, sizeof(ttl_str), "%lld", (long long)ttl);
@@ -921,11 +1028,130 @@ void handle_persist_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    remove_expiry(expires, &buffer[5], key_len);
+    // An already-expired key must not be revived by dropping its deadline.
+    const hash_table_entry_t *entry = lookup_live(&buffer[5], key_len);
+    if (entry && entry->expirable)
+        remove_expiry(table, expires, &buffer[5], key_len);
 
     send_ok(client);
 }
 
+// KEYS replies are short frames: at most this much listing.
+#define KEYS_MAX_OUTPUT 65500
+
+// Bytes `key_len` adds to the reply as entry number `n`: "N) key\n".
+static size_t keys_line_len(const size_t n, const size_t key_len)
+{
+    size_t digits = 1;
+    for (size_t rest = n; rest >= 10; rest /= 10)
+        digits++;
+    return digits + 2 + key_len + 1;
+}
+
+// List one more key; false (and `failed`) once the reply would outgrow its
+// frame, or on OOM.
+static bool keys_listing_add(keys_listing_t *listing, const unsigned char *key,
+                             const uint32_t key_len)
+{
+    if (listing->failed)
+        return false;
+    const size_t line_len = keys_line_len(listing->count + 1, key_len);
+    if (line_len > KEYS_MAX_OUTPUT - listing->text_len) {
+        listing->failed = true;
+        return false;
+    }
+
+    // Each entry is shorter than its line, so the buffer stays under the cap.
+    const size_t len = sizeof(key_len) + key_len;
+    if (listing->used + len > listing->capacity) {
+        size_t new_cap = listing->capacity ? listing->capacity * 2 : 4096;
+        if (new_cap > KEYS_MAX_OUTPUT)
+            new_cap = KEYS_MAX_OUTPUT;
+        if (new_cap < listing->used + len)
+            new_cap = listing->used + len;
+        unsigned char *tmp = realloc(listing->buf, new_cap);
+        if (!tmp) {
+            listing->failed = true;
+            return false;
+        }
+        listing->buf = tmp;
+        listing->capacity = new_cap;
+    }
+
+    unsigned char *entry = listing->buf + listing->used;
+    memcpy(entry, &key_len, sizeof(key_len));
+    memcpy(entry + sizeof(key_len), key, key_len);
+    listing->used += len;
+    listing->text_len += line_len;
+    listing->count++;
+    return true;
+}
+
+void keys_listing_collect(keys_listing_t *listing)
+{
+    // Scan both sub-tables so keys mid-resize are not missed.
+    const size_t slots = hashtable_slot_count(table);
+    for (size_t i = 0; i < slots && !listing->failed; i++) {
+        hash_table_entry_t *entry = hashtable_slot_entry(table, i);
+        if (!entry)
+            continue;
+        if (is_expired(entry)) {
+            expire_entry(entry);
+            continue;
+        }
+        keys_listing_add(listing, entry->key, entry->key_len);
+    }
+}
+
+void keys_listing_merge(keys_listing_t *listing, const keys_listing_t *more)
+{
+    if (more->failed)
+        listing->failed = true;
+    size_t at = 0;
+    while (at < more->used && !listing->failed) {
+        uint32_t key_len;
+        memcpy(&key_len, more->buf + at, sizeof(key_len));
+        at += sizeof(key_len);
+        keys_listing_add(listing, more->buf + at, key_len);
+        at += key_len;
+    }
+}
+
+void send_keys_listing(client_t *client, keys_listing_t *listing)
+{
+    char *text = NULL;
+    if (!listing->failed && listing->count > 0) {
+        text = malloc(listing->text_len);
+        if (!text)
+            listing->failed = true;
+    }
+
+    if (listing->failed) {
+        send_error(client);
+    } else if (listing->count == 0) {
+        send_keys_reply(client, (const unsigned char *)"", 0);
+    } else {
+        size_t used = 0;
+        size_t at = 0;
+        for (size_t n = 1; n <= listing->count; n++) {
+            uint32_t key_len;
+            memcpy(&key_len, listing->buf + at, sizeof(key_len));
+            at += sizeof(key_len);
+            used += (size_t)sprintf(text + used, "%zu) ", n);
+            memcpy(text + used, listing->buf + at, key_len);
+            used += key_len;
+            text[used++] = '\n';
+            at += key_len;
+        }
+        // Newlines separate entries; drop the trailing one after the last key.
+        send_keys_reply(client, (const unsigned char *)text, used - 1);
+    }
+
+    free(text);
+    free(listing->buf);
+    *listing = (keys_listing_t){0};
+}
+
 void handle_keys_command(client_t *client, unsigned char *buffer,
                          size_t bytes_read)
 {
@@ -940,91 +1166,130 @@ void handle_keys_command(client_t *client, unsigned char *buffer,
         return;
     }
 
-    const size_t max_output = 65500;
-    size_t capacity = 4096;
-    if (capacity > max_output) {
-        capacity = max_output;
+    keys_listing_t listing = {0};
+    keys_listing_collect(&listing);
+    send_keys_listing(client, &listing);
+}
+
+void handle_object_freq_command(client_t *client, unsigned char *buffer,
+                                size_t bytes_read)
+{
+    if (bytes_read < 5) {
+        send_error(client);
+        return;
+    }
+
+    const size_t command_len = buffer[0] << 8 | buffer[1];
+    const size_t key_len = buffer[3] << 8 | buffer[4];
+
+    if (buffer[2] != CMD_OBJECT_FREQ) {
+        send_error(client);
+        return;
     }
 
-    char *buf = malloc(capacity);
-    if (!buf) {
+    if (bytes_read - 2 != command_len) {
+        fprintf(stderr, "Incomplete command data for OBJECT FREQ.\n");
         send_error(client);
         return;
     }
 
-    size_t used = 0;
-    size_t count = 0;
+    if (!table->lfu) {
+        fprintf(stderr, "OBJECT FREQ needs an LFU maxmemory-policy.\n");
+        send_error(client);
+        return;
+    }
 
-    // Scan both sub-tables so keys mid-resize are not missed.
-    for (int t = 0; t < 2; t++) {
-        if (!table->buckets[t])
-            continue;
-        for (size_t i = 0; i < table->size[t]; i++) {
-            hash_table_entry_t *entry = table->buckets[t][i];
-            while (entry) {
-                hash_table_entry_t *next = entry->next;
-
-                if (check_and_expire(entry->key, entry->key_len)) {
-                    entry = next;
-                    continue;
-                }
-
-                // Format: "N) key\n"
-                char num_buf[24];
-                int num_len =
-                    snprintf(num_buf, sizeof(num_buf), "%zu) ", count + 1);
-                if (num_len < 0 || (size_t)num_len >= sizeof(num_buf)) {
-                    free(buf);
-                    send_error(client);
-                    return;
-                }
-
-                size_t line_len =
-                    (size_t)num_len + entry->key_len + 1; // +1 for \n
-
-                if (line_len > max_output - used) {
-                    free(buf);
-                    send_error(client);
-                    return;
-                }
-
-                if (used + line_len > capacity) {
-                    size_t new_cap = capacity * 2;
-                    if (new_cap > max_output) {
-                        new_cap = max_output;
-                    }
-                    if (new_cap < used + line_len) {
-                        new_cap = used + line_len;
-                    }
-                    char *tmp = realloc(buf, new_cap);
-                    if (!tmp) {
-                        free(buf);
-                        send_error(client);
-                        return;
-                    }
-                    buf = tmp;
-                    capacity = new_cap;
-                }
-
-                memcpy(buf + used, num_buf, num_len);
-                used += num_len;
-                memcpy(buf + used, entry->key, entry->key_len);
-                used += entry->key_len;
-                buf[used] = '\n';
-                used++;
-
-                count++;
-                entry = next;
-            }
-        }
+    // Reading the counter must not count as an access, so peek rather than
+    // look up; an expired key is still cleaned up and reported missing.
+    const hash_table_entry_t *entry = hashtable_peek_entry_hashed(
+        table, &buffer[5], key_len,
+        hashtable_hash_key(table, &buffer[5], key_len));
+    if (entry && is_expired(entry)) {
+        expire_entry(entry);
+        entry = NULL;
+    }
+    if (!entry) {
+        send_error(client);
+        return;
     }
 
-    if (count == 0) {
-        send_keys_reply(client, (const unsigned char *)"", 0);
+    send_integer_reply(client, hashtable_lfu_counter(table, entry));
+}
+
+void handle_unlink_command(client_t *client, unsigned char *buffer,
+                           size_t bytes_read)
+{
+    if (bytes_read < 5) {
+        send_error(client);
+        return;
+    }
+
+    const size_t command_len = buffer[0] << 8 | buffer[1];
+    const size_t key_len = buffer[3] << 8 | buffer[4];
+
+    if (buffer[2] != CMD_UNLINK) {
+        send_error(client);
+        return;
+    }
+
+    if (bytes_read - 2 != command_len) {
+        fprintf(stderr, "Incomplete command data for UNLINK.\n");
+        send_error(client);
+        return;
+    }
+
+    // As DEL, but a large value leaves the keyspace now and is freed by the
+    // lazyfree thread.
+    const hash_table_entry_t *entry = lookup_entry(table, &buffer[5], key_len);
+    if (entry) {
+        if (entry->expirable)
+            untrack_expiry(expires, entry->key, entry->key_len);
+        void *detached;
+        hashtable_unlink_hashed(table, entry->key, entry->key_len, entry->hash,
+                                lazyfree ? LAZYFREE_VALUE_BYTES : SIZE_MAX,
+                                &detached);
+        if (detached)
+            lazyfree_block(lazyfree, detached);
+    }
+
+    send_ok(client);
+}
+
+void handle_flushall_command(client_t *client, unsigned char *buffer,
+                             size_t bytes_read)
+{
+    if (bytes_read < 3 || bytes_read > 4 || buffer[2] != CMD_FLUSHALL) {
+        send_error(client);
+        return;
+    }
+
+    const size_t command_len = buffer[0] << 8 | buffer[1];
+    if (bytes_read - 2 != command_len) {
+        fprintf(stderr, "Incomplete command data for FLUSHALL.\n");
+        send_error(client);
+        return;
+    }
+    const bool async = bytes_read == 4 && buffer[3] == FLUSHALL_ASYNC;
+
+    // Both tables are emptied in O(1) and their old contents freed afterwards:
+    // by the lazyfree thread for ASYNC (when big enough to be worth it),
+    // otherwise right here.
+    hashtable_t *old_store = hashtable_detach(table);
+    if (!old_store) {
+        fprintf(stderr, "Unable to allocate an empty keyspace.\n");
+        send_error(client);
+        return;
+    }
+    // Should this fail, the index keeps timers for keys that are gone; active
+    // expiry discards those as they come due.
+    expiry_index_t *old_expires = expiry_index_detach(expires);
+    if (async) {
+        lazyfree_table(lazyfree, old_store);
+        lazyfree_expiry_index(lazyfree, old_expires);
     } else {
-        // Newlines separate entries; drop the trailing one after the last key.
-        send_keys_reply(client, (const unsigned char *)buf, used - 1);
+        free_hash_table(old_store);
+        free_expiry_index(old_expires);
     }
 
-    free(buf);
+    send_ok(client);
 }
@@ -5,11 +5,44 @@
 #include "../../core/hashtable.h"
 #include "../../server.h"
 
+/*
+ * register_command_handlers() fills the process-wide command table once;
+ * bind_command_handlers() points the calling thread's handlers at `db`, so
+ * every reactor thread serves its own shard. init_command_handlers() does
+ * both, for a single thread.
+ */
+void register_command_handlers(void);
+void bind_command_handlers(db_t *db);
 void init_command_handlers(db_t *db);
 
+/*
+ * Pipelined-lookup hints for try_process_frames(). prefetch_frame_key() hashes
+ * the key of a single-key command frame and prefetches its home groups in the
+ * keyspace and expiry tables, returning false for frames without a key;
+ * prefetch_frame_entry() later prefetches the matching entries for that hash.
+ */
+bool prefetch_frame_key(const unsigned char *frame, size_t frame_len,
+                        uint64_t *hash);
+void prefetch_frame_entry(uint64_t hash);
+
 void handle_set_command(client_t *client, unsigned char *buffer,
                         size_t bytes_read);
 
+/*
+ * Streaming SET: a long SET frame too big for the client buffer has its value
+ * received straight into the entry that will be stored (see networking.h).
+ * measure_streamed_set() looks at the first `avail` bytes of such a frame:
+ * 1 when it can be streamed, with the value's offset in the frame and its
+ * length; 0 until enough has arrived to tell; -1 when it must be assembled
+ * whole instead. handle_streamed_set() then runs the SET given the frame with
+ * the value cut out (`len` bytes, the value was at `value_at`) and the filled
+ * entry from hashtable_alloc_large_value(), which it owns from then on.
+ */
+int measure_streamed_set(const unsigned char *frame, size_t avail,
+                         size_t frame_len, size_t *value_at, size_t *value_len);
+void handle_streamed_set(client_t *client, const unsigned char *frame,
+                         size_t len, size_t value_at, value_entry_t *value);
+
 void handle_get_command(client_t *client, unsigned char *buffer,
                         size_t bytes_read);
 
@@ -46,4 +79,34 @@ void handle_persist_command(client_t *client, unsigned char *buffer,
 void handle_keys_command(client_t *client, unsigned char *buffer,
                          size_t bytes_read);
 
+/*
+ * KEYS in steps, so one reply can list every shard's keys (see shard.h).
+ * keys_listing_collect() adds the calling thread's live keys to a listing, and
+ * keys_listing_merge() adds another listing's keys after them. Entries are
+ * numbered only when send_keys_listing() writes the "N) key" lines. It replies
+ * with the listing, or an error if the listing outgrew a short frame, and
+ * then frees it.
+ */
+typedef struct keys_listing_t {
+    unsigned char *buf; // [key_len:4][key] per key, in listing order
+    size_t used;
+    size_t capacity;
+    size_t count;
+    size_t text_len; // the reply's size: "N) key\n" per key
+    bool failed;
+} keys_listing_t;
+
+void keys_listing_collect(keys_listing_t *listing);
+void keys_listing_merge(keys_listing_t *listing, const keys_listing_t *more);
+void send_keys_listing(client_t *client, keys_listing_t *listing);
+
+void handle_object_freq_command(client_t *client, unsigned char *buffer,
+                                size_t bytes_read);
+
+void handle_unlink_command(client_t *client, unsigned char *buffer,
+                           size_t bytes_read);
+
+void handle_flushall_command(client_t *client, unsigned char *buffer,
+                             size_t bytes_read);
+
 #endif // SERVER_COMMAND_HANDLERS_H
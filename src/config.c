@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #ifdef SERVER
 static int64_t parse_config_i64(const char *key, const char *value,
@@ -30,6 +31,40 @@ static int64_t parse_config_i64(const char *key, const char *value,
     return parsed;
 }
 
+// A byte count with an optional k/kb, m/mb or g/gb suffix (powers of 1024).
+static size_t parse_config_bytes(const char *key, const char *value)
+{
+    static const struct {
+        const char *suffix;
+        uint64_t scale;
+    } units[] = {{"gb", 1ULL << 30}, {"g", 1ULL << 30}, {"mb", 1ULL << 20},
+                 {"m", 1ULL << 20},  {"kb", 1ULL << 10}, {"k", 1ULL << 10}};
+
+    const size_t len = strlen(value);
+    uint64_t scale = 1;
+    size_t digits = len;
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+        const size_t suffix_len = strlen(units[i].suffix);
+        if (len > suffix_len &&
+            strcasecmp(value + len - suffix_len, units[i].suffix) == 0) {
+            scale = units[i].scale;
+            digits = len - suffix_len;
+            break;
+        }
+    }
+
+    int64_t parsed = 0;
+    if (!fkvs_parse_i64_decimal((const unsigned char *)value, digits, 0,
+                                (int64_t)(SIZE_MAX / 2 / scale), &parsed)) {
+        fprintf(stderr,
+                "Invalid config value for '%s': '%s' (expected bytes, "
+                "optionally with a kb/mb/gb suffix)\n",
+                key, value);
+        exit(EXIT_FAILURE);
+    }
+    return (size_t)parsed * scale;
+}
+
 static void set_server_bind_address(const char *value)
 {
     char *copy = strdup(value);
@@ -67,6 +102,24 @@ server_t load_server_config(const char *path)
     server.bind_address = (char *)FKVS_DEFAULT_BIND_ADDRESS;
     server.owns_bind_address = false;
     server.max_clients = FKVS_DEFAULT_MAX_CLIENTS;
+    server.shared_integers = FKVS_DEFAULT_SHARED_INTEGERS;
+    server.active_rehash_us = FKVS_DEFAULT_ACTIVE_REHASH_US;
+    server.active_expire_cpu_percent = FKVS_DEFAULT_ACTIVE_EXPIRE_CPU_PERCENT;
+    server.clock_source = FKVS_CLOCK_REALTIME;
+    server.maxmemory = 0;
+    server.maxmemory_policy = EVICT_NOEVICTION;
+    server.maxmemory_samples = EVICT_DEFAULT_SAMPLES;
+    server.lfu_log_factor = EVICT_DEFAULT_LFU_LOG_FACTOR;
+    server.lfu_decay_time = EVICT_DEFAULT_LFU_DECAY_TIME;
+    server.proto_max_bulk_len = FKVS_DEFAULT_PROTO_MAX_BULK_LEN;
+    server.zerocopy_send_min = FKVS_DEFAULT_ZEROCOPY_SEND_MIN;
+    server.io_uring_mode = io_uring_ring_default;
+    server.io_uring_sqpoll_idle_ms = FKVS_DEFAULT_IO_URING_SQPOLL_IDLE_MS;
+    server.io_uring_sqpoll_cpu = -1;
+    server.threads = 1;
+    server.shard_id = 0;
+    server.shard = NULL;
+    server.idle_rehash = true;
     server.uds_socket_path = NULL;
     server.owns_uds_socket_path = false;
     server.socket_domain = TCP_IP;
@@ -108,6 +161,83 @@ server_t load_server_config(const char *path)
                 (uint32_t)parse_config_i64(key, value, 1, UINT32_MAX);
         }
 
+        if (strcmp(key, "shared-integers") == 0) {
+            server.shared_integers =
+                (uint32_t)parse_config_i64(key, value, 0, 1000000);
+        }
+
+        if (strcmp(key, "active-rehash-us") == 0) {
+            server.active_rehash_us = parse_config_i64(key, value, 0, 100000);
+        }
+
+        if (strcmp(key, "active-expire-cpu-percent") == 0) {
+            server.active_expire_cpu_percent =
+                (int)parse_config_i64(key, value, 0, 100);
+        }
+
+        if (strcmp(key, "maxmemory") == 0) {
+            server.maxmemory = parse_config_bytes(key, value);
+        }
+
+        if (strcmp(key, "maxmemory-policy") == 0 &&
+            !evict_policy_from_string(value, &server.maxmemory_policy)) {
+            ERROR_AND_EXIT("'maxmemory-policy' expects noeviction, "
+                           "allkeys-lru, volatile-lru, allkeys-random, "
+                           "volatile-ttl, allkeys-lfu or volatile-lfu.");
+        }
+
+        if (strcmp(key, "maxmemory-samples") == 0) {
+            server.maxmemory_samples = (int)parse_config_i64(key, value, 1, 64);
+        }
+
+        if (strcmp(key, "lfu-log-factor") == 0) {
+            server.lfu_log_factor = (int)parse_config_i64(key, value, 0, 65535);
+        }
+
+        if (strcmp(key, "lfu-decay-time") == 0) {
+            server.lfu_decay_time = (int)parse_config_i64(key, value, 0, 65535);
+        }
+
+        if (strcmp(key, "proto-max-bulk-len") == 0) {
+            server.proto_max_bulk_len = parse_config_bytes(key, value);
+            // Short frames always fit; long ones carry a 32-bit length.
+            if (server.proto_max_bulk_len < FKVS_CLIENT_READ_BUFFER_SIZE ||
+                server.proto_max_bulk_len > UINT32_MAX) {
+                ERROR_AND_EXIT("'proto-max-bulk-len' expects 64kb..4095mb.");
+            }
+        }
+
+        if (strcmp(key, "zerocopy-send-min") == 0) {
+            server.zerocopy_send_min = parse_config_bytes(key, value);
+            // Only values sent from the stored entry can go out zero-copy.
+            if (server.zerocopy_send_min != 0 &&
+                server.zerocopy_send_min < FKVS_ZERO_COPY_REPLY_MIN) {
+                ERROR_AND_EXIT("'zerocopy-send-min' expects 0 (off) or at "
+                               "least 16kb.");
+            }
+        }
+
+        if (strcmp(key, "clock-source") == 0) {
+            if (strcmp(value, "realtime") == 0) {
+                server.clock_source = FKVS_CLOCK_REALTIME;
+            } else if (strcmp(value, "monotonic") == 0) {
+                server.clock_source = FKVS_CLOCK_MONOTONIC;
+            } else {
+                ERROR_AND_EXIT(
+                    "'clock-source' expects 'realtime' or 'monotonic'.");
+            }
+        }
+
+        if (strcmp(key, "idle-rehash") == 0) {
+            if (strcmp(value, "true") == 0) {
+                server.idle_rehash = true;
+            } else if (strcmp(value, "false") == 0) {
+                server.idle_rehash = false;
+            } else {
+                ERROR_AND_EXIT("'idle-rehash' expects a truthy value.");
+            }
+        }
+
         if (strcmp(key, "unixsocket") == 0) {
             server.uds_socket_path = strdup(value);
             if (!server.uds_socket_path) {
@@ -166,6 +296,34 @@ server_t load_server_config(const char *path)
                 ERROR_AND_EXIT("'use-io-uring' expects a truthy value.");
             }
         }
+
+        if (strcmp(key, "io-uring-mode") == 0) {
+            if (strcmp(value, "default") == 0) {
+                server.io_uring_mode = io_uring_ring_default;
+            } else if (strcmp(value, "sqpoll") == 0) {
+                server.io_uring_mode = io_uring_ring_sqpoll;
+            } else if (strcmp(value, "defer-taskrun") == 0) {
+                server.io_uring_mode = io_uring_ring_defer_taskrun;
+            } else {
+                ERROR_AND_EXIT("'io-uring-mode' expects 'default', 'sqpoll' "
+                               "or 'defer-taskrun'.");
+            }
+        }
+
+        if (strcmp(key, "io-uring-sqpoll-idle-ms") == 0) {
+            server.io_uring_sqpoll_idle_ms =
+                (uint32_t)parse_config_i64(key, value, 1, 60000);
+        }
+
+        if (strcmp(key, "io-uring-sqpoll-cpu") == 0) {
+            server.io_uring_sqpoll_cpu =
+                (int)parse_config_i64(key, value, -1, 65535);
+        }
+
+        if (strcmp(key, "threads") == 0) {
+            server.threads =
+                (uint32_t)parse_config_i64(key, value, 1, FKVS_MAX_THREADS);
+        }
     }
 
     fclose(config);
@@ -1,11 +1,119 @@
 #include "hashtable.h"
+#include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
-// DJB2 hash. Returns the raw (unfolded) hash; callers fold it into a specific
-// table with fold().
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Control bytes. FULL slots hold the 7-bit hash tag (0..127); both special
+// values have the sign bit set so "free" is a single sign test.
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+#define GROUP_WIDTH 16
+#define MAX_LOAD_NUM 7 // grow at 7/8 occupancy (live + tombstones)
+#define MAX_LOAD_DEN 8
+#define SHRINK_LOAD_DEN 8      // shrink below 1/8 live occupancy
+#define REHASH_EMPTY_VISITS 10 // empty groups one rehash step may skip
+#define REHASH_STEPS_PER_CLOCK 64 // steps between clock reads in timed rehash
+
+// A group mask has one set bit per matching slot. SSE2 yields one bit per
+// lane; NEON has no movemask, so it yields one nibble per lane and the lane
+// index is recovered by shifting the bit position.
+#if defined(__SSE2__)
+typedef uint32_t group_mask_t;
+#define GROUP_MASK_SHIFT 0
+
+static inline group_mask_t group_match(const int8_t *ctrl, const int8_t tag)
+{
+    const __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (group_mask_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+}
+
+static inline group_mask_t group_match_free(const int8_t *ctrl)
+{
+    const __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (group_mask_t)_mm_movemask_epi8(group);
+}
+
+static inline group_mask_t group_match_full(const int8_t *ctrl)
+{
+    return group_match_free(ctrl) ^ 0xFFFFu;
+}
+#elif defined(__ARM_NEON)
+typedef uint64_t group_mask_t;
+#define GROUP_MASK_SHIFT 2
+
+static inline group_mask_t neon_lanes_to_mask(const uint8x16_t lanes)
+{
+    const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(lanes), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+           0x8888888888888888ULL;
+}
+
+static inline group_mask_t group_match(const int8_t *ctrl, const int8_t tag)
+{
+    return neon_lanes_to_mask(vceqq_s8(vld1q_s8(ctrl), vdupq_n_s8(tag)));
+}
+
+static inline group_mask_t group_match_free(const int8_t *ctrl)
+{
+    return neon_lanes_to_mask(vcltq_s8(vld1q_s8(ctrl), vdupq_n_s8(0)));
+}
+
+static inline group_mask_t group_match_full(const int8_t *ctrl)
+{
+    return group_match_free(ctrl) ^ 0x8888888888888888ULL;
+}
+#else
+typedef uint32_t group_mask_t;
+#define GROUP_MASK_SHIFT 0
+
+static inline group_mask_t group_match(const int8_t *ctrl, const int8_t tag)
+{
+    group_mask_t mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++)
+        mask |= (group_mask_t)(ctrl[i] == tag) << i;
+    return mask;
+}
+
+static inline group_mask_t group_match_free(const int8_t *ctrl)
+{
+    group_mask_t mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++)
+        mask |= (group_mask_t)(ctrl[i] < 0) << i;
+    return mask;
+}
+
+static inline group_mask_t group_match_full(const int8_t *ctrl)
+{
+    return group_match_free(ctrl) ^ 0xFFFFu;
+}
+#endif
+
+static inline group_mask_t group_match_empty(const int8_t *ctrl)
+{
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+// Index of the lowest matching slot in a non-zero mask.
+static inline size_t mask_first(const group_mask_t mask)
+{
+    return (size_t)__builtin_ctzll((unsigned long long)mask) >>
+           GROUP_MASK_SHIFT;
+}
+
+// DJB2 hash, kept only for the hash_function() back-compat shim.
 static size_t djb2(const unsigned char *key, const size_t key_len)
 {
     size_t hash = 5381;
@@ -15,10 +123,153 @@ static size_t djb2(const unsigned char *key, const size_t key_len)
     return hash;
 }
 
-// Fold a raw hash into a bucket index. `size` must be a power of two.
-static inline size_t fold(const size_t hash, const size_t size)
+// wyhash (final v4, public domain, https://github.com/wangyi-fudan/wyhash).
+// Reads are little-endian; big-endian hosts byte-swap so every host places
+// keys identically for a given seed.
+static const uint64_t wyp[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+                                0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+static inline void wy_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 wy_u128;
+    const wy_u128 r = (wy_u128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32;
+    const uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    const uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wy_r8(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t wy_r4(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t wy_r3(const unsigned char *p, const size_t k)
 {
-    return hash & (size - 1);
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t hashtable_default_hash(const unsigned char *key, const size_t key_len,
+                                uint64_t seed)
+{
+    const unsigned char *p = key;
+    uint64_t a;
+    uint64_t b;
+
+    seed ^= wy_mix(seed ^ wyp[0], wyp[1]);
+    if (key_len <= 16) {
+        if (key_len >= 4) {
+            const size_t step = (key_len >> 3) << 2;
+            a = (wy_r4(p) << 32) | wy_r4(p + step);
+            b = (wy_r4(p + key_len - 4) << 32) | wy_r4(p + key_len - 4 - step);
+        } else if (key_len > 0) {
+            a = wy_r3(p, key_len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = key_len;
+        if (i > 48) {
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do {
+                seed = wy_mix(wy_r8(p) ^ wyp[1], wy_r8(p + 8) ^ seed);
+                see1 = wy_mix(wy_r8(p + 16) ^ wyp[2], wy_r8(p + 24) ^ see1);
+                see2 = wy_mix(wy_r8(p + 32) ^ wyp[3], wy_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mix(wy_r8(p) ^ wyp[1], wy_r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
+    }
+
+    a ^= wyp[1];
+    b ^= seed;
+    wy_mum(&a, &b);
+    return wy_mix(a ^ wyp[0] ^ key_len, b ^ wyp[1]);
+}
+
+// One random seed per process, drawn lazily from the kernel. If no entropy
+// source is readable we still vary the seed per run with time/pid/ASLR bits.
+static uint64_t process_seed(void)
+{
+    static uint64_t seed;
+    static bool seeded;
+    if (seeded)
+        return seed;
+
+    bool ok = false;
+    const int fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0) {
+        ok = read(fd, &seed, sizeof(seed)) == (ssize_t)sizeof(seed);
+        close(fd);
+    }
+    if (!ok) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        seed = ((uint64_t)tv.tv_sec << 20) ^ (uint64_t)tv.tv_usec ^
+               ((uint64_t)getpid() << 40) ^ (uint64_t)(uintptr_t)&seed;
+    }
+    seeded = true;
+    return seed;
+}
+
+static inline uint64_t hash_key(const hashtable_t *table,
+                                const unsigned char *key, const size_t key_len)
+{
+    if (table->hash_fn)
+        return table->hash_fn(key, key_len, table->seed);
+    return hashtable_default_hash(key, key_len, table->seed);
+}
+
+// The low 7 bits tag a FULL slot; the rest pick the home group.
+static inline int8_t hash_tag(const uint64_t hash)
+{
+    return (int8_t)(hash & 0x7F);
+}
+
+static inline size_t hash_group(const uint64_t hash)
+{
+    return (size_t)(hash >> 7);
 }
 
 // Smallest power of two >= n (and >= 1).
@@ -38,6 +289,11 @@ static size_t next_pow2(size_t n)
     return n + 1;
 }
 
+static inline size_t max_load(const size_t size)
+{
+    return size / MAX_LOAD_DEN * MAX_LOAD_NUM;
+}
+
 static inline bool is_rehashing(const hashtable_t *table)
 {
     return table->rehash_index != -1;
@@ -52,9 +308,115 @@ size_t hash_function(const unsigned char *key, const size_t key_len,
     return djb2(key, key_len) % table_size;
 }
 
+static inline size_t segment_slots(const size_t size)
+{
+    return size < HASHTABLE_SEGMENT_SLOTS ? size : HASHTABLE_SEGMENT_SLOTS;
+}
+
+// Segment holding slot `pos` of sub-table `t`. Groups never straddle segments
+// (both are powers of two and a segment is at least one group), and a table
+// smaller than one segment has a single segment that `pos` indexes directly.
+static inline hashtable_segment_t *segment_at(const hashtable_t *table,
+                                              const int t, const size_t pos)
+{
+    return &table->segments[t][pos / HASHTABLE_SEGMENT_SLOTS];
+}
+
+static inline size_t segment_offset(const size_t pos)
+{
+    return pos & (HASHTABLE_SEGMENT_SLOTS - 1);
+}
+
+// Back a segment with real arrays (all EMPTY) the first time a slot in it is
+// claimed.
+static bool materialize_segment(hashtable_t *table, const int t,
+                                hashtable_segment_t *seg)
+{
+    const size_t n = segment_slots(table->size[t]);
+    int8_t *ctrl = malloc(n);
+    hash_table_entry_t **slots = malloc(n * sizeof(hash_table_entry_t *));
+    if (!ctrl || !slots) {
+        free(ctrl);
+        free(slots);
+        return false;
+    }
+    memset(ctrl, CTRL_EMPTY, n);
+    seg->ctrl = ctrl;
+    seg->slots = slots;
+    table->slot_bytes += n + n * sizeof(hash_table_entry_t *);
+    return true;
+}
+
+// Drop the entry pointers of a table-0 segment the resize has fully migrated.
+// Its control bytes stay: they are all DELETED or EMPTY now, and probes for
+// keys still waiting in later groups must keep stopping where they used to.
+static void release_segment_slots(hashtable_t *table, hashtable_segment_t *seg)
+{
+    if (!seg->slots)
+        return;
+    free(seg->slots);
+    seg->slots = NULL;
+    table->slot_bytes -=
+        segment_slots(table->size[0]) * sizeof(hash_table_entry_t *);
+}
+
+// Set up sub-table `t` as a directory of unmaterialized segments. No slot
+// memory is allocated until entries arrive, so starting a resize costs one
+// small directory allocation instead of a whole new slot array.
+static bool alloc_subtable(hashtable_t *table, const int t, const size_t size)
+{
+    const size_t count = size / segment_slots(size);
+    hashtable_segment_t *segments = calloc(count, sizeof(hashtable_segment_t));
+    if (!segments)
+        return false;
+
+    table->segments[t] = segments;
+    table->size[t] = size;
+    table->used[t] = 0;
+    table->growth_left[t] = max_load(size);
+    table->slot_bytes += count * sizeof(hashtable_segment_t);
+    return true;
+}
+
+static void clear_subtable(hashtable_t *table, const int t)
+{
+    table->segments[t] = NULL;
+    table->size[t] = 0;
+    table->used[t] = 0;
+    table->growth_left[t] = 0;
+}
+
+static void free_subtable(hashtable_t *table, const int t)
+{
+    if (!table->segments[t])
+        return;
+
+    const size_t n = segment_slots(table->size[t]);
+    const size_t count = table->size[t] / n;
+    for (size_t i = 0; i < count; i++) {
+        hashtable_segment_t *seg = &table->segments[t][i];
+        if (seg->ctrl)
+            table->slot_bytes -= n;
+        if (seg->slots)
+            table->slot_bytes -= n * sizeof(hash_table_entry_t *);
+        free(seg->ctrl);
+        free(seg->slots);
+    }
+    free(table->segments[t]);
+    table->slot_bytes -= count * sizeof(hashtable_segment_t);
+    clear_subtable(table, t);
+}
+
 // Create a new hash table. The requested size is rounded up to a power of two
-// so bucket indices can be computed with a mask instead of a division.
+// (and at least one probe group) so group indices can be computed with a mask.
 hashtable_t *create_hash_table(const size_t size)
+{
+    return create_hash_table_with_hash(size, NULL, process_seed());
+}
+
+hashtable_t *create_hash_table_with_hash(const size_t size,
+                                         const hashtable_hash_fn hash_fn,
+                                         const uint64_t seed)
 {
     if (size == 0)
         return NULL;
@@ -63,48 +425,256 @@ hashtable_t *create_hash_table(const size_t size)
     if (!table)
         return NULL;
 
-    const size_t cap = next_pow2(size);
-    table->buckets[0] = calloc(cap, sizeof(hash_table_entry_t *));
-    if (!table->buckets[0]) {
+    const size_t cap = next_pow2(size < GROUP_WIDTH ? GROUP_WIDTH : size);
+    if (!alloc_subtable(table, 0, cap)) {
         free(table);
         return NULL;
     }
-    table->size[0] = cap;
-    table->used[0] = 0;
-    table->buckets[1] = NULL;
-    table->size[1] = 0;
-    table->used[1] = 0;
+    clear_subtable(table, 1);
     table->rehash_index = -1;
+    table->hash_fn = hash_fn;
+    table->seed = seed;
+    table->min_size = cap;
+    slab_init(&table->slab);
     return table;
 }
 
-// Allocate a value entry with its bytes stored inline in the same block, so a
-// value costs one allocation and free_value_entry() is a single free. `ptr`
-// points just past the header. A trailing NUL is written past value_len as a
+// Fill a value entry whose bytes are stored inline in the same block, so a
+// value costs one allocation. A trailing NUL is written past value_len as a
 // defensive pad for callers that read values as C strings; value_len stays
 // authoritative (values may be binary).
-static value_entry_t *make_value_entry(const void *value, const size_t value_len,
+static value_entry_t *init_value_entry(value_entry_t *v, const void *value,
+                                       const size_t value_len,
                                        const int encoding)
 {
-    value_entry_t *v = malloc(sizeof(*v) + value_len + 1);
-    if (!v)
-        return NULL;
-
-    v->ptr = v + 1; // bytes live immediately after the header
     v->value_len = value_len;
     v->encoding = encoding;
     v->type = 0;
-    v->expirable = 0;
+    v->shared = 0;
+    atomic_init(&v->refs, 1);
     if (value_len > 0)
-        memcpy(v->ptr, value, value_len);
-    ((unsigned char *)v->ptr)[value_len] = '\0';
+        memcpy(v->data, value, value_len);
+    v->data[value_len] = '\0';
     return v;
 }
 
+static inline size_t value_alloc_size(const size_t value_len)
+{
+    const size_t n = offsetof(value_entry_t, data) + value_len + 1;
+    return n < sizeof(value_entry_t) ? sizeof(value_entry_t) : n;
+}
+
+static inline size_t node_alloc_size(const size_t key_len)
+{
+    const size_t n = offsetof(hash_table_entry_t, key) + key_len;
+    return n < sizeof(hash_table_entry_t) ? sizeof(hash_table_entry_t) : n;
+}
+
+// Embedded layout: [node][key bytes][pad to value_entry_t alignment][value].
+static inline size_t embedded_value_offset(const size_t key_len)
+{
+    const size_t align = _Alignof(value_entry_t);
+    return (offsetof(hash_table_entry_t, key) + key_len + align - 1) /
+           align * align;
+}
+
+static inline size_t embedded_alloc_size(const size_t key_len,
+                                         const size_t value_len)
+{
+    return embedded_value_offset(key_len) + value_alloc_size(value_len);
+}
+
+static inline bool fits_embedded(const size_t key_len, const size_t value_len)
+{
+    return key_len + value_len <= HASHTABLE_EMBED_MAX;
+}
+
+// The shared integer pool: `shared_int_count` fixed-size entries, each a value
+// header followed by its int64, laid out back to back.
+#define SHARED_INT_STRIDE                                                      \
+    ((sizeof(value_entry_t) + sizeof(int64_t) + 1 + _Alignof(value_entry_t) - \
+      1) /                                                                     \
+     _Alignof(value_entry_t) * _Alignof(value_entry_t))
+
+static unsigned char *shared_ints;
+static size_t shared_int_count;
+
+bool hashtable_init_shared_integers(const size_t count)
+{
+    hashtable_free_shared_integers();
+    if (count == 0)
+        return true;
+
+    shared_ints = malloc(count * SHARED_INT_STRIDE);
+    if (!shared_ints)
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        const int64_t n = (int64_t)i;
+        value_entry_t *v = (value_entry_t *)(void *)(shared_ints +
+                                                     i * SHARED_INT_STRIDE);
+        init_value_entry(v, &n, sizeof(n), VALUE_ENTRY_TYPE_INT64);
+        v->shared = 1;
+    }
+    shared_int_count = count;
+    return true;
+}
+
+void hashtable_free_shared_integers(void)
+{
+    free(shared_ints);
+    shared_ints = NULL;
+    shared_int_count = 0;
+}
+
+// The pool entry for a value being stored, or NULL if it is not a pooled int.
+static value_entry_t *shared_integer(const void *value, const size_t value_len,
+                                     const int encoding)
+{
+    if (encoding != VALUE_ENTRY_TYPE_INT64 || value_len != sizeof(int64_t) ||
+        shared_int_count == 0)
+        return NULL;
+
+    int64_t n;
+    memcpy(&n, value, sizeof(n));
+    if (n < 0 || (uint64_t)n >= shared_int_count)
+        return NULL;
+    return (value_entry_t *)(void *)(shared_ints +
+                                     (size_t)n * SHARED_INT_STRIDE);
+}
+
+// Stored values live in the table's slab.
+static value_entry_t *table_value_alloc(hashtable_t *table, const void *value,
+                                        const size_t value_len,
+                                        const int encoding)
+{
+    value_entry_t *v = slab_alloc(&table->slab, value_alloc_size(value_len));
+    return v ? init_value_entry(v, value, value_len, encoding) : NULL;
+}
+
+static void table_value_free(hashtable_t *table, value_entry_t *v)
+{
+    if (!v || v->shared)
+        return;
+    // Malloc'd values may be pinned (see value_entry_t); drop the table's
+    // reference instead of freeing outright.
+    const size_t size = value_alloc_size(v->value_len);
+    if (slab_disown(&table->slab, size))
+        value_entry_unpin(v);
+    else
+        slab_free(&table->slab, v, size);
+}
+
+// A node with a deadline is allocated with an int64 just in front of it, so the
+// node layout (and the embedded value offset) is the same either way.
+static inline size_t node_prefix(const bool expirable)
+{
+    return expirable ? sizeof(int64_t) : 0;
+}
+
+static inline size_t node_size(const hash_table_entry_t *node)
+{
+    return node->embedded
+               ? embedded_alloc_size(node->key_len, node->value->value_len)
+               : node_alloc_size(node->key_len);
+}
+
+static inline void write_deadline(hash_table_entry_t *node,
+                                  const int64_t deadline)
+{
+    memcpy((unsigned char *)node - sizeof(deadline), &deadline,
+           sizeof(deadline));
+}
+
+// Allocate `size` node bytes, plus the deadline prefix unless `deadline` is
+// HASHTABLE_NO_DEADLINE. Only `expirable` is initialized.
+static hash_table_entry_t *node_block_alloc(hashtable_t *table,
+                                            const size_t size,
+                                            const int64_t deadline)
+{
+    const bool expirable = deadline != HASHTABLE_NO_DEADLINE;
+    unsigned char *block =
+        slab_alloc(&table->slab, node_prefix(expirable) + size);
+    if (!block)
+        return NULL;
+
+    hash_table_entry_t *node =
+        (hash_table_entry_t *)(void *)(block + node_prefix(expirable));
+    node->expirable = expirable;
+    if (expirable) {
+        write_deadline(node, deadline);
+        table->expirable_count++;
+    }
+    return node;
+}
+
+static void node_block_free(hashtable_t *table, hash_table_entry_t *node,
+                            const size_t size)
+{
+    const size_t prefix = node_prefix(node->expirable);
+    if (node->expirable)
+        table->expirable_count--;
+    slab_free(&table->slab, (unsigned char *)node - prefix, prefix + size);
+}
+
+// Build a node for a key absent from the table (or replacing a node), pointing
+// at `shared` (a pooled integer or an adopted value) if given, else embedding
+// the value when the pair is small enough. Returns NULL on OOM with nothing
+// allocated.
+static hash_table_entry_t *
+table_node_alloc(hashtable_t *table, const unsigned char *key,
+                 const size_t key_len, const uint64_t hash, const void *value,
+                 const size_t value_len, const int encoding,
+                 value_entry_t *shared, const int64_t deadline)
+{
+    hash_table_entry_t *node;
+    if (shared) {
+        node = node_block_alloc(table, node_alloc_size(key_len), deadline);
+        if (!node)
+            return NULL;
+        node->value = shared;
+        node->embedded = 0;
+    } else if (fits_embedded(key_len, value_len)) {
+        node = node_block_alloc(table, embedded_alloc_size(key_len, value_len),
+                                deadline);
+        if (!node)
+            return NULL;
+        node->value = (value_entry_t *)((unsigned char *)node +
+                                        embedded_value_offset(key_len));
+        init_value_entry(node->value, value, value_len, encoding);
+        node->embedded = 1;
+    } else {
+        value_entry_t *v = table_value_alloc(table, value, value_len, encoding);
+        if (!v)
+            return NULL;
+        node = node_block_alloc(table, node_alloc_size(key_len), deadline);
+        if (!node) {
+            table_value_free(table, v);
+            return NULL;
+        }
+        node->value = v;
+        node->embedded = 0;
+    }
+    memcpy(node->key, key, key_len);
+    node->key_len = (uint32_t)key_len;
+    node->hash = hash;
+    node->lru = table->lfu ? table->access_clock << 8 | HASHTABLE_LFU_INIT
+                           : table->access_clock;
+    return node;
+}
+
+static void table_node_free(hashtable_t *table, hash_table_entry_t *node)
+{
+    const size_t size = node_size(node);
+    if (!node->embedded)
+        table_value_free(table, node->value);
+    node_block_free(table, node, size);
+}
+
 void free_value_entry(value_entry_t *value)
 {
     // Value bytes are inline in the same allocation; one free releases both.
-    free(value);
+    if (value && !value->shared)
+        free(value);
 }
 
 void free_hash_table(hashtable_t *table)
@@ -112,215 +682,658 @@ void free_hash_table(hashtable_t *table)
     if (!table)
         return;
 
+    // Nodes and values live in slab pages, so there is no per-entry walk
+    // unless some were too large for the slab and came from malloc.
+    if (table->slab.large_count > 0) {
+        const size_t slots = hashtable_slot_count(table);
+        for (size_t pos = 0; pos < slots; pos++) {
+            hash_table_entry_t *entry = hashtable_slot_entry(table, pos);
+            if (entry)
+                table_node_free(table, entry);
+        }
+    }
+    for (int t = 0; t < 2; t++)
+        free_subtable(table, t);
+    slab_destroy(&table->slab);
+    free(table);
+}
+
+hashtable_t *hashtable_detach(hashtable_t *table)
+{
+    hashtable_t *detached = create_hash_table_with_hash(
+        table->min_size, table->hash_fn, table->seed);
+    if (!detached)
+        return NULL;
+
+    // No part of a table points back into its own struct, so swapping the
+    // structs moves the data.
+    const hashtable_t empty = *detached;
+    *detached = *table;
+    *table = empty;
+    table->grows = detached->grows;
+    table->shrinks = detached->shrinks;
+    table->access_clock = detached->access_clock;
+    table->lfu = detached->lfu;
+    table->lfu_log_factor = detached->lfu_log_factor;
+    table->lfu_decay_time = detached->lfu_decay_time;
+    table->lfu_rng = detached->lfu_rng;
+    return detached;
+}
+
+size_t hashtable_free_effort(const hashtable_t *table)
+{
+    size_t effort = 0;
+    for (int c = 0; c < table->slab.num_classes; c++)
+        effort += table->slab.classes[c].pages;
     for (int t = 0; t < 2; t++) {
-        if (!table->buckets[t])
+        if (!table->segments[t])
             continue;
-        for (size_t i = 0; i < table->size[t]; i++) {
-            hash_table_entry_t *entry = table->buckets[t][i];
-            while (entry) {
-                hash_table_entry_t *next = entry->next;
-                free_value_entry(entry->value);
-                free(entry); // key is inline in the node allocation
-                entry = next;
+        const size_t count = table->size[t] / segment_slots(table->size[t]);
+        for (size_t i = 0; i < count; i++)
+            effort += table->segments[t][i].ctrl ? 2 : 0;
+    }
+    if (table->slab.large_count > 0)
+        effort += table->used[0] + table->used[1];
+    return effort;
+}
+
+// Probe sub-table `t` for a key. Groups are visited in triangular order, which
+// covers every group of a power-of-two table; a group with an EMPTY slot ends
+// the probe because an insert would have stopped there. An unmaterialized
+// segment is all EMPTY, so reaching one ends the probe too.
+static hash_table_entry_t *find_in(const hashtable_t *table, const int t,
+                                   const unsigned char *key,
+                                   const size_t key_len, const uint64_t hash,
+                                   size_t *slot_out)
+{
+    const size_t group_mask = table->size[t] / GROUP_WIDTH - 1;
+    const int8_t tag = hash_tag(hash);
+    size_t group = hash_group(hash) & group_mask;
+
+    for (size_t probe = 1; probe <= group_mask + 1; probe++) {
+        const size_t base = group * GROUP_WIDTH;
+        const hashtable_segment_t *seg = segment_at(table, t, base);
+        if (!seg->ctrl)
+            return NULL;
+        const size_t off = segment_offset(base);
+        const int8_t *ctrl = seg->ctrl + off;
+
+        for (group_mask_t m = group_match(ctrl, tag); m; m &= m - 1) {
+            const size_t i = off + mask_first(m);
+            hash_table_entry_t *entry = seg->slots[i];
+            if (entry->hash == hash && entry->key_len == key_len &&
+                memcmp(entry->key, key, key_len) == 0) {
+                if (slot_out)
+                    *slot_out = base + (i - off);
+                return entry;
             }
         }
-        free(table->buckets[t]);
+
+        if (group_match_empty(ctrl))
+            return NULL;
+        group = (group + probe) & group_mask;
     }
-    free(table);
+    return NULL;
+}
+
+// Place an entry known to be absent into the first free slot on its probe
+// path. Reusing a tombstone is free; claiming an EMPTY slot spends growth
+// budget, and fails once the sub-table is at its maximum load (or if the
+// segment it lands in cannot be materialized).
+static bool insert_in(hashtable_t *table, const int t, const uint64_t hash,
+                      hash_table_entry_t *entry)
+{
+    const size_t group_mask = table->size[t] / GROUP_WIDTH - 1;
+    size_t group = hash_group(hash) & group_mask;
+
+    for (size_t probe = 1; probe <= group_mask + 1; probe++) {
+        const size_t base = group * GROUP_WIDTH;
+        hashtable_segment_t *seg = segment_at(table, t, base);
+        if (!seg->ctrl) {
+            // First free slot is in an untouched segment.
+            if (table->growth_left[t] == 0 ||
+                !materialize_segment(table, t, seg))
+                return false;
+        }
+        const size_t off = segment_offset(base);
+        const group_mask_t m = group_match_free(seg->ctrl + off);
+        if (m) {
+            const size_t i = off + mask_first(m);
+            if (seg->ctrl[i] == CTRL_EMPTY) {
+                if (table->growth_left[t] == 0)
+                    return false;
+                table->growth_left[t]--;
+            }
+            seg->ctrl[i] = hash_tag(hash);
+            seg->slots[i] = entry;
+            table->used[t]++;
+            return true;
+        }
+        group = (group + probe) & group_mask;
+    }
+    return false;
+}
+
+static inline hash_table_entry_t **slot_ref(const hashtable_t *table,
+                                            const int t, const size_t slot)
+{
+    return &segment_at(table, t, slot)->slots[segment_offset(slot)];
+}
+
+// Free a slot. If its group still has an EMPTY slot no probe ever continued
+// past it, so the slot can become EMPTY again; otherwise it must stay a
+// tombstone to keep later entries on the same probe path reachable.
+static void erase_slot(hashtable_t *table, const int t, const size_t slot)
+{
+    int8_t *ctrl = segment_at(table, t, slot)->ctrl;
+    const size_t i = segment_offset(slot);
+    if (group_match_empty(ctrl + (i & ~(size_t)(GROUP_WIDTH - 1)))) {
+        ctrl[i] = CTRL_EMPTY;
+        table->growth_left[t]++;
+    } else {
+        ctrl[i] = CTRL_DELETED;
+    }
+    table->used[t]--;
 }
 
 // Move table 1 into the primary slot once table 0 has fully drained.
 static void rehash_finalize(hashtable_t *table)
 {
-    free(table->buckets[0]);
-    table->buckets[0] = table->buckets[1];
+    free_subtable(table, 0);
+    table->segments[0] = table->segments[1];
     table->size[0] = table->size[1];
     table->used[0] = table->used[1];
-    table->buckets[1] = NULL;
-    table->size[1] = 0;
-    table->used[1] = 0;
+    table->growth_left[0] = table->growth_left[1];
+    clear_subtable(table, 1);
     table->rehash_index = -1;
 }
 
-// Migrate at most one non-empty bucket from table 0 to table 1, bounding the
-// number of empty buckets skipped so a single call stays O(1)-ish.
+// Move the rehash cursor past one table-0 group, releasing the slot array of
+// each segment it finishes so the old table shrinks as the new one fills.
+static void rehash_advance(hashtable_t *table)
+{
+    table->rehash_index++;
+    const size_t pos = (size_t)table->rehash_index * GROUP_WIDTH;
+    if (segment_offset(pos) == 0)
+        release_segment_slots(table, segment_at(table, 0, pos - 1));
+}
+
+// Migrate at most one non-empty group from table 0 to table 1, bounding the
+// number of empty groups skipped so a single call stays O(1)-ish. Migrated
+// slots become tombstones, not EMPTY, so keys further along the same probe
+// path in table 0 stay reachable until they move too.
 static void rehash_step(hashtable_t *table)
 {
     if (!is_rehashing(table))
         return;
 
+    const size_t groups = table->size[0] / GROUP_WIDTH;
     int empty_visited = 0;
-    while ((size_t)table->rehash_index < table->size[0] &&
-           table->buckets[0][table->rehash_index] == NULL) {
-        table->rehash_index++;
-        if (++empty_visited >= 10)
+    group_mask_t full = 0;
+    while ((size_t)table->rehash_index < groups) {
+        const size_t base = (size_t)table->rehash_index * GROUP_WIDTH;
+        const hashtable_segment_t *seg = segment_at(table, 0, base);
+        if (seg->ctrl) {
+            full = group_match_full(seg->ctrl + segment_offset(base));
+            if (full)
+                break;
+        }
+        rehash_advance(table);
+        if (++empty_visited >= REHASH_EMPTY_VISITS)
             return; // resume from here on the next operation
     }
 
-    if ((size_t)table->rehash_index >= table->size[0]) {
+    if ((size_t)table->rehash_index >= groups) {
         rehash_finalize(table);
         return;
     }
 
-    hash_table_entry_t *entry = table->buckets[0][table->rehash_index];
-    while (entry) {
-        hash_table_entry_t *next = entry->next;
-        const size_t j = fold(djb2(entry->key, entry->key_len), table->size[1]);
-        entry->next = table->buckets[1][j];
-        table->buckets[1][j] = entry;
+    const size_t base = (size_t)table->rehash_index * GROUP_WIDTH;
+    hashtable_segment_t *seg = segment_at(table, 0, base);
+    const size_t off = segment_offset(base);
+    for (; full; full &= full - 1) {
+        const size_t i = off + mask_first(full);
+        hash_table_entry_t *entry = seg->slots[i];
+        // Table 1 is sized to absorb every migrating entry plus the inserts
+        // that can land before migration completes, so this only fails if a
+        // table-1 segment cannot be materialized; the rest of the group then
+        // stays put and a later step retries it. The cached hash means no key
+        // bytes are read during migration.
+        if (!insert_in(table, 1, entry->hash, entry))
+            return;
+        seg->ctrl[i] = CTRL_DELETED;
         table->used[0]--;
-        table->used[1]++;
-        entry = next;
     }
-    table->buckets[0][table->rehash_index] = NULL;
-    table->rehash_index++;
+    rehash_advance(table);
 
-    if ((size_t)table->rehash_index >= table->size[0])
+    if ((size_t)table->rehash_index >= groups)
         rehash_finalize(table);
 }
 
-// Begin a resize when the primary table reaches load factor 1.0. Best-effort:
-// if the new array cannot be allocated we simply stay single-table.
+// Begin a resize once the primary table reaches its maximum load. The new
+// table is sized for twice the live entries, so a table full of tombstones is
+// rebuilt at the same size. Best-effort: if the new arrays cannot be allocated
+// we simply stay single-table.
 static void maybe_start_rehash(hashtable_t *table)
 {
     if (is_rehashing(table))
         return;
 
-    size_t new_size = table->size[0] ? table->size[0] : 1;
-    while (new_size < table->used[0] * 2)
+    size_t new_size = table->size[0];
+    while (max_load(new_size) < table->used[0] * 2)
         new_size <<= 1;
 
-    hash_table_entry_t **buckets =
-        calloc(new_size, sizeof(hash_table_entry_t *));
-    if (!buckets)
+    if (!alloc_subtable(table, 1, new_size))
         return;
+    table->rehash_index = 0;
+    table->grows++;
+}
 
-    table->buckets[1] = buckets;
-    table->size[1] = new_size;
-    table->used[1] = 0;
+// Begin shrinking once deletes leave the primary table below 1/8 occupancy.
+// Only inserts land in table 1 during a resize, at most one per migration
+// step, so it is sized for twice the live entries plus the worst-case number
+// of steps; a very sparse table therefore shrinks in a few rounds rather than
+// one. Best-effort like growing.
+static void maybe_start_shrink(hashtable_t *table)
+{
+    if (is_rehashing(table) || table->size[0] <= table->min_size ||
+        table->used[0] * SHRINK_LOAD_DEN >= table->size[0])
+        return;
+
+    const size_t groups = table->size[0] / GROUP_WIDTH;
+    const size_t needed =
+        table->used[0] * 2 + groups / REHASH_EMPTY_VISITS + 1;
+    size_t new_size = table->min_size;
+    while (max_load(new_size) < needed)
+        new_size <<= 1;
+    if (new_size >= table->size[0])
+        return;
+
+    if (!alloc_subtable(table, 1, new_size))
+        return;
     table->rehash_index = 0;
+    table->shrinks++;
 }
 
 // Find an entry by key, consulting both tables while a resize is in flight.
 static hash_table_entry_t *find_entry(const hashtable_t *table,
                                       const unsigned char *key,
-                                      const size_t key_len, const size_t hash)
+                                      const size_t key_len, const uint64_t hash,
+                                      int *table_out, size_t *slot_out)
 {
     const int last = is_rehashing(table) ? 1 : 0;
     for (int t = 0; t <= last; t++) {
-        if (table->size[t] == 0)
+        if (table->used[t] == 0)
             continue;
-        const size_t idx = fold(hash, table->size[t]);
-        for (hash_table_entry_t *entry = table->buckets[t][idx]; entry;
-             entry = entry->next) {
-            if (entry->key_len == key_len &&
-                memcmp(entry->key, key, key_len) == 0) {
-                return entry;
-            }
+        hash_table_entry_t *entry =
+            find_in(table, t, key, key_len, hash, slot_out);
+        if (entry) {
+            if (table_out)
+                *table_out = t;
+            return entry;
         }
     }
     return NULL;
 }
 
-bool set_value(hashtable_t *table, const unsigned char *key, size_t key_len,
-               const void *value, size_t value_len, int value_type_encoding)
+void hashtable_enable_lfu(hashtable_t *table, const unsigned log_factor,
+                          const unsigned decay_time)
+{
+    table->lfu = true;
+    table->lfu_log_factor = (uint16_t)log_factor;
+    table->lfu_decay_time = (uint16_t)decay_time;
+    table->lfu_rng = (uint32_t)table->seed | 1;
+    table->access_clock &= HASHTABLE_LFU_TIME_MAX;
+}
+
+uint8_t hashtable_lfu_counter(const hashtable_t *table,
+                              const hash_table_entry_t *entry)
+{
+    if (!table->lfu)
+        return 0;
+    const uint8_t counter = entry->lru & 0xFF;
+    if (table->lfu_decay_time == 0)
+        return counter;
+    const uint32_t elapsed =
+        (table->access_clock - (entry->lru >> 8)) & HASHTABLE_LFU_TIME_MAX;
+    const uint32_t periods = elapsed / table->lfu_decay_time;
+    return periods >= counter ? 0 : (uint8_t)(counter - periods);
+}
+
+// Morris increment: the higher the counter, the less likely a hit bumps it.
+static uint8_t lfu_log_incr(hashtable_t *table, const uint8_t counter)
+{
+    if (counter == 255)
+        return counter;
+    const uint32_t base =
+        counter > HASHTABLE_LFU_INIT ? counter - HASHTABLE_LFU_INIT : 0;
+    // xorshift32: a coin flip per access, no need for quality.
+    uint32_t x = table->lfu_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    table->lfu_rng = x;
+    const uint64_t limit =
+        (uint64_t)UINT32_MAX / ((uint64_t)base * table->lfu_log_factor + 1);
+    return x <= limit ? counter + 1 : counter;
+}
+
+// Record an access to `entry` for eviction (see hashtable_t.access_clock).
+static inline hash_table_entry_t *touch(hashtable_t *table,
+                                        hash_table_entry_t *entry)
+{
+    if (!entry)
+        return entry;
+    if (table->lfu)
+        entry->lru = table->access_clock << 8 |
+                     lfu_log_incr(table, hashtable_lfu_counter(table, entry));
+    else
+        entry->lru = table->access_clock;
+    return entry;
+}
+
+// Re-home `node` (in slot `slot` of sub-table `t`) in a block with or without
+// the deadline prefix. The node bytes (and an embedded value) are copied; an
+// out-of-line value is moved, not copied.
+static hash_table_entry_t *replace_node_deadline(hashtable_t *table,
+                                                 const int t, const size_t slot,
+                                                 hash_table_entry_t *node,
+                                                 const int64_t deadline)
 {
-    if (!table || !table->buckets[0] || table->size[0] == 0 || !key ||
-        (!value && value_len > 0))
+    const size_t size = node_size(node);
+    hash_table_entry_t *copy = node_block_alloc(table, size, deadline);
+    if (!copy)
+        return NULL;
+
+    const unsigned expirable = copy->expirable;
+    memcpy(copy, node, size);
+    copy->expirable = expirable;
+    if (node->embedded)
+        copy->value = (value_entry_t *)((unsigned char *)copy +
+                                        embedded_value_offset(node->key_len));
+    *slot_ref(table, t, slot) = copy;
+    node_block_free(table, node, size);
+    return copy;
+}
+
+// `adopted`, if given, is a complete out-of-line value (`value` and
+// `value_len` describe it) that is linked in instead of copied. The table owns
+// it only if the store succeeds.
+static bool store_value(hashtable_t *table, const unsigned char *key,
+                        size_t key_len, const void *value, size_t value_len,
+                        int value_type_encoding, const bool keep_deadline,
+                        int64_t deadline, value_entry_t *adopted)
+{
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key ||
+        (!value && value_len > 0) || key_len > UINT32_MAX)
         return false;
 
     // Advance any in-flight resize by one step on every insert.
     if (is_rehashing(table))
         rehash_step(table);
 
-    const size_t hash = djb2(key, key_len);
-    hash_table_entry_t *current = find_entry(table, key, key_len, hash);
+    const uint64_t hash = hash_key(table, key, key_len);
+    int t = 0;
+    size_t slot = 0;
+    hash_table_entry_t *current =
+        touch(table, find_entry(table, key, key_len, hash, &t, &slot));
+
+    // Adopted values take the same path as shared integers: the node just
+    // points at them.
+    value_entry_t *shared =
+        adopted ? adopted
+                : shared_integer(value, value_len, value_type_encoding);
+
+    if (keep_deadline)
+        deadline = current ? hashtable_entry_deadline(current)
+                           : HASHTABLE_NO_DEADLINE;
+    const bool expirable = deadline != HASHTABLE_NO_DEADLINE;
+    // Adding or dropping a deadline changes the node's allocation, so only an
+    // unchanged layout can be updated in place.
+    const bool same_layout = current && current->expirable == expirable;
 
     // Fast path: overwrite an existing value of the same length in place, with
     // no allocation or free. This is the common case for repeated SETs of the
-    // same key (and matches calloc semantics by resetting type/expirable).
-    if (current && current->value && current->value->value_len == value_len) {
+    // same key (and matches calloc semantics by resetting type).
+    if (same_layout && !shared && !current->value->shared &&
+        current->value->value_len == value_len &&
+        !value_entry_is_pinned(current->value)) {
         value_entry_t *v = current->value;
         if (value_len > 0)
-            memcpy(v->ptr, value, value_len);
+            memcpy(v->data, value, value_len);
         v->encoding = value_type_encoding;
         v->type = 0;
-        v->expirable = 0;
+        if (expirable)
+            write_deadline(current, deadline);
         return true;
     }
 
-    // Build the new value entry up front so an OOM never corrupts the old one.
-    value_entry_t *new_val = make_value_entry(value, value_len, value_type_encoding);
-    if (!new_val)
+    // Existing out-of-line value that stays out of line (or becomes a shared
+    // integer): build the new value first so an OOM never corrupts the old
+    // one, then swap it in.
+    if (same_layout && !current->embedded &&
+        (shared || !fits_embedded(key_len, value_len))) {
+        value_entry_t *new_val =
+            shared ? shared
+                   : table_value_alloc(table, value, value_len,
+                                       value_type_encoding);
+        if (!new_val)
+            return false;
+        table_value_free(table, current->value);
+        current->value = new_val;
+        if (expirable)
+            write_deadline(current, deadline);
+        return true;
+    }
+
+    hash_table_entry_t *node =
+        table_node_alloc(table, key, key_len, hash, value, value_len,
+                         value_type_encoding, shared, deadline);
+    if (!node)
         return false;
 
-    // Existing key: replace the value in place.
+    // Existing key changing format or deadline layout, or embedded with a new
+    // size baked into the node: replace the whole node in its slot (same hash,
+    // so the control byte is unchanged).
     if (current) {
-        if (current->value)
-            free_value_entry(current->value);
-        current->value = new_val;
+        node->lru = current->lru;
+        *slot_ref(table, t, slot) = node;
+        table_node_free(table, current);
         return true;
     }
 
-    // New key: one allocation holds the node and its inline key bytes.
-    const size_t key_alloc = key_len == 0 ? 1 : key_len;
-    hash_table_entry_t *node = malloc(sizeof(*node) + key_alloc);
-    if (!node) {
-        free_value_entry(new_val);
+    // Grow (or purge tombstones) once the primary table is at maximum load.
+    if (!is_rehashing(table) && table->growth_left[0] == 0)
+        maybe_start_rehash(table);
+
+    // Insert into the active insertion table: table 1 mid-resize, else table 0.
+    t = is_rehashing(table) ? 1 : 0;
+    if (!insert_in(table, t, hash, node)) {
+        // The caller still owns an adopted value when the store fails.
+        if (adopted)
+            node->value = NULL;
+        table_node_free(table, node);
         return false;
     }
-    node->key = (unsigned char *)(node + 1); // key lives after the header
-    memcpy(node->key, key, key_len);
-    node->key_len = key_len;
-    node->value = new_val;
 
-    // Insert into the active insertion table: table 1 mid-resize, else table 0.
-    const int t = is_rehashing(table) ? 1 : 0;
-    const size_t idx = fold(hash, table->size[t]);
-    node->next = table->buckets[t][idx];
-    table->buckets[t][idx] = node;
-    table->used[t]++;
-
-    // Grow once the primary table hits load factor 1.0.
-    if (!is_rehashing(table) && table->used[0] >= table->size[0])
-        maybe_start_rehash(table);
+    return true;
+}
 
+bool set_value(hashtable_t *table, const unsigned char *key, size_t key_len,
+               const void *value, size_t value_len, int value_type_encoding)
+{
+    return store_value(table, key, key_len, value, value_len,
+                       value_type_encoding, true, HASHTABLE_NO_DEADLINE, NULL);
+}
+
+bool set_value_with_deadline(hashtable_t *table, const unsigned char *key,
+                             size_t key_len, const void *value,
+                             size_t value_len, int value_type_encoding,
+                             const int64_t deadline_ms)
+{
+    return store_value(table, key, key_len, value, value_len,
+                       value_type_encoding, false, deadline_ms, NULL);
+}
+
+value_entry_t *hashtable_alloc_large_value(const size_t value_len)
+{
+    if (value_len <= HASHTABLE_LARGE_VALUE_MIN)
+        return NULL;
+    value_entry_t *v = malloc(value_alloc_size(value_len));
+    if (!v)
+        return NULL;
+    v->value_len = value_len;
+    v->encoding = VALUE_ENTRY_TYPE_RAW;
+    v->type = 0;
+    v->shared = 0;
+    atomic_init(&v->refs, 1);
+    v->data[value_len] = '\0';
+    return v;
+}
+
+bool set_value_entry_with_deadline(hashtable_t *table, const unsigned char *key,
+                                   const size_t key_len, value_entry_t *value,
+                                   const int value_type_encoding,
+                                   const int64_t deadline_ms)
+{
+    if (!value)
+        return false;
+    if (!table) {
+        free(value);
+        return false;
+    }
+
+    // From here the table's slab accounts for it, as if it had allocated it.
+    // Sizes above SLAB_MAX_OBJECT are plain malloc there too.
+    const size_t size = value_alloc_size(value->value_len);
+    slab_adopt(&table->slab, size);
+    value->encoding = value_type_encoding;
+    if (!store_value(table, key, key_len, value->data, value->value_len,
+                     value_type_encoding, false, deadline_ms, value)) {
+        slab_free(&table->slab, value, size);
+        return false;
+    }
     return true;
 }
 
+bool hashtable_set_deadline(hashtable_t *table, const unsigned char *key,
+                            const size_t key_len, const int64_t deadline_ms)
+{
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key)
+        return false;
+
+    int t = 0;
+    size_t slot = 0;
+    hash_table_entry_t *entry = touch(
+        table, find_entry(table, key, key_len, hash_key(table, key, key_len),
+                          &t, &slot));
+    if (!entry)
+        return false;
+
+    const bool expirable = deadline_ms != HASHTABLE_NO_DEADLINE;
+    if (entry->expirable == expirable) {
+        if (expirable)
+            write_deadline(entry, deadline_ms);
+        return true;
+    }
+    return replace_node_deadline(table, t, slot, entry, deadline_ms) != NULL;
+}
+
+uint64_t hashtable_hash_key(const hashtable_t *table, const unsigned char *key,
+                            const size_t key_len)
+{
+    return hash_key(table, key, key_len);
+}
+
 bool delete_value(hashtable_t *table, const unsigned char *key, size_t key_len)
 {
-    if (!table || !table->buckets[0] || table->size[0] == 0 || !key)
+    if (!table || !key)
+        return false;
+    return delete_value_hashed(table, key, key_len,
+                               hash_key(table, key, key_len));
+}
+
+bool delete_value_hashed(hashtable_t *table, const unsigned char *key,
+                         const size_t key_len, const uint64_t hash)
+{
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key)
+        return false;
+
+    int t = 0;
+    size_t slot = 0;
+    hash_table_entry_t *entry = find_entry(table, key, key_len, hash, &t, &slot);
+    if (!entry)
         return false;
 
-    const size_t hash = djb2(key, key_len);
+    erase_slot(table, t, slot);
+    table_node_free(table, entry); // key is inline in the node allocation
+    maybe_start_shrink(table);
+    return true;
+}
+
+bool hashtable_unlink_hashed(hashtable_t *table, const unsigned char *key,
+                             const size_t key_len, const uint64_t hash,
+                             const size_t min_detach, void **detached)
+{
+    *detached = NULL;
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key)
+        return false;
+
+    int t = 0;
+    size_t slot = 0;
+    hash_table_entry_t *entry = find_entry(table, key, key_len, hash, &t, &slot);
+    if (!entry)
+        return false;
+
+    erase_slot(table, t, slot);
+    value_entry_t *v = entry->value;
+    const size_t size = value_alloc_size(v->value_len);
+    if (!entry->embedded && !v->shared && size >= min_detach &&
+        !value_entry_is_pinned(v) && slab_disown(&table->slab, size)) {
+        *detached = v;
+        node_block_free(table, entry, node_size(entry));
+    } else {
+        table_node_free(table, entry);
+    }
+    maybe_start_shrink(table);
+    return true;
+}
+
+void hashtable_prefetch_group(const hashtable_t *table, const uint64_t hash)
+{
     const int last = is_rehashing(table) ? 1 : 0;
     for (int t = 0; t <= last; t++) {
-        if (table->size[t] == 0)
+        if (table->used[t] == 0)
             continue;
-        const size_t idx = fold(hash, table->size[t]);
-        hash_table_entry_t *current = table->buckets[t][idx];
-        hash_table_entry_t *prev = NULL;
-
-        while (current != NULL) {
-            if (current->key_len == key_len &&
-                memcmp(current->key, key, key_len) == 0) {
-                if (prev) {
-                    prev->next = current->next;
-                } else {
-                    table->buckets[t][idx] = current->next;
-                }
-                free_value_entry(current->value);
-                free(current); // key is inline in the node allocation
-                table->used[t]--;
-                return true;
-            }
-            prev = current;
-            current = current->next;
-        }
+        const size_t group_mask = table->size[t] / GROUP_WIDTH - 1;
+        const size_t base = (hash_group(hash) & group_mask) * GROUP_WIDTH;
+        const hashtable_segment_t *seg = segment_at(table, t, base);
+        if (!seg->ctrl)
+            continue;
+        const size_t off = segment_offset(base);
+        __builtin_prefetch(seg->ctrl + off);
+        // A group's 16 slot pointers span two cache lines.
+        __builtin_prefetch(seg->slots + off);
+        __builtin_prefetch(seg->slots + off + GROUP_WIDTH / 2);
     }
+}
 
-    return false;
+void hashtable_prefetch_entry(const hashtable_t *table, const uint64_t hash)
+{
+    const int last = is_rehashing(table) ? 1 : 0;
+    for (int t = 0; t <= last; t++) {
+        if (table->used[t] == 0)
+            continue;
+        const size_t group_mask = table->size[t] / GROUP_WIDTH - 1;
+        const size_t base = (hash_group(hash) & group_mask) * GROUP_WIDTH;
+        const hashtable_segment_t *seg = segment_at(table, t, base);
+        if (!seg->ctrl)
+            continue;
+        const size_t off = segment_offset(base);
+        const group_mask_t m = group_match(seg->ctrl + off, hash_tag(hash));
+        if (m)
+            __builtin_prefetch(seg->slots[off + mask_first(m)]);
+    }
 }
 
 bool get_value(hashtable_t *table, const unsigned char *key, size_t key_len,
@@ -331,24 +1344,25 @@ bool get_value(hashtable_t *table, const unsigned char *key, size_t key_len,
     if (value_len)
         *value_len = 0;
 
-    if (!table || !table->buckets[0] || table->size[0] == 0 || !key || !value ||
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key || !value ||
         !value_len)
         return false;
 
-    const size_t hash = djb2(key, key_len);
-    hash_table_entry_t *current = find_entry(table, key, key_len, hash);
-    if (!current || !current->value)
+    const uint64_t hash = hash_key(table, key, key_len);
+    hash_table_entry_t *current =
+        touch(table, find_entry(table, key, key_len, hash, NULL, NULL));
+    if (!current)
         return false;
 
     // Owned snapshot: one allocation with the value bytes inline. Use this only
     // when the copy must survive a later mutation (see lookup_value() for the
     // zero-copy read path).
     const value_entry_t *src = current->value;
-    value_entry_t *out = make_value_entry(src->ptr, src->value_len, src->encoding);
+    value_entry_t *out = malloc(value_alloc_size(src->value_len));
     if (!out)
         return false;
+    init_value_entry(out, src->data, src->value_len, src->encoding);
     out->type = src->type;
-    out->expirable = src->expirable;
 
     *value = out;
     *value_len = out->value_len;
@@ -359,10 +1373,193 @@ bool get_value(hashtable_t *table, const unsigned char *key, size_t key_len,
 const value_entry_t *lookup_value(hashtable_t *table, const unsigned char *key,
                                   const size_t key_len)
 {
-    if (!table || !table->buckets[0] || table->size[0] == 0 || !key)
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key)
+        return NULL;
+
+    const uint64_t hash = hash_key(table, key, key_len);
+    const hash_table_entry_t *e =
+        touch(table, find_entry(table, key, key_len, hash, NULL, NULL));
+    return e ? e->value : NULL;
+}
+
+const hash_table_entry_t *lookup_entry(hashtable_t *table,
+                                       const unsigned char *key,
+                                       const size_t key_len)
+{
+    if (!table || !key)
+        return NULL;
+    return lookup_entry_hashed(table, key, key_len,
+                               hash_key(table, key, key_len));
+}
+
+const hash_table_entry_t *lookup_entry_hashed(hashtable_t *table,
+                                              const unsigned char *key,
+                                              const size_t key_len,
+                                              const uint64_t hash)
+{
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key)
+        return NULL;
+    return touch(table, find_entry(table, key, key_len, hash, NULL, NULL));
+}
+
+const hash_table_entry_t *hashtable_peek_entry_hashed(const hashtable_t *table,
+                                                      const unsigned char *key,
+                                                      const size_t key_len,
+                                                      const uint64_t hash)
+{
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key)
+        return NULL;
+    return find_entry(table, key, key_len, hash, NULL, NULL);
+}
+
+int64_t *lookup_int_value(hashtable_t *table, const unsigned char *key,
+                          const size_t key_len)
+{
+    if (!table || !table->segments[0] || table->size[0] == 0 || !key)
+        return NULL;
+
+    const uint64_t hash = hash_key(table, key, key_len);
+    int t = 0;
+    size_t slot = 0;
+    hash_table_entry_t *e =
+        touch(table, find_entry(table, key, key_len, hash, &t, &slot));
+    if (!e || e->value->encoding != VALUE_ENTRY_TYPE_INT64)
         return NULL;
 
-    const size_t hash = djb2(key, key_len);
-    const hash_table_entry_t *e = find_entry(table, key, key_len, hash);
-    return (e && e->value) ? e->value : NULL;
+    // Copy-on-write: give the key a private copy of a shared integer so it can
+    // be updated in place from now on.
+    if (e->value->shared) {
+        const value_entry_t *shared = e->value;
+        if (fits_embedded(e->key_len, shared->value_len)) {
+            hash_table_entry_t *node = table_node_alloc(
+                table, e->key, e->key_len, e->hash, shared->data,
+                shared->value_len, VALUE_ENTRY_TYPE_INT64, NULL,
+                hashtable_entry_deadline(e));
+            if (!node)
+                return NULL;
+            node->lru = e->lru;
+            *slot_ref(table, t, slot) = node;
+            table_node_free(table, e);
+            e = node;
+        } else {
+            value_entry_t *v = table_value_alloc(
+                table, shared->data, shared->value_len, VALUE_ENTRY_TYPE_INT64);
+            if (!v)
+                return NULL;
+            e->value = v;
+        }
+    }
+    return (int64_t *)(void *)e->value->data;
+}
+
+bool hashtable_is_rehashing(const hashtable_t *table)
+{
+    return table && is_rehashing(table);
+}
+
+bool hashtable_rehash_steps(hashtable_t *table, size_t steps)
+{
+    if (!table)
+        return false;
+    while (steps-- > 0 && is_rehashing(table))
+        rehash_step(table);
+    return is_rehashing(table);
+}
+
+static int64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t hashtable_rehash_clock_us(void)
+{
+    return monotonic_us();
+}
+
+bool hashtable_rehash_until(hashtable_t *table, const int64_t deadline_us)
+{
+    if (!table || !is_rehashing(table))
+        return false;
+
+    while (monotonic_us() < deadline_us &&
+           hashtable_rehash_steps(table, REHASH_STEPS_PER_CLOCK))
+        ;
+    return is_rehashing(table);
+}
+
+bool hashtable_rehash_for_us(hashtable_t *table, const int64_t budget_us)
+{
+    if (budget_us <= 0)
+        return hashtable_is_rehashing(table);
+    return hashtable_rehash_until(table, monotonic_us() + budget_us);
+}
+
+size_t hashtable_slot_count(const hashtable_t *table)
+{
+    return table ? table->size[0] + table->size[1] : 0;
+}
+
+hash_table_entry_t *hashtable_slot_entry(const hashtable_t *table, size_t pos)
+{
+    if (!table)
+        return NULL;
+
+    int t = 0;
+    if (pos >= table->size[0]) {
+        pos -= table->size[0];
+        t = 1;
+        if (pos >= table->size[1])
+            return NULL;
+    }
+    const hashtable_segment_t *seg = segment_at(table, t, pos);
+    const size_t i = segment_offset(pos);
+    return !seg->ctrl || seg->ctrl[i] < 0 ? NULL : seg->slots[i];
+}
+
+void hashtable_memory_stats(const hashtable_t *table, slab_stats_t *out)
+{
+    slab_get_stats(&table->slab, out);
+}
+
+size_t hashtable_slot_bytes(const hashtable_t *table)
+{
+    return table ? table->slot_bytes : 0;
+}
+
+size_t hashtable_used_memory(const hashtable_t *table)
+{
+    if (!table)
+        return 0;
+    return table->slab.bytes_in_use + table->slab.large_bytes +
+           table->slot_bytes;
+}
+
+size_t hashtable_sample_entries(const hashtable_t *table, const uint64_t rand,
+                                hash_table_entry_t **out, const size_t count)
+{
+    const size_t slots = hashtable_slot_count(table);
+    const size_t used = table->used[0] + table->used[1];
+    if (slots == 0 || count == 0 || used == 0)
+        return 0;
+
+    // Sparse tables (a large initial size, or mass deletes before a shrink)
+    // need proportionally more visits per sample.
+    const size_t per_entry = 2 * slots / used > HASHTABLE_SAMPLE_VISITS
+                                 ? 2 * slots / used
+                                 : HASHTABLE_SAMPLE_VISITS;
+    const size_t max_visits = count * per_entry;
+    size_t pos = (size_t)(rand % slots);
+    size_t found = 0;
+    for (size_t visited = 0; visited < slots && found < count; visited++) {
+        if (visited >= max_visits && found > 0)
+            break;
+        hash_table_entry_t *entry = hashtable_slot_entry(table, pos);
+        if (entry)
+            out[found++] = entry;
+        if (++pos == slots)
+            pos = 0;
+    }
+    return found;
 }
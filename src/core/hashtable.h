@@ -1,67 +1,287 @@
 #ifndef HASHTABLE_H
 #define HASHTABLE_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
-#define VALUE_ENTRY_TYPE_INT 1
+#include "slab.h"
+
+#define VALUE_ENTRY_TYPE_INT 1 // decimal text that parses as an int64
 #define VALUE_ENTRY_TYPE_RAW 2
+// Native int64_t in data[0..8), host byte order; value_len is sizeof(int64_t).
+// Readers that need text must render it (see value_entry_int64()).
+#define VALUE_ENTRY_TYPE_INT64 3
 
 /*
- * A value entry owns its bytes inline: `ptr` points just past this header into
- * the same allocation, so a value costs one malloc and free_value_entry() is a
- * single free. Do not free `ptr` separately.
+ * A value entry owns its bytes inline: `data` is a flexible array member, so a
+ * value costs one allocation and has no self-pointer. `data[value_len]` is
+ * always a NUL pad, and `data` is int64-aligned so VALUE_ENTRY_TYPE_INT64
+ * values can be updated in place. Values stored in a table are carved from
+ * the table's slab and released by the table; free_value_entry() is only for
+ * the malloc'd snapshots returned by get_value(). Entries flagged `shared`
+ * belong to the shared integer pool and are immutable. Expiry is per key, so
+ * it lives on the hashtable entry, not here (a shared value has many keys).
+ *
+ * Values too large for the slab (see HASHTABLE_LARGE_VALUE_MIN) can be pinned
+ * to keep their bytes alive and unchanged while something outside the table
+ * reads them, such as a queued zero-copy reply. `refs` is 1 for the table's
+ * own reference plus one per pin. A pinned value is never overwritten in place
+ * or handed off to another owner; when the table lets go of it, the last
+ * value_entry_unpin() frees it. The count is atomic because a table may be
+ * freed on the lazyfree thread while the event loop unpins.
  */
 typedef struct value_entry_t {
-    void *ptr;
+    size_t value_len;
     unsigned type : 4;
     unsigned encoding : 4;
-    unsigned expirable : 1;
-    size_t value_len;
+    unsigned shared : 1; // lives in the shared integer pool; never freed
+    _Atomic uint32_t refs;
+    _Alignas(int64_t) unsigned char data[];
 } value_entry_t;
 
+static inline void value_entry_pin(value_entry_t *value)
+{
+    atomic_fetch_add_explicit(&value->refs, 1, memory_order_relaxed);
+}
+
+static inline void value_entry_unpin(value_entry_t *value)
+{
+    if (atomic_fetch_sub_explicit(&value->refs, 1, memory_order_acq_rel) == 1)
+        free(value);
+}
+
+static inline bool value_entry_is_pinned(const value_entry_t *value)
+{
+    return atomic_load_explicit(&value->refs, memory_order_relaxed) > 1;
+}
+
+static inline int64_t value_entry_int64(const value_entry_t *value)
+{
+    int64_t n;
+    memcpy(&n, value->data, sizeof(n));
+    return n;
+}
+
 /*
- * An entry owns its key inline: `key` points just past this header into the same
- * allocation, so a new key costs one malloc (node+key) and the key never needs a
- * separate free. The key is immutable for the entry's lifetime, keeping the node
- * address stable across resizes.
+ * Shared small integers: a process-wide, read-only pool of
+ * VALUE_ENTRY_TYPE_INT64 entries for 0..count-1. While it exists, storing one
+ * of these integers makes the node reference the pool entry instead of
+ * allocating a value. Shared entries are never written or freed through a
+ * table, and free_value_entry() ignores them. Initialize before creating
+ * tables and free only after every table is gone; count 0 disables sharing.
+ */
+bool hashtable_init_shared_integers(size_t count);
+void hashtable_free_shared_integers(void);
+
+/*
+ * Key/value pairs whose key_len + value_len is at most this many bytes are
+ * stored embedded: node, key, value header and value bytes share one
+ * allocation, so a GET touches one object. Larger pairs keep the value
+ * out-of-line in its own allocation.
+ */
+#define HASHTABLE_EMBED_MAX 64
+
+#define HASHTABLE_LRU_BITS 24
+#define HASHTABLE_LRU_MAX ((1U << HASHTABLE_LRU_BITS) - 1)
+
+/*
+ * In LFU mode (hashtable_enable_lfu()) the same 24 bits hold, as in Redis, a
+ * 16-bit access time in the owner's clock units (high bits) and an 8-bit
+ * Morris counter (low bits). Each access bumps the counter with probability
+ * 1 / ((counter - HASHTABLE_LFU_INIT) * log_factor + 1), so it grows roughly
+ * logarithmically with the access count and saturates at 255. A new key starts
+ * at HASHTABLE_LFU_INIT so it is not evicted before it had a chance to be
+ * used. The counter loses one per `decay_time` clock units since the key's last
+ * access; the decay is applied on the next access or read.
+ */
+#define HASHTABLE_LFU_INIT 5
+#define HASHTABLE_LFU_TIME_MAX 0xFFFFU
+
+/*
+ * An entry owns its key inline (`key` is a flexible array member), so a new key
+ * costs one slab allocation and the key never needs a separate free. The key is
+ * immutable for the entry's lifetime. `hash` caches the key's full 64-bit hash
+ * so resizes never rehash keys and probes compare it before touching key bytes.
+ *
+ * When `embedded` is set, `value` points into this same allocation, just past
+ * the key. When `expirable` is set, the key's deadline is stored in the 8 bytes
+ * immediately before the entry (see hashtable_entry_deadline()); keys without
+ * one do not allocate them. `lru` holds the table's `access_clock` as of the
+ * key's last lookup or store (deletes, slot walks and peeks do not count), or
+ * the LFU time and counter in LFU mode. Resizes never move nodes, but
+ * overwriting a value with one of a different length, or adding/removing a
+ * deadline, may replace the node, so do not hold an entry pointer across
+ * set_value() or hashtable_set_deadline().
  */
 typedef struct hashtable_entry_t {
-    unsigned char *key;
-    size_t key_len;
+    uint64_t hash;
     value_entry_t *value;
-    struct hashtable_entry_t *next;
+    uint32_t key_len;
+    unsigned embedded : 1;
+    unsigned expirable : 1;
+    unsigned lru : HASHTABLE_LRU_BITS;
+    unsigned char key[];
 } hash_table_entry_t;
 
+// Deadline value meaning "no deadline" (see hashtable_set_deadline()).
+#define HASHTABLE_NO_DEADLINE INT64_MIN
+
+static inline int64_t hashtable_entry_deadline(const hash_table_entry_t *entry)
+{
+    if (!entry->expirable)
+        return HASHTABLE_NO_DEADLINE;
+    int64_t deadline;
+    memcpy(&deadline, (const unsigned char *)entry - sizeof(deadline),
+           sizeof(deadline));
+    return deadline;
+}
+
+/*
+ * Keyed hash used to place entries. The seed is mixed into every hash so
+ * bucket placement is unpredictable to clients (collision-flood resistance).
+ */
+typedef uint64_t (*hashtable_hash_fn)(const unsigned char *key, size_t key_len,
+                                      uint64_t seed);
+
+/*
+ * Sub-tables are split into segments of HASHTABLE_SEGMENT_SLOTS slots (a table
+ * smaller than that is a single segment) reached through a small directory. A
+ * segment's arrays are allocated the first time one of its slots is claimed;
+ * until then `ctrl` is NULL and every slot reads as EMPTY.
+ */
+#define HASHTABLE_SEGMENT_SLOTS 4096
+
+typedef struct hashtable_segment {
+    int8_t *ctrl; // one control byte per slot; NULL while unmaterialized
+    struct hashtable_entry_t **slots; // entry pointers, parallel to ctrl
+} hashtable_segment_t;
+
 /*
- * Separate-chaining hash table with incremental (Redis dict-style) resizing.
+ * Open-addressing (Swiss-table style) hash table with incremental (Redis
+ * dict-style) resizing.
+ *
+ * Each sub-table is an array of entry pointers plus a parallel array of one-byte
+ * control words: EMPTY, DELETED (tombstone), or FULL with the low 7 bits of the
+ * key's hash. Slots are probed 16 at a time (one SSE2/NEON compare per group),
+ * and only slots whose control byte matches the hash tag are dereferenced, so
+ * a lookup usually touches one control group and one entry.
  *
  * Two sub-tables are kept so a resize can be spread across many operations
  * instead of stalling one of them:
  *   - index 0 is the primary table;
- *   - index 1 is the larger table that only exists while a resize is in flight.
+ *   - index 1 is the new table that only exists while a resize is in flight.
+ *
+ * A resize starts when table 0 reaches its maximum load (grow, or rebuild at
+ * the same size if it is mostly tombstones) or when a delete leaves it below
+ * 1/8 occupancy (shrink, never below the size the table was created with).
+ * Both targets size the new table for about twice the live entries, well away
+ * from either trigger, so a table hovering around one threshold does not
+ * thrash.
+ *
+ * When `rehash_index` is >= 0 a resize is active and it marks the next group of
+ * table 0 still to be migrated into table 1. New keys are inserted into table 1
+ * during a resize, so table 0 only ever drains. Lookups and deletes consult both
+ * tables; a key lives in at most one of them at any instant. Migration only
+ * moves entry pointers between slot arrays — it never copies keys/values or
+ * frees nodes — so entry addresses stay stable across a resize.
  *
- * When `rehash_index` is >= 0 a resize is active and it marks the next bucket
- * of table 0 still to be migrated into table 1. New keys are inserted into
- * table 1 during a resize, so table 0 only ever drains. Lookups and deletes
- * consult both tables; a key lives in at most one of them at any instant.
- * Migration only relinks existing nodes between bucket arrays — it never copies
- * keys/values or frees nodes — so entry addresses stay stable across a resize.
+ * Starting a resize allocates only table 1's segment directory. Its segments
+ * materialize as migration (which proceeds in slot order, and so fills table 1
+ * roughly in order) or new inserts reach them, and each table-0 segment drops
+ * its entry-pointer array as soon as migration has passed it. Memory therefore
+ * ramps from the old size to the new one in segment-sized steps instead of
+ * holding both full slot arrays at once.
+ *
+ * Nodes and value entries come from the table's own size-class slab, so the
+ * steady-state SET/DEL path recycles objects through free lists instead of
+ * calling malloc/free. Only the slot/control arrays use malloc directly.
  */
 typedef struct hashtable {
-    hash_table_entry_t **buckets[2];
-    size_t size[2]; // bucket counts (always powers of two)
-    size_t used[2]; // live entry counts, for load-factor tracking
+    hashtable_segment_t *segments[2]; // segment directories
+    size_t size[2];        // slot counts (powers of two, >= one group)
+    size_t used[2];        // live entry counts
+    size_t growth_left[2]; // EMPTY slots that may still be claimed
     ssize_t
-        rehash_index; // -1 when not resizing; else next table-0 bucket to move
+        rehash_index; // -1 when not resizing; else next table-0 group to move
+    hashtable_hash_fn hash_fn; // NULL selects the built-in wyhash
+    uint64_t seed;
+    size_t min_size;   // shrinking never goes below the initial size
+    uint64_t grows;    // resizes started at maximum load
+    uint64_t shrinks;  // resizes started after deletes emptied the table
+    size_t slot_bytes; // directories plus materialized segment arrays
+    size_t expirable_count; // entries carrying a deadline
+    // Stamped into entry->lru by every lookup and store. The owner advances it
+    // (e.g. seconds modulo HASHTABLE_LRU_MAX + 1); the table never reads a
+    // clock itself. In LFU mode it must stay within HASHTABLE_LFU_TIME_MAX.
+    uint32_t access_clock;
+    bool lfu;
+    uint16_t lfu_log_factor;
+    uint16_t lfu_decay_time; // clock units per counter decrement; 0: never
+    uint32_t lfu_rng;        // Morris counter coin flips
+    slab_allocator_t slab; // backs every node and stored value entry
 } hashtable_t;
 
+/*
+ * create_hash_table() uses the built-in hash with a random per-process seed.
+ * create_hash_table_with_hash() plugs in another hash function and/or a fixed
+ * seed (e.g. for reproducible tests); pass NULL for the built-in function.
+ */
 hashtable_t *create_hash_table(size_t size);
+hashtable_t *create_hash_table_with_hash(size_t size, hashtable_hash_fn hash_fn,
+                                         uint64_t seed);
+// The built-in hash (wyhash): a handful of multiplies for keys <= 16 bytes.
+uint64_t hashtable_default_hash(const unsigned char *key, size_t key_len,
+                                uint64_t seed);
 void free_hash_table(hashtable_t *table);
+/*
+ * Empty `table` in O(1): its entries, slot arrays and slab move to a new table
+ * object, which is returned for the caller to free_hash_table() (e.g. on
+ * another thread). `table` keeps its identity and settings (hash, seed,
+ * initial size, access clock, LFU mode, resize counters) and starts over at
+ * its initial size. NULL on OOM, leaving `table` untouched.
+ */
+hashtable_t *hashtable_detach(hashtable_t *table);
+/*
+ * Rough cost of free_hash_table(table), in blocks returned to the allocator:
+ * slab pages and slot arrays, plus every entry when some of them hold malloc'd
+ * (larger than SLAB_MAX_OBJECT) keys or values that need a walk to find.
+ */
+size_t hashtable_free_effort(const hashtable_t *table);
 void free_value_entry(value_entry_t *value);
 bool set_value(hashtable_t *table, const unsigned char *key, size_t key_len,
                const void *value, size_t value_len, int value_type);
+/*
+ * Per-key deadlines (absolute milliseconds on the caller's clock) are stored
+ * inline with the entry, so reading a key and its TTL is one lookup.
+ * set_value() keeps an existing deadline; set_value_with_deadline() replaces it
+ * in the same operation (HASHTABLE_NO_DEADLINE clears it). The table never
+ * expires anything itself: callers compare the deadline against their clock.
+ */
+bool set_value_with_deadline(hashtable_t *table, const unsigned char *key,
+                             size_t key_len, const void *value,
+                             size_t value_len, int value_type,
+                             int64_t deadline_ms);
+/*
+ * Large values built in place, e.g. received straight from a socket.
+ * hashtable_alloc_large_value() mallocs an entry for `value_len` bytes (more
+ * than HASHTABLE_LARGE_VALUE_MIN, else NULL) with the data left for the caller
+ * to fill. set_value_entry_with_deadline() then stores it under `key` without
+ * copying, taking ownership whether or not it succeeds. An entry never stored
+ * is released with free().
+ */
+#define HASHTABLE_LARGE_VALUE_MIN SLAB_MAX_OBJECT
+value_entry_t *hashtable_alloc_large_value(size_t value_len);
+bool set_value_entry_with_deadline(hashtable_t *table, const unsigned char *key,
+                                   size_t key_len, value_entry_t *value,
+                                   int value_type, int64_t deadline_ms);
+// Set or (with HASHTABLE_NO_DEADLINE) clear the deadline of an existing key.
+// Returns false if the key is absent or on OOM.
+bool hashtable_set_deadline(hashtable_t *table, const unsigned char *key,
+                            size_t key_len, int64_t deadline_ms);
 bool get_value(hashtable_t *table, const unsigned char *key, size_t key_len,
                value_entry_t **value, size_t *value_len);
 /*
@@ -72,8 +292,120 @@ bool get_value(hashtable_t *table, const unsigned char *key, size_t key_len,
  */
 const value_entry_t *lookup_value(hashtable_t *table, const unsigned char *key,
                                   size_t key_len);
+// Borrowing lookup of the whole entry (value, key and deadline); same lifetime
+// rules as lookup_value(). The _hashed form takes hashtable_hash_key()'s hash.
+const hash_table_entry_t *lookup_entry(hashtable_t *table,
+                                       const unsigned char *key,
+                                       size_t key_len);
+const hash_table_entry_t *lookup_entry_hashed(hashtable_t *table,
+                                              const unsigned char *key,
+                                              size_t key_len, uint64_t hash);
+/*
+ * Switch the access stamps to LFU counters (see HASHTABLE_LFU_INIT). Call it
+ * on an empty table: existing stamps would be misread as counters.
+ */
+void hashtable_enable_lfu(hashtable_t *table, unsigned log_factor,
+                          unsigned decay_time);
+// The LFU counter of `entry` with decay applied as of `access_clock`, without
+// recording an access. 0 for tables not in LFU mode.
+uint8_t hashtable_lfu_counter(const hashtable_t *table,
+                              const hash_table_entry_t *entry);
+// As lookup_entry_hashed(), but does not count as an access (entry->lru is
+// left alone), for callers inspecting keys on the table owner's behalf.
+const hash_table_entry_t *hashtable_peek_entry_hashed(const hashtable_t *table,
+                                                      const unsigned char *key,
+                                                      size_t key_len,
+                                                      uint64_t hash);
+/*
+ * Writable view of a stored VALUE_ENTRY_TYPE_INT64 value, so INCR-style
+ * updates cost one probe and no allocation. A key referencing a shared integer
+ * first gets a private copy (copy-on-write) — the only case that allocates.
+ * Returns NULL if the key is absent, holds any other encoding, or on OOM. Same
+ * lifetime rules as lookup_value().
+ */
+int64_t *lookup_int_value(hashtable_t *table, const unsigned char *key,
+                          size_t key_len);
 bool delete_value(hashtable_t *table, const unsigned char *key, size_t key_len);
+/*
+ * Hash a key the way `table` does, and delete with a precomputed hash. Tables
+ * with the same hash_fn and seed (all create_hash_table() tables in a process)
+ * agree, so a cached entry->hash from one can be reused to delete from another.
+ */
+uint64_t hashtable_hash_key(const hashtable_t *table, const unsigned char *key,
+                            size_t key_len);
+bool delete_value_hashed(hashtable_t *table, const unsigned char *key,
+                         size_t key_len, uint64_t hash);
+/*
+ * As delete_value_hashed(), but an out-of-line value of at least `min_detach`
+ * bytes that malloc (not the slab) backs is handed to the caller in *detached
+ * instead of being freed, so the caller can free() it later or on another
+ * thread. *detached is NULL if everything was freed in place. A pinned value
+ * is never detached; the table drops its reference and the last unpin frees it.
+ */
+bool hashtable_unlink_hashed(hashtable_t *table, const unsigned char *key,
+                             size_t key_len, uint64_t hash, size_t min_detach,
+                             void **detached);
+/*
+ * Software-pipelined lookup hints. Issue hashtable_prefetch_group() well ahead
+ * of a lookup to pull in the control bytes and slot pointers of the key's home
+ * group, then hashtable_prefetch_entry() a little later (once those lines have
+ * likely arrived) to pull in the first entry whose tag matches. Both are pure
+ * hints: they never fault, allocate, or change the table.
+ */
+void hashtable_prefetch_group(const hashtable_t *table, uint64_t hash);
+void hashtable_prefetch_entry(const hashtable_t *table, uint64_t hash);
 size_t hash_function(const unsigned char *key, size_t key_len,
                      size_t table_size);
 
+/*
+ * Slot-space iteration. Both sub-tables are exposed as one contiguous range of
+ * hashtable_slot_count() positions; hashtable_slot_entry() returns the entry in
+ * a position, or NULL if it is empty. Deleting entries while walking is safe
+ * (deletes never move other entries), but set_value() may start or advance a
+ * resize, so re-read the slot count after inserting.
+ */
+size_t hashtable_slot_count(const hashtable_t *table);
+hash_table_entry_t *hashtable_slot_entry(const hashtable_t *table, size_t pos);
+
+/*
+ * Active rehashing. Inserts advance a resize by one step each, but reads and
+ * deletes do not (so slot walkers stay valid), so a read-mostly table would
+ * otherwise keep both sub-tables — and two probes per miss — for a long time.
+ * The event loop drives resizes to completion with these instead:
+ *   - hashtable_rehash_steps() runs up to `steps` steps (each migrates one
+ *     group or skips a few empty ones);
+ *   - hashtable_rehash_until() keeps stepping until `deadline_us` on the
+ *     hashtable_rehash_clock_us() clock, checking it every few groups, so
+ *     several tables can share one budget;
+ *   - hashtable_rehash_for_us() does the same for roughly `budget_us`
+ *     microseconds from now.
+ * All three return true while a resize is still active.
+ */
+bool hashtable_is_rehashing(const hashtable_t *table);
+bool hashtable_rehash_steps(hashtable_t *table, size_t steps);
+int64_t hashtable_rehash_clock_us(void);
+bool hashtable_rehash_until(hashtable_t *table, int64_t deadline_us);
+bool hashtable_rehash_for_us(hashtable_t *table, int64_t budget_us);
+
+// Snapshot of the slab backing `table` (node + value memory, fragmentation).
+void hashtable_memory_stats(const hashtable_t *table, slab_stats_t *out);
+// Bytes currently held by slot/control arrays and segment directories.
+size_t hashtable_slot_bytes(const hashtable_t *table);
+/*
+ * Memory held for live data, in O(1): slab objects at their class size,
+ * malloc'd large values, and slot arrays. Unlike the slab's reserved bytes it
+ * drops as soon as entries are deleted, which is what a memory limit needs.
+ */
+size_t hashtable_used_memory(const hashtable_t *table);
+/*
+ * Random sampling for eviction: collect up to `count` entries from the slots
+ * that follow a random position (`rand` picks it), wrapping around. It visits
+ * at most HASHTABLE_SAMPLE_VISITS slots per wanted entry (or twice the mean gap
+ * between entries, if larger), unless it has found none yet. Returns the number
+ * stored in `out`. Entries are borrowed, as with hashtable_slot_entry().
+ */
+#define HASHTABLE_SAMPLE_VISITS 16
+size_t hashtable_sample_entries(const hashtable_t *table, uint64_t rand,
+                                hash_table_entry_t **out, size_t count);
+
 #endif // HASHTABLE_H
@@ -0,0 +1,173 @@
+#include "slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Classes step by SLAB_ALIGN up to this size, then grow by ~1.25x.
+#define SLAB_LINEAR_LIMIT 128
+
+static inline size_t round_up(const size_t n, const size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+void slab_init(slab_allocator_t *slab)
+{
+    memset(slab, 0, sizeof(*slab));
+
+    size_t size = SLAB_ALIGN;
+    int n = 0;
+    while (n < SLAB_NUM_CLASSES) {
+        slab->classes[n++].object_size = size;
+        if (size == SLAB_MAX_OBJECT)
+            break;
+        size = size < SLAB_LINEAR_LIMIT ? size + SLAB_ALIGN
+                                        : round_up(size + size / 4, SLAB_ALIGN);
+        if (size > SLAB_MAX_OBJECT || n == SLAB_NUM_CLASSES - 1)
+            size = SLAB_MAX_OBJECT;
+    }
+    slab->num_classes = n;
+
+    // class_for[i] is the smallest class holding i * SLAB_ALIGN bytes.
+    int c = 0;
+    for (size_t i = 0; i < sizeof(slab->class_for); i++) {
+        while (slab->classes[c].object_size < i * SLAB_ALIGN)
+            c++;
+        slab->class_for[i] = (uint8_t)c;
+    }
+}
+
+void slab_destroy(slab_allocator_t *slab)
+{
+    if (!slab)
+        return;
+
+    void *page = slab->pages;
+    while (page) {
+        void *next = *(void **)page;
+        free(page);
+        page = next;
+    }
+    slab->pages = NULL;
+    for (int c = 0; c < slab->num_classes; c++) {
+        slab_class_t *cls = &slab->classes[c];
+        cls->free_list = NULL;
+        cls->bump = cls->bump_end = NULL;
+        cls->live = 0;
+        cls->pages = 0;
+    }
+    slab->bytes_requested = 0;
+    slab->bytes_in_use = 0;
+}
+
+static inline slab_class_t *class_for_size(slab_allocator_t *slab,
+                                           const size_t size)
+{
+    return &slab->classes[slab->class_for[(size + SLAB_ALIGN - 1) /
+                                          SLAB_ALIGN]];
+}
+
+// Start a new page for `cls`. The first SLAB_ALIGN bytes link the page into
+// the slab's page list; objects are carved from the rest.
+static bool grow_class(slab_allocator_t *slab, slab_class_t *cls)
+{
+    unsigned char *page = malloc(SLAB_PAGE_SIZE);
+    if (!page)
+        return false;
+
+    *(void **)page = slab->pages;
+    slab->pages = page;
+    cls->bump = page + SLAB_ALIGN;
+    cls->bump_end = page + SLAB_PAGE_SIZE;
+    cls->pages++;
+    return true;
+}
+
+void *slab_alloc(slab_allocator_t *slab, const size_t size)
+{
+    if (size > SLAB_MAX_OBJECT) {
+        void *ptr = malloc(size);
+        if (ptr) {
+            slab->large_bytes += size;
+            slab->large_count++;
+        }
+        return ptr;
+    }
+
+    slab_class_t *cls = class_for_size(slab, size == 0 ? 1 : size);
+    void *ptr = cls->free_list;
+    if (ptr) {
+        cls->free_list = *(void **)ptr;
+    } else {
+        if ((size_t)(cls->bump_end - cls->bump) < cls->object_size &&
+            !grow_class(slab, cls))
+            return NULL;
+        ptr = cls->bump;
+        cls->bump += cls->object_size;
+    }
+
+    cls->live++;
+    slab->bytes_in_use += cls->object_size;
+    slab->bytes_requested += size;
+    return ptr;
+}
+
+void slab_free(slab_allocator_t *slab, void *ptr, const size_t size)
+{
+    if (!ptr)
+        return;
+
+    if (size > SLAB_MAX_OBJECT) {
+        free(ptr);
+        slab->large_bytes -= size;
+        slab->large_count--;
+        return;
+    }
+
+    slab_class_t *cls = class_for_size(slab, size == 0 ? 1 : size);
+    *(void **)ptr = cls->free_list;
+    cls->free_list = ptr;
+    cls->live--;
+    slab->bytes_in_use -= cls->object_size;
+    slab->bytes_requested -= size;
+}
+
+bool slab_disown(slab_allocator_t *slab, const size_t size)
+{
+    if (size <= SLAB_MAX_OBJECT)
+        return false;
+    slab->large_bytes -= size;
+    slab->large_count--;
+    return true;
+}
+
+bool slab_adopt(slab_allocator_t *slab, const size_t size)
+{
+    if (size <= SLAB_MAX_OBJECT)
+        return false;
+    slab->large_bytes += size;
+    slab->large_count++;
+    return true;
+}
+
+void slab_get_stats(const slab_allocator_t *slab, slab_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int c = 0; c < slab->num_classes; c++)
+        out->pages += slab->classes[c].pages;
+
+    out->reserved_bytes = out->pages * SLAB_PAGE_SIZE;
+    out->used_bytes = slab->bytes_in_use;
+    out->requested_bytes = slab->bytes_requested;
+    out->free_bytes = out->reserved_bytes - out->used_bytes;
+    out->large_bytes = slab->large_bytes;
+    if (out->reserved_bytes == 0) {
+        out->utilization = 1.0;
+        out->fragmentation = 0.0;
+    } else {
+        out->utilization =
+            (double)out->used_bytes / (double)out->reserved_bytes;
+        out->fragmentation =
+            1.0 - (double)out->requested_bytes / (double)out->reserved_bytes;
+    }
+}
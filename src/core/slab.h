@@ -0,0 +1,73 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Size-class slab allocator for small, fixed-lifetime objects (hashtable nodes
+ * and value entries).
+ *
+ * Requests up to SLAB_MAX_OBJECT bytes are rounded up to one of
+ * SLAB_NUM_CLASSES size classes (16-byte steps, then ~1.25x growth). Each class
+ * bump-allocates from its current SLAB_PAGE_SIZE page and recycles freed
+ * objects through an intrusive free list, so steady-state alloc/free is a
+ * pointer pop/push with no call into malloc. Larger requests fall through to
+ * malloc/free.
+ *
+ * Pages are only returned to the system by slab_destroy(); a class's freed
+ * objects are reused by that class only. The caller passes the original
+ * request size to slab_free(), so objects carry no per-allocation header.
+ * Not thread-safe: a slab belongs to a single owner (one hashtable).
+ */
+#define SLAB_ALIGN 16
+#define SLAB_MAX_OBJECT 4096
+#define SLAB_PAGE_SIZE (64 * 1024)
+#define SLAB_NUM_CLASSES 32
+
+typedef struct slab_class {
+    size_t object_size;
+    void *free_list;         // recycled objects, linked through their first word
+    unsigned char *bump;     // next never-used byte in the current page
+    unsigned char *bump_end; // end of the current page
+    size_t live;             // objects currently handed out
+    size_t pages;            // pages owned by this class
+} slab_class_t;
+
+typedef struct slab_allocator {
+    slab_class_t classes[SLAB_NUM_CLASSES];
+    uint8_t class_for[SLAB_MAX_OBJECT / SLAB_ALIGN + 1]; // 16-byte step -> class
+    int num_classes;
+    void *pages;            // every page, linked for slab_destroy()
+    size_t bytes_requested; // live bytes as asked for (before rounding)
+    size_t bytes_in_use;    // live bytes at class size
+    size_t large_bytes;     // live bytes served by malloc (> SLAB_MAX_OBJECT)
+    size_t large_count;
+} slab_allocator_t;
+
+typedef struct slab_stats {
+    size_t reserved_bytes;  // page memory held by the slab
+    size_t used_bytes;      // live objects at class size
+    size_t requested_bytes; // live objects as requested
+    size_t free_bytes;      // reserved but not handed out (free lists + tails)
+    size_t large_bytes;     // live malloc fall-through bytes
+    size_t pages;
+    double utilization;   // used / reserved (1.0 when nothing is reserved)
+    double fragmentation; // 1 - requested / reserved: rounding + free space
+} slab_stats_t;
+
+void slab_init(slab_allocator_t *slab);
+void slab_destroy(slab_allocator_t *slab);
+void *slab_alloc(slab_allocator_t *slab, size_t size);
+void slab_free(slab_allocator_t *slab, void *ptr, size_t size);
+// Stop accounting for a malloc'd object (size > SLAB_MAX_OBJECT) without
+// freeing it: the caller now owns `ptr` and releases it with free(), possibly
+// on another thread. False (and nothing changes) for slab-backed sizes.
+bool slab_disown(slab_allocator_t *slab, size_t size);
+// The reverse: start accounting for a malloc'd object of `size` (greater than
+// SLAB_MAX_OBJECT) that the slab now owns. False for slab-backed sizes.
+bool slab_adopt(slab_allocator_t *slab, size_t size);
+void slab_get_stats(const slab_allocator_t *slab, slab_stats_t *out);
+
+#endif // SLAB_H
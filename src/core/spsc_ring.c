@@ -0,0 +1,34 @@
+#include "spsc_ring.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+spsc_ring_t *spsc_ring_create(const size_t capacity)
+{
+    if (capacity == 0 || capacity > SIZE_MAX / 2 / sizeof(void *))
+        return NULL;
+
+    size_t slots = 1;
+    while (slots < capacity)
+        slots <<= 1;
+
+    // Rounded up so the flexible array ends on the alignment boundary.
+    size_t size = sizeof(spsc_ring_t) + slots * sizeof(void *);
+    size = (size + SPSC_RING_CACHE_LINE - 1) &
+           ~(size_t)(SPSC_RING_CACHE_LINE - 1);
+    spsc_ring_t *ring = aligned_alloc(SPSC_RING_CACHE_LINE, size);
+    if (!ring)
+        return NULL;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->tail_cache = 0;
+    ring->head_cache = 0;
+    ring->mask = slots - 1;
+    return ring;
+}
+
+void spsc_ring_free(spsc_ring_t *ring)
+{
+    free(ring);
+}
@@ -0,0 +1,70 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Bounded single-producer, single-consumer ring of pointers, lock-free.
+ *
+ * One thread pushes and one other thread pops; neither ever waits for the
+ * other. The producer owns `tail` and the consumer `head`, each on its own
+ * cache line. Each side also keeps a private copy of the other side's index
+ * and reloads the shared one only when that copy says the ring looks full
+ * (producer) or empty (consumer). A burst of pushes or pops then touches the
+ * other side's cache line once, not once per element.
+ *
+ * Publishing is a release store of the index after the slot is written, so a
+ * popped pointer's target is visible to the consumer as the producer left it.
+ * The ring does not block or wake anyone: callers add their own wakeup.
+ */
+#define SPSC_RING_CACHE_LINE 64
+
+typedef struct spsc_ring {
+    _Alignas(SPSC_RING_CACHE_LINE) atomic_size_t head; // next slot to pop
+    size_t tail_cache; // consumer's last view of tail
+    _Alignas(SPSC_RING_CACHE_LINE) atomic_size_t tail; // next slot to fill
+    size_t head_cache; // producer's last view of head
+    _Alignas(SPSC_RING_CACHE_LINE) size_t mask; // capacity - 1
+    void *slots[];
+} spsc_ring_t;
+
+// `capacity` is rounded up to a power of two. NULL on OOM.
+spsc_ring_t *spsc_ring_create(size_t capacity);
+// Entries still queued are not freed.
+void spsc_ring_free(spsc_ring_t *ring);
+
+// Producer side. False (nothing queued) when the ring is full.
+static inline bool spsc_ring_push(spsc_ring_t *ring, void *item)
+{
+    const size_t tail =
+        atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->head_cache > ring->mask) {
+        ring->head_cache =
+            atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail - ring->head_cache > ring->mask)
+            return false;
+    }
+    ring->slots[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+// Consumer side. NULL when the ring is empty.
+static inline void *spsc_ring_pop(spsc_ring_t *ring)
+{
+    const size_t head =
+        atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == ring->tail_cache) {
+        ring->tail_cache =
+            atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head == ring->tail_cache)
+            return NULL;
+    }
+    void *item = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return item;
+}
+
+#endif // SPSC_RING_H
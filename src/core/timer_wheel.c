@@ -0,0 +1,142 @@
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static inline unsigned level_shift(const unsigned level)
+{
+    return level * TIMER_WHEEL_BITS;
+}
+
+static inline unsigned digit(const uint64_t time, const unsigned level)
+{
+    return (unsigned)(time >> level_shift(level)) & SLOT_MASK;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, const int64_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->current = now > 0 ? (uint64_t)now : 0;
+}
+
+// Link a node into the slot its deadline maps to relative to the cursor.
+static void place(timer_wheel_t *wheel, timer_wheel_node_t *node)
+{
+    const uint64_t time = node->deadline > (int64_t)wheel->current
+                              ? (uint64_t)node->deadline
+                              : wheel->current;
+    const uint64_t diff = time ^ wheel->current;
+    const unsigned level =
+        diff ? (unsigned)(63 - __builtin_clzll(diff)) / TIMER_WHEEL_BITS : 0;
+    const unsigned slot = digit(time, level);
+
+    node->level = (uint8_t)level;
+    node->slot = (uint8_t)slot;
+    node->prev = NULL;
+    node->next = wheel->slots[level][slot];
+    if (node->next)
+        node->next->prev = node;
+    wheel->slots[level][slot] = node;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+static void unlink_node(timer_wheel_t *wheel, timer_wheel_node_t *node)
+{
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        wheel->slots[node->level][node->slot] = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    if (!wheel->slots[node->level][node->slot])
+        wheel->occupied[node->level] &= ~(1ULL << node->slot);
+}
+
+void timer_wheel_add(timer_wheel_t *wheel, timer_wheel_node_t *node,
+                     const int64_t deadline)
+{
+    node->deadline = deadline;
+    place(wheel, node);
+    wheel->count++;
+}
+
+void timer_wheel_remove(timer_wheel_t *wheel, timer_wheel_node_t *node)
+{
+    unlink_node(wheel, node);
+    wheel->count--;
+}
+
+// The earliest time after the cursor at which an occupied slot is entered, or
+// UINT64_MAX if the wheel is empty apart from the cursor's own level-0 slot.
+static uint64_t next_event(const timer_wheel_t *wheel)
+{
+    uint64_t next = UINT64_MAX;
+    for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        const unsigned d = digit(wheel->current, level);
+        const uint64_t ahead =
+            d == SLOT_MASK ? 0 : wheel->occupied[level] & (~0ULL << (d + 1));
+        if (!ahead)
+            continue;
+
+        const unsigned shift = level_shift(level);
+        const unsigned above = shift + TIMER_WHEEL_BITS;
+        const uint64_t high =
+            above >= 64 ? 0 : (wheel->current >> above) << above;
+        const uint64_t at =
+            high | ((uint64_t)__builtin_ctzll(ahead) << shift);
+        if (at < next)
+            next = at;
+    }
+    return next;
+}
+
+// Re-file the nodes of every higher-level slot the cursor has just entered,
+// highest level first so they can cascade all the way down in one pass.
+static void cascade(timer_wheel_t *wheel)
+{
+    for (unsigned level = TIMER_WHEEL_LEVELS - 1; level >= 1; level--) {
+        const unsigned shift = level_shift(level);
+        if (wheel->current & ((1ULL << shift) - 1))
+            continue; // lower digits non-zero: this slot was not just entered
+
+        const unsigned slot = digit(wheel->current, level);
+        timer_wheel_node_t *node = wheel->slots[level][slot];
+        if (!node)
+            continue;
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~(1ULL << slot);
+        while (node) {
+            timer_wheel_node_t *next = node->next;
+            place(wheel, node);
+            node = next;
+        }
+    }
+}
+
+timer_wheel_node_t *timer_wheel_pop_due(timer_wheel_t *wheel,
+                                        const int64_t now)
+{
+    if (now < 0 || (uint64_t)now < wheel->current)
+        return NULL;
+    const uint64_t target = (uint64_t)now;
+
+    for (;;) {
+        const unsigned slot = digit(wheel->current, 0);
+        timer_wheel_node_t *node = wheel->slots[0][slot];
+        if (node) {
+            timer_wheel_remove(wheel, node);
+            return node;
+        }
+        if (wheel->current == target)
+            return NULL;
+
+        const uint64_t next = next_event(wheel);
+        if (next > target) {
+            wheel->current = target;
+            return NULL;
+        }
+        wheel->current = next;
+        cascade(wheel);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hierarchical timing wheel with millisecond resolution, used to drain key
+ * deadlines in order.
+ *
+ * Times are split into 6-bit digits; level L has TIMER_WHEEL_SLOTS slots, one
+ * per value of digit L. A node is filed at the highest digit where its
+ * deadline differs from the wheel's current time, so it sits strictly ahead of
+ * the cursor on that level. When the cursor enters a slot on a higher level,
+ * its nodes are re-filed on lower levels; level 0 slots hold nodes due at
+ * exactly that millisecond. Each level keeps a 64-bit occupancy bitmap, so
+ * moving the cursor across any span of empty time costs a few bit scans, not
+ * one step per millisecond.
+ *
+ * Nodes are intrusive (embed a timer_wheel_node_t) and removal is O(1). Add,
+ * remove and pop are O(1) apart from cascading, which moves each node at most
+ * once per level. Deadlines at or before the cursor are due immediately.
+ * Not thread-safe.
+ */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 11 // 66 bits: any non-negative int64 time
+
+typedef struct timer_wheel_node {
+    struct timer_wheel_node *prev;
+    struct timer_wheel_node *next;
+    int64_t deadline;
+    uint8_t level;
+    uint8_t slot;
+} timer_wheel_node_t;
+
+typedef struct timer_wheel {
+    timer_wheel_node_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS]; // bit s set: slots[level][s] used
+    uint64_t current; // every node due before this time has been popped
+    size_t count;
+} timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t *wheel, int64_t now);
+void timer_wheel_add(timer_wheel_t *wheel, timer_wheel_node_t *node,
+                     int64_t deadline);
+void timer_wheel_remove(timer_wheel_t *wheel, timer_wheel_node_t *node);
+/*
+ * Advance the cursor towards `now` and unlink the next node whose deadline is
+ * at or before it, earliest first (nodes due in the same millisecond come out
+ * in no particular order). Returns NULL once nothing more is due. The cursor
+ * never moves backwards, so a clock step back only delays expiry.
+ */
+timer_wheel_node_t *timer_wheel_pop_due(timer_wheel_t *wheel, int64_t now);
+
+#endif // TIMER_WHEEL_H
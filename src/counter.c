@@ -14,6 +14,7 @@ counter_t *init_counter()
         return NULL;
     counter->memory_usage = 0;
     counter->num_executed_commands = 0;
+    counter->disconnected_clients = 0;
     counter->start_time = time(NULL);
     return counter;
 }
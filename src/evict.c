@@ -0,0 +1,242 @@
+#include "evict.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Candidate collection: at most this many samples per round.
+#define EVICT_MAX_SAMPLES 64
+
+static inline bool policy_is_volatile(const evict_policy_t policy)
+{
+    return policy == EVICT_VOLATILE_LRU || policy == EVICT_VOLATILE_TTL ||
+           policy == EVICT_VOLATILE_LFU;
+}
+
+static int64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// xorshift64*: sampling positions only need to be spread, not secret.
+static uint64_t next_random(eviction_t *eviction)
+{
+    uint64_t x = eviction->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    eviction->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+eviction_t *create_eviction(const size_t maxmemory,
+                            const evict_policy_t policy, const int samples)
+{
+    eviction_t *eviction = calloc(1, sizeof(*eviction));
+    if (!eviction)
+        return NULL;
+    eviction->maxmemory = maxmemory;
+    eviction->policy = policy;
+    eviction->samples = samples < 1                   ? 1
+                        : samples > EVICT_MAX_SAMPLES ? EVICT_MAX_SAMPLES
+                                                      : samples;
+    eviction->rng = (uint64_t)monotonic_us() | 1;
+    return eviction;
+}
+
+static void pool_release(evict_pool_entry_t *slot)
+{
+    if (slot->key != slot->cached)
+        free(slot->key);
+    slot->key = NULL;
+    slot->key_len = 0;
+    slot->score = 0;
+}
+
+void free_eviction(eviction_t *eviction)
+{
+    if (!eviction)
+        return;
+    for (int i = 0; i < EVICT_POOL_SIZE; i++)
+        pool_release(&eviction->pool[i]);
+    free(eviction);
+}
+
+size_t evict_used_memory(const hashtable_t *store,
+                         const expiry_index_t *expires)
+{
+    return hashtable_used_memory(store) +
+           (expires ? expiry_index_memory(expires) : 0);
+}
+
+// The keyspace entry for a sampled key. Volatile policies sample the expiry
+// index, whose entries share the key (and, normally, the hash).
+static const hash_table_entry_t *
+store_entry_for(const hashtable_t *store, const hashtable_t *sampled,
+                const hash_table_entry_t *entry)
+{
+    if (sampled == store)
+        return entry;
+    const uint64_t hash =
+        store->hash_fn == sampled->hash_fn && store->seed == sampled->seed
+            ? entry->hash
+            : hashtable_hash_key(store, entry->key, entry->key_len);
+    return hashtable_peek_entry_hashed(store, entry->key, entry->key_len,
+                                       hash);
+}
+
+/*
+ * Merge one candidate into the pool, which stays sorted by ascending score
+ * with unused slots at the end, so the best candidate is the last used one. A
+ * full pool drops its worst entry to make room, or ignores a candidate no
+ * better than all of them. Keys already pooled are skipped.
+ */
+static void pool_insert(eviction_t *eviction, const uint64_t score,
+                        const unsigned char *key, const size_t key_len)
+{
+    evict_pool_entry_t *pool = eviction->pool;
+    int k = 0;
+    for (int i = 0; i < EVICT_POOL_SIZE && pool[i].score; i++) {
+        if (pool[i].key_len == key_len && memcmp(pool[i].key, key, key_len) == 0)
+            return;
+        if (pool[i].score < score)
+            k = i + 1;
+    }
+    const bool full = pool[EVICT_POOL_SIZE - 1].score != 0;
+    if (k == 0 && full)
+        return;
+
+    unsigned char *copy = NULL;
+    if (key_len > EVICT_POOL_KEY_CACHE) {
+        copy = malloc(key_len);
+        if (!copy)
+            return;
+        memcpy(copy, key, key_len);
+    }
+
+    if (full) {
+        // Drop the worst candidate and shift the lower part left.
+        k--;
+        pool_release(&pool[0]);
+        memmove(&pool[0], &pool[1], (size_t)k * sizeof(pool[0]));
+    } else if (pool[k].score) {
+        // Shift the higher part right into the free tail.
+        memmove(&pool[k + 1], &pool[k],
+                (size_t)(EVICT_POOL_SIZE - k - 1) * sizeof(pool[0]));
+    }
+
+    // pool[k] is now free or a stale duplicate of a shifted neighbour.
+    pool[k].score = score;
+    pool[k].key_len = key_len;
+    pool[k].key = copy;
+    if (!copy)
+        memcpy(pool[k].cached, key, key_len);
+    // Shifting moved inline keys away from the `cached` their pointer names.
+    for (int i = 0; i < EVICT_POOL_SIZE; i++) {
+        if (pool[i].score && pool[i].key_len <= EVICT_POOL_KEY_CACHE)
+            pool[i].key = pool[i].cached;
+    }
+}
+
+static void pool_populate(eviction_t *eviction, hashtable_t *store,
+                          hashtable_t *sampled, const uint32_t clock)
+{
+    hash_table_entry_t *samples[EVICT_MAX_SAMPLES];
+    const size_t n =
+        hashtable_sample_entries(sampled, next_random(eviction), samples,
+                                 (size_t)eviction->samples);
+    for (size_t i = 0; i < n; i++) {
+        const hash_table_entry_t *entry =
+            store_entry_for(store, sampled, samples[i]);
+        if (!entry || (policy_is_volatile(eviction->policy) &&
+                       !entry->expirable))
+            continue; // stale timer for a key that is gone or persistent
+
+        uint64_t score;
+        if (eviction->policy == EVICT_VOLATILE_TTL) {
+            // Sooner deadline, higher score.
+            score = UINT64_MAX - (uint64_t)hashtable_entry_deadline(entry);
+        } else if (evict_policy_is_lfu(eviction->policy)) {
+            // Fewer (decayed) accesses, higher score.
+            score = 256 - (uint64_t)hashtable_lfu_counter(store, entry);
+        } else {
+            score = (uint64_t)evict_idle_time(entry, clock) + 1;
+        }
+        pool_insert(eviction, score, entry->key, entry->key_len);
+    }
+}
+
+static void evict_entry(hashtable_t *store, expiry_index_t *expires,
+                        const hash_table_entry_t *entry)
+{
+    if (entry->expirable && expires)
+        untrack_expiry(expires, entry->key, entry->key_len);
+    delete_value_hashed(store, entry->key, entry->key_len, entry->hash);
+}
+
+// Evict one key. Returns false if no candidate could be found.
+static bool evict_one(eviction_t *eviction, hashtable_t *store,
+                      expiry_index_t *expires)
+{
+    hashtable_t *sampled =
+        policy_is_volatile(eviction->policy) ? expires->keys : store;
+
+    if (eviction->policy == EVICT_ALLKEYS_RANDOM) {
+        hash_table_entry_t *entry;
+        if (hashtable_sample_entries(store, next_random(eviction), &entry,
+                                     1) == 0)
+            return false;
+        evict_entry(store, expires, entry);
+        return true;
+    }
+
+    const uint32_t clock = store->access_clock;
+    // A few rounds, since a round's samples may all be stale timers.
+    for (int round = 0; round < 4; round++) {
+        pool_populate(eviction, store, sampled, clock);
+        for (int i = EVICT_POOL_SIZE - 1; i >= 0; i--) {
+            evict_pool_entry_t *best = &eviction->pool[i];
+            if (!best->score)
+                continue;
+            const hash_table_entry_t *entry = hashtable_peek_entry_hashed(
+                store, best->key, best->key_len,
+                hashtable_hash_key(store, best->key, best->key_len));
+            const bool eligible =
+                entry && (!policy_is_volatile(eviction->policy) ||
+                          entry->expirable);
+            // The candidate leaves the pool whether or not it still exists.
+            pool_release(best);
+            if (eligible) {
+                evict_entry(store, expires, entry);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool evict_until_fits(eviction_t *eviction, hashtable_t *store,
+                      expiry_index_t *expires)
+{
+    if (evict_used_memory(store, expires) <= eviction->maxmemory)
+        return true;
+    if (eviction->policy == EVICT_NOEVICTION) {
+        eviction->oom_rejections++;
+        return false;
+    }
+
+    const int64_t start = monotonic_us();
+    bool fits = true;
+    while (evict_used_memory(store, expires) > eviction->maxmemory) {
+        if (!evict_one(eviction, store, expires)) {
+            fits = false;
+            eviction->oom_rejections++;
+            break;
+        }
+        eviction->evicted_keys++;
+    }
+    eviction->eviction_time_us += (uint64_t)(monotonic_us() - start);
+    return fits;
+}
@@ -0,0 +1,145 @@
+#ifndef EVICT_H
+#define EVICT_H
+
+#include "clock.h"
+#include "core/hashtable.h"
+#include "ttl.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * maxmemory enforcement with approximated LRU, after Redis.
+ *
+ * Each entry carries a 24-bit access stamp (entry->lru) in LRU clock units:
+ * seconds, wrapping every ~194 days. The server advances the tables'
+ * access_clock from its timer tick, and every lookup or store stamps the key.
+ *
+ * Before a write, evict_make_room() compares the data set's memory with
+ * `maxmemory`. Over the limit, it evicts one key at a time until the data
+ * fits. Each round samples `samples` keys, from the whole keyspace (allkeys-*)
+ * or from keys with a TTL (volatile-*). The samples are merged into a pool
+ * kept sorted by idle time (or by nearest deadline for volatile-ttl), and the
+ * best candidate in the pool is evicted. The pool persists across rounds, so
+ * good candidates found earlier are not forgotten. The random policies skip
+ * the pool. If nothing can be evicted (noeviction, or no volatile keys) the
+ * write is refused.
+ *
+ * The LFU policies put the store in LFU mode (hashtable_enable_lfu()): the
+ * access stamp becomes a logarithmic access counter that decays by one every
+ * `lfu-decay-time` minutes, and the pool ranks keys by lowest counter. A scan
+ * touching many keys once cannot push out a hot set, as it can under LRU.
+ */
+typedef enum {
+    EVICT_NOEVICTION = 0,
+    EVICT_ALLKEYS_LRU,
+    EVICT_VOLATILE_LRU,
+    EVICT_ALLKEYS_RANDOM,
+    EVICT_VOLATILE_TTL,
+    EVICT_ALLKEYS_LFU,
+    EVICT_VOLATILE_LFU,
+} evict_policy_t;
+
+#define EVICT_DEFAULT_SAMPLES 5
+#define EVICT_DEFAULT_LFU_LOG_FACTOR 10
+#define EVICT_DEFAULT_LFU_DECAY_TIME 1 // minutes
+#define EVICT_POOL_SIZE 16
+#define EVICT_POOL_KEY_CACHE 48 // keys up to this long are copied inline
+
+typedef struct evict_pool_entry {
+    uint64_t score; // higher evicts first; 0 marks an unused slot
+    size_t key_len;
+    unsigned char *key; // `cached`, or malloc'd for longer keys
+    unsigned char cached[EVICT_POOL_KEY_CACHE];
+} evict_pool_entry_t;
+
+typedef struct eviction {
+    size_t maxmemory; // 0: no limit
+    evict_policy_t policy;
+    int samples;
+    uint64_t rng;
+    evict_pool_entry_t pool[EVICT_POOL_SIZE]; // ascending by score
+    uint64_t evicted_keys;
+    uint64_t eviction_time_us; // time spent evicting on the write path
+    uint64_t oom_rejections;   // writes refused because nothing could go
+} eviction_t;
+
+eviction_t *create_eviction(size_t maxmemory, evict_policy_t policy,
+                            int samples);
+void free_eviction(eviction_t *eviction);
+
+// Config names; inline so config parsing does not pull in the evictor.
+static inline const char *evict_policy_to_string(const evict_policy_t policy)
+{
+    switch (policy) {
+    case EVICT_ALLKEYS_LRU:
+        return "allkeys-lru";
+    case EVICT_VOLATILE_LRU:
+        return "volatile-lru";
+    case EVICT_ALLKEYS_RANDOM:
+        return "allkeys-random";
+    case EVICT_VOLATILE_TTL:
+        return "volatile-ttl";
+    case EVICT_ALLKEYS_LFU:
+        return "allkeys-lfu";
+    case EVICT_VOLATILE_LFU:
+        return "volatile-lfu";
+    case EVICT_NOEVICTION:
+    default:
+        return "noeviction";
+    }
+}
+
+static inline bool evict_policy_from_string(const char *name,
+                                            evict_policy_t *out)
+{
+    for (int p = EVICT_NOEVICTION; p <= EVICT_VOLATILE_LFU; p++) {
+        if (strcmp(name, evict_policy_to_string((evict_policy_t)p)) == 0) {
+            *out = (evict_policy_t)p;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool evict_policy_is_lfu(const evict_policy_t policy)
+{
+    return policy == EVICT_ALLKEYS_LFU || policy == EVICT_VOLATILE_LFU;
+}
+
+// Memory counted against maxmemory: both tables and the expiry timers.
+size_t evict_used_memory(const hashtable_t *store,
+                         const expiry_index_t *expires);
+
+static inline uint32_t evict_lru_clock(void)
+{
+    return (uint32_t)(fkvs_now_ms() / 1000) & HASHTABLE_LRU_MAX;
+}
+
+// LFU mode's access clock: minutes, in the 16 bits kept per key.
+static inline uint32_t evict_lfu_clock(void)
+{
+    return (uint32_t)(fkvs_now_ms() / 60000) & HASHTABLE_LFU_TIME_MAX;
+}
+
+// Seconds since `entry` was last accessed, as of `clock`.
+static inline uint32_t evict_idle_time(const hash_table_entry_t *entry,
+                                       const uint32_t clock)
+{
+    return (clock - entry->lru) & HASHTABLE_LRU_MAX;
+}
+
+bool evict_until_fits(eviction_t *eviction, hashtable_t *store,
+                      expiry_index_t *expires);
+
+// Returns false if the data set is over maxmemory and nothing can be evicted.
+static inline bool evict_make_room(eviction_t *eviction, hashtable_t *store,
+                                   expiry_index_t *expires)
+{
+    if (!eviction || eviction->maxmemory == 0)
+        return true;
+    return evict_until_fits(eviction, store, expires);
+}
+
+#endif // EVICT_H
@@ -24,6 +24,31 @@ event_loop_dispatcher_kind_to_string(const event_loop_dispatcher_kind kind)
     }
 }
 
+// How the io_uring backend sets up its ring (io-uring-mode).
+typedef enum io_uring_ring_mode {
+    io_uring_ring_default,
+    // A kernel thread polls the submission queue: no syscall to submit.
+    io_uring_ring_sqpoll,
+    // Completions are posted only when the loop asks for them, by the one
+    // thread that submits (SINGLE_ISSUER | DEFER_TASKRUN).
+    io_uring_ring_defer_taskrun
+} io_uring_ring_mode;
+
+static inline const char *
+io_uring_ring_mode_to_string(const io_uring_ring_mode mode)
+{
+    switch (mode) {
+    case io_uring_ring_default:
+        return "default";
+    case io_uring_ring_sqpoll:
+        return "sqpoll";
+    case io_uring_ring_defer_taskrun:
+        return "defer-taskrun";
+    default:
+        return "(unknown)";
+    }
+}
+
 // Defines the interface for platform-specific event loops
 int run_event_loop();
 
@@ -7,6 +7,7 @@
 #include "../server.h"
 #include "../server_lifecycle.h"
 #include "../server_limits.h"
+#include "../shard.h"
 #include "../ttl.h"
 #include "../utils.h"
 #include "event_dispatcher.h"
@@ -55,7 +56,7 @@ static void close_and_drop_client(const int epfd, client_t *c)
 
 static int sync_client_write_interest(const int epfd, client_t *c)
 {
-    const bool want_write = c->wbuf_used > 0;
+    const bool want_write = client_write_pending(c);
     if (c->write_registered == want_write)
         return 0;
 
@@ -73,6 +74,28 @@ static int sync_client_write_interest(const int epfd, client_t *c)
     return 0;
 }
 
+// A batch's events still to handle, so a client dropped early skips them.
+typedef struct {
+    int epfd;
+    struct epoll_event *events;
+    int count;
+} epoll_batch_t;
+
+// A deferred reply arrived from another shard (see shard_drain()).
+static void send_shard_reply(client_t *c, void *ctx)
+{
+    const epoll_batch_t *batch = ctx;
+    wbuf_flush(c);
+    if (!c->write_failed && sync_client_write_interest(batch->epfd, c) != -1)
+        return;
+
+    close_and_drop_client(batch->epfd, c);
+    for (int j = 0; j < batch->count; j++) {
+        if (batch->events[j].data.ptr == c)
+            batch->events[j].data.ptr = NULL;
+    }
+}
+
 int run_event_loop()
 {
     set_nonblocking(server.fd);
@@ -93,12 +116,12 @@ int run_event_loop()
         return -1;
     }
 
-    // Create a 100ms timerfd for active key expiration sweep
+    // Create a timerfd for active key expiration and rehashing
     int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
     if (tfd >= 0) {
         struct itimerspec its = {
-            .it_interval = {0, 100000000}, // 100ms
-            .it_value = {0, 100000000}     // 100ms
+            .it_interval = {0, FKVS_TIMER_TICK_MS * 1000000L},
+            .it_value = {0, FKVS_TIMER_TICK_MS * 1000000L}
         };
         timerfd_settime(tfd, 0, &its, NULL);
 
@@ -109,12 +132,41 @@ int run_event_loop()
         epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &tev);
     }
 
+    // Messages from the other shards (see shard.h)
+    const int wake_fd = server.shard ? server.shard->wake_fd : -1;
+    if (wake_fd >= 0) {
+        struct epoll_event wev;
+        memset(&wev, 0, sizeof(wev));
+        wev.events = EPOLLIN;
+        wev.data.fd = wake_fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &wev) == -1) {
+            perror("epoll_ctl (shard wakeup)");
+            if (tfd >= 0)
+                close(tfd);
+            close(epfd);
+            return -1;
+        }
+    }
+
     const int max_evs =
         server.event_loop_max_events > 1024 ? 1024 : server.event_loop_max_events;
     struct epoll_event events[max_evs];
 
     while (!server_shutdown_requested()) {
-        const int n = epoll_wait(epfd, events, max_evs, -1);
+        db_expire_fast_cycle(server.database);
+        const bool shard_backlog = server.shard && shard_flush(server.shard);
+        // Poll instead of blocking while a resize is pending so idle passes
+        // can finish it; wake up soon while expired keys or messages for
+        // other shards are backlogged.
+        const bool idle_work =
+            server.idle_rehash && db_is_rehashing(server.database);
+        int timeout = -1;
+        if (idle_work)
+            timeout = 0;
+        else if (db_expire_backlog(server.database) || shard_backlog)
+            timeout = FKVS_EXPIRE_BACKLOG_WAIT_MS;
+        const int n = epoll_wait(epfd, events, max_evs, timeout);
+        fkvs_clock_update();
         if (n < 0) {
             if (errno == EINTR && !server_shutdown_requested())
                 continue;
@@ -123,9 +175,13 @@ int run_event_loop()
             perror("epoll_wait");
             break;
         }
+        if (n == 0 && idle_work) {
+            db_rehash_for_us(server.database, FKVS_IDLE_REHASH_SLICE_US);
+            continue;
+        }
 
         for (int i = 0; i < n; i++) {
-            const uint32_t evt = events[i].events;
+            uint32_t evt = events[i].events;
 
             // Timer event for active expiration sweep
             if (tfd >= 0 && events[i].data.fd == tfd) {
@@ -134,8 +190,12 @@ int run_event_loop()
                     const ssize_t nread =
                         read(tfd, &expirations, sizeof(expirations));
                     if (nread == (ssize_t)sizeof(expirations)) {
-                        expire_sweep(server.database->store,
-                                     server.database->expires, 20);
+                        db_update_lru_clock(server.database);
+                        db_expire_slow_cycle(
+                            server.database,
+                            server.active_expire_cpu_percent);
+                        db_rehash_for_us(server.database,
+                                         server.active_rehash_us);
                         break;
                     }
                     if (nread < 0 && errno == EINTR)
@@ -150,6 +210,17 @@ int run_event_loop()
                 continue;
             }
 
+            // Frames and replies from the other shards
+            if (wake_fd >= 0 && events[i].data.fd == wake_fd) {
+                uint64_t wakeups;
+                while (read(wake_fd, &wakeups, sizeof(wakeups)) < 0 &&
+                       errno == EINTR)
+                    ;
+                epoll_batch_t batch = {epfd, events + i + 1, n - i - 1};
+                shard_drain(server.shard, send_shard_reply, &batch);
+                continue;
+            }
+
             // New connections on the listening socket
             if (events[i].data.fd == server.fd) {
                 for (;;) {
@@ -212,6 +283,11 @@ int run_event_loop()
                 continue;
             }
 
+            // Zero-copy send completions also raise EPOLLERR; only a real
+            // socket error drops the client.
+            if ((evt & EPOLLERR) && c && wbuf_zerocopy_reap(c))
+                evt &= ~(uint32_t)EPOLLERR;
+
             // Hangup/half-close/errors
             if ((evt & EPOLLRDHUP) || (evt & EPOLLHUP) || (evt & EPOLLERR)) {
                 if (server.verbose) {
@@ -242,34 +318,16 @@ int run_event_loop()
             // Drain readable data (edge-triggered)
             if (evt & EPOLLIN) {
                 for (;;) {
-                    ssize_t nread = recv(c->fd, c->buffer + c->buf_used,
-                                         sizeof(c->buffer) - c->buf_used, 0);
+                    size_t space;
+                    unsigned char *target = client_read_target(c, &space);
+                    ssize_t nread = recv(c->fd, target, space, 0);
                     if (nread > 0) {
-                        c->buf_used += (size_t)nread;
                         if (server.verbose) {
-                            printf("fd=%d read %zd bytes (buf_used=%zu)\n",
-                                   c->fd, nread, c->buf_used);
+                            printf("fd=%d read %zd bytes\n", c->fd, nread);
                         }
 
                         // Process as many complete frames as possible
-                        if (try_process_frames(c) < 0) {
-                            close_and_drop_client(epfd, c);
-                            for (int j = i + 1; j < n; j++) {
-                                if (events[j].data.ptr == c)
-                                    events[j].data.ptr = NULL;
-                            }
-                            break;
-                        }
-
-                        // If buffer is full but frame needs more → protocol
-                        // error
-                        if (c->buf_used == sizeof(c->buffer) &&
-                            c->frame_need > 0 &&
-                            (ssize_t)c->buf_used < c->frame_need) {
-                            fprintf(stderr,
-                                    "fd=%d frame exceeds buffer capacity; "
-                                    "dropping client\n",
-                                    c->fd);
+                        if (client_read_done(c, (size_t)nread) < 0) {
                             close_and_drop_client(epfd, c);
                             for (int j = i + 1; j < n; j++) {
                                 if (events[j].data.ptr == c)
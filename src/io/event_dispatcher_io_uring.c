@@ -1,19 +1,20 @@
 #ifdef __linux__
 #include "../client.h"
 #include "../commands/common/command_registry.h"
+#include "../core/hashtable.h"
 #include "../core/list.h"
 #include "../networking/modes.h"
 #include "../networking/networking.h"
 #include "../server.h"
 #include "../server_lifecycle.h"
 #include "../server_limits.h"
+#include "../shard.h"
 #include "../ttl.h"
 #include "../utils.h"
 #include "event_dispatcher.h"
 
 #include <errno.h>
 #include <liburing.h>
-#include <poll.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -26,42 +27,80 @@
 #define IO_URING_MIN_QUEUE_DEPTH 256U
 #define IO_URING_MAX_QUEUE_DEPTH 32768U
 #define IO_URING_QUEUE_HEADROOM 8U
-#define TTL_SWEEP_BATCH 20U
+
+/*
+ * Completion-based I/O: the kernel does the reads and writes and the loop
+ * only handles their results.
+ *   - Each client has one multishot IORING_OP_RECV. The kernel picks a buffer
+ *     from a shared provided-buffer ring for every chunk it receives; the
+ *     loop copies the chunk into the client's parser and hands the buffer
+ *     straight back.
+ *   - Replies go out as IORING_OP_SEND straight from wbuf (or a pinned
+ *     value), one send in flight per client (see wbuf_send_begin()). Values
+ *     of zerocopy-send-min bytes or more go out as IORING_OP_SEND_ZC; the
+ *     request keeps a pin on the value until the kernel's notification.
+ *   - One multishot IORING_OP_ACCEPT places new sockets straight into a
+ *     registered file table. Client ops name the slot with IOSQE_FIXED_FILE,
+ *     so the kernel skips the per-op fd lookup and reference count. Accepted
+ *     sockets inherit TCP_NODELAY from the listener, so accepting takes no
+ *     syscalls of its own.
+ *   - SQEs are not submitted one by one: everything queued while a batch of
+ *     completions is handled goes to the kernel in the single
+ *     io_uring_enter() that also waits for the next batch.
+ *   - io-uring-mode picks the ring flags. sqpoll hands submission to a
+ *     kernel thread (no io_uring_enter() to submit while it is awake);
+ *     defer-taskrun posts completions only when the loop enters the kernel
+ *     to wait for them, so they arrive in batches on this thread instead
+ *     of interrupting it.
+ */
+#define IO_URING_RECV_BUFFER_GROUP 0
+#define IO_URING_RECV_BUFFER_COUNT 1024U // a power of two
+#define IO_URING_RECV_BUFFER_SIZE (16U * 1024U)
+#define IO_URING_CQE_BATCH 256U
 
 typedef enum {
-    URING_ACCEPT_READY,
-    URING_CLIENT_READ_READY,
-    URING_CLIENT_WRITE_READY,
-    URING_TIMER_READY,
+    URING_ACCEPT,
+    URING_TIMER_TICK,
+    URING_SHARD_WAKE,
+    URING_CLIENT_RECV,
+    URING_CLIENT_SEND,
+    URING_CLIENT_SEND_ZC,
+    URING_UNTRACKED, // cancels and closes; nothing to do on completion
 } uring_op_kind_t;
 
-typedef struct uring_op {
-    uring_op_kind_t kind;
-    client_t *client;
-    struct uring_op *next;
-} uring_op_t;
+// user_data holds the op kind in its low bits and the client (64-byte
+// aligned) above them, so a completion finds its op without a lookup or a
+// per-op allocation.
+#define URING_OP_KIND_MASK 0x7U
+_Static_assert(_Alignof(client_t) > URING_OP_KIND_MASK,
+               "client_t alignment must leave room for the op kind");
+
+// A SEND_ZC awaiting its notification, which can come after the client is
+// gone: the kernel reads `value` until then. Its user_data points here, so
+// each send's notification releases exactly its own pin.
+typedef struct uring_zerocopy_send_t {
+    client_t *client; // NULL once the client is freed
+    value_entry_t *value;
+    struct uring_zerocopy_send_t *prev;
+    struct uring_zerocopy_send_t *next;
+} uring_zerocopy_send_t;
 
 typedef struct {
     struct io_uring ring;
-    uring_op_t *ops;
-    unsigned int outstanding_ops;
+    struct io_uring_buf_ring *recv_ring;
+    unsigned char *recv_buffers;
     int timer_fd;
+    uint64_t timer_expirations; // the timer read lands here
+    uint64_t shard_wakeups;     // and the shard wakeup read (see shard.h)
+    bool fixed_files; // accepted sockets go into the registered file table
+    uring_zerocopy_send_t *zerocopy_sends; // outstanding, for teardown
 } uring_dispatcher_t;
 
-static bool reject_if_server_at_capacity(const int cfd)
+// `target` is a client, or a zero-copy send for URING_CLIENT_SEND_ZC (from
+// malloc(), so aligned at least as much as a client_t needs here).
+static uint64_t op_data(const uring_op_kind_t kind, void *target)
 {
-    if (fkvs_server_can_accept_client(&server))
-        return false;
-
-    if (server.verbose) {
-        fprintf(stderr,
-                "Rejecting client fd=%d: max-clients limit reached (%u)\n",
-                cfd, server.max_clients);
-    }
-
-    close(cfd);
-    fkvs_server_record_rejected_client(&server);
-    return true;
+    return (uint64_t)(uintptr_t)target | kind;
 }
 
 static unsigned int queue_depth_for_server(void)
@@ -82,41 +121,6 @@ static unsigned int queue_depth_for_server(void)
                : needed;
 }
 
-static void track_op(uring_dispatcher_t *dispatcher,
-                     uring_op_t *op)
-{
-    op->next = dispatcher->ops;
-    dispatcher->ops = op;
-    dispatcher->outstanding_ops += 1;
-}
-
-static void untrack_op(uring_dispatcher_t *dispatcher,
-                       uring_op_t *op)
-{
-    uring_op_t **cursor = &dispatcher->ops;
-    while (*cursor) {
-        if (*cursor == op) {
-            *cursor = op->next;
-            if (dispatcher->outstanding_ops > 0)
-                dispatcher->outstanding_ops -= 1;
-            return;
-        }
-        cursor = &(*cursor)->next;
-    }
-}
-
-static void free_tracked_ops(uring_dispatcher_t *dispatcher)
-{
-    uring_op_t *op = dispatcher->ops;
-    while (op) {
-        uring_op_t *next = op->next;
-        free(op);
-        op = next;
-    }
-    dispatcher->ops = NULL;
-    dispatcher->outstanding_ops = 0;
-}
-
 static struct io_uring_sqe *get_sqe(uring_dispatcher_t *dispatcher)
 {
     struct io_uring_sqe *sqe = io_uring_get_sqe(&dispatcher->ring);
@@ -129,118 +133,347 @@ static struct io_uring_sqe *get_sqe(uring_dispatcher_t *dispatcher)
         return NULL;
     }
 
+    struct io_uring_sqe *retry = io_uring_get_sqe(&dispatcher->ring);
+    if (retry || !(dispatcher->ring.flags & IORING_SETUP_SQPOLL))
+        return retry;
+
+    // The SQPOLL thread consumes the queue on its own time; wait for room.
+    const int wait_res = io_uring_sqring_wait(&dispatcher->ring);
+    if (wait_res < 0) {
+        fprintf(stderr, "io_uring SQ wait failed: %s\n", strerror(-wait_res));
+        return NULL;
+    }
     return io_uring_get_sqe(&dispatcher->ring);
 }
 
-static int submit_poll_op(uring_dispatcher_t *dispatcher,
-                          const uring_op_kind_t kind, client_t *client,
-                          const int fd, const unsigned int poll_mask)
+// Submit without waiting. Under DEFER_TASKRUN completions are only posted
+// by an io_uring_enter() that asks for events, so a peek must follow one.
+static int submit_pending(uring_dispatcher_t *dispatcher)
 {
-    if (fd < 0)
-        return -1;
+    if (dispatcher->ring.flags & IORING_SETUP_DEFER_TASKRUN)
+        return io_uring_submit_and_get_events(&dispatcher->ring);
+    return io_uring_submit(&dispatcher->ring);
+}
 
-    uring_op_t *op = calloc(1, sizeof(*op));
-    if (!op) {
-        perror("calloc io_uring op");
+static int submit_accept(uring_dispatcher_t *dispatcher)
+{
+    struct io_uring_sqe *sqe = get_sqe(dispatcher);
+    if (!sqe)
         return -1;
+
+    // Peer addresses are not collected: one shared buffer would be
+    // overwritten by the next connection before this one is handled.
+    if (dispatcher->fixed_files)
+        io_uring_prep_multishot_accept_direct(sqe, server.fd, NULL, NULL, 0);
+    else
+        io_uring_prep_multishot_accept(sqe, server.fd, NULL, NULL, 0);
+    io_uring_sqe_set_data64(sqe, op_data(URING_ACCEPT, NULL));
+    return 0;
+}
+
+// Close an accepted socket, by slot if it is in the registered file table.
+static void close_accepted(uring_dispatcher_t *dispatcher, const int fd,
+                           const bool fixed)
+{
+    if (!fixed) {
+        close(fd);
+        return;
     }
-    op->kind = kind;
-    op->client = client;
 
     struct io_uring_sqe *sqe = get_sqe(dispatcher);
-    if (!sqe) {
-        free(op);
+    if (!sqe)
+        return;
+
+    io_uring_prep_close_direct(sqe, (unsigned int)fd);
+    io_uring_sqe_set_data64(sqe, op_data(URING_UNTRACKED, NULL));
+}
+
+static void use_client_fd(struct io_uring_sqe *sqe, const client_t *client)
+{
+    if (client->fd_fixed)
+        sqe->flags |= IOSQE_FIXED_FILE;
+}
+
+static int submit_timer_read(uring_dispatcher_t *dispatcher)
+{
+    if (dispatcher->timer_fd < 0)
+        return 0;
+
+    struct io_uring_sqe *sqe = get_sqe(dispatcher);
+    if (!sqe)
         return -1;
-    }
 
-    io_uring_prep_poll_add(sqe, fd, poll_mask);
-    io_uring_sqe_set_data(sqe, op);
-    track_op(dispatcher, op);
+    io_uring_prep_read(sqe, dispatcher->timer_fd,
+                       &dispatcher->timer_expirations,
+                       sizeof(dispatcher->timer_expirations), 0);
+    io_uring_sqe_set_data64(sqe, op_data(URING_TIMER_TICK, NULL));
+    return 0;
+}
 
-    const int res = io_uring_submit(&dispatcher->ring);
-    if (res <= 0) {
-        if (res == 0) {
-            fprintf(stderr, "io_uring submit queued no operations\n");
-            return -1;
-        }
-        fprintf(stderr, "io_uring submit failed: %s\n", strerror(-res));
+// Messages from the other shards; reads the blocking wake eventfd.
+static int submit_shard_wake_read(uring_dispatcher_t *dispatcher)
+{
+    if (!server.shard)
+        return 0;
+
+    struct io_uring_sqe *sqe = get_sqe(dispatcher);
+    if (!sqe)
         return -1;
-    }
 
+    io_uring_prep_read(sqe, server.shard->wake_fd, &dispatcher->shard_wakeups,
+                       sizeof(dispatcher->shard_wakeups), 0);
+    io_uring_sqe_set_data64(sqe, op_data(URING_SHARD_WAKE, NULL));
     return 0;
 }
 
-static int submit_accept_ready(uring_dispatcher_t *dispatcher)
+static int arm_client_recv(uring_dispatcher_t *dispatcher, client_t *client)
 {
-    return submit_poll_op(dispatcher, URING_ACCEPT_READY, NULL, server.fd,
-                          POLLIN);
+    struct io_uring_sqe *sqe = get_sqe(dispatcher);
+    if (!sqe)
+        return -1;
+
+    io_uring_prep_recv_multishot(sqe, client->fd, NULL, 0, 0);
+    use_client_fd(sqe, client);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IO_URING_RECV_BUFFER_GROUP;
+    io_uring_sqe_set_data64(sqe, op_data(URING_CLIENT_RECV, client));
+    client->recv_armed = true;
+    return 0;
 }
 
-static int submit_client_read_ready(uring_dispatcher_t *dispatcher,
-                                    client_t *client)
+// Pin `value` for a SEND_ZC about to be queued; NULL (send by copying
+// instead) if the client has too many in flight or memory is short.
+static uring_zerocopy_send_t *
+track_zerocopy_send(uring_dispatcher_t *dispatcher, client_t *client,
+                    value_entry_t *value)
 {
-    return submit_poll_op(dispatcher, URING_CLIENT_READ_READY, client,
-                          client ? client->fd : -1, POLLIN);
+    if (client->zerocopy_inflight == FKVS_ZEROCOPY_MAX_INFLIGHT)
+        return NULL;
+    uring_zerocopy_send_t *send = malloc(sizeof(*send));
+    if (!send)
+        return NULL;
+
+    value_entry_pin(value);
+    *send = (uring_zerocopy_send_t){.client = client,
+                                    .value = value,
+                                    .next = dispatcher->zerocopy_sends};
+    if (send->next)
+        send->next->prev = send;
+    dispatcher->zerocopy_sends = send;
+    client->zerocopy_inflight++;
+    return send;
 }
 
-static int submit_client_write_ready(uring_dispatcher_t *dispatcher,
-                                     client_t *client)
+static void release_zerocopy_send(uring_dispatcher_t *dispatcher,
+                                  uring_zerocopy_send_t *send)
 {
-    const int res =
-        submit_poll_op(dispatcher, URING_CLIENT_WRITE_READY, client,
-                       client ? client->fd : -1, POLLOUT);
-    if (res == 0)
-        client->write_registered = true;
-    return res;
+    if (send->prev)
+        send->prev->next = send->next;
+    else
+        dispatcher->zerocopy_sends = send->next;
+    if (send->next)
+        send->next->prev = send->prev;
+    if (send->client)
+        send->client->zerocopy_inflight--;
+    value_entry_unpin(send->value);
+    free(send);
 }
 
-static int submit_timer_ready(uring_dispatcher_t *dispatcher)
+// Before freeing `client`: its zero-copy sends keep their pins until their
+// notifications arrive, but no longer report to it.
+static void detach_zerocopy_sends(uring_dispatcher_t *dispatcher,
+                                  client_t *client)
 {
-    if (dispatcher->timer_fd < 0)
+    for (uring_zerocopy_send_t *send = dispatcher->zerocopy_sends;
+         send && client->zerocopy_inflight > 0; send = send->next) {
+        if (send->client == client) {
+            send->client = NULL;
+            client->zerocopy_inflight--;
+        }
+    }
+}
+
+static int start_client_send(uring_dispatcher_t *dispatcher, client_t *client)
+{
+    size_t len;
+    const unsigned char *run = wbuf_send_begin(client, &len);
+    if (!run)
         return 0;
 
-    return submit_poll_op(dispatcher, URING_TIMER_READY, NULL,
-                          dispatcher->timer_fd, POLLIN);
+    struct io_uring_sqe *sqe = get_sqe(dispatcher);
+    if (!sqe) {
+        wbuf_send_end(client, 0);
+        return -1;
+    }
+
+    // Runs are bounded by the write cap and proto-max-bulk-len, far below
+    // the 32-bit SQE length.
+    value_entry_t *value = wbuf_zerocopy_value(client);
+    uring_zerocopy_send_t *zerocopy =
+        value ? track_zerocopy_send(dispatcher, client, value) : NULL;
+    if (zerocopy) {
+        io_uring_prep_send_zc(sqe, client->fd, run, len, MSG_NOSIGNAL,
+                              IORING_SEND_ZC_REPORT_USAGE);
+        client->send_op = op_data(URING_CLIENT_SEND_ZC, zerocopy);
+    } else {
+        io_uring_prep_send(sqe, client->fd, run, len, MSG_NOSIGNAL);
+        client->send_op = op_data(URING_CLIENT_SEND, client);
+    }
+    io_uring_sqe_set_data64(sqe, client->send_op);
+    use_client_fd(sqe, client);
+    return 0;
 }
 
-static void close_untracked_client(client_t *client)
+// Cancel the op submitted with `user_data`.
+static void cancel_client_op(uring_dispatcher_t *dispatcher,
+                             const uint64_t user_data)
 {
-    if (!client)
+    struct io_uring_sqe *sqe = get_sqe(dispatcher);
+    if (!sqe)
         return;
 
-    if (client->fd >= 0) {
-        close(client->fd);
-        client->fd = -1;
-    }
-    free_client(client);
+    io_uring_prep_cancel64(sqe, user_data, 0);
+    io_uring_sqe_set_data64(sqe, op_data(URING_UNTRACKED, NULL));
 }
 
-static void close_and_drop_client(client_t *client)
+// Free a dropped client once the kernel has returned all of its ops: a recv
+// or send still in flight may write to the client or read from its wbuf.
+static void release_if_idle(uring_dispatcher_t *dispatcher, client_t *client)
 {
-    if (!client)
+    if (!client->close_pending || client->recv_armed || client->send_inflight)
         return;
 
+    if (client->zerocopy_inflight > 0)
+        detach_zerocopy_sends(dispatcher, client);
+    if (client->fd_fixed)
+        close_accepted(dispatcher, client->fd, true);
     server_drop_client(&server, client);
 }
 
-static bool client_has_oversized_partial_frame(const client_t *client)
+static void close_and_drop_client(uring_dispatcher_t *dispatcher,
+                                  client_t *client)
+{
+    if (!client || client->close_pending)
+        return;
+
+    client->close_pending = true;
+    if (client->recv_armed)
+        cancel_client_op(dispatcher, op_data(URING_CLIENT_RECV, client));
+    // A zero-copy send is tagged with its tracking record, not the client.
+    if (client->send_inflight)
+        cancel_client_op(dispatcher, client->send_op);
+    release_if_idle(dispatcher, client);
+}
+
+static void recycle_recv_buffer(uring_dispatcher_t *dispatcher,
+                                const unsigned int bid)
+{
+    io_uring_buf_ring_add(
+        dispatcher->recv_ring,
+        dispatcher->recv_buffers + (size_t)bid * IO_URING_RECV_BUFFER_SIZE,
+        IO_URING_RECV_BUFFER_SIZE, (unsigned short)bid,
+        io_uring_buf_ring_mask(IO_URING_RECV_BUFFER_COUNT), 0);
+    io_uring_buf_ring_advance(dispatcher->recv_ring, 1);
+}
+
+static int setup_recv_buffers(uring_dispatcher_t *dispatcher)
+{
+    int res = 0;
+    dispatcher->recv_ring = io_uring_setup_buf_ring(
+        &dispatcher->ring, IO_URING_RECV_BUFFER_COUNT,
+        IO_URING_RECV_BUFFER_GROUP, 0, &res);
+    if (!dispatcher->recv_ring) {
+        fprintf(stderr,
+                "Unable to register io_uring receive buffers (Linux 6.0+ "
+                "required): %s\n",
+                strerror(-res));
+        return -1;
+    }
+
+    dispatcher->recv_buffers =
+        malloc((size_t)IO_URING_RECV_BUFFER_COUNT * IO_URING_RECV_BUFFER_SIZE);
+    if (!dispatcher->recv_buffers) {
+        perror("malloc io_uring receive buffers");
+        return -1;
+    }
+
+    for (unsigned int bid = 0; bid < IO_URING_RECV_BUFFER_COUNT; bid++)
+        recycle_recv_buffer(dispatcher, bid);
+    return 0;
+}
+
+// Wait for the probe recv's next completion and hand its buffer back.
+static int probe_recv_completion(uring_dispatcher_t *dispatcher,
+                                 unsigned int *cqe_flags)
+{
+    struct io_uring_cqe *cqe = NULL;
+    int res = io_uring_submit_and_wait(&dispatcher->ring, 1);
+    if (res >= 0)
+        res = io_uring_peek_cqe(&dispatcher->ring, &cqe);
+    if (res < 0)
+        return res;
+
+    res = cqe->res;
+    *cqe_flags = cqe->flags;
+    io_uring_cqe_seen(&dispatcher->ring, cqe);
+    if (*cqe_flags & IORING_CQE_F_BUFFER)
+        recycle_recv_buffer(dispatcher,
+                            *cqe_flags >> IORING_CQE_BUFFER_SHIFT);
+    return res;
+}
+
+// Multishot recv needs Linux 6.0. On 5.19 the buffer ring registers but
+// every such recv fails with -EINVAL, which would drop each client as soon
+// as it is accepted; try one on a socket pair before accepting any.
+static int probe_recv_multishot(uring_dispatcher_t *dispatcher)
 {
-    return client->buf_used == sizeof(client->buffer) &&
-           client->frame_need > 0 &&
-           (ssize_t)client->buf_used < client->frame_need;
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+
+    int res = -EIO;
+    unsigned int cqe_flags = 0;
+    struct io_uring_sqe *sqe = get_sqe(dispatcher);
+    if (sqe && write(fds[1], "", 1) == 1) {
+        io_uring_prep_recv_multishot(sqe, fds[0], NULL, 0, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = IO_URING_RECV_BUFFER_GROUP;
+        io_uring_sqe_set_data64(sqe, op_data(URING_UNTRACKED, NULL));
+        res = probe_recv_completion(dispatcher, &cqe_flags);
+    }
+    close(fds[1]);
+    // The peer's close ends the recv with a final EOF completion.
+    if (res >= 0 && (cqe_flags & IORING_CQE_F_MORE)) {
+        while (probe_recv_completion(dispatcher, &cqe_flags) >= 0 &&
+               (cqe_flags & IORING_CQE_F_MORE))
+            ;
+    }
+    close(fds[0]);
+
+    if (res < 0) {
+        fprintf(stderr,
+                "io_uring multishot receive unavailable (Linux 6.0+ "
+                "required): %s\n",
+                strerror(-res));
+        return -1;
+    }
+    return 0;
 }
 
 static int setup_timer(uring_dispatcher_t *dispatcher)
 {
-    dispatcher->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    // Blocking: the ring waits for ticks with IORING_OP_READ.
+    dispatcher->timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
     if (dispatcher->timer_fd < 0) {
         perror("timerfd_create");
         return 0;
     }
 
     const struct itimerspec its = {
-        .it_interval = {0, 100000000},
-        .it_value = {0, 100000000},
+        .it_interval = {0, FKVS_TIMER_TICK_MS * 1000000L},
+        .it_value = {0, FKVS_TIMER_TICK_MS * 1000000L},
     };
 
     if (timerfd_settime(dispatcher->timer_fd, 0, &its, NULL) == -1) {
@@ -252,235 +485,322 @@ static int setup_timer(uring_dispatcher_t *dispatcher)
     return 0;
 }
 
-static int handle_accept_ready(uring_dispatcher_t *dispatcher,
-                               const int cqe_res)
+static void accept_client(uring_dispatcher_t *dispatcher, const int fd)
 {
-    if (cqe_res < 0 && !server_shutdown_requested()) {
-        fprintf(stderr, "io_uring accept readiness failed: %s\n",
-                strerror(-cqe_res));
-        return -1;
-    }
-
-    for (;;) {
-        struct sockaddr_storage ss;
-        socklen_t slen = sizeof(ss);
-        const int cfd = accept(server.fd, (struct sockaddr *)&ss, &slen);
-
-        if (cfd < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-                break;
-            if (errno == EINTR)
-                continue;
-            perror("accept");
-            break;
+    const bool fixed = dispatcher->fixed_files;
+    if (!fkvs_server_can_accept_client(&server)) {
+        if (server.verbose) {
+            fprintf(stderr,
+                    "Rejecting client fd=%d: max-clients limit reached (%u)\n",
+                    fd, server.max_clients);
         }
+        close_accepted(dispatcher, fd, fixed);
+        fkvs_server_record_rejected_client(&server);
+        return;
+    }
 
-        if (reject_if_server_at_capacity(cfd))
-            continue;
-
-        set_nonblocking(cfd);
-        if (server.socket_domain == TCP_IP)
-            set_tcp_no_delay(cfd);
-
-        client_t *client = init_client(cfd, ss, server.socket_domain);
-        if (!client)
-            continue;
-
-        list_t *updated_clients = listAddNodeToTail(server.clients, client);
-        if (!updated_clients) {
-            fprintf(stderr, "Unable to allocate client list node\n");
-            close_untracked_client(client);
-            continue;
-        }
-        server.clients = updated_clients;
-        server.num_clients += 1;
+    // init_client() closes its fd on failure, which must not happen to a
+    // slot number, so the fd is filled in afterwards.
+    const struct sockaddr_storage ss = {.ss_family = AF_UNSPEC};
+    client_t *client = init_client(-1, ss, server.socket_domain);
+    if (!client) {
+        close_accepted(dispatcher, fd, fixed);
+        return;
+    }
+    client->fd = fd;
+    client->fd_fixed = fixed;
+    client->write_async = true;
+
+    list_t *updated_clients = listAddNodeToTail(server.clients, client);
+    if (!updated_clients) {
+        fprintf(stderr, "Unable to allocate client list node\n");
+        close_accepted(dispatcher, fd, fixed);
+        free_client(client);
+        return;
+    }
+    server.clients = updated_clients;
+    server.num_clients += 1;
 
-        if (server.verbose) {
-            printf("Client connected fd=%d %s:%d (total=%d)\n", client->fd,
-                   client->ip_str, client->port, (int)server.num_clients);
-        }
+    if (server.verbose) {
+        printf("Client connected fd=%d%s (total=%d)\n", client->fd,
+               fixed ? " (fixed)" : "", (int)server.num_clients);
+    }
 
-        if (submit_client_read_ready(dispatcher, client) == -1) {
-            close_and_drop_client(client);
-            return -1;
-        }
+    if (arm_client_recv(dispatcher, client) == -1) {
+        client->close_pending = true;
+        release_if_idle(dispatcher, client);
     }
+}
 
-    if (!server_shutdown_requested() && submit_accept_ready(dispatcher) == -1)
+static int handle_accept(uring_dispatcher_t *dispatcher, const int cqe_res,
+                         const unsigned int cqe_flags)
+{
+    if (cqe_res >= 0) {
+        accept_client(dispatcher, cqe_res);
+    } else if (cqe_res == -EINVAL || cqe_res == -EBADF ||
+               cqe_res == -ENOTSOCK) {
+        if (server_shutdown_requested())
+            return 0;
+        fprintf(stderr, "io_uring accept failed: %s\n", strerror(-cqe_res));
         return -1;
+    } else if (server.verbose) {
+        // Transient: an aborted handshake, or the file table is full while
+        // slots of dropped clients are still closing.
+        fprintf(stderr, "io_uring accept: %s\n", strerror(-cqe_res));
+    }
 
+    // Multishot accept stays armed until the kernel says otherwise.
+    if (!(cqe_flags & IORING_CQE_F_MORE) && !server_shutdown_requested())
+        return submit_accept(dispatcher);
     return 0;
 }
 
-static int handle_timer_ready(uring_dispatcher_t *dispatcher,
-                              const int cqe_res)
+static int handle_timer_tick(uring_dispatcher_t *dispatcher,
+                             const int cqe_res)
 {
-    if (cqe_res < 0 && !server_shutdown_requested()) {
-        fprintf(stderr, "io_uring timer readiness failed: %s\n",
+    if (cqe_res == (int)sizeof(dispatcher->timer_expirations)) {
+        db_update_lru_clock(server.database);
+        db_expire_slow_cycle(server.database,
+                             server.active_expire_cpu_percent);
+        db_rehash_for_us(server.database, server.active_rehash_us);
+    } else if (cqe_res < 0 && cqe_res != -EINTR &&
+               !server_shutdown_requested()) {
+        fprintf(stderr, "io_uring timer read failed: %s\n",
                 strerror(-cqe_res));
         return -1;
     }
 
-    for (;;) {
-        uint64_t expirations = 0;
-        const ssize_t nread =
-            read(dispatcher->timer_fd, &expirations, sizeof(expirations));
-        if (nread == (ssize_t)sizeof(expirations)) {
-            expire_sweep(server.database->store, server.database->expires,
-                         TTL_SWEEP_BATCH);
-            continue;
-        }
-        if (nread < 0 && errno == EINTR)
-            continue;
-        if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
-            break;
-        if (nread < 0)
-            perror("timerfd read");
-        break;
-    }
-
-    if (!server_shutdown_requested() && submit_timer_ready(dispatcher) == -1)
+    if (!server_shutdown_requested() && submit_timer_read(dispatcher) == -1)
         return -1;
 
     return 0;
 }
 
-static int rearm_client_after_read(uring_dispatcher_t *dispatcher,
-                                   client_t *client)
+// A deferred reply arrived from another shard (see shard_drain()).
+static void send_shard_reply(client_t *client, void *ctx)
 {
-    if (client->wbuf_used > 0)
-        return submit_client_write_ready(dispatcher, client);
-
-    return submit_client_read_ready(dispatcher, client);
+    uring_dispatcher_t *dispatcher = ctx;
+    if (client->close_pending)
+        return;
+    if (client->write_failed || start_client_send(dispatcher, client) == -1)
+        close_and_drop_client(dispatcher, client);
 }
 
-static int handle_client_read_ready(uring_dispatcher_t *dispatcher,
-                                    client_t *client, const int cqe_res)
+static int handle_shard_wake(uring_dispatcher_t *dispatcher, const int cqe_res)
 {
-    if (!client)
-        return 0;
-
-    if (cqe_res < 0) {
-        if (server.verbose) {
-            printf("Client fd=%d read readiness failed (%s)\n", client->fd,
-                   strerror(-cqe_res));
-        }
-        close_and_drop_client(client);
-        return 0;
+    if (cqe_res == (int)sizeof(dispatcher->shard_wakeups)) {
+        shard_drain(server.shard, send_shard_reply, dispatcher);
+    } else if (cqe_res < 0 && cqe_res != -EINTR &&
+               !server_shutdown_requested()) {
+        fprintf(stderr, "io_uring shard wakeup read failed: %s\n",
+                strerror(-cqe_res));
+        return -1;
     }
 
-    for (;;) {
-        const size_t available = sizeof(client->buffer) - client->buf_used;
+    if (!server_shutdown_requested() &&
+        submit_shard_wake_read(dispatcher) == -1)
+        return -1;
+
+    return 0;
+}
+
+// Feed one received chunk to the client's parser; false if the client must
+// be dropped.
+static bool feed_client(client_t *client, const unsigned char *data,
+                        size_t len)
+{
+    while (len > 0) {
+        size_t available;
+        unsigned char *target = client_read_target(client, &available);
         if (available == 0) {
             fprintf(stderr,
                     "fd=%d read buffer full before frame completion; dropping "
                     "client\n",
                     client->fd);
-            close_and_drop_client(client);
-            return 0;
+            return false;
         }
 
-        const ssize_t nread =
-            recv(client->fd, client->buffer + client->buf_used, available, 0);
-        if (nread > 0) {
-            client->buf_used += (size_t)nread;
-            if (server.verbose) {
-                printf("fd=%d read %zd bytes (buf_used=%zu)\n", client->fd,
-                       nread, client->buf_used);
-            }
-
-            if (try_process_frames(client) < 0) {
-                close_and_drop_client(client);
-                return 0;
-            }
-
-            if (client_has_oversized_partial_frame(client)) {
-                fprintf(stderr,
-                        "fd=%d frame exceeds buffer capacity; dropping "
-                        "client\n",
-                        client->fd);
-                close_and_drop_client(client);
-                return 0;
-            }
+        const size_t n = len < available ? len : available;
+        memcpy(target, data, n);
+        if (client_read_done(client, n) < 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return !client->write_failed;
+}
 
-            continue;
-        }
+static int handle_client_recv(uring_dispatcher_t *dispatcher, client_t *client,
+                              const int cqe_res, const unsigned int cqe_flags)
+{
+    if (!(cqe_flags & IORING_CQE_F_MORE))
+        client->recv_armed = false;
 
-        if (nread == 0) {
+    bool keep = cqe_res > 0;
+    if (cqe_flags & IORING_CQE_F_BUFFER) {
+        const unsigned int bid = cqe_flags >> IORING_CQE_BUFFER_SHIFT;
+        if (keep && !client->close_pending) {
             if (server.verbose)
-                printf("Client fd=%d closed (recv=0)\n", client->fd);
-            close_and_drop_client(client);
-            return 0;
+                printf("fd=%d read %d bytes\n", client->fd, cqe_res);
+            keep = feed_client(
+                client,
+                dispatcher->recv_buffers +
+                    (size_t)bid * IO_URING_RECV_BUFFER_SIZE,
+                (size_t)cqe_res);
         }
+        recycle_recv_buffer(dispatcher, bid);
+    }
 
-        if (errno == EINTR)
-            continue;
+    if (client->close_pending) {
+        release_if_idle(dispatcher, client);
+        return 0;
+    }
 
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
-            return rearm_client_after_read(dispatcher, client);
+    // Out of provided buffers for a moment: they are handed back as this
+    // batch is handled, so just re-arm.
+    if (cqe_res == -ENOBUFS)
+        keep = true;
 
-        perror("recv");
-        close_and_drop_client(client);
+    if (!keep) {
+        if (server.verbose) {
+            if (cqe_res == 0)
+                printf("Client fd=%d closed (recv=0)\n", client->fd);
+            else if (cqe_res < 0)
+                printf("Client fd=%d recv failed (%s)\n", client->fd,
+                       strerror(-cqe_res));
+        }
+        close_and_drop_client(dispatcher, client);
         return 0;
     }
+
+    if ((!client->recv_armed && arm_client_recv(dispatcher, client) == -1) ||
+        start_client_send(dispatcher, client) == -1) {
+        close_and_drop_client(dispatcher, client);
+        return -1;
+    }
+    return 0;
 }
 
-static int handle_client_write_ready(uring_dispatcher_t *dispatcher,
-                                     client_t *client, const int cqe_res)
+static int handle_client_send(uring_dispatcher_t *dispatcher, client_t *client,
+                              const int cqe_res)
 {
-    if (!client)
-        return 0;
+    wbuf_send_end(client, cqe_res > 0 ? (size_t)cqe_res : 0);
 
-    client->write_registered = false;
+    if (client->close_pending) {
+        release_if_idle(dispatcher, client);
+        return 0;
+    }
 
     if (cqe_res < 0) {
         if (server.verbose) {
-            printf("Client fd=%d write readiness failed (%s)\n", client->fd,
+            printf("Client fd=%d send failed (%s)\n", client->fd,
                    strerror(-cqe_res));
         }
-        close_and_drop_client(client);
+        close_and_drop_client(dispatcher, client);
         return 0;
     }
 
-    wbuf_flush(client);
-    if (client->write_failed) {
-        close_and_drop_client(client);
-        return 0;
+    if (start_client_send(dispatcher, client) == -1) {
+        close_and_drop_client(dispatcher, client);
+        return -1;
     }
+    return 0;
+}
 
-    if (client->wbuf_used > 0)
-        return submit_client_write_ready(dispatcher, client);
+// A SEND_ZC completes twice: first its result, like a plain send, then (if
+// the result has F_MORE) a notification once the kernel is done with the
+// value.
+static int handle_zerocopy_send(uring_dispatcher_t *dispatcher,
+                                uring_zerocopy_send_t *send, int cqe_res,
+                                const unsigned int cqe_flags)
+{
+    client_t *client = send->client;
+    if (cqe_flags & IORING_CQE_F_NOTIF) {
+        // The kernel copied the data after all (loopback does): from here
+        // on zero-copy would only add the notification overhead.
+        if (client && ((uint32_t)cqe_res & IORING_NOTIF_USAGE_ZC_COPIED))
+            client->zerocopy_refused = true;
+        release_zerocopy_send(dispatcher, send);
+        return 0;
+    }
 
-    return submit_client_read_ready(dispatcher, client);
+    // The client waits for this result (send_inflight), so it is alive.
+    if (!(cqe_flags & IORING_CQE_F_MORE))
+        release_zerocopy_send(dispatcher, send);
+    if (cqe_res == -EOPNOTSUPP || cqe_res == -EINVAL) {
+        // The socket (e.g. a Unix domain one) or the kernel cannot send
+        // zero-copy. Nothing went out; the next send copies.
+        client->zerocopy_refused = true;
+        cqe_res = 0;
+    }
+    return handle_client_send(dispatcher, client, cqe_res);
 }
 
 static int handle_cqe(uring_dispatcher_t *dispatcher,
-                      struct io_uring_cqe *cqe)
+                      const struct io_uring_cqe *cqe)
 {
-    uring_op_t *op = io_uring_cqe_get_data(cqe);
-    const int cqe_res = cqe->res;
-    io_uring_cqe_seen(&dispatcher->ring, cqe);
-
-    if (!op)
+    const uint64_t data = io_uring_cqe_get_data64(cqe);
+    void *target = (void *)(uintptr_t)(data & ~(uint64_t)URING_OP_KIND_MASK);
+    client_t *client = target;
+
+    switch ((uring_op_kind_t)(data & URING_OP_KIND_MASK)) {
+    case URING_ACCEPT:
+        return handle_accept(dispatcher, cqe->res, cqe->flags);
+    case URING_TIMER_TICK:
+        return handle_timer_tick(dispatcher, cqe->res);
+    case URING_SHARD_WAKE:
+        return handle_shard_wake(dispatcher, cqe->res);
+    case URING_CLIENT_RECV:
+        return handle_client_recv(dispatcher, client, cqe->res, cqe->flags);
+    case URING_CLIENT_SEND:
+        return handle_client_send(dispatcher, client, cqe->res);
+    case URING_CLIENT_SEND_ZC:
+        return handle_zerocopy_send(dispatcher, target, cqe->res, cqe->flags);
+    case URING_UNTRACKED:
         return 0;
+    }
 
-    const uring_op_kind_t kind = op->kind;
-    client_t *client = op->client;
-    untrack_op(dispatcher, op);
-    free(op);
+    return 0;
+}
 
-    switch (kind) {
-    case URING_ACCEPT_READY:
-        return handle_accept_ready(dispatcher, cqe_res);
-    case URING_CLIENT_READ_READY:
-        return handle_client_read_ready(dispatcher, client, cqe_res);
-    case URING_CLIENT_WRITE_READY:
-        return handle_client_write_ready(dispatcher, client, cqe_res);
-    case URING_TIMER_READY:
-        return handle_timer_ready(dispatcher, cqe_res);
+// Ring setup for io-uring-mode. SQPOLL and DEFER_TASKRUN exclude each other.
+static void ring_params_for_server(struct io_uring_params *params)
+{
+    memset(params, 0, sizeof(*params));
+    switch (server.io_uring_mode) {
+    case io_uring_ring_default:
+        break;
+    case io_uring_ring_sqpoll:
+        params->flags = IORING_SETUP_SQPOLL;
+        params->sq_thread_idle = server.io_uring_sqpoll_idle_ms;
+        if (server.io_uring_sqpoll_cpu >= 0) {
+            params->flags |= IORING_SETUP_SQ_AFF;
+            params->sq_thread_cpu = (uint32_t)server.io_uring_sqpoll_cpu;
+        }
+        break;
+    case io_uring_ring_defer_taskrun:
+        params->flags =
+            IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        break;
     }
+}
 
-    return 0;
+// Handle up to one batch of completions; false once a handler failed.
+static bool reap_completions(uring_dispatcher_t *dispatcher,
+                             unsigned int *reaped)
+{
+    struct io_uring_cqe *cqes[IO_URING_CQE_BATCH];
+    const unsigned int ready =
+        io_uring_peek_batch_cqe(&dispatcher->ring, cqes, IO_URING_CQE_BATCH);
+    for (unsigned int i = 0; i < ready; i++) {
+        if (handle_cqe(dispatcher, cqes[i]) == -1) {
+            io_uring_cq_advance(&dispatcher->ring, i + 1);
+            return false;
+        }
+    }
+    io_uring_cq_advance(&dispatcher->ring, ready);
+    *reaped = ready;
+    return true;
 }
 
 static void cleanup_dispatcher(uring_dispatcher_t *dispatcher)
@@ -490,26 +810,51 @@ static void cleanup_dispatcher(uring_dispatcher_t *dispatcher)
         dispatcher->timer_fd = -1;
     }
 
+    // Tearing the ring down cancels everything in flight and closes the
+    // registered sockets, so clients and receive buffers can be freed after
+    // it.
     io_uring_queue_exit(&dispatcher->ring);
-    free_tracked_ops(dispatcher);
+    free(dispatcher->recv_buffers);
+    dispatcher->recv_buffers = NULL;
+    // Notifications still due will not be delivered now.
+    while (dispatcher->zerocopy_sends)
+        release_zerocopy_send(dispatcher, dispatcher->zerocopy_sends);
 }
 
 int run_event_loop()
 {
     uring_dispatcher_t dispatcher = {.timer_fd = -1};
-    set_nonblocking(server.fd);
 
     const unsigned int queue_depth = queue_depth_for_server();
-    int res = io_uring_queue_init(queue_depth, &dispatcher.ring, 0);
+    struct io_uring_params params;
+    ring_params_for_server(&params);
+    int res =
+        io_uring_queue_init_params(queue_depth, &dispatcher.ring, &params);
     if (res < 0) {
-        fprintf(stderr, "Unable to setup io_uring: %s\n", strerror(-res));
+        fprintf(stderr, "Unable to setup io_uring (io-uring-mode %s): %s\n",
+                io_uring_ring_mode_to_string(server.io_uring_mode),
+                strerror(-res));
         return -1;
     }
 
     setup_timer(&dispatcher);
 
-    if (submit_accept_ready(&dispatcher) == -1 ||
-        submit_timer_ready(&dispatcher) == -1) {
+    // A sparse table as large as the ring; without one (e.g. RLIMIT_NOFILE
+    // is too low), accepted sockets are plain descriptors.
+    res = io_uring_register_files_sparse(&dispatcher.ring, queue_depth);
+    dispatcher.fixed_files = res == 0;
+    if (res < 0 && server.verbose) {
+        fprintf(stderr, "io_uring file table unavailable (%s); using plain fds\n",
+                strerror(-res));
+    }
+    if (server.socket_domain == TCP_IP)
+        set_tcp_no_delay(server.fd); // inherited by every accepted socket
+
+    if (setup_recv_buffers(&dispatcher) == -1 ||
+        probe_recv_multishot(&dispatcher) == -1 ||
+        submit_accept(&dispatcher) == -1 ||
+        submit_timer_read(&dispatcher) == -1 ||
+        submit_shard_wake_read(&dispatcher) == -1) {
         cleanup_dispatcher(&dispatcher);
         return -1;
     }
@@ -517,7 +862,31 @@ int run_event_loop()
     int status = 0;
     while (!server_shutdown_requested()) {
         struct io_uring_cqe *cqe = NULL;
-        res = io_uring_wait_cqe(&dispatcher.ring, &cqe);
+        db_expire_fast_cycle(server.database);
+        const bool shard_backlog = server.shard && shard_flush(server.shard);
+        // Each wait also submits the SQEs queued since the last one. Peek
+        // instead of blocking while a resize is pending so idle passes can
+        // finish it; wake up soon while expired keys or messages for other
+        // shards are backlogged.
+        if (server.idle_rehash && db_is_rehashing(server.database)) {
+            res = submit_pending(&dispatcher);
+            if (res >= 0)
+                res = io_uring_peek_cqe(&dispatcher.ring, &cqe);
+            if (res == -EAGAIN) {
+                db_rehash_for_us(server.database, FKVS_IDLE_REHASH_SLICE_US);
+                continue;
+            }
+        } else if (db_expire_backlog(server.database) || shard_backlog) {
+            struct __kernel_timespec backlog_wait = {
+                .tv_sec = 0,
+                .tv_nsec = FKVS_EXPIRE_BACKLOG_WAIT_MS * 1000000L};
+            res = io_uring_submit_and_wait_timeout(&dispatcher.ring, &cqe, 1,
+                                                   &backlog_wait, NULL);
+            if (res == -ETIME)
+                continue;
+        } else {
+            res = io_uring_submit_and_wait(&dispatcher.ring, 1);
+        }
         if (res < 0) {
             if (res == -EINTR && server_shutdown_requested())
                 break;
@@ -529,10 +898,18 @@ int run_event_loop()
             break;
         }
 
-        if (handle_cqe(&dispatcher, cqe) == -1) {
-            status = -1;
+        // One clock read per wakeup: it covers every frame the completions
+        // deliver. Keep reaping while batches come back full.
+        fkvs_clock_update();
+        unsigned int reaped = 0;
+        do {
+            if (!reap_completions(&dispatcher, &reaped)) {
+                status = -1;
+                break;
+            }
+        } while (reaped == IO_URING_CQE_BATCH);
+        if (status == -1)
             break;
-        }
     }
 
     cleanup_dispatcher(&dispatcher);
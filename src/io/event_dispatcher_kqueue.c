@@ -53,7 +53,7 @@ static void close_and_drop_client(const int kq, client_t *c)
 
 static int sync_client_write_interest(const int kq, client_t *c)
 {
-    const bool want_write = c->wbuf_used > 0;
+    const bool want_write = client_write_pending(c);
     if (c->write_registered == want_write)
         return 0;
 
@@ -95,7 +95,8 @@ int run_event_loop()
     // Register a 100ms timer for active key expiration sweep
     // EVFILT_TIMER default unit is milliseconds on macOS
     struct kevent timer_ev;
-    EV_SET(&timer_ev, 1, EVFILT_TIMER, EV_ADD | EV_ENABLE, 0, 100, NULL);
+    EV_SET(&timer_ev, 1, EVFILT_TIMER, EV_ADD | EV_ENABLE, 0,
+           FKVS_TIMER_TICK_MS, NULL);
     if (kevent(kq, &timer_ev, 1, NULL, 0, NULL) == -1) {
         perror("kevent register (timer)");
     }
@@ -104,8 +105,22 @@ int run_event_loop()
         server.event_loop_max_events > 1024 ? 1024 : server.event_loop_max_events;
     struct kevent evs[max_evs];
 
+    const struct timespec poll_now = {0, 0};
+    const struct timespec backlog_wait = {
+        0, FKVS_EXPIRE_BACKLOG_WAIT_MS * 1000000L};
     while (!server_shutdown_requested()) {
-        const int n = kevent(kq, NULL, 0, evs, max_evs, NULL);
+        db_expire_fast_cycle(server.database);
+        // Poll instead of blocking while a resize is pending so idle passes
+        // can finish it; wake up soon while expired keys are backlogged.
+        const bool idle_work =
+            server.idle_rehash && db_is_rehashing(server.database);
+        const struct timespec *timeout = NULL;
+        if (idle_work)
+            timeout = &poll_now;
+        else if (db_expire_backlog(server.database))
+            timeout = &backlog_wait;
+        const int n = kevent(kq, NULL, 0, evs, max_evs, timeout);
+        fkvs_clock_update();
         if (n < 0) {
             if (errno == EINTR && !server_shutdown_requested())
                 continue;
@@ -114,6 +129,10 @@ int run_event_loop()
             perror("kevent wait");
             break;
         }
+        if (n == 0 && idle_work) {
+            db_rehash_for_us(server.database, FKVS_IDLE_REHASH_SLICE_US);
+            continue;
+        }
 
         // We have new events
         for (int i = 0; i < n; i++) {
@@ -121,8 +140,10 @@ int run_event_loop()
 
             // Timer event for active expiration sweep
             if (evs[i].filter == EVFILT_TIMER) {
-                expire_sweep(server.database->store, server.database->expires,
-                             20);
+                db_update_lru_clock(server.database);
+                db_expire_slow_cycle(server.database,
+                                     server.active_expire_cpu_percent);
+                db_rehash_for_us(server.database, server.active_rehash_us);
                 continue;
             }
 
@@ -220,33 +241,16 @@ int run_event_loop()
 
             // Drain socket data (non-blocking)
             for (;;) {
-                ssize_t nread = recv(c->fd, c->buffer + c->buf_used,
-                                     sizeof(c->buffer) - c->buf_used, 0);
+                size_t space;
+                unsigned char *target = client_read_target(c, &space);
+                ssize_t nread = recv(c->fd, target, space, 0);
                 if (nread > 0) {
-                    c->buf_used += (size_t)nread;
                     if (server.verbose) {
-                        printf("fd=%d read %zd bytes (buf_used=%zu)\n", c->fd,
-                               nread, c->buf_used);
-                    }
-
-                    // Process all complete frames currently in buffer
-                    if (try_process_frames(c) < 0) {
-                        close_and_drop_client(kq, c);
-                        for (int j = i + 1; j < n; j++) {
-                            if (evs[j].udata == c)
-                                evs[j].udata = NULL;
-                        }
-                        break;
+                        printf("fd=%d read %zd bytes\n", c->fd, nread);
                     }
 
-                    // If the buffer is full, but we still need more for a frame
-                    // → protocol error.
-                    if (c->buf_used == sizeof(c->buffer) && c->frame_need > 0 &&
-                        (ssize_t)c->buf_used < c->frame_need) {
-                        fprintf(stderr,
-                                "fd=%d frame exceeds buffer capacity; dropping "
-                                "client\n",
-                                c->fd);
+                    // Process all complete frames received so far
+                    if (client_read_done(c, (size_t)nread) < 0) {
                         close_and_drop_client(kq, c);
                         for (int j = i + 1; j < n; j++) {
                             if (evs[j].udata == c)
@@ -0,0 +1,161 @@
+#include "lazyfree.h"
+
+#include <stdlib.h>
+
+static void run_job(lazyfree_job_t *job)
+{
+    switch (job->kind) {
+    case LAZYFREE_BLOCK:
+        free(job->ptr); // the job lives inside the block
+        return;
+    case LAZYFREE_TABLE:
+        free_hash_table(job->ptr);
+        break;
+    case LAZYFREE_EXPIRY_INDEX:
+        free_expiry_index(job->ptr);
+        break;
+    }
+    free(job);
+}
+
+static void *lazyfree_main(void *arg)
+{
+    lazyfree_t *lazyfree = arg;
+    for (;;) {
+        lazyfree_job_t *job = atomic_exchange(&lazyfree->head, NULL);
+        if (!job) {
+            pthread_mutex_lock(&lazyfree->lock);
+            pthread_cond_broadcast(&lazyfree->idle);
+            while (!atomic_load(&lazyfree->head) &&
+                   !atomic_load(&lazyfree->stop))
+                pthread_cond_wait(&lazyfree->wake, &lazyfree->lock);
+            const bool stop = atomic_load(&lazyfree->stop) &&
+                              !atomic_load(&lazyfree->head);
+            pthread_mutex_unlock(&lazyfree->lock);
+            if (stop)
+                return NULL;
+            continue;
+        }
+        // The stack is newest first; order does not matter for frees.
+        while (job) {
+            lazyfree_job_t *next = job->next;
+            run_job(job);
+            atomic_fetch_sub(&lazyfree->pending, 1);
+            atomic_fetch_add(&lazyfree->freed, 1);
+            job = next;
+        }
+    }
+}
+
+lazyfree_t *create_lazyfree(void)
+{
+    lazyfree_t *lazyfree = calloc(1, sizeof(*lazyfree));
+    if (!lazyfree)
+        return NULL;
+    atomic_init(&lazyfree->head, NULL);
+    atomic_init(&lazyfree->stop, false);
+    atomic_init(&lazyfree->pending, 0);
+    atomic_init(&lazyfree->freed, 0);
+    pthread_mutex_init(&lazyfree->lock, NULL);
+    pthread_cond_init(&lazyfree->wake, NULL);
+    pthread_cond_init(&lazyfree->idle, NULL);
+    if (pthread_create(&lazyfree->thread, NULL, lazyfree_main, lazyfree) != 0) {
+        pthread_cond_destroy(&lazyfree->idle);
+        pthread_cond_destroy(&lazyfree->wake);
+        pthread_mutex_destroy(&lazyfree->lock);
+        free(lazyfree);
+        return NULL;
+    }
+    return lazyfree;
+}
+
+void free_lazyfree(lazyfree_t *lazyfree)
+{
+    if (!lazyfree)
+        return;
+    pthread_mutex_lock(&lazyfree->lock);
+    atomic_store(&lazyfree->stop, true);
+    pthread_cond_signal(&lazyfree->wake);
+    pthread_mutex_unlock(&lazyfree->lock);
+    pthread_join(lazyfree->thread, NULL);
+    pthread_cond_destroy(&lazyfree->idle);
+    pthread_cond_destroy(&lazyfree->wake);
+    pthread_mutex_destroy(&lazyfree->lock);
+    free(lazyfree);
+}
+
+static void push(lazyfree_t *lazyfree, lazyfree_job_t *job)
+{
+    atomic_fetch_add(&lazyfree->pending, 1);
+    lazyfree_job_t *head = atomic_load(&lazyfree->head);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak(&lazyfree->head, &head, job));
+
+    // Only the empty-to-non-empty transition can find the thread asleep. It
+    // rechecks the head under the lock, so signalling under it cannot be lost.
+    if (!head) {
+        pthread_mutex_lock(&lazyfree->lock);
+        pthread_cond_signal(&lazyfree->wake);
+        pthread_mutex_unlock(&lazyfree->lock);
+    }
+}
+
+void lazyfree_block(lazyfree_t *lazyfree, void *block)
+{
+    if (!lazyfree) {
+        free(block);
+        return;
+    }
+    lazyfree_job_t *job = block;
+    job->kind = LAZYFREE_BLOCK;
+    job->ptr = block;
+    push(lazyfree, job);
+}
+
+// Queue `ptr` for the thread; false (the caller frees inline) without one,
+// or if even the queue node cannot be allocated.
+static bool push_object(lazyfree_t *lazyfree, const lazyfree_kind_t kind,
+                        void *ptr)
+{
+    if (!lazyfree)
+        return false;
+    lazyfree_job_t *job = malloc(sizeof(*job));
+    if (!job)
+        return false;
+    job->kind = kind;
+    job->ptr = ptr;
+    push(lazyfree, job);
+    return true;
+}
+
+void lazyfree_table(lazyfree_t *lazyfree, hashtable_t *table)
+{
+    if (!table)
+        return;
+    if (hashtable_free_effort(table) <= LAZYFREE_EFFORT_THRESHOLD ||
+        !push_object(lazyfree, LAZYFREE_TABLE, table))
+        free_hash_table(table);
+}
+
+void lazyfree_expiry_index(lazyfree_t *lazyfree, expiry_index_t *expires)
+{
+    if (!expires)
+        return;
+    // Each tracked key also owns a malloc'd timer.
+    const size_t effort =
+        hashtable_free_effort(expires->keys) + expires->wheel.count;
+    if (effort <= LAZYFREE_EFFORT_THRESHOLD ||
+        !push_object(lazyfree, LAZYFREE_EXPIRY_INDEX, expires))
+        free_expiry_index(expires);
+}
+
+void lazyfree_wait_idle(lazyfree_t *lazyfree)
+{
+    if (!lazyfree)
+        return;
+    pthread_mutex_lock(&lazyfree->lock);
+    while (atomic_load(&lazyfree->pending) > 0)
+        pthread_cond_wait(&lazyfree->idle, &lazyfree->lock);
+    pthread_mutex_unlock(&lazyfree->lock);
+}
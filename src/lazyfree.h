@@ -0,0 +1,76 @@
+#ifndef LAZYFREE_H
+#define LAZYFREE_H
+
+#include "core/hashtable.h"
+#include "ttl.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Background freeing, after Redis's lazyfree. UNLINK and FLUSHALL ASYNC
+ * detach data from the keyspace right away, then queue the memory for a
+ * background thread. The event loop only pays for the unlink.
+ *
+ * The queue is a lock-free stack. The event loop pushes jobs with a
+ * compare-and-swap. The thread takes the whole stack with one exchange and
+ * sleeps on a condition variable only when the stack is empty. Only pushes
+ * onto an empty stack signal it.
+ *
+ * Offloading has a cost of its own (a push, a wakeup, cold cache lines on
+ * another core), so small frees stay inline:
+ *   - a single value goes to the thread only if malloc backs it and it is at
+ *     least LAZYFREE_VALUE_BYTES long. Slab objects are not thread-safe to
+ *     free and are cheap to recycle in place;
+ *   - a table or expiry index goes only if freeing it takes more than
+ *     LAZYFREE_EFFORT_THRESHOLD blocks (see hashtable_free_effort()).
+ *
+ * Everything queued is owned by the thread once pushed. free_lazyfree()
+ * drains the queue before joining, so shutdown frees everything.
+ */
+#define LAZYFREE_VALUE_BYTES (64 * 1024)
+#define LAZYFREE_EFFORT_THRESHOLD 64
+
+typedef enum {
+    LAZYFREE_BLOCK,        // a malloc'd block: free(ptr)
+    LAZYFREE_TABLE,        // free_hash_table(ptr)
+    LAZYFREE_EXPIRY_INDEX, // free_expiry_index(ptr)
+} lazyfree_kind_t;
+
+typedef struct lazyfree_job {
+    struct lazyfree_job *next;
+    lazyfree_kind_t kind;
+    void *ptr;
+} lazyfree_job_t;
+
+typedef struct lazyfree {
+    _Atomic(lazyfree_job_t *) head;
+    atomic_bool stop;
+    atomic_size_t pending;  // queued objects not freed yet
+    atomic_uint_fast64_t freed; // objects freed by the thread
+    pthread_t thread;
+    pthread_mutex_t lock; // guards sleeping only; the queue itself is lock-free
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+} lazyfree_t;
+
+// Starts the thread; NULL if it cannot, and callers then free inline.
+lazyfree_t *create_lazyfree(void);
+void free_lazyfree(lazyfree_t *lazyfree);
+
+/*
+ * Hand memory to the thread, or free it inline when `lazyfree` is NULL or the
+ * free is too cheap to offload. lazyfree_block() takes a block from
+ * hashtable_unlink_hashed() (at least LAZYFREE_VALUE_BYTES long) and reuses
+ * its first bytes as the queue node, so queueing it allocates nothing.
+ */
+void lazyfree_block(lazyfree_t *lazyfree, void *block);
+void lazyfree_table(lazyfree_t *lazyfree, hashtable_t *table);
+void lazyfree_expiry_index(lazyfree_t *lazyfree, expiry_index_t *expires);
+
+// Block until everything queued so far has been freed (tests, shutdown).
+void lazyfree_wait_idle(lazyfree_t *lazyfree);
+
+#endif // LAZYFREE_H
@@ -3,6 +3,7 @@
 
 #include "server.h"
 
-extern server_t server;
+// One per reactor thread: each shard runs its own copy (see shard.h).
+extern _Thread_local server_t server;
 
 #endif
@@ -13,8 +13,15 @@
 
 #ifdef SERVER
 
+#ifdef __linux__
+#include <asm/socket.h> // SO_REUSEPORT
+#endif
+
 #include "../commands/common/command_registry.h"
+#include "../commands/common/frame.h"
+#include "../commands/server/server_command_handlers.h"
 #include "../counter.h"
+#include "../shard.h"
 #include <errno.h>
 #include <libgen.h>
 #include <sys/stat.h>
@@ -43,6 +50,17 @@ int start_server()
 
     const int one = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+    // Every reactor thread listens on the port (see shard.h).
+    if (server.threads > 1 &&
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) <
+            0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(server_fd);
+        server.fd = -1;
+        return -1;
+    }
+#endif
     setsockopt(server_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
     memset(&server_addr, 0, sizeof(server_addr));
@@ -158,45 +176,160 @@ void set_nonblocking(const int fd)
     (void)fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+// Frames are scanned (hashed, home group prefetched) up to PREFETCH_AHEAD
+// frames before they execute, and their entries are prefetched
+// PREFETCH_ENTRY_AHEAD frames before, so a pipeline of random-key commands
+// overlaps its cache misses instead of taking them one at a time.
+#define PREFETCH_AHEAD 16
+#define PREFETCH_ENTRY_AHEAD 8
+
+typedef struct {
+    size_t len;
+    uint64_t hash;
+    bool has_key;
+} frame_hint_t;
+
+// Frames above proto-max-bulk-len are refused before anything is allocated.
+static bool frame_within_limit(const client_t *c, const size_t frame_len)
+{
+    if (frame_len - FRAME_LONG_HEADER_LEN <= server.proto_max_bulk_len)
+        return true;
+    fprintf(stderr, "fd=%d frame of %zu bytes exceeds proto-max-bulk-len %zu\n",
+            c->fd, frame_len, server.proto_max_bulk_len);
+    return false;
+}
+
+/*
+ * Set up the receive of a frame too big for the client buffer, given the
+ * `avail` bytes of it that have arrived (fewer than the buffer holds), and
+ * move them out: 1 when started, 0 to wait for more of its head, -1 on OOM.
+ *
+ * A SET whose value is large enough has its value received straight into the
+ * entry that will be stored, and the few bytes around it (header, key, EX)
+ * into `large`. Anything else is assembled whole in `large`. Either way the
+ * rest of the frame is then read into place, never copied again.
+ */
+static int start_large_frame(client_t *c, const unsigned char *head,
+                             const size_t avail, const size_t frame_len)
+{
+    size_t value_at = 0;
+    size_t value_len = 0;
+    const int streamed =
+        measure_streamed_set(head, avail, frame_len, &value_at, &value_len);
+    if (streamed == 0)
+        return 0;
+
+    const size_t large_len = streamed > 0 ? frame_len - value_len : frame_len;
+    c->large = malloc(large_len);
+    if (streamed > 0)
+        c->stream_value = hashtable_alloc_large_value(value_len);
+    if (!c->large || (streamed > 0 && !c->stream_value)) {
+        fprintf(stderr, "fd=%d cannot allocate a %zu byte frame\n", c->fd,
+                frame_len);
+        return -1; // free_client() releases whichever was allocated
+    }
+    c->large_len = large_len;
+
+    if (streamed < 0) {
+        memcpy(c->large, head, avail);
+        c->large_used = avail;
+        return 1;
+    }
+
+    // Split what has arrived: head, then value bytes, then any tail.
+    const size_t value_part =
+        avail - value_at < value_len ? avail - value_at : value_len;
+    memcpy(c->large, head, value_at);
+    memcpy(c->stream_value->data, head + value_at, value_part);
+    memcpy(c->large + value_at, head + value_at + value_part,
+           avail - value_at - value_part);
+    c->stream_at = value_at;
+    c->stream_used = value_part;
+    c->large_used = avail - value_part;
+    return 1;
+}
+
 int try_process_frames(client_t *c)
 {
     // Parse as many complete frames as possible.
     if (server.verbose) {
         printf("Attempting to process frame \n");
     }
-    // Parse forward through the buffer with a cursor and compact only once at
+    // Parse forward through the buffer with cursors and compact only once at
     // the end, so a deep pipeline does not pay an O(bytes) memmove per frame.
+    // `scan` runs ahead of `pos`; frames in between are complete and hinted.
+    frame_hint_t hints[PREFETCH_AHEAD];
     size_t pos = 0;
+    size_t scan = 0;
+    size_t executed = 0;
+    size_t scanned = 0;
+    size_t large_len = 0; // a frame at `scan` too big for the buffer
     for (;;) {
-        const size_t avail = c->buf_used - pos;
-        if (avail < 2)
-            break; // need length prefix
-
-        const uint16_t core_len =
-            ((uint16_t)c->buffer[pos] << 8) | c->buffer[pos + 1];
-        const size_t frame_len = 2 + (size_t)core_len; // prefix + core
-        if (frame_len > sizeof(c->buffer)) {
-            fprintf(stderr, "Frame too large: %zu > %zu\n", frame_len,
-                    sizeof(c->buffer));
-            c->buf_used = 0;
-            c->frame_need = -1;
-            return -1;
+        while (!large_len && scanned - executed < PREFETCH_AHEAD) {
+            size_t header_len;
+            size_t frame_len;
+            const size_t avail = c->buf_used - scan;
+            if (!frame_measure(c->buffer + scan, avail, &header_len,
+                               &frame_len))
+                break; // need the length prefix
+            if (frame_len > sizeof(c->buffer)) {
+                // Only long frames get here. Assemble it once the frames
+                // before it have run.
+                large_len = frame_len;
+                break;
+            }
+            if (avail < frame_len)
+                break; // incomplete frame; we wait for more data
+
+            frame_hint_t *hint = &hints[scanned % PREFETCH_AHEAD];
+            hint->len = frame_len;
+            hint->has_key =
+                prefetch_frame_key(c->buffer + scan, frame_len, &hint->hash);
+            scan += frame_len;
+            scanned++;
         }
 
-        if (avail < frame_len)
-            break; // incomplete frame; we wait for more data
+        if (executed == scanned)
+            break;
 
+        if (scanned - executed > PREFETCH_ENTRY_AHEAD) {
+            const frame_hint_t *next =
+                &hints[(executed + PREFETCH_ENTRY_AHEAD) % PREFETCH_AHEAD];
+            if (next->has_key)
+                prefetch_frame_entry(next->hash);
+        }
+
+        const frame_hint_t *hint = &hints[executed % PREFETCH_AHEAD];
+        const size_t frame_len = hint->len;
         if (server.verbose) {
             printf("Complete frame (%zu bytes) from fd=%d\n", frame_len, c->fd);
         }
 
-        // Dispatch exactly one frame.
-        dispatch_command(c, c->buffer + pos, frame_len);
+        // Dispatch exactly one frame, here or on the shard owning its key.
+        if (!server.shard ||
+            !shard_route_frame(c, c->buffer + pos, frame_len,
+                               hint->has_key ? &hint->hash : NULL))
+            dispatch_command(c, c->buffer + pos, frame_len);
         increment_command_count(&server.metrics);
         if (c->write_failed)
             return -1;
 
         pos += frame_len;
+        executed++;
+    }
+
+    if (large_len) {
+        if (!frame_within_limit(c, large_len)) {
+            c->buf_used = 0;
+            c->frame_need = -1;
+            return -1;
+        }
+        const int started = start_large_frame(c, c->buffer + pos,
+                                              c->buf_used - pos, large_len);
+        if (started < 0)
+            return -1;
+        if (started > 0)
+            pos = c->buf_used;
     }
 
     // Compact any unparsed remainder to the front of the buffer.
@@ -209,7 +342,65 @@ int try_process_frames(client_t *c)
     }
 
     // Flush any batched responses after processing all queued frames.
-    if (c->wbuf_used > 0)
+    if (client_write_pending(c))
+        wbuf_flush(c);
+    return c->write_failed ? -1 : 0;
+}
+
+unsigned char *client_read_target(client_t *c, size_t *len)
+{
+    if (c->stream_value && c->stream_used < c->stream_value->value_len) {
+        *len = c->stream_value->value_len - c->stream_used;
+        return c->stream_value->data + c->stream_used;
+    }
+    if (c->large) {
+        *len = c->large_len - c->large_used;
+        return c->large + c->large_used;
+    }
+    *len = sizeof(c->buffer) - c->buf_used;
+    return c->buffer + c->buf_used;
+}
+
+int client_read_done(client_t *c, const size_t nread)
+{
+    if (!c->large) {
+        c->buf_used += nread;
+        return try_process_frames(c);
+    }
+
+    if (c->stream_value && c->stream_used < c->stream_value->value_len)
+        c->stream_used += nread;
+    else
+        c->large_used += nread;
+    if (c->large_used < c->large_len ||
+        (c->stream_value && c->stream_used < c->stream_value->value_len))
+        return 0;
+
+    unsigned char *frame = c->large;
+    value_entry_t *value = c->stream_value;
+    const size_t len = c->large_len;
+    c->large = NULL;
+    c->stream_value = NULL;
+    c->large_len = 0;
+    c->large_used = 0;
+    c->stream_used = 0;
+    if (server.verbose) {
+        printf("Complete frame (%zu bytes) from fd=%d\n",
+               len + (value ? value->value_len : 0), c->fd);
+    }
+    if (server.shard &&
+        shard_route_large(c, frame, len, c->stream_at, value))
+        frame = NULL; // the owning shard runs it
+    else if (value)
+        handle_streamed_set(c, frame, len, c->stream_at, value);
+    else
+        dispatch_command(c, frame, len);
+    increment_command_count(&server.metrics);
+    free(frame);
+    if (c->write_failed)
+        return -1;
+
+    if (client_write_pending(c))
         wbuf_flush(c);
     return c->write_failed ? -1 : 0;
 }
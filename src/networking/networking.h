@@ -11,6 +11,18 @@
 int start_server();
 int start_uds_server();
 int try_process_frames(client_t *c);
+/*
+ * The read path for event loops: recv() at most `*len` bytes into
+ * client_read_target(), then hand the count to client_read_done(), which runs
+ * every frame completed (-1: drop the client). Frames normally collect in the
+ * client's fixed buffer. A long frame larger than that (up to
+ * proto-max-bulk-len) gets a block of its exact size, and the target becomes
+ * the rest of that block, so it is never copied or moved while it arrives. A
+ * long SET's value goes one better: the target is the value entry SET will
+ * store (see measure_streamed_set()), so its bytes are never copied at all.
+ */
+unsigned char *client_read_target(client_t *c, size_t *len);
+int client_read_done(client_t *c, size_t nread);
 void set_tcp_no_delay(const int fd);
 void set_nonblocking(const int fd);
 #endif
@@ -59,6 +59,24 @@ bool fkvs_parse_i64_decimal(const unsigned char *buf, size_t len,
     return *out >= min_value && *out <= max_value;
 }
 
+size_t fkvs_format_i64_decimal(int64_t value, unsigned char *buf)
+{
+    unsigned char tmp[FKVS_I64_DECIMAL_MAX];
+    size_t n = 0;
+    uint64_t mag = signed_abs_limit(value);
+    do {
+        tmp[n++] = (unsigned char)('0' + mag % 10);
+        mag /= 10;
+    } while (mag);
+
+    size_t len = 0;
+    if (value < 0)
+        buf[len++] = '-';
+    while (n)
+        buf[len++] = tmp[--n];
+    return len;
+}
+
 bool fkvs_parse_deadline_ms(const unsigned char *buf, size_t len,
                             int64_t now_ms, int64_t *deadline_ms)
 {
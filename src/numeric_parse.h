@@ -9,6 +9,14 @@ bool fkvs_parse_i64_decimal(const unsigned char *buf, size_t len,
                             int64_t min_value, int64_t max_value,
                             int64_t *out);
 
+// Longest int64 in decimal ("-9223372036854775808"), without a terminator.
+#define FKVS_I64_DECIMAL_MAX 20
+
+// Render `value` in canonical decimal (no '+', no leading zeros) into `buf`,
+// which must hold FKVS_I64_DECIMAL_MAX bytes. Returns the length written; no
+// NUL is appended.
+size_t fkvs_format_i64_decimal(int64_t value, unsigned char *buf);
+
 bool fkvs_parse_deadline_ms(const unsigned char *buf, size_t len,
                             int64_t now_ms, int64_t *deadline_ms);
 
@@ -1,3 +1,4 @@
+#include "commands/common/command_registry.h"
 #include "commands/server/server_command_handlers.h"
 #include "config.h"
 #include "core/hashtable.h"
@@ -7,6 +8,7 @@
 #include "memory.h"
 #include "networking/networking.h"
 #include "server_lifecycle.h"
+#include "shard_lifecycle.h"
 #include "utils.h"
 #include <errno.h>
 #include <fcntl.h>
@@ -20,8 +22,8 @@
 #include <sys/utsname.h>
 #include <unistd.h>
 
-/* Global Server instance */
-server_t server;
+/* Server instance, one per reactor thread */
+_Thread_local server_t server;
 
 void show_logo()
 {
@@ -159,30 +161,69 @@ int main(int argc, char *argv[])
         LOG_INFO("Server starting");
     }
 
-    setup_client_list();
     install_signal_handlers();
 
-    if (server.socket_domain == UNIX) {
-        server.fd = start_uds_server();
-    } else {
-        server.fd = start_server();
+#ifndef __linux__
+    if (server.threads > 1) {
+        WARN("'threads' needs Linux; running a single reactor thread");
+        server.threads = 1;
+    }
+#endif
+    if (server.threads > 1 && server.socket_domain == UNIX) {
+        ERROR_AND_EXIT("'threads' above 1 shares a TCP port between threads "
+                       "and cannot be used with 'unixsocket'");
     }
 
-    if (server.fd == -1) {
-        fprintf(stderr, "Failed to start the server. Exiting.\n");
-        exit(EXIT_FAILURE);
+    // With several threads, each shard opens its own listener and keyspace
+    // (see shard.h).
+    if (server.threads == 1) {
+        setup_client_list();
+
+        if (server.socket_domain == UNIX) {
+            server.fd = start_uds_server();
+        } else {
+            server.fd = start_server();
+        }
+
+        if (server.fd == -1) {
+            fprintf(stderr, "Failed to start the server. Exiting.\n");
+            exit(EXIT_FAILURE);
+        }
     }
 
-    server.database = malloc(sizeof(db_t));
-    server.database->store = create_hash_table(TABLE_SIZE);
-    server.database->expires = create_hash_table(TABLE_SIZE);
+    if (!hashtable_init_shared_integers(server.shared_integers)) {
+        fprintf(stderr, "Failed to allocate shared integers. Exiting.\n");
+        exit(EXIT_FAILURE);
+    }
 
-    init_command_handlers(server.database);
+    fkvs_clock_init(server.clock_source, true);
+    char clock_log[64];
+    snprintf(clock_log, sizeof(clock_log), "clock-source: %s",
+             fkvs_clock_source_to_string(server.clock_source));
+    LOG_INFO(clock_log);
+
+    if (server.threads == 1) {
+        server.database = create_database(&server, server.maxmemory);
+        if (!server.database) {
+            fprintf(stderr, "Failed to allocate the keyspace. Exiting.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (!server.database->lazyfree)
+            LOG_INFO("lazyfree: no background thread, freeing inline");
+        init_command_handlers(server.database);
+    } else {
+        register_command_handlers();
+    }
+    set_zerocopy_send_min(server.zerocopy_send_min);
 
 #ifdef __linux__
     if (server.use_io_uring) {
         server.event_dispatcher_kind = io_uring_kind;
         LOG_INFO("event-loop-kind: io_uring");
+        char mode_log[64];
+        snprintf(mode_log, sizeof(mode_log), "io-uring-mode: %s",
+                 io_uring_ring_mode_to_string(server.io_uring_mode));
+        LOG_INFO(mode_log);
     } else {
         server.event_dispatcher_kind = epoll_kind;
         LOG_INFO("event-loop-kind: epoll");
@@ -200,7 +241,15 @@ int main(int argc, char *argv[])
              get_allocator_name());
     LOG_INFO(allocator_log);
 
-    const int event_loop_result = run_event_loop();
+    if (server.threads > 1) {
+        char threads_log[64];
+        snprintf(threads_log, sizeof(threads_log), "threads: %u",
+                 server.threads);
+        LOG_INFO(threads_log);
+    }
+
+    const int event_loop_result =
+        server.threads > 1 ? run_shards() : run_event_loop();
     shutdown_server(&server);
 
     return event_loop_result == 0 ? 0 : 1;
@@ -1,24 +1,53 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "clock.h"
 #include "core/hashtable.h"
 #include "core/list.h"
 #include "counter.h"
+#include "evict.h"
 #include "io/event_dispatcher.h"
+#include "lazyfree.h"
 #include "networking/modes.h"
+#include "ttl.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 
 #define FKVS_DEFAULT_BIND_ADDRESS "127.0.0.1"
 #define FKVS_DEFAULT_MAX_CLIENTS 128U
+// Integers 0..N-1 share one immutable value entry (see hashtable.h).
+#define FKVS_DEFAULT_SHARED_INTEGERS 10000U
+// Per-tick budget for migrating in-flight hashtable resizes (see below).
+#define FKVS_DEFAULT_ACTIVE_REHASH_US 1000
+// Slice of rehash work done per idle event-loop pass.
+#define FKVS_IDLE_REHASH_SLICE_US 1000
+// Period of the event-loop timer that drives active expiry and rehashing.
+#define FKVS_TIMER_TICK_MS 100
+// Share of each tick that active expiry may spend deleting due keys.
+#define FKVS_DEFAULT_ACTIVE_EXPIRE_CPU_PERCENT 25
+// Longest the loop blocks for events while an expiry backlog remains, or
+// messages for other shards wait for room (see shard.h).
+#define FKVS_EXPIRE_BACKLOG_WAIT_MS 1
+// Largest request frame core accepted (long frames, see frame.h).
+#define FKVS_DEFAULT_PROTO_MAX_BULK_LEN (512U * 1024U * 1024U)
+// Replies with values this long go out zero-copy (MSG_ZEROCOPY / SEND_ZC).
+#define FKVS_DEFAULT_ZEROCOPY_SEND_MIN (64U * 1024U)
+// How long an idle io_uring SQPOLL thread spins before it sleeps.
+#define FKVS_DEFAULT_IO_URING_SQPOLL_IDLE_MS 1000U
+// Most reactor threads (`threads`, see shard.h).
+#define FKVS_MAX_THREADS 64U
 
 typedef struct {
 #define TABLE_SIZE 8192
     hashtable_t *store;
-    hashtable_t *expires;
+    expiry_index_t *expires;
+    eviction_t *eviction;
+    lazyfree_t *lazyfree; // NULL: everything is freed inline
 } db_t;
 
+struct shard_t;
+
 typedef struct server_t {
     list_t *clients;
     const char *config_file_path;
@@ -34,9 +63,27 @@ typedef struct server_t {
     pid_t pid;
     uint32_t num_clients;
     uint32_t max_clients;
+    uint32_t shared_integers;
+    int64_t active_rehash_us;
+    int active_expire_cpu_percent;
+    size_t maxmemory;
+    evict_policy_t maxmemory_policy;
+    int maxmemory_samples;
+    int lfu_log_factor;
+    int lfu_decay_time; // minutes
+    size_t proto_max_bulk_len;
+    size_t zerocopy_send_min; // 0: zero-copy sends off
     enum socket_domain socket_domain;
+    fkvs_clock_source clock_source;
     event_loop_dispatcher_kind event_dispatcher_kind;
+    io_uring_ring_mode io_uring_mode;
+    uint32_t io_uring_sqpoll_idle_ms;
+    int io_uring_sqpoll_cpu; // -1: the SQPOLL thread is not pinned
+    uint32_t threads;        // reactor threads, each owning a shard
+    uint32_t shard_id;
+    struct shard_t *shard;   // NULL with a single thread
     bool use_io_uring;
+    bool idle_rehash;
     bool is_logging_enabled;
     bool verbose;
     bool show_logo;
@@ -45,4 +92,61 @@ typedef struct server_t {
     bool owns_uds_socket_path;
 } server_t __attribute__((aligned(128)));
 
+/*
+ * Drive in-flight keyspace resizes from the event loop: the 100ms timer tick
+ * spends up to `active_rehash_us`, and with `idle_rehash` the loop polls
+ * instead of blocking while a resize is pending and spends
+ * FKVS_IDLE_REHASH_SLICE_US per pass that finds no events. The keyspace and
+ * expiry tables share each budget: the second gets what the first left.
+ * Returns true while either table is still resizing.
+ */
+static inline bool db_is_rehashing(const db_t *db)
+{
+    return hashtable_is_rehashing(db->store) ||
+           hashtable_is_rehashing(db->expires->keys);
+}
+
+static inline bool db_rehash_for_us(db_t *db, const int64_t budget_us)
+{
+    if (budget_us <= 0)
+        return db_is_rehashing(db);
+
+    const int64_t deadline = hashtable_rehash_clock_us() + budget_us;
+    const bool store = hashtable_rehash_until(db->store, deadline);
+    const bool expires = hashtable_rehash_until(db->expires->keys, deadline);
+    return store || expires;
+}
+
+/*
+ * Active expiry (see expire_slow_cycle() in ttl.h). The timer tick runs a slow
+ * cycle. While one has left a backlog, every loop pass also tries a fast cycle
+ * (rate-limited in ttl.c) and waits at most FKVS_EXPIRE_BACKLOG_WAIT_MS for
+ * events, so the backlog keeps draining between ticks.
+ */
+static inline void db_expire_slow_cycle(db_t *db, const int cpu_percent)
+{
+    expire_slow_cycle(db->store, db->expires, cpu_percent,
+                      (int64_t)FKVS_TIMER_TICK_MS * 1000);
+}
+
+// Advance the clock stamped into keys on access (see evict.h): seconds for
+// LRU, minutes in LFU mode. Either resolution makes the timer tick frequent
+// enough.
+static inline void db_update_lru_clock(db_t *db)
+{
+    db->store->access_clock =
+        db->store->lfu ? evict_lfu_clock() : evict_lru_clock();
+}
+
+static inline bool db_expire_backlog(const db_t *db)
+{
+    return db->expires->backlog;
+}
+
+static inline void db_expire_fast_cycle(db_t *db)
+{
+    if (db->expires->backlog)
+        expire_fast_cycle(db->store, db->expires);
+}
+
 #endif // SERVER_H
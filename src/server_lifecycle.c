@@ -2,28 +2,66 @@
 #include "client.h"
 
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
-static volatile sig_atomic_t shutdown_requested = 0;
+// Lock-free, so async-signal-safe; every reactor thread polls it.
+static atomic_bool shutdown_requested = false;
 
 void request_server_shutdown(int sig)
 {
     (void)sig;
     // Async-signal-safe: event loops observe this flag and clean up normally.
-    shutdown_requested = 1;
+    atomic_store(&shutdown_requested, true);
 }
 
 bool server_shutdown_requested(void)
 {
-    return shutdown_requested != 0;
+    return atomic_load_explicit(&shutdown_requested, memory_order_relaxed);
 }
 
 void reset_server_shutdown_request(void)
 {
-    shutdown_requested = 0;
+    atomic_store(&shutdown_requested, false);
+}
+
+db_t *create_database(const server_t *srv, const size_t maxmemory)
+{
+    db_t *db = calloc(1, sizeof(*db));
+    if (!db)
+        return NULL;
+
+    db->store = create_hash_table(TABLE_SIZE);
+    db->expires = create_expiry_index(TABLE_SIZE);
+    db->eviction = create_eviction(maxmemory, srv->maxmemory_policy,
+                                   srv->maxmemory_samples);
+    if (!db->store || !db->expires || !db->eviction) {
+        free_database(db);
+        return NULL;
+    }
+    db->lazyfree = create_lazyfree();
+    if (evict_policy_is_lfu(srv->maxmemory_policy))
+        hashtable_enable_lfu(db->store, (unsigned)srv->lfu_log_factor,
+                             (unsigned)srv->lfu_decay_time);
+    db_update_lru_clock(db);
+    return db;
+}
+
+void free_database(db_t *db)
+{
+    if (!db)
+        return;
+
+    // Finish queued frees first: they may still read shared integers.
+    free_lazyfree(db->lazyfree);
+    free_hash_table(db->store);
+    free_expiry_index(db->expires);
+    free_eviction(db->eviction);
+    free(db);
 }
 
 static void free_client_ptr(void *ptr)
@@ -35,7 +73,8 @@ static void close_clients(list_t *clients)
 {
     for (list_node_t *node = clients->head; node; node = node->next) {
         client_t *client = node->val;
-        if (client && client->fd >= 0) {
+        // Registered io_uring slots were closed with the ring.
+        if (client && client->fd >= 0 && !client->fd_fixed) {
             close(client->fd);
             client->fd = -1;
         }
@@ -71,7 +110,16 @@ void server_drop_client(server_t *srv, client_t *client)
         srv->num_clients -= 1;
     }
 
-    if (client->fd >= 0) {
+    // A registered io_uring slot is closed by the dispatcher instead.
+    if (client->fd >= 0 && !client->fd_fixed) {
+        // Zero-copy sends still queued point into values free_client()
+        // unpins. Reset the connection so the kernel discards them instead
+        // of sending whatever that memory holds by then.
+        if (client->zerocopy_inflight > 0) {
+            const struct linger reset = {.l_onoff = 1, .l_linger = 0};
+            setsockopt(client->fd, SOL_SOCKET, SO_LINGER, &reset,
+                       sizeof(reset));
+        }
         close(client->fd);
         client->fd = -1;
     }
@@ -81,6 +129,11 @@ void server_drop_client(server_t *srv, client_t *client)
     }
     srv->metrics.disconnected_clients = srv->num_disconnected_clients;
 
+    // Shards still running its frames reply to it; the last reply frees it.
+    if (client->shard_inflight > 0) {
+        client->shard_orphaned = true;
+        return;
+    }
     free_client(client);
 }
 
@@ -96,14 +149,11 @@ void shutdown_server(server_t *srv)
     }
     srv->num_clients = 0;
 
-    if (srv->database) {
-        if (srv->database->store)
-            free_hash_table(srv->database->store);
-        if (srv->database->expires)
-            free_hash_table(srv->database->expires);
-        free(srv->database);
-        srv->database = NULL;
-    }
+    free_database(srv->database);
+    srv->database = NULL;
+    // Shards share the pool; the main thread frees it after they stop.
+    if (!srv->shard)
+        hashtable_free_shared_integers();
 
     if (srv->socket_domain == UNIX && srv->uds_socket_path) {
         unlink(srv->uds_socket_path);
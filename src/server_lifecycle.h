@@ -10,6 +10,10 @@ typedef struct client_t client_t;
 void request_server_shutdown(int sig);
 bool server_shutdown_requested(void);
 void reset_server_shutdown_request(void);
+// An empty keyspace set up per `srv` (maxmemory-policy, LFU settings) and
+// capped at `maxmemory` bytes; NULL on OOM.
+db_t *create_database(const server_t *srv, size_t maxmemory);
+void free_database(db_t *db);
 void server_drop_client(server_t *srv, client_t *client);
 void shutdown_server(server_t *srv);
 
@@ -0,0 +1,529 @@
+#ifdef __linux__
+
+#include "shard.h"
+#include "commands/common/command_defs.h"
+#include "commands/common/command_registry.h"
+#include "commands/common/frame.h"
+#include "commands/server/server_command_handlers.h"
+#include "main.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Slots per ring; a full ring spills into the sender's backlog.
+#define SHARD_RING_CAPACITY 1024
+
+typedef enum {
+    SHARD_RUN,   // run `frame`, then reply to `client` on shard `from`
+    SHARD_KEYS,  // list this shard's keys in `keys` for `gather`
+    SHARD_REPLY, // `reply` fills `client`'s deferred reply `ticket`
+} shard_msg_kind_t;
+
+// A KEYS reply being put together on the client's shard, from its own keys
+// and a listing from each other shard.
+typedef struct keys_gather_t {
+    keys_listing_t keys;
+    uint32_t ticket;  // see wbuf_defer_reply()
+    uint32_t pending; // listings still to come
+} keys_gather_t;
+
+struct shard_msg_t {
+    shard_msg_kind_t kind;
+    uint32_t from; // shard `client` is on
+    client_t *client;
+    uint32_t ticket;      // see wbuf_defer_reply()
+    bool quiet;           // the reply only says it ran: nothing goes out
+    bool failed;          // the reply could not be built: drop the client
+    unsigned char *frame; // inline_frame or a large frame it owns
+    size_t len;
+    size_t value_at;      // streamed SET: where its value was cut out
+    value_entry_t *value; // streamed SET: the value, see handle_streamed_set()
+    value_entry_t *reply;
+    keys_listing_t keys;
+    keys_gather_t *gather; // SHARD_KEYS: the reply it adds to
+    shard_msg_t *next;     // in a backlog
+    unsigned char inline_frame[];
+};
+
+// All shards, by id. Set up before the threads start and fixed after.
+static shard_t *shards;
+static uint32_t shard_count;
+
+static uint32_t shard_of(const uint64_t hash)
+{
+    // Tables index groups by the low bits: route by the high half.
+    return (uint32_t)(((hash >> 32) * shard_count) >> 32);
+}
+
+static shard_msg_t *new_msg(const shard_msg_kind_t kind,
+                            const size_t inline_len)
+{
+    shard_msg_t *msg = calloc(1, sizeof(*msg) + inline_len);
+    if (msg)
+        msg->kind = kind;
+    return msg;
+}
+
+static void free_msg(shard_msg_t *msg)
+{
+    if (msg->frame != msg->inline_frame)
+        free(msg->frame);
+    free(msg->value);
+    if (msg->reply)
+        value_entry_unpin(msg->reply);
+    free(msg->keys.buf);
+    free(msg);
+}
+
+void shard_wake(shard_t *shard)
+{
+    // Pairs with the fence in shard_drain(): either that drain sees what was
+    // pushed before this, or this sees wake_due cleared and signals again.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&shard->wake_due, true))
+        return;
+    const uint64_t one = 1;
+    while (write(shard->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+// Queue `msg` for shard `to`, behind anything already backlogged for it.
+static void send_msg(shard_t *self, const uint32_t to, shard_msg_t *msg)
+{
+    const uint64_t bit = 1ULL << to;
+    if (!(self->backlogged & bit) &&
+        spsc_ring_push(shards[to].inbox[self->id], msg)) {
+        self->bells |= bit;
+        return;
+    }
+
+    msg->next = NULL;
+    if (self->backlog_tail[to])
+        self->backlog_tail[to]->next = msg;
+    else
+        self->backlog_head[to] = msg;
+    self->backlog_tail[to] = msg;
+    self->backlogged |= bit;
+}
+
+// Hold `c`'s reply slot and have shard `to` run `msg` for it.
+static void send_for_client(shard_t *self, const uint32_t to, client_t *c,
+                            shard_msg_t *msg)
+{
+    if (!wbuf_defer_reply(c, &msg->ticket)) {
+        free_msg(msg);
+        c->write_failed = true;
+        return;
+    }
+    msg->from = self->id;
+    msg->client = c;
+    c->shard_inflight++;
+    send_msg(self, to, msg);
+}
+
+// FLUSHALL runs on every shard. The other shards' replies are dropped, but
+// the client's reply waits behind them, so once it arrives every shard has
+// flushed.
+static void flush_other_shards(shard_t *self, client_t *c,
+                               const unsigned char *frame, const size_t len)
+{
+    for (uint32_t to = 0; to < shard_count && !c->write_failed; to++) {
+        if (to == self->id)
+            continue;
+        shard_msg_t *msg = new_msg(SHARD_RUN, len);
+        if (!msg) {
+            c->write_failed = true;
+            return;
+        }
+        memcpy(msg->inline_frame, frame, len);
+        msg->frame = msg->inline_frame;
+        msg->len = len;
+        msg->quiet = true;
+        send_for_client(self, to, c, msg);
+    }
+}
+
+// KEYS lists this shard's keys now and asks every other shard for its own,
+// like FLUSHALL, so each shard lists its keys after the client's earlier
+// frames for it. deliver_keys() adds the listings as they come back.
+static bool gather_keys(shard_t *self, client_t *c)
+{
+    keys_gather_t *gather = calloc(1, sizeof(*gather));
+    shard_msg_t *msgs[FKVS_MAX_THREADS] = {0};
+    bool ok = gather && wbuf_defer_reply(c, &gather->ticket);
+    for (uint32_t to = 0; to < shard_count && ok; to++) {
+        if (to == self->id)
+            continue;
+        msgs[to] = new_msg(SHARD_KEYS, 0);
+        ok = msgs[to] != NULL;
+    }
+    if (!ok) {
+        for (uint32_t to = 0; to < shard_count; to++) {
+            if (msgs[to])
+                free_msg(msgs[to]);
+        }
+        free(gather);
+        c->write_failed = true;
+        return true;
+    }
+
+    keys_listing_collect(&gather->keys);
+    gather->pending = shard_count - 1;
+    for (uint32_t to = 0; to < shard_count; to++) {
+        shard_msg_t *msg = msgs[to];
+        if (!msg)
+            continue;
+        msg->from = self->id;
+        msg->client = c;
+        msg->gather = gather;
+        c->shard_inflight++;
+        send_msg(self, to, msg);
+    }
+    return true;
+}
+
+bool shard_route_frame(client_t *c, const unsigned char *frame,
+                       const size_t len, const uint64_t *hash)
+{
+    shard_t *self = server.shard;
+    if (hash) {
+        const uint32_t owner = shard_of(*hash);
+        if (owner == self->id)
+            return false;
+
+        shard_msg_t *msg = new_msg(SHARD_RUN, len);
+        if (!msg) {
+            c->write_failed = true;
+            return true;
+        }
+        memcpy(msg->inline_frame, frame, len);
+        msg->frame = msg->inline_frame;
+        msg->len = len;
+        send_for_client(self, owner, c, msg);
+        return true;
+    }
+
+    if (frame_is_long(frame) || len < FRAME_SHORT_HEADER_LEN + 1)
+        return false;
+    switch (frame[FRAME_SHORT_HEADER_LEN]) {
+    case CMD_FLUSHALL:
+        flush_other_shards(self, c, frame, len);
+        return c->write_failed; // else it runs here too
+    case CMD_KEYS:
+        // Anything else is malformed: the handler here answers it.
+        return len == FRAME_SHORT_HEADER_LEN + 1 && gather_keys(self, c);
+    default:
+        return false;
+    }
+}
+
+bool shard_route_large(client_t *c, unsigned char *frame, const size_t len,
+                       const size_t value_at, value_entry_t *value)
+{
+    shard_t *self = server.shard;
+    // prefetch_frame_key() is also what hashes a frame's key.
+    uint64_t hash;
+    if (!prefetch_frame_key(frame, len, &hash))
+        return false;
+    const uint32_t owner = shard_of(hash);
+    if (owner == self->id)
+        return false;
+
+    shard_msg_t *msg = new_msg(SHARD_RUN, 0);
+    if (!msg) {
+        free(frame);
+        free(value);
+        c->write_failed = true;
+        return true;
+    }
+    msg->frame = frame;
+    msg->len = len;
+    msg->value_at = value_at;
+    msg->value = value;
+    send_for_client(self, owner, c, msg);
+    return true;
+}
+
+// Send what the relay client queued back as `msg`'s reply.
+static void return_reply(shard_t *self, shard_msg_t *msg)
+{
+    bool failed;
+    value_entry_t *reply = wbuf_take_replies(self->relay, &failed);
+    if (msg->quiet) {
+        if (reply)
+            value_entry_unpin(reply);
+        reply = NULL;
+        failed = false;
+    }
+    msg->kind = SHARD_REPLY;
+    msg->reply = reply;
+    msg->failed = failed;
+    send_msg(self, msg->from, msg);
+}
+
+static void run_frame(shard_t *self, shard_msg_t *msg)
+{
+    if (msg->value) {
+        handle_streamed_set(self->relay, msg->frame, msg->len, msg->value_at,
+                            msg->value);
+        msg->value = NULL;
+    } else {
+        dispatch_command(self->relay, msg->frame, msg->len);
+    }
+    if (msg->frame != msg->inline_frame)
+        free(msg->frame);
+    msg->frame = NULL;
+    return_reply(self, msg);
+}
+
+static void collect_keys(shard_t *self, shard_msg_t *msg)
+{
+    keys_listing_collect(&msg->keys);
+    msg->kind = SHARD_REPLY;
+    send_msg(self, msg->from, msg);
+}
+
+// Fill `c`'s deferred reply `ticket`, or free `c` if it was dropped while
+// this was out (see server_drop_client()) and nothing else is.
+static void finish_reply(client_t *c, const uint32_t ticket,
+                         value_entry_t *reply, const bool failed,
+                         const shard_reply_fn on_reply, void *ctx)
+{
+    c->shard_inflight--;
+    if (c->shard_orphaned) {
+        if (reply)
+            value_entry_unpin(reply);
+        if (c->shard_inflight == 0)
+            free_client(c);
+        return;
+    }
+    if (failed)
+        c->write_failed = true;
+    wbuf_complete_reply(c, ticket, reply);
+    on_reply(c, ctx);
+}
+
+// Add a shard's listing to its KEYS reply; the last one sends it.
+static void deliver_keys(shard_t *self, shard_msg_t *msg,
+                         const shard_reply_fn on_reply, void *ctx)
+{
+    client_t *c = msg->client;
+    keys_gather_t *gather = msg->gather;
+    if (!c->shard_orphaned)
+        keys_listing_merge(&gather->keys, &msg->keys);
+    free_msg(msg);
+    if (--gather->pending > 0) {
+        c->shard_inflight--; // others are still out: `c` stays
+        return;
+    }
+
+    bool failed = false;
+    value_entry_t *reply = NULL;
+    if (c->shard_orphaned) {
+        free(gather->keys.buf);
+    } else {
+        send_keys_listing(self->relay, &gather->keys);
+        reply = wbuf_take_replies(self->relay, &failed);
+    }
+    const uint32_t ticket = gather->ticket;
+    free(gather);
+    finish_reply(c, ticket, reply, failed, on_reply, ctx);
+}
+
+static void deliver_reply(shard_t *self, shard_msg_t *msg,
+                          const shard_reply_fn on_reply, void *ctx)
+{
+    if (msg->gather) {
+        deliver_keys(self, msg, on_reply, ctx);
+        return;
+    }
+
+    client_t *c = msg->client;
+    value_entry_t *reply = msg->reply;
+    const uint32_t ticket = msg->ticket;
+    const bool failed = msg->failed;
+    msg->reply = NULL;
+    free_msg(msg);
+    finish_reply(c, ticket, reply, failed, on_reply, ctx);
+}
+
+void shard_drain(shard_t *self, const shard_reply_fn on_reply, void *ctx)
+{
+    atomic_store(&self->wake_due, false);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    bool more = false;
+    for (uint32_t from = 0; from < shard_count; from++) {
+        if (from == self->id)
+            continue;
+        // A ring's worth per sender and pass, so the loop gets back to its
+        // own clients; the rest wakes us again.
+        shard_msg_t *msg;
+        size_t budget = SHARD_RING_CAPACITY;
+        while (budget-- > 0 && (msg = spsc_ring_pop(self->inbox[from]))) {
+            switch (msg->kind) {
+            case SHARD_RUN:
+                run_frame(self, msg);
+                break;
+            case SHARD_KEYS:
+                collect_keys(self, msg);
+                break;
+            case SHARD_REPLY:
+                deliver_reply(self, msg, on_reply, ctx);
+                break;
+            }
+        }
+        if (budget == SIZE_MAX)
+            more = true;
+    }
+    if (more)
+        shard_wake(self);
+}
+
+bool shard_flush(shard_t *self)
+{
+    for (uint64_t pending = self->backlogged; pending;
+         pending &= pending - 1) {
+        const uint32_t to = (uint32_t)__builtin_ctzll(pending);
+        spsc_ring_t *ring = shards[to].inbox[self->id];
+        shard_msg_t *msg = self->backlog_head[to];
+        while (msg) {
+            // Once pushed, the message is the receiver's.
+            shard_msg_t *next = msg->next;
+            if (!spsc_ring_push(ring, msg))
+                break;
+            self->bells |= 1ULL << to;
+            msg = next;
+        }
+        self->backlog_head[to] = msg;
+        if (!msg) {
+            self->backlog_tail[to] = NULL;
+            self->backlogged &= ~(1ULL << to);
+        }
+    }
+
+    for (uint64_t bells = self->bells; bells; bells &= bells - 1)
+        shard_wake(&shards[__builtin_ctzll(bells)]);
+    self->bells = 0;
+    return self->backlogged != 0;
+}
+
+// A message that will never be handled; its client may be waiting on it.
+static void discard_msg(shard_msg_t *msg)
+{
+    client_t *c = msg->client;
+    keys_gather_t *gather = msg->gather;
+    free_msg(msg);
+    if (gather && --gather->pending == 0) {
+        free(gather->keys.buf);
+        free(gather);
+    }
+    if (c && --c->shard_inflight == 0 && c->shard_orphaned)
+        free_client(c);
+}
+
+void discard_shard_messages(void)
+{
+    for (uint32_t s = 0; s < shard_count; s++) {
+        shard_t *shard = &shards[s];
+        for (uint32_t other = 0; other < shard_count; other++) {
+            if (other == s)
+                continue;
+            shard_msg_t *msg;
+            while ((msg = spsc_ring_pop(shard->inbox[other])))
+                discard_msg(msg);
+            while ((msg = shard->backlog_head[other])) {
+                shard->backlog_head[other] = msg->next;
+                discard_msg(msg);
+            }
+            shard->backlog_tail[other] = NULL;
+        }
+        shard->backlogged = 0;
+        shard->bells = 0;
+    }
+}
+
+static bool init_shard(shard_t *shard, const uint32_t id)
+{
+    shard->id = id;
+    atomic_init(&shard->wake_due, false);
+    // Blocking, so io_uring can wait in a read. epoll reads it only once
+    // readable, and only this shard's thread reads it.
+    shard->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (shard->wake_fd == -1) {
+        perror("eventfd");
+        return false;
+    }
+
+    for (uint32_t from = 0; from < shard_count; from++) {
+        if (from == id)
+            continue;
+        shard->inbox[from] = spsc_ring_create(SHARD_RING_CAPACITY);
+        if (!shard->inbox[from])
+            return false;
+    }
+
+    // Replies queue on the relay and are taken from it, never sent; the fd
+    // only has to be valid for the send paths to queue anything.
+    const struct sockaddr_storage ss = {.ss_family = AF_UNSPEC};
+    shard->relay = init_client(-1, ss, TCP_IP);
+    if (!shard->relay)
+        return false;
+    shard->relay->fd = shard->wake_fd;
+    shard->relay->write_async = true;
+    shard->relay->zerocopy_refused = true;
+    return true;
+}
+
+shard_t *create_shards(const uint32_t count)
+{
+    if (count == 0 || count > FKVS_MAX_THREADS)
+        return NULL;
+
+    size_t size = count * sizeof(shard_t);
+    size = (size + SPSC_RING_CACHE_LINE - 1) &
+           ~(size_t)(SPSC_RING_CACHE_LINE - 1);
+    shards = aligned_alloc(SPSC_RING_CACHE_LINE, size);
+    if (!shards)
+        return NULL;
+    memset(shards, 0, size);
+    shard_count = count;
+    for (uint32_t i = 0; i < count; i++)
+        shards[i].wake_fd = -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!init_shard(&shards[i], i)) {
+            fprintf(stderr, "Failed to set up shard %u\n", i);
+            free_shards();
+            return NULL;
+        }
+    }
+    return shards;
+}
+
+void free_shards(void)
+{
+    if (!shards)
+        return;
+
+    for (uint32_t i = 0; i < shard_count; i++) {
+        shard_t *shard = &shards[i];
+        for (uint32_t from = 0; from < shard_count; from++)
+            spsc_ring_free(shard->inbox[from]);
+        if (shard->relay)
+            free_client(shard->relay);
+        if (shard->wake_fd >= 0)
+            close(shard->wake_fd);
+    }
+    free(shards);
+    shards = NULL;
+    shard_count = 0;
+}
+
+#endif // __linux__
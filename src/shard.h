@@ -0,0 +1,128 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "client.h"
+#include "core/hashtable.h"
+#include "core/spsc_ring.h"
+#include "server.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared-nothing reactor threads (`threads N`, Linux only).
+ *
+ * Each thread is a shard with its own thread-local server_t, its own
+ * listening socket on the shared port (SO_REUSEPORT, so the kernel spreads
+ * connections across shards), its own epoll or io_uring instance and its own
+ * keyspace. Threads are pinned to the CPUs the process may run on, in order.
+ *
+ * Each key belongs to one shard, picked from the high half of its hash. The
+ * tables place entries by the low bits, so each shard's table still spreads
+ * its keys evenly. A connection may land on any shard. A frame whose key lives
+ * elsewhere is copied to the owner over a lock-free SPSC ring (one for each
+ * ordered pair of shards) and runs there on a relay client. The reply comes
+ * back the same way and fills a deferred slot that the frame left in the
+ * client's reply queue (see wbuf_defer_reply()). A pipeline's replies
+ * therefore still go out in order while the client keeps sending. All frames
+ * for one key travel through the same ring, so they run in the order sent.
+ *
+ * Commands without a key run on the connection's shard, with two exceptions.
+ * FLUSHALL also runs on every other shard, and its reply waits until all of
+ * them are done. KEYS lists the connection's shard's keys and asks every other
+ * shard for its own over the same rings, so each shard lists its keys after
+ * the client's earlier frames for it. The listings are merged on the
+ * connection's shard. INFO describes the connection's shard only.
+ *
+ * Messages are pushed as frames run. The event loop calls shard_flush() once
+ * per pass, which wakes each destination through its eventfd unless that
+ * shard is already due to wake. A full ring is never waited on: messages
+ * queue in a backlog that shard_flush() retries, and while one remains the
+ * loop waits at most FKVS_EXPIRE_BACKLOG_WAIT_MS for events.
+ */
+
+typedef struct shard_msg_t shard_msg_t;
+
+typedef struct shard_t {
+    uint32_t id;
+    int wake_fd; // eventfd the event loop polls; signalled by other shards
+    spsc_ring_t *inbox[FKVS_MAX_THREADS]; // inbox[i]: from shard i
+    // Messages for shard i that found its ring full, oldest first.
+    shard_msg_t *backlog_head[FKVS_MAX_THREADS];
+    shard_msg_t *backlog_tail[FKVS_MAX_THREADS];
+    uint64_t backlogged; // bit i: backlog for shard i is not empty
+    uint64_t bells;      // bit i: pushed to shard i since the last flush
+    client_t *relay;     // runs the frames other shards send here
+    db_t *db;            // handed to the shard's thread when it starts
+    pthread_t thread;
+    int status; // run_event_loop() result
+    // Written by other shards: kept off the lines the owner writes.
+    _Alignas(SPSC_RING_CACHE_LINE) atomic_bool wake_due;
+} shard_t;
+
+#ifdef __linux__
+
+/*
+ * The shard group, set up before the reactor threads start (see
+ * shard_lifecycle.h) and fixed while they run. create_shards() allocates
+ * `count` shards with their rings, wake eventfds and relay clients; NULL on
+ * failure. Keyspaces are left to the caller. Once every shard's event loop
+ * has stopped, discard_shard_messages() releases whatever is still queued,
+ * including clients that were dropped while waiting for replies, and
+ * free_shards() frees the group. shard_wake() signals a shard's wake_fd
+ * unless it is already due to wake.
+ */
+shard_t *create_shards(uint32_t count);
+void discard_shard_messages(void);
+void free_shards(void);
+void shard_wake(shard_t *shard);
+
+/*
+ * Frame routing for networking.c, used only while `server.shard` is set.
+ * True when the frame was taken over by another shard, or by all of them, and
+ * must not run here. shard_route_frame() copies the frame; `hash` is its key's
+ * hash (see prefetch_frame_key()), NULL if it has none.
+ * shard_route_large() takes an assembled frame (and a streamed SET's value,
+ * see handle_streamed_set()) as it is; both are owned by the call when it
+ * returns true. Either one sets write_failed on OOM.
+ */
+bool shard_route_frame(client_t *c, const unsigned char *frame, size_t len,
+                       const uint64_t *hash);
+bool shard_route_large(client_t *c, unsigned char *frame, size_t len,
+                       size_t value_at, value_entry_t *value);
+
+/*
+ * Event loop side. Once `wake_fd` is readable and has been read,
+ * shard_drain() runs every message queued for this shard. `on_reply` is called
+ * for each local client whose deferred reply arrived, so that the dispatcher
+ * can send it (or drop the client if write_failed is set). shard_flush()
+ * pushes backlogged messages and wakes their destinations. It returns true
+ * while a backlog remains.
+ */
+typedef void (*shard_reply_fn)(client_t *client, void *ctx);
+void shard_drain(shard_t *shard, shard_reply_fn on_reply, void *ctx);
+bool shard_flush(shard_t *shard);
+
+#else
+
+static inline bool shard_route_frame(client_t *c, const unsigned char *frame,
+                                     size_t len, const uint64_t *hash)
+{
+    (void)c, (void)frame, (void)len, (void)hash;
+    return false;
+}
+
+static inline bool shard_route_large(client_t *c, unsigned char *frame,
+                                     size_t len, size_t value_at,
+                                     value_entry_t *value)
+{
+    (void)c, (void)frame, (void)len, (void)value_at, (void)value;
+    return false;
+}
+
+#endif // __linux__
+
+#endif // SHARD_H
@@ -0,0 +1,170 @@
+#ifdef __linux__
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pthread_setaffinity_np()
+#endif
+
+#include "shard_lifecycle.h"
+#include "commands/server/server_command_handlers.h"
+#include "core/list.h"
+#include "io/event_dispatcher.h"
+#include "main.h"
+#include "networking/networking.h"
+#include "server_lifecycle.h"
+#include "shard.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static shard_t *shards;
+static uint32_t shard_count;
+static server_t shard_config; // the main thread's `server`, copied by each
+static pthread_t main_thread;
+static pthread_barrier_t shards_stopped;
+static pthread_barrier_t shards_drained;
+
+// Shard `id` takes the id-th CPU this process may run on (wrapping).
+static void pin_to_cpu(const uint32_t id)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    const int cpus = CPU_COUNT(&allowed);
+    if (cpus <= 0)
+        return;
+
+    int nth = (int)(id % (uint32_t)cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || nth-- > 0)
+            continue;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(one), &one) != 0)
+            WARN("Failed to pin a reactor thread to its CPU");
+        return;
+    }
+}
+
+static void *shard_main(void *arg)
+{
+    shard_t *self = arg;
+    pin_to_cpu(self->id);
+
+    server = shard_config;
+    server.shard = self;
+    server.shard_id = self->id;
+    server.database = self->db;
+    self->db = NULL;
+    server.fd = -1;
+    // The main thread's copy frees these.
+    server.owns_bind_address = false;
+    server.owns_uds_socket_path = false;
+    server.max_clients =
+        (shard_config.max_clients + shard_count - 1) / shard_count;
+    server.clients = listCreate();
+    fkvs_clock_init(server.clock_source, true);
+    bind_command_handlers(server.database);
+
+    self->status = -1;
+    if (server.clients && start_server() != -1)
+        self->status = run_event_loop();
+
+    // One shard stopping stops them all.
+    if (!server_shutdown_requested())
+        pthread_kill(main_thread, SIGTERM);
+
+    // Nothing is queued or pushed once every loop has stopped, so one thread
+    // can release what is left before each frees its own clients.
+    if (pthread_barrier_wait(&shards_stopped) == PTHREAD_BARRIER_SERIAL_THREAD)
+        discard_shard_messages();
+    pthread_barrier_wait(&shards_drained);
+    shutdown_server(&server);
+    return NULL;
+}
+
+// Every shard's keyspace, made here: tables share a lazily seeded hash (see
+// hashtable.h), so the first one must not be created by several threads.
+static bool create_shard_databases(void)
+{
+    size_t maxmemory = shard_config.maxmemory / shard_count;
+    if (shard_config.maxmemory > 0 && maxmemory == 0)
+        maxmemory = 1;
+
+    for (uint32_t i = 0; i < shard_count; i++) {
+        shards[i].db = create_database(&shard_config, maxmemory);
+        if (!shards[i].db)
+            return false;
+    }
+    return true;
+}
+
+static void free_shard_databases(void)
+{
+    for (uint32_t i = 0; i < shard_count; i++) {
+        free_database(shards[i].db);
+        shards[i].db = NULL;
+    }
+}
+
+int run_shards(void)
+{
+    shard_count = server.threads;
+    shard_config = server;
+    main_thread = pthread_self();
+
+    // Blocked before any thread starts (lazyfree's too), so that only this
+    // thread takes them, in sigwait().
+    sigset_t stop_signals;
+    sigset_t previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+
+    shards = create_shards(shard_count);
+    if (!shards || !create_shard_databases()) {
+        fprintf(stderr, "Failed to set up %u shards\n", shard_count);
+        if (shards)
+            free_shard_databases();
+        free_shards();
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+        return -1;
+    }
+
+    // A shard that is missing would leave the others at the barriers.
+    if (pthread_barrier_init(&shards_stopped, NULL, shard_count) != 0 ||
+        pthread_barrier_init(&shards_drained, NULL, shard_count) != 0)
+        ERROR_AND_EXIT("Failed to set up the reactor threads");
+    for (uint32_t i = 0; i < shard_count; i++) {
+        if (pthread_create(&shards[i].thread, NULL, shard_main, &shards[i]) !=
+            0)
+            ERROR_AND_EXIT("Failed to start the reactor threads");
+    }
+
+    int sig;
+    sigwait(&stop_signals, &sig);
+    request_server_shutdown(sig);
+    for (uint32_t i = 0; i < shard_count; i++)
+        shard_wake(&shards[i]);
+
+    int status = 0;
+    for (uint32_t i = 0; i < shard_count; i++) {
+        pthread_join(shards[i].thread, NULL);
+        if (shards[i].status != 0)
+            status = -1;
+    }
+    pthread_barrier_destroy(&shards_stopped);
+    pthread_barrier_destroy(&shards_drained);
+
+    free_shards();
+    shards = NULL;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return status;
+}
+
+#endif // __linux__
@@ -0,0 +1,21 @@
+#ifndef SHARD_LIFECYCLE_H
+#define SHARD_LIFECYCLE_H
+
+/*
+ * Starts `server.threads` reactor threads from the loaded config (the main
+ * thread's `server`). Each one owns a shard (see shard.h), pinned to the CPUs
+ * the process may run on, in order. max-clients and maxmemory are split
+ * evenly between the shards. The calling thread only waits for SIGINT or
+ * SIGTERM and then stops them all. Returns once every shard has stopped: -1
+ * if one could not start or its event loop failed, 0 otherwise.
+ */
+#ifdef __linux__
+int run_shards(void);
+#else
+static inline int run_shards(void)
+{
+    return -1;
+}
+#endif
+
+#endif // SHARD_LIFECYCLE_H
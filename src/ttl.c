@@ -1,109 +1,269 @@
 #include "ttl.h"
 #include "utils.h"
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-bool set_expiry(hashtable_t *expires, const unsigned char *key, size_t key_len,
-                int64_t deadline_ms)
+#define EXPIRE_KEYS_PER_CLOCK 32 // keys deleted between clock reads
+
+/*
+ * One per tracked key, referenced from its `keys` entry (whose value is the
+ * item pointer). The item points back at that entry for the key bytes and
+ * hash instead of copying them: index entries are never overwritten, so they
+ * are never reallocated, and resizes do not move entries.
+ */
+typedef struct expiry_item {
+    timer_wheel_node_t node;
+    const hash_table_entry_t *indexed;
+} expiry_item_t;
+
+static inline expiry_item_t *item_of(timer_wheel_node_t *node)
 {
-    unsigned char buf[8];
-    buf[0] = (deadline_ms >> 56) & 0xFF;
-    buf[1] = (deadline_ms >> 48) & 0xFF;
-    buf[2] = (deadline_ms >> 40) & 0xFF;
-    buf[3] = (deadline_ms >> 32) & 0xFF;
-    buf[4] = (deadline_ms >> 24) & 0xFF;
-    buf[5] = (deadline_ms >> 16) & 0xFF;
-    buf[6] = (deadline_ms >> 8) & 0xFF;
-    buf[7] = deadline_ms & 0xFF;
+    return (expiry_item_t *)(void *)((unsigned char *)node -
+                                     offsetof(expiry_item_t, node));
+}
 
-    return set_value(expires, key, key_len, buf, sizeof(buf),
-                     VALUE_ENTRY_TYPE_INT);
+static expiry_item_t *find_item(expiry_index_t *expires,
+                                const unsigned char *key, size_t key_len)
+{
+    const value_entry_t *value = lookup_value(expires->keys, key, key_len);
+    if (!value)
+        return NULL;
+    expiry_item_t *item;
+    memcpy(&item, value->data, sizeof(item));
+    return item;
 }
 
-static bool get_deadline(hashtable_t *expires, const unsigned char *key,
-                         size_t key_len, int64_t *deadline_out)
+// Forget a popped or unlinked item: drop its index entry and free it.
+static void discard_item(expiry_index_t *expires, expiry_item_t *item)
 {
-    const value_entry_t *val = lookup_value(expires, key, key_len);
-    if (!val || val->value_len != 8)
-        return false;
+    const hash_table_entry_t *indexed = item->indexed;
+    delete_value_hashed(expires->keys, indexed->key, indexed->key_len,
+                        indexed->hash);
+    free(item);
+}
+
+expiry_index_t *create_expiry_index(size_t size)
+{
+    expiry_index_t *expires = calloc(1, sizeof(*expires));
+    if (!expires)
+        return NULL;
+    expires->keys = create_hash_table(size);
+    if (!expires->keys) {
+        free(expires);
+        return NULL;
+    }
+    timer_wheel_init(&expires->wheel, fkvs_now_ms());
+    return expires;
+}
 
-    const unsigned char *b = val->ptr;
-    *deadline_out = ((int64_t)b[0] << 56) | ((int64_t)b[1] << 48) |
-                    ((int64_t)b[2] << 40) | ((int64_t)b[3] << 32) |
-                    ((int64_t)b[4] << 24) | ((int64_t)b[5] << 16) |
-                    ((int64_t)b[6] << 8) | (int64_t)b[7];
+void free_expiry_index(expiry_index_t *expires)
+{
+    if (!expires)
+        return;
+
+    const size_t slots = hashtable_slot_count(expires->keys);
+    for (size_t i = 0; i < slots; i++) {
+        const hash_table_entry_t *entry =
+            hashtable_slot_entry(expires->keys, i);
+        if (!entry)
+            continue;
+        expiry_item_t *item;
+        memcpy(&item, entry->value->data, sizeof(item));
+        free(item);
+    }
+    free_hash_table(expires->keys);
+    free(expires);
+}
+
+expiry_index_t *expiry_index_detach(expiry_index_t *expires)
+{
+    expiry_index_t *detached = calloc(1, sizeof(*detached));
+    if (!detached)
+        return NULL;
+    detached->keys = hashtable_detach(expires->keys);
+    if (!detached->keys) {
+        free(detached);
+        return NULL;
+    }
+    // Freeing walks `keys`, not the wheel, so the detached wheel stays empty.
+    timer_wheel_init(&detached->wheel, 0);
+    timer_wheel_init(&expires->wheel, fkvs_now_ms());
+    expires->backlog = false;
+    return detached;
+}
+
+size_t expiry_index_memory(const expiry_index_t *expires)
+{
+    return hashtable_used_memory(expires->keys) +
+           expires->wheel.count * sizeof(expiry_item_t);
+}
+
+bool track_expiry(expiry_index_t *expires, const unsigned char *key,
+                  size_t key_len, int64_t deadline_ms)
+{
+    expiry_item_t *item = find_item(expires, key, key_len);
+    if (item) {
+        timer_wheel_remove(&expires->wheel, &item->node);
+        timer_wheel_add(&expires->wheel, &item->node, deadline_ms);
+        return true;
+    }
+
+    item = malloc(sizeof(*item));
+    if (!item)
+        return false;
+    if (!set_value(expires->keys, key, key_len, &item, sizeof(item),
+                   VALUE_ENTRY_TYPE_RAW)) {
+        free(item);
+        return false;
+    }
+    item->indexed = lookup_entry(expires->keys, key, key_len);
+    timer_wheel_add(&expires->wheel, &item->node, deadline_ms);
     return true;
 }
 
-bool remove_expiry(hashtable_t *expires, const unsigned char *key,
-                   size_t key_len)
+void untrack_expiry(expiry_index_t *expires, const unsigned char *key,
+                    size_t key_len)
 {
-    return delete_value(expires, key, key_len);
+    expiry_item_t *item = find_item(expires, key, key_len);
+    if (!item)
+        return;
+    timer_wheel_remove(&expires->wheel, &item->node);
+    discard_item(expires, item);
 }
 
-bool is_expired(hashtable_t *expires, const unsigned char *key, size_t key_len)
+bool set_expiry(hashtable_t *store, expiry_index_t *expires,
+                const unsigned char *key, size_t key_len, int64_t deadline_ms)
 {
-    int64_t deadline;
-    if (!get_deadline(expires, key, key_len, &deadline))
+    // Track first: if that fails nothing has changed. If setting the deadline
+    // then fails, the drain discards the item when it comes due.
+    if (!track_expiry(expires, key, key_len, deadline_ms))
         return false;
+    return hashtable_set_deadline(store, key, key_len, deadline_ms);
+}
 
-    return deadline <= fkvs_now_ms();
+bool remove_expiry(hashtable_t *store, expiry_index_t *expires,
+                   const unsigned char *key, size_t key_len)
+{
+    untrack_expiry(expires, key, key_len);
+    return hashtable_set_deadline(store, key, key_len, HASHTABLE_NO_DEADLINE);
 }
 
-int64_t get_ttl(hashtable_t *expires, const unsigned char *key, size_t key_len)
+bool is_expired(const hash_table_entry_t *entry)
 {
-    int64_t deadline;
-    if (!get_deadline(expires, key, key_len, &deadline))
+    return entry->expirable &&
+           hashtable_entry_deadline(entry) <= fkvs_now_ms();
+}
+
+int64_t get_ttl(const hash_table_entry_t *entry)
+{
+    if (!entry)
         return -2;
+    if (!entry->expirable)
+        return -1;
 
-    int64_t remaining_ms = deadline - fkvs_now_ms();
+    int64_t remaining_ms = hashtable_entry_deadline(entry) - fkvs_now_ms();
     if (remaining_ms <= 0)
         return 0;
 
     return remaining_ms / 1000;
 }
 
-size_t expire_sweep(hashtable_t *store, hashtable_t *expires,
-                    size_t sample_count)
+static int64_t monotonic_us(void)
 {
-    static size_t cursor = 0;
-    size_t deleted = 0;
-    const int64_t now = fkvs_now_ms();
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-    // Treat both sub-tables as one contiguous bucket space so a resize in
-    // progress is sampled too (size[1] is 0 when not resizing).
-    const size_t total = expires->size[0] + expires->size[1];
-    if (total == 0)
+size_t expire_due_keys(hashtable_t *store, expiry_index_t *expires,
+                       int64_t budget_us)
+{
+    if (budget_us <= 0 || expires->wheel.count == 0) {
+        expires->backlog = false;
         return 0;
+    }
+
+    const int64_t now = fkvs_now_ms();
+    const int64_t start = monotonic_us();
+    const int64_t stop = start + budget_us;
+    // Reuse the index's cached hash when both tables hash alike (the normal
+    // case) rather than hashing the key again for the keyspace.
+    const bool same_hash = store->hash_fn == expires->keys->hash_fn &&
+                           store->seed == expires->keys->seed;
+    size_t deleted = 0;
+    size_t visited = 0;
+    bool timed_out = false;
+
+    timer_wheel_node_t *node;
+    while ((node = timer_wheel_pop_due(&expires->wheel, now))) {
+        expiry_item_t *item = item_of(node);
+        const hash_table_entry_t *indexed = item->indexed;
+        const uint64_t hash =
+            same_hash ? indexed->hash
+                      : hashtable_hash_key(store, indexed->key,
+                                           indexed->key_len);
+        const hash_table_entry_t *entry = hashtable_peek_entry_hashed(
+            store, indexed->key, indexed->key_len, hash);
+        const int64_t deadline =
+            entry ? hashtable_entry_deadline(entry) : HASHTABLE_NO_DEADLINE;
 
-    for (size_t i = 0; i < sample_count; i++) {
-        const size_t pos = (cursor + i) % total;
-        hash_table_entry_t *entry =
-            pos < expires->size[0]
-                ? expires->buckets[0][pos]
-                : expires->buckets[1][pos - expires->size[0]];
-
-        while (entry) {
-            hash_table_entry_t *next = entry->next;
-
-            if (entry->value && entry->value->value_len == 8) {
-                const unsigned char *b = entry->value->ptr;
-                int64_t deadline =
-                    ((int64_t)b[0] << 56) | ((int64_t)b[1] << 48) |
-                    ((int64_t)b[2] << 40) | ((int64_t)b[3] << 32) |
-                    ((int64_t)b[4] << 24) | ((int64_t)b[5] << 16) |
-                    ((int64_t)b[6] << 8) | (int64_t)b[7];
-
-                if (deadline <= now) {
-                    delete_value(store, entry->key, entry->key_len);
-                    delete_value(expires, entry->key, entry->key_len);
-                    deleted++;
-                }
+        if (deadline != HASHTABLE_NO_DEADLINE && deadline > now) {
+            // The key's deadline moved without the index (a failed or
+            // partial update): follow it.
+            timer_wheel_add(&expires->wheel, node, deadline);
+        } else {
+            if (deadline != HASHTABLE_NO_DEADLINE) {
+                const int64_t lag = now - deadline;
+                expires->lag_total_ms += (uint64_t)lag;
+                if (lag > expires->lag_max_ms)
+                    expires->lag_max_ms = lag;
+                delete_value_hashed(store, indexed->key, indexed->key_len,
+                                    hash);
+                expires->expired_active++;
+                deleted++;
             }
+            // Expired, or the key is gone or no longer has a deadline.
+            discard_item(expires, item);
+        }
 
-            entry = next;
+        if (++visited % EXPIRE_KEYS_PER_CLOCK == 0 &&
+            monotonic_us() >= stop) {
+            timed_out = true;
+            break;
         }
     }
 
-    cursor = (cursor + sample_count) % total;
+    // A cycle that stops on its budget most likely left keys due; clearing
+    // the flag waits for one that drains them all.
+    expires->backlog = timed_out;
+    if (timed_out)
+        expires->time_cap_hits++;
+    if (visited > 0)
+        expires->cycle_time_us += (uint64_t)(monotonic_us() - start);
     return deleted;
 }
+
+size_t expire_slow_cycle(hashtable_t *store, expiry_index_t *expires,
+                         const int cpu_percent, const int64_t tick_us)
+{
+    if (cpu_percent <= 0 || expires->wheel.count == 0) {
+        expires->backlog = false;
+        return 0;
+    }
+    expires->slow_cycles++;
+    return expire_due_keys(store, expires, tick_us * cpu_percent / 100);
+}
+
+size_t expire_fast_cycle(hashtable_t *store, expiry_index_t *expires)
+{
+    if (!expires->backlog)
+        return 0;
+    const int64_t now_us = monotonic_us();
+    if (now_us - expires->last_fast_cycle_us < 2 * EXPIRE_FAST_CYCLE_US)
+        return 0;
+    expires->last_fast_cycle_us = now_us;
+    expires->fast_cycles++;
+    return expire_due_keys(store, expires, EXPIRE_FAST_CYCLE_US);
+}
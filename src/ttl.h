@@ -2,23 +2,87 @@
 #define TTL_H
 
 #include "core/hashtable.h"
+#include "core/timer_wheel.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-bool set_expiry(hashtable_t *expires, const unsigned char *key,
-                size_t key_len, int64_t deadline_ms);
+/*
+ * Key expiry. A key's deadline lives inline with its entry in the keyspace
+ * (`store`), so lazy expiry and TTL reads cost no extra lookup. The expiry
+ * index tracks which keys have deadlines for active expiry:
+ *   - `keys` maps each tracked key to its expiry item (so a new EXPIRE moves
+ *     the existing item instead of adding another);
+ *   - `wheel` orders the items by deadline, so each timer tick drains exactly
+ *     the keys that are due, earliest first, within a time budget.
+ * DEL, PERSIST and lazy expiry untrack a key immediately. A plain SET that
+ * drops a deadline leaves the item in place until it comes due, when the drain
+ * finds the key persistent and discards it.
+ */
+typedef struct expiry_index {
+    hashtable_t *keys;
+    timer_wheel_t wheel;
+    uint64_t expired_active; // keys deleted by expire_due_keys()
+    uint64_t expired_lazy;   // keys deleted when touched after their deadline
+    uint64_t lag_total_ms;   // sum of (deletion time - deadline), active only
+    int64_t lag_max_ms;
+    uint64_t slow_cycles;     // timer-tick cycles run with keys tracked
+    uint64_t fast_cycles;     // between-tick cycles run to clear a backlog
+    uint64_t cycle_time_us;   // time spent in both kinds of cycle
+    uint64_t time_cap_hits;   // cycles stopped by their budget
+    int64_t last_fast_cycle_us;
+    bool backlog; // the last cycle ran out of time with keys still due
+} expiry_index_t;
 
-bool remove_expiry(hashtable_t *expires, const unsigned char *key,
-                   size_t key_len);
+expiry_index_t *create_expiry_index(size_t size);
+void free_expiry_index(expiry_index_t *expires);
+// Empty `expires` (see hashtable_detach()), keeping its counters. Returns an
+// index holding every tracked key, for free_expiry_index(); NULL on OOM.
+expiry_index_t *expiry_index_detach(expiry_index_t *expires);
+// Bytes held by the index: its table plus one timer per tracked key.
+size_t expiry_index_memory(const expiry_index_t *expires);
 
-bool is_expired(hashtable_t *expires, const unsigned char *key,
-                size_t key_len);
+bool set_expiry(hashtable_t *store, expiry_index_t *expires,
+                const unsigned char *key, size_t key_len,
+                int64_t deadline_ms);
+// Track `key` as due at `deadline_ms` without touching the keyspace; for
+// callers that store the value and deadline together (SET EX).
+bool track_expiry(expiry_index_t *expires, const unsigned char *key,
+                  size_t key_len, int64_t deadline_ms);
+void untrack_expiry(expiry_index_t *expires, const unsigned char *key,
+                    size_t key_len);
 
-int64_t get_ttl(hashtable_t *expires, const unsigned char *key,
-                size_t key_len);
+bool remove_expiry(hashtable_t *store, expiry_index_t *expires,
+                   const unsigned char *key, size_t key_len);
 
-size_t expire_sweep(hashtable_t *store, hashtable_t *expires,
-                    size_t sample_count);
+// True if `entry` has a deadline that has passed.
+bool is_expired(const hash_table_entry_t *entry);
+
+// Seconds left; -1 for a key without a deadline, -2 for NULL (absent key).
+int64_t get_ttl(const hash_table_entry_t *entry);
+
+/*
+ * Active expiry: delete keys whose deadline has passed, in deadline order,
+ * until none are due or about `budget_us` microseconds have been spent.
+ * Returns the number of keys deleted.
+ */
+size_t expire_due_keys(hashtable_t *store, expiry_index_t *expires,
+                       int64_t budget_us);
+
+/*
+ * Adaptive expire cycle, after Redis's activeExpireCycle. The timing wheel
+ * yields only keys that are due, so there is no sampling: a cycle runs until
+ * nothing is due or its budget is spent. A slow cycle runs every timer tick
+ * with a budget of `cpu_percent` of the tick. A cycle that hits its budget
+ * leaves `backlog` set. The event loop then runs fast cycles between ticks:
+ * each one gets EXPIRE_FAST_CYCLE_US and runs at most once every two such
+ * periods. Fast cycles continue until a cycle drains every due key, as after
+ * a bulk-loaded keyset sharing one TTL.
+ */
+#define EXPIRE_FAST_CYCLE_US 1000
+
+size_t expire_slow_cycle(hashtable_t *store, expiry_index_t *expires,
+                         int cpu_percent, int64_t tick_us);
+size_t expire_fast_cycle(hashtable_t *store, expiry_index_t *expires);
 
 #endif // TTL_H
@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include "client.h"
+#include "clock.h"
 #include "main.h"
 #include "server.h"
 #include <inttypes.h>
@@ -12,13 +13,6 @@
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
-static inline int64_t fkvs_now_ms(void)
-{
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
-}
-
 static inline void error_and_exit(const char *ctx, const char *file,
                                   const int line)
 {
@@ -57,8 +51,10 @@ static inline void log_std_out(char *ctx)
 {
     const time_t ct = time(NULL);
     char ts[32];
+    struct tm tm;
 
-    strftime(ts, sizeof ts, "%Y-%m-%d %H:%M:%S", localtime(&ct));
+    // localtime_r(): reactor threads log concurrently (see shard.h).
+    strftime(ts, sizeof ts, "%Y-%m-%d %H:%M:%S", localtime_r(&ct, &tm));
 
     fprintf(stdout, "%s - %s \n", ts, ctx);
 }
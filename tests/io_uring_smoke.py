@@ -12,6 +12,7 @@ import time
 CMD_SET = 0x01
 CMD_GET = 0x02
 CMD_PING = 0x05
+CMD_INFO = 0x07
 STATUS_FAILURE = 0x00
 STATUS_SUCCESS = 0x01
 
@@ -22,6 +23,12 @@ def build_set(key: bytes, value: bytes) -> bytes:
     return struct.pack(">H", len(core)) + core
 
 
+def build_long_set(key: bytes, value: bytes) -> bytes:
+    core = bytes([CMD_SET]) + struct.pack(">H", len(key)) + key
+    core += struct.pack(">I", len(value)) + value
+    return b"\xff\xff" + struct.pack(">I", len(core)) + core
+
+
 def build_get(key: bytes) -> bytes:
     core = bytes([CMD_GET]) + struct.pack(">H", len(key)) + key
     return struct.pack(">H", len(core)) + core
@@ -46,7 +53,10 @@ def read_exact(sock: socket.socket, size: int) -> bytes:
 
 def read_frame(sock: socket.socket) -> bytes:
     header = read_exact(sock, 2)
-    (core_len,) = struct.unpack(">H", header)
+    if header == b"\xff\xff":
+        (core_len,) = struct.unpack(">I", read_exact(sock, 4))
+    else:
+        (core_len,) = struct.unpack(">H", header)
     return read_exact(sock, core_len)
 
 
@@ -59,6 +69,19 @@ def expect_success_value(sock: socket.socket, expected: bytes) -> None:
     assert value_len == len(expected), frame
 
 
+def expect_long_success_value(sock: socket.socket, expected: bytes) -> None:
+    frame = read_frame(sock)
+    assert frame[0] == STATUS_SUCCESS, frame[:16]
+    (value_len,) = struct.unpack(">I", frame[1:5])
+    assert value_len == len(expected), value_len
+    assert frame[5:] == expected, "long value mismatch"
+
+
+def expect_ok(sock: socket.socket) -> None:
+    frame = read_frame(sock)
+    assert frame == bytes([STATUS_SUCCESS]), frame
+
+
 def expect_ping(sock: socket.socket, expected: bytes) -> None:
     frame = read_frame(sock)
     assert frame[0] == CMD_PING, frame
@@ -86,6 +109,18 @@ def expect_disconnect(sock: socket.socket) -> None:
     raise AssertionError("server did not close malformed connection")
 
 
+def connected_clients(port: int) -> int:
+    # INFO's count, less the connection asking.
+    with socket.create_connection(("127.0.0.1", port), timeout=2) as sock:
+        sock.settimeout(2)
+        sock.sendall(struct.pack(">H", 1) + bytes([CMD_INFO]))
+        info = read_frame(sock).decode(errors="replace")
+    for line in info.splitlines():
+        if line.startswith("connected clients:"):
+            return int(line.split(":")[1]) - 1
+    raise AssertionError("INFO has no client count")
+
+
 def unused_port() -> int:
     with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
         sock.bind(("127.0.0.1", 0))
@@ -142,11 +177,15 @@ def stop_server(proc: subprocess.Popen, print_output: bool = False) -> None:
 
 
 def main() -> int:
-    if len(sys.argv) != 2:
-        print("usage: io_uring_smoke.py /path/to/fkvs-server", file=sys.stderr)
+    if len(sys.argv) not in (2, 3):
+        print(
+            "usage: io_uring_smoke.py /path/to/fkvs-server [io-uring-mode]",
+            file=sys.stderr,
+        )
         return 2
 
     server_path = sys.argv[1]
+    mode = sys.argv[2] if len(sys.argv) == 3 else "default"
     port = unused_port()
     config = (
         f"port {port}\n"
@@ -157,6 +196,8 @@ def main() -> int:
         "verbose false\n"
         "daemonize false\n"
         "use-io-uring true\n"
+        f"io-uring-mode {mode}\n"
+        "io-uring-sqpoll-idle-ms 10\n"
     )
 
     with tempfile.NamedTemporaryFile("w", delete=False) as cfg:
@@ -185,10 +226,69 @@ def main() -> int:
             expect_success_value(sock, b"one")
             expect_ping(sock, b"probe")
 
+        # Values many receive buffers long, in and out, and pipelined
+        # clients sharing the buffer ring.
+        big = bytes(range(256)) * 1200
+        with socket.create_connection(("127.0.0.1", port), timeout=2) as sock:
+            sock.settimeout(2)
+            sock.sendall(build_long_set(b"big", big) + build_get(b"big"))
+            expect_ok(sock)
+            expect_long_success_value(sock, big)
+
+        clients = [
+            socket.create_connection(("127.0.0.1", port), timeout=2)
+            for _ in range(8)
+        ]
+        try:
+            for n, sock in enumerate(clients):
+                sock.settimeout(2)
+                batch = b"".join(
+                    build_set(b"k%d:%d" % (n, i), b"v%d" % i)
+                    + build_get(b"k%d:%d" % (n, i))
+                    for i in range(200)
+                )
+                sock.sendall(batch)
+            for sock in clients:
+                for i in range(200):
+                    expect_success_value(sock, b"v%d" % i)
+                    expect_success_value(sock, b"v%d" % i)
+        finally:
+            for sock in clients:
+                sock.close()
+
+        # Leaving with a large reply still queued.
+        with socket.create_connection(("127.0.0.1", port), timeout=2) as sock:
+            sock.sendall(build_get(b"big") * 4)
+
+        # Dropped while a large send waits on a peer that stopped reading:
+        # cancelling the send must still free the client.
+        huge = big * 4
+        with socket.create_connection(("127.0.0.1", port), timeout=2) as sock:
+            sock.settimeout(2)
+            sock.sendall(build_long_set(b"huge", huge))
+            expect_ok(sock)
+        idle = connected_clients(port)
+        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as stalled:
+            stalled.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+            stalled.connect(("127.0.0.1", port))
+            try:
+                for _ in range(8):
+                    stalled.sendall(build_get(b"huge"))
+                    time.sleep(0.05)
+                # Over proto-max-bulk-len, as below.
+                stalled.sendall(b"\xff\xff" * 3)
+            except (BrokenPipeError, ConnectionResetError):
+                pass
+            deadline = time.monotonic() + 2
+            while connected_clients(port) != idle:
+                assert time.monotonic() < deadline, "dropped client not freed"
+                time.sleep(0.05)
+
         with socket.create_connection(("127.0.0.1", port), timeout=2) as bad:
             bad.settimeout(2)
             try:
-                bad.sendall(b"\xff\xff" + (b"\x01" * (65536 - 2)))
+                # A long frame header claiming 4 GiB, over proto-max-bulk-len.
+                bad.sendall(b"\xff\xff" * 3 + (b"\x01" * (65536 - 6)))
             except (BrokenPipeError, ConnectionResetError):
                 pass
             expect_disconnect(bad)
@@ -0,0 +1,60 @@
+#include "../src/clock.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+static int64_t realtime_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(const long ms)
+{
+    const struct timespec ts = {0, ms * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static void test_uncached_clock_reads_wall_time(void)
+{
+    assert(!fkvs_clock.cached);
+    const int64_t before = realtime_ms();
+    const int64_t now = fkvs_now_ms();
+    assert(now >= before && now <= realtime_ms());
+    printf("test_uncached_clock_reads_wall_time passed.\n");
+}
+
+static void test_cached_clock_moves_only_on_update(void)
+{
+    fkvs_clock_init(FKVS_CLOCK_REALTIME, true);
+    const int64_t first = fkvs_now_ms();
+    sleep_ms(5);
+    assert(fkvs_now_ms() == first);
+
+    const int64_t updated = fkvs_clock_update();
+    assert(updated >= first + 5);
+    assert(fkvs_now_ms() == updated);
+    printf("test_cached_clock_moves_only_on_update passed.\n");
+}
+
+static void test_monotonic_source_tracks_wall_time(void)
+{
+    fkvs_clock_init(FKVS_CLOCK_MONOTONIC, false);
+    // Same epoch as the wall clock, give or take the offset sampling.
+    const int64_t wall = realtime_ms();
+    const int64_t mono = fkvs_now_ms();
+    assert(mono >= wall - 2 && mono <= wall + 2);
+
+    sleep_ms(5);
+    assert(fkvs_now_ms() >= mono + 5);
+    printf("test_monotonic_source_tracks_wall_time passed.\n");
+}
+
+int main(void)
+{
+    test_uncached_clock_reads_wall_time();
+    test_cached_clock_moves_only_on_update();
+    test_monotonic_source_tracks_wall_time();
+    return 0;
+}
@@ -15,6 +15,7 @@ void test_init_counter()
     assert(counter != NULL);
     assert(counter->memory_usage == 0);
     assert(counter->num_executed_commands == 0);
+    assert(counter->disconnected_clients == 0);
     printf("test_init_counter passed.\n");
     free(counter);
 }
@@ -20,8 +20,7 @@ static void test_zero_length_value_roundtrip_is_freeable(void)
     assert(value != NULL);
     assert(value_len == 0);
     assert(value->value_len == 0);
-    assert(value->ptr != NULL);
-    assert(((unsigned char *)value->ptr)[0] == '\0');
+    assert(value->data[0] == '\0');
 
     free_value_entry(value);
     free_hash_table(table);
@@ -76,7 +75,7 @@ static void test_replace_delete_and_free_are_sanitizer_clean(void)
     size_t value_len = 0;
     assert(get_value(table, key, sizeof(key) - 1, &value, &value_len));
     assert(value_len == sizeof(second) - 1);
-    assert(memcmp(value->ptr, second, value_len) == 0);
+    assert(memcmp(value->data, second, value_len) == 0);
     free_value_entry(value);
 
     assert(delete_value(table, key, sizeof(key) - 1));
@@ -119,7 +118,7 @@ static void test_incremental_resize_preserves_all_entries(void)
         assert(get_value(table, (const unsigned char *)key, (size_t)kl, &out,
                          &out_len));
         assert(out_len == (size_t)vl);
-        assert(memcmp(out->ptr, val, (size_t)vl) == 0);
+        assert(memcmp(out->data, val, (size_t)vl) == 0);
         free_value_entry(out);
     }
 
@@ -146,7 +145,7 @@ static void test_incremental_resize_preserves_all_entries(void)
             const int vl = snprintf(val, sizeof(val), "UPD:%d", i);
             assert(found);
             assert(out_len == (size_t)vl);
-            assert(memcmp(out->ptr, val, (size_t)vl) == 0);
+            assert(memcmp(out->data, val, (size_t)vl) == 0);
             free_value_entry(out);
         } else {
             assert(!found);
@@ -158,11 +157,939 @@ static void test_incremental_resize_preserves_all_entries(void)
     printf("test_incremental_resize_preserves_all_entries passed.\n");
 }
 
+// Repeatedly insert and delete disjoint key ranges so probe groups fill with
+// tombstones, forcing same-size rebuilds, then confirm survivors stay
+// reachable and the slot iterator sees exactly the live entries.
+static void test_delete_churn_keeps_probe_chains_intact(void)
+{
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    char key[32];
+    const int survivors = 200;
+    for (int i = 0; i < survivors; i++) {
+        const int kl = snprintf(key, sizeof(key), "keep:%d", i);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, key,
+                         (size_t)kl, VALUE_ENTRY_TYPE_RAW));
+    }
+
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 500; i++) {
+            const int kl = snprintf(key, sizeof(key), "tmp:%d:%d", round, i);
+            assert(set_value(table, (const unsigned char *)key, (size_t)kl,
+                             "x", 1, VALUE_ENTRY_TYPE_RAW));
+        }
+        for (int i = 0; i < 500; i++) {
+            const int kl = snprintf(key, sizeof(key), "tmp:%d:%d", round, i);
+            assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+            assert(lookup_value(table, (const unsigned char *)key,
+                                (size_t)kl) == NULL);
+        }
+    }
+
+    for (int i = 0; i < survivors; i++) {
+        const int kl = snprintf(key, sizeof(key), "keep:%d", i);
+        const value_entry_t *v =
+            lookup_value(table, (const unsigned char *)key, (size_t)kl);
+        assert(v != NULL);
+        assert(v->value_len == (size_t)kl);
+        assert(memcmp(v->data, key, (size_t)kl) == 0);
+    }
+
+    size_t seen = 0;
+    const size_t slots = hashtable_slot_count(table);
+    for (size_t i = 0; i < slots; i++) {
+        const hash_table_entry_t *e = hashtable_slot_entry(table, i);
+        if (e) {
+            assert(e->key_len > 5 && memcmp(e->key, "keep:", 5) == 0);
+            seen++;
+        }
+    }
+    assert(seen == (size_t)survivors);
+
+    free_hash_table(table);
+
+    printf("test_delete_churn_keeps_probe_chains_intact passed.\n");
+}
+
+// The built-in hash must match the reference wyhash vectors, so placement is
+// identical across hosts for a given seed.
+static void test_default_hash_matches_reference_vectors(void)
+{
+    assert(hashtable_default_hash((const unsigned char *)"", 0, 0) ==
+           0x93228a4de0eec5a2ULL);
+    assert(hashtable_default_hash((const unsigned char *)"a", 1, 1) ==
+           0xc5bac3db178713c4ULL);
+    assert(hashtable_default_hash((const unsigned char *)"abc", 3, 2) ==
+           0xa97f2f7b1d9b3314ULL);
+    const char *digits = "1234567890123456789012345678901234567890"
+                         "1234567890123456789012345678901234567890";
+    assert(hashtable_default_hash((const unsigned char *)digits,
+                                  strlen(digits), 6) == 0x6cc5eab49a92d617ULL);
+
+    printf("test_default_hash_matches_reference_vectors passed.\n");
+}
+
+static uint64_t constant_hash(const unsigned char *key, size_t key_len,
+                              uint64_t seed)
+{
+    (void)key;
+    (void)key_len;
+    (void)seed;
+    return 42;
+}
+
+// A plugged-in hash that sends every key to the same group (the worst case a
+// collision flood can force) must still store, find and delete correctly.
+static void test_pluggable_hash_survives_total_collision(void)
+{
+    hashtable_t *table = create_hash_table_with_hash(16, constant_hash, 0);
+    assert(table != NULL);
+
+    char key[32];
+    const int n = 300;
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "c:%d", i);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, key,
+                         (size_t)kl, VALUE_ENTRY_TYPE_RAW));
+    }
+    for (int i = 0; i < n; i += 2) {
+        const int kl = snprintf(key, sizeof(key), "c:%d", i);
+        assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "c:%d", i);
+        const value_entry_t *v =
+            lookup_value(table, (const unsigned char *)key, (size_t)kl);
+        if (i % 2 == 0) {
+            assert(v == NULL);
+        } else {
+            assert(v != NULL && v->value_len == (size_t)kl);
+            assert(memcmp(v->data, key, (size_t)kl) == 0);
+        }
+    }
+
+    free_hash_table(table);
+
+    printf("test_pluggable_hash_survives_total_collision passed.\n");
+}
+
+static void test_nodes_and_values_are_recycled_by_the_slab(void)
+{
+    hashtable_t *table = create_hash_table(64);
+    assert(table != NULL);
+
+    char key[32];
+    char val[64];
+    const int n = 2000;
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "s:%d", i);
+        const int vl = snprintf(val, sizeof(val), "value-%d", i * 7);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, val,
+                         (size_t)vl, VALUE_ENTRY_TYPE_RAW));
+    }
+
+    slab_stats_t full;
+    hashtable_memory_stats(table, &full);
+    assert(full.pages > 0 && full.used_bytes > 0);
+    assert(full.requested_bytes <= full.used_bytes);
+    assert(full.used_bytes <= full.reserved_bytes);
+
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "s:%d", i);
+        assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+    slab_stats_t empty;
+    hashtable_memory_stats(table, &empty);
+    assert(empty.used_bytes == 0 && empty.requested_bytes == 0);
+
+    // Refilling reuses the freed nodes and values without new pages.
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "s:%d", i);
+        const int vl = snprintf(val, sizeof(val), "value-%d", i * 7);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, val,
+                         (size_t)vl, VALUE_ENTRY_TYPE_RAW));
+    }
+    slab_stats_t refilled;
+    hashtable_memory_stats(table, &refilled);
+    assert(refilled.pages == full.pages);
+    assert(refilled.used_bytes == full.used_bytes);
+
+    free_hash_table(table);
+
+    printf("test_nodes_and_values_are_recycled_by_the_slab passed.\n");
+}
+
+static void test_embedded_entries_follow_value_size(void)
+{
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    const unsigned char key[] = "session:0123456789abcdef";
+    const size_t key_len = sizeof(key) - 1;
+    char big[HASHTABLE_EMBED_MAX + 32];
+    memset(big, 'x', sizeof(big));
+
+    // Small pair: value shares the node's allocation.
+    assert(set_value(table, key, key_len, "tok-1", 5, VALUE_ENTRY_TYPE_RAW));
+    hash_table_entry_t *e = NULL;
+    for (size_t i = 0; i < hashtable_slot_count(table) && !e; i++)
+        e = hashtable_slot_entry(table, i);
+    assert(e != NULL && e->embedded);
+    assert((unsigned char *)e->value > (unsigned char *)e &&
+           (unsigned char *)e->value < e->key + key_len + 16);
+
+    // Growing past the embed limit moves the value out of line, and shrinking
+    // back embeds it again; the key stays readable throughout.
+    const int lens[] = {(int)sizeof(big), 7, 40, 3, (int)sizeof(big) - 1, 0};
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        const size_t vl = (size_t)lens[i];
+        assert(set_value(table, key, key_len, big, vl, VALUE_ENTRY_TYPE_RAW));
+        const value_entry_t *v = lookup_value(table, key, key_len);
+        assert(v != NULL && v->value_len == vl);
+        assert(vl == 0 || memcmp(v->data, big, vl) == 0);
+        assert(v->data[vl] == '\0');
+
+        e = NULL;
+        for (size_t s = 0; s < hashtable_slot_count(table) && !e; s++)
+            e = hashtable_slot_entry(table, s);
+        assert(e != NULL && e->value == v);
+        assert(e->embedded == (key_len + vl <= HASHTABLE_EMBED_MAX));
+        assert(e->key_len == key_len && memcmp(e->key, key, key_len) == 0);
+    }
+
+    assert(delete_value(table, key, key_len));
+    slab_stats_t stats;
+    hashtable_memory_stats(table, &stats);
+    assert(stats.used_bytes == 0 && stats.large_bytes == 0);
+
+    free_hash_table(table);
+
+    printf("test_embedded_entries_follow_value_size passed.\n");
+}
+
+static void test_shared_integers_are_referenced_not_copied(void)
+{
+    assert(hashtable_init_shared_integers(100));
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    const int64_t one = 1;
+    const int64_t big = 100;
+    assert(set_value(table, (const unsigned char *)"a", 1, &one, sizeof(one),
+                     VALUE_ENTRY_TYPE_INT64));
+    assert(set_value(table, (const unsigned char *)"b", 1, &one, sizeof(one),
+                     VALUE_ENTRY_TYPE_INT64));
+    assert(set_value(table, (const unsigned char *)"c", 1, &big, sizeof(big),
+                     VALUE_ENTRY_TYPE_INT64));
+
+    const value_entry_t *a = lookup_value(table, (const unsigned char *)"a", 1);
+    const value_entry_t *b = lookup_value(table, (const unsigned char *)"b", 1);
+    const value_entry_t *c = lookup_value(table, (const unsigned char *)"c", 1);
+    assert(a == b && a->shared && value_entry_int64(a) == 1);
+    assert(!c->shared && value_entry_int64(c) == 100);
+
+    // Snapshots are private copies; freeing a shared entry is a no-op.
+    value_entry_t *snap = NULL;
+    size_t snap_len = 0;
+    assert(get_value(table, (const unsigned char *)"a", 1, &snap, &snap_len));
+    assert(!snap->shared && value_entry_int64(snap) == 1);
+    free_value_entry(snap);
+    free_value_entry((value_entry_t *)a);
+
+    // Updating one key copies it out of the pool and leaves the other alone.
+    int64_t *n = lookup_int_value(table, (const unsigned char *)"a", 1);
+    assert(n != NULL && *n == 1);
+    *n = 2;
+    a = lookup_value(table, (const unsigned char *)"a", 1);
+    b = lookup_value(table, (const unsigned char *)"b", 1);
+    assert(!a->shared && value_entry_int64(a) == 2);
+    assert(b->shared && value_entry_int64(b) == 1);
+
+    // Raw values and overwrites move off the pool without freeing it.
+    assert(set_value(table, (const unsigned char *)"b", 1, "xyz", 3,
+                     VALUE_ENTRY_TYPE_RAW));
+    assert(set_value(table, (const unsigned char *)"c", 1, &one, sizeof(one),
+                     VALUE_ENTRY_TYPE_INT64));
+    c = lookup_value(table, (const unsigned char *)"c", 1);
+    assert(c->shared && value_entry_int64(c) == 1);
+    assert(delete_value(table, (const unsigned char *)"c", 1));
+
+    free_hash_table(table);
+    hashtable_free_shared_integers();
+
+    printf("test_shared_integers_are_referenced_not_copied passed.\n");
+}
+
+static void test_mass_delete_shrinks_incrementally(void)
+{
+    hashtable_t *table = create_hash_table(64);
+    assert(table != NULL);
+    const size_t initial = table->size[0];
+
+    char key[32];
+    const int n = 50000;
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "m:%d", i);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, key,
+                         (size_t)kl, VALUE_ENTRY_TYPE_RAW));
+    }
+    while (hashtable_rehash_steps(table, 1024))
+        ;
+    const size_t grown = table->size[0];
+    assert(grown > initial && table->grows > 0);
+    assert(table->shrinks == 0);
+
+    // Delete all but a few keys, advancing any shrink as we go.
+    const int keep = 20;
+    for (int i = keep; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "m:%d", i);
+        assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+        hashtable_rehash_steps(table, 1);
+    }
+    while (hashtable_rehash_steps(table, 1024))
+        ;
+
+    assert(table->shrinks > 0);
+    assert(table->size[0] < grown / 8);
+    assert(table->size[0] >= initial);
+    assert(table->used[0] == (size_t)keep);
+    for (int i = 0; i < keep; i++) {
+        const int kl = snprintf(key, sizeof(key), "m:%d", i);
+        const value_entry_t *v =
+            lookup_value(table, (const unsigned char *)key, (size_t)kl);
+        assert(v != NULL && v->value_len == (size_t)kl);
+    }
+
+    // A shrink never goes below the size the table was created with.
+    for (int i = 0; i < keep; i++) {
+        const int kl = snprintf(key, sizeof(key), "m:%d", i);
+        assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+    while (hashtable_rehash_steps(table, 1024))
+        ;
+    assert(table->size[0] == initial);
+
+    free_hash_table(table);
+
+    printf("test_mass_delete_shrinks_incrementally passed.\n");
+}
+
+static void test_inserts_during_shrink_never_fail(void)
+{
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    char key[32];
+    const int n = 40000;
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "i:%d", i);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    while (hashtable_rehash_steps(table, 1024))
+        ;
+
+    // Deletes alone start a shrink but never advance it; a burst of inserts
+    // must then fit in the smaller table while they drive the migration.
+    for (int i = 0; i < n - 100; i++) {
+        const int kl = snprintf(key, sizeof(key), "i:%d", i);
+        assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+    assert(table->shrinks > 0);
+    for (int i = n; i < 2 * n; i++) {
+        const int kl = snprintf(key, sizeof(key), "i:%d", i);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    for (int i = n - 100; i < 2 * n; i++) {
+        const int kl = snprintf(key, sizeof(key), "i:%d", i);
+        assert(lookup_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+
+    free_hash_table(table);
+
+    printf("test_inserts_during_shrink_never_fail passed.\n");
+}
+
+static void test_timed_rehash_finishes_without_inserts(void)
+{
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    // Insert until a resize is in flight, then stop writing entirely.
+    char key[32];
+    int n = 0;
+    while (table->grows < 10 || !hashtable_is_rehashing(table)) {
+        const int kl = snprintf(key, sizeof(key), "t:%d", n++);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    assert(table->size[1] > 0);
+
+    // No budget, or a deadline already spent on another table: no progress.
+    const ssize_t index = table->rehash_index;
+    assert(hashtable_rehash_for_us(table, 0));
+    assert(hashtable_rehash_until(table, hashtable_rehash_clock_us()));
+    assert(table->rehash_index == index);
+
+    int slices = 0;
+    while (hashtable_rehash_for_us(table, 200))
+        slices++;
+    assert(!hashtable_is_rehashing(table));
+    assert(table->size[1] == 0 && table->used[0] == (size_t)n);
+    assert(slices < 1000);
+
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "t:%d", i);
+        assert(lookup_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+
+    free_hash_table(table);
+
+    printf("test_timed_rehash_finishes_without_inserts passed.\n");
+}
+
+static void test_resize_hysteresis_prevents_thrash(void)
+{
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    char key[32];
+    // Fill to just past a grow, then churn a band of keys around the
+    // resulting load: neither threshold should be crossed repeatedly.
+    int live = 0;
+    while (table->grows < 3) {
+        const int kl = snprintf(key, sizeof(key), "h:%d", live++);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    while (hashtable_rehash_steps(table, 1024))
+        ;
+    const uint64_t grows = table->grows;
+    const uint64_t shrinks = table->shrinks;
+
+    for (int round = 0; round < 200; round++) {
+        for (int i = live - 8; i < live; i++) {
+            const int kl = snprintf(key, sizeof(key), "h:%d", i);
+            assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+        }
+        for (int i = live - 8; i < live; i++) {
+            const int kl = snprintf(key, sizeof(key), "h:%d", i);
+            assert(set_value(table, (const unsigned char *)key, (size_t)kl,
+                             "v", 1, VALUE_ENTRY_TYPE_RAW));
+        }
+    }
+    assert(table->shrinks == shrinks);
+    // Tombstone churn may force same-size rebuilds, but only occasionally.
+    assert(table->grows - grows <= 4);
+
+    free_hash_table(table);
+
+    printf("test_resize_hysteresis_prevents_thrash passed.\n");
+}
+
+static void test_prefetch_hints_are_side_effect_free(void)
+{
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    // Empty table: nothing to prefetch, nothing to touch.
+    hashtable_prefetch_group(table, 0);
+    hashtable_prefetch_entry(table, UINT64_MAX);
+
+    char key[32];
+    for (int i = 0; i < 500; i++) {
+        const int kl = snprintf(key, sizeof(key), "p:%d", i);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    // Hint present and absent keys, mid-resize included.
+    for (int i = 0; i < 1000; i++) {
+        const int kl = snprintf(key, sizeof(key), "p:%d", i);
+        const uint64_t hash =
+            hashtable_hash_key(table, (const unsigned char *)key, (size_t)kl);
+        hashtable_prefetch_group(table, hash);
+        hashtable_prefetch_entry(table, hash);
+        assert((lookup_value(table, (const unsigned char *)key, (size_t)kl) !=
+                NULL) == (i < 500));
+    }
+
+    free_hash_table(table);
+
+    printf("test_prefetch_hints_are_side_effect_free passed.\n");
+}
+
+static void test_resize_ramps_memory_segment_by_segment(void)
+{
+    hashtable_t *table = create_hash_table(8 * HASHTABLE_SEGMENT_SLOTS);
+    assert(table != NULL);
+    // Nothing is materialized until keys arrive.
+    assert(hashtable_slot_bytes(table) < 1024);
+
+    char key[32];
+    int n = 0;
+    while (!hashtable_is_rehashing(table)) {
+        const int kl = snprintf(key, sizeof(key), "seg:%d", n++);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    // Starting the resize allocated only a directory for the new table, plus
+    // the one segment the triggering insert landed in.
+    const size_t segment_bytes = HASHTABLE_SEGMENT_SLOTS * (1 + sizeof(void *));
+    const size_t old_bytes = table->size[0] * (1 + sizeof(void *));
+    assert(hashtable_slot_bytes(table) < old_bytes + segment_bytes + 4096);
+
+    // Migrating in order releases old slot arrays while new segments fill, so
+    // the old and new tables are never both fully resident.
+    const size_t new_bytes = table->size[1] * (1 + sizeof(void *));
+    size_t peak = 0;
+    while (hashtable_rehash_steps(table, 1)) {
+        const size_t bytes = hashtable_slot_bytes(table);
+        if (bytes > peak)
+            peak = bytes;
+    }
+    assert(peak < old_bytes + new_bytes * 3 / 4);
+    assert(hashtable_slot_bytes(table) < new_bytes + 4096);
+
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "seg:%d", i);
+        assert(lookup_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+    for (int i = 0; i < n; i++) {
+        const int kl = snprintf(key, sizeof(key), "seg:%d", i);
+        assert(delete_value(table, (const unsigned char *)key, (size_t)kl));
+    }
+
+    free_hash_table(table);
+
+    printf("test_resize_ramps_memory_segment_by_segment passed.\n");
+}
+
+static void test_deadlines_are_stored_inline(void)
+{
+    assert(hashtable_init_shared_integers(16));
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    const unsigned char small[] = "small";
+    unsigned char big[200];
+    memset(big, 'b', sizeof(big));
+    const int64_t seven = 7;
+
+    // Embedded, out-of-line and shared values all carry a deadline the same way.
+    assert(set_value_with_deadline(table, small, 5, "v", 1, VALUE_ENTRY_TYPE_RAW,
+                                   1000));
+    assert(set_value_with_deadline(table, (const unsigned char *)"big", 3, big,
+                                   sizeof(big), VALUE_ENTRY_TYPE_RAW, 2000));
+    assert(set_value_with_deadline(table, (const unsigned char *)"int", 3,
+                                   &seven, sizeof(seven),
+                                   VALUE_ENTRY_TYPE_INT64, 3000));
+    assert(table->expirable_count == 3);
+    assert(hashtable_entry_deadline(lookup_entry(table, small, 5)) == 1000);
+    assert(hashtable_entry_deadline(
+               lookup_entry(table, (const unsigned char *)"big", 3)) == 2000);
+    const hash_table_entry_t *e =
+        lookup_entry(table, (const unsigned char *)"int", 3);
+    assert(e->value->shared && hashtable_entry_deadline(e) == 3000);
+
+    // set_value() keeps the deadline across in-place, swapped and rebuilt
+    // updates, and copy-on-write of a shared integer keeps it too.
+    assert(set_value(table, small, 5, "w", 1, VALUE_ENTRY_TYPE_RAW));
+    assert(set_value(table, small, 5, "longer", 6, VALUE_ENTRY_TYPE_RAW));
+    big[0] = 'c';
+    assert(set_value(table, (const unsigned char *)"big", 3, big, sizeof(big),
+                     VALUE_ENTRY_TYPE_RAW));
+    int64_t *n = lookup_int_value(table, (const unsigned char *)"int", 3);
+    assert(n && *n == 7);
+    assert(hashtable_entry_deadline(lookup_entry(table, small, 5)) == 1000);
+    assert(hashtable_entry_deadline(
+               lookup_entry(table, (const unsigned char *)"big", 3)) == 2000);
+    assert(hashtable_entry_deadline(
+               lookup_entry(table, (const unsigned char *)"int", 3)) == 3000);
+    assert(table->expirable_count == 3);
+
+    // Adding and clearing a deadline rebuilds the entry without losing data.
+    assert(hashtable_set_deadline(table, small, 5, HASHTABLE_NO_DEADLINE));
+    e = lookup_entry(table, small, 5);
+    assert(!e->expirable && e->value->value_len == 6 &&
+           memcmp(e->value->data, "longer", 6) == 0);
+    assert(hashtable_set_deadline(table, small, 5, 4000));
+    assert(hashtable_entry_deadline(lookup_entry(table, small, 5)) == 4000);
+    assert(hashtable_set_deadline(table, (const unsigned char *)"big", 3,
+                                  HASHTABLE_NO_DEADLINE));
+    e = lookup_entry(table, (const unsigned char *)"big", 3);
+    assert(!e->expirable && e->value->data[0] == 'c');
+    assert(!hashtable_set_deadline(table, (const unsigned char *)"nope", 4, 1));
+    assert(set_value_with_deadline(table, (const unsigned char *)"int", 3,
+                                   &seven, sizeof(seven),
+                                   VALUE_ENTRY_TYPE_INT64,
+                                   HASHTABLE_NO_DEADLINE));
+    assert(table->expirable_count == 1);
+
+    // Every block is returned at the size it was allocated with.
+    assert(delete_value(table, small, 5));
+    assert(delete_value(table, (const unsigned char *)"big", 3));
+    assert(delete_value(table, (const unsigned char *)"int", 3));
+    slab_stats_t stats;
+    hashtable_memory_stats(table, &stats);
+    assert(stats.used_bytes == 0 && stats.requested_bytes == 0);
+    assert(stats.large_bytes == 0 && table->expirable_count == 0);
+
+    free_hash_table(table);
+    hashtable_free_shared_integers();
+
+    printf("test_deadlines_are_stored_inline passed.\n");
+}
+
+static void test_access_stamps_sampling_and_used_memory(void)
+{
+    hashtable_t *table = create_hash_table(64);
+    assert(table != NULL);
+    const size_t empty = hashtable_used_memory(table);
+
+    char key[16];
+    table->access_clock = 7;
+    for (int i = 0; i < 40; i++) {
+        const int len = snprintf(key, sizeof(key), "k%d", i);
+        assert(set_value(table, (const unsigned char *)key, len, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    assert(hashtable_used_memory(table) > empty);
+
+    // Lookups and stores stamp the current clock; peeks do not.
+    table->access_clock = HASHTABLE_LRU_MAX;
+    const unsigned char *k1 = (const unsigned char *)"k1";
+    const hash_table_entry_t *e = hashtable_peek_entry_hashed(
+        table, k1, 2, hashtable_hash_key(table, k1, 2));
+    assert(e && e->lru == 7);
+    assert(lookup_value(table, k1, 2));
+    assert(e->lru == HASHTABLE_LRU_MAX);
+    assert(set_value(table, (const unsigned char *)"k2", 2, "w", 1,
+                     VALUE_ENTRY_TYPE_RAW));
+    assert(lookup_entry(table, (const unsigned char *)"k2", 2)->lru ==
+           HASHTABLE_LRU_MAX);
+
+    // Samples are distinct live entries, wherever sampling starts.
+    for (uint64_t r = 0; r < 200; r += 7) {
+        hash_table_entry_t *sample[8];
+        const size_t n = hashtable_sample_entries(table, r, sample, 8);
+        assert(n == 8);
+        for (size_t i = 0; i < n; i++) {
+            assert(lookup_entry(table, sample[i]->key, sample[i]->key_len) ==
+                   sample[i]);
+            for (size_t j = 0; j < i; j++)
+                assert(sample[i] != sample[j]);
+        }
+    }
+
+    for (int i = 0; i < 40; i++) {
+        const int len = snprintf(key, sizeof(key), "k%d", i);
+        assert(delete_value(table, (const unsigned char *)key, len));
+    }
+    // Only the (now materialized) slot arrays remain.
+    assert(hashtable_used_memory(table) == hashtable_slot_bytes(table));
+    hash_table_entry_t *none;
+    assert(hashtable_sample_entries(table, 3, &none, 1) == 0);
+
+    free_hash_table(table);
+    printf("test_access_stamps_sampling_and_used_memory passed.\n");
+}
+
+static void test_lfu_counters_grow_logarithmically_and_decay(void)
+{
+    hashtable_t *table = create_hash_table(64);
+    assert(table != NULL);
+    const unsigned char *hot = (const unsigned char *)"hot";
+    const unsigned char *cold = (const unsigned char *)"cold";
+    assert(set_value(table, hot, 3, "v", 1, VALUE_ENTRY_TYPE_RAW));
+    assert(hashtable_lfu_counter(table, lookup_entry(table, hot, 3)) == 0);
+    assert(delete_value(table, hot, 3));
+
+    hashtable_enable_lfu(table, 10, 2);
+    table->access_clock = 100;
+    assert(set_value(table, hot, 3, "v", 1, VALUE_ENTRY_TYPE_RAW));
+    assert(set_value(table, cold, 4, "v", 1, VALUE_ENTRY_TYPE_RAW));
+    const hash_table_entry_t *c = hashtable_peek_entry_hashed(
+        table, cold, 4, hashtable_hash_key(table, cold, 4));
+    assert(hashtable_lfu_counter(table, c) == HASHTABLE_LFU_INIT);
+
+    // Ten thousand hits move the counter far less than ten thousand steps.
+    for (int i = 0; i < 10000; i++)
+        assert(lookup_value(table, hot, 3));
+    const hash_table_entry_t *h = hashtable_peek_entry_hashed(
+        table, hot, 3, hashtable_hash_key(table, hot, 3));
+    const uint8_t counter = hashtable_lfu_counter(table, h);
+    assert(counter > HASHTABLE_LFU_INIT + 10 && counter < 100);
+
+    // Replacing the node (a longer value) keeps the counter.
+    assert(set_value(table, hot, 3, "a longer value", 14,
+                     VALUE_ENTRY_TYPE_RAW));
+    h = hashtable_peek_entry_hashed(table, hot, 3,
+                                    hashtable_hash_key(table, hot, 3));
+    assert(hashtable_lfu_counter(table, h) >= counter);
+    const uint8_t stored = hashtable_lfu_counter(table, h);
+
+    // One decrement per decay_time units idle, applied on read; peeks and
+    // counter reads leave the stamp alone.
+    table->access_clock = 106;
+    assert(hashtable_lfu_counter(table, h) == stored - 3);
+    assert(hashtable_lfu_counter(table, c) == HASHTABLE_LFU_INIT - 3);
+    table->access_clock = 120;
+    assert(hashtable_lfu_counter(table, c) == 0);
+    // The 16-bit time wraps.
+    table->access_clock = (100 + 4) & HASHTABLE_LFU_TIME_MAX;
+    assert(hashtable_lfu_counter(table, c) == HASHTABLE_LFU_INIT - 2);
+
+    // Factor 0 counts every hit, up to saturation.
+    hashtable_enable_lfu(table, 0, 0);
+    for (int i = 0; i < 300; i++)
+        assert(lookup_value(table, cold, 4));
+    c = hashtable_peek_entry_hashed(table, cold, 4,
+                                    hashtable_hash_key(table, cold, 4));
+    assert(hashtable_lfu_counter(table, c) == 255);
+
+    free_hash_table(table);
+    printf("test_lfu_counters_grow_logarithmically_and_decay passed.\n");
+}
+
+static void test_detach_unlink_and_large_allocations(void)
+{
+    hashtable_t *table = create_hash_table(64);
+    assert(table != NULL);
+    static unsigned char big[3 * SLAB_MAX_OBJECT];
+    memset(big, 'x', sizeof(big));
+    char key[16];
+    for (int i = 0; i < 200; i++) {
+        const int len = snprintf(key, sizeof(key), "k%d", i);
+        assert(set_value(table, (const unsigned char *)key, len, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    const size_t small_effort = hashtable_free_effort(table);
+    assert(small_effort > 0);
+    assert(set_value(table, (const unsigned char *)"big1", 4, big, sizeof(big),
+                     VALUE_ENTRY_TYPE_RAW));
+    assert(set_value(table, (const unsigned char *)"big2", 4, big, sizeof(big),
+                     VALUE_ENTRY_TYPE_RAW));
+    // Malloc'd values need a walk to free: every entry counts.
+    assert(hashtable_free_effort(table) >= small_effort + 202);
+
+    // Unlinking hands large values over only above the threshold.
+    const unsigned char *b1 = (const unsigned char *)"big1";
+    void *detached;
+    assert(hashtable_unlink_hashed(table, b1, 4, hashtable_hash_key(table, b1, 4),
+                                   sizeof(big) + SLAB_MAX_OBJECT, &detached));
+    assert(detached == NULL);
+    assert(set_value(table, b1, 4, big, sizeof(big), VALUE_ENTRY_TYPE_RAW));
+    slab_stats_t before;
+    hashtable_memory_stats(table, &before);
+    assert(hashtable_unlink_hashed(table, b1, 4, hashtable_hash_key(table, b1, 4),
+                                   sizeof(big), &detached));
+    assert(detached != NULL);
+    assert(((value_entry_t *)detached)->value_len == sizeof(big));
+    slab_stats_t after;
+    hashtable_memory_stats(table, &after);
+    assert(after.large_bytes < before.large_bytes);
+    assert(lookup_value(table, b1, 4) == NULL);
+    free(detached);
+    assert(!hashtable_unlink_hashed(table, b1, 4,
+                                    hashtable_hash_key(table, b1, 4), 0,
+                                    &detached));
+
+    // Detaching empties the table but keeps its settings.
+    table->access_clock = 42;
+    hashtable_t *old = hashtable_detach(table);
+    assert(old != NULL);
+    assert(old->used[0] + old->used[1] == 201);
+    assert(table->used[0] + table->used[1] == 0);
+    assert(table->access_clock == 42 && table->seed == old->seed);
+    assert(lookup_value(table, (const unsigned char *)"k1", 2) == NULL);
+    assert(lookup_value(old, (const unsigned char *)"k1", 2) != NULL);
+    assert(set_value(table, (const unsigned char *)"k1", 2, "w", 1,
+                     VALUE_ENTRY_TYPE_RAW));
+
+    // free_hash_table() releases the malloc'd value still in `old`.
+    free_hash_table(old);
+    free_hash_table(table);
+    printf("test_detach_unlink_and_large_allocations passed.\n");
+}
+
+static void test_large_values_are_adopted_without_copying(void)
+{
+    hashtable_t *table = create_hash_table(64);
+    assert(table != NULL);
+    const unsigned char *key = (const unsigned char *)"blob";
+    assert(hashtable_alloc_large_value(HASHTABLE_LARGE_VALUE_MIN) == NULL);
+
+    enum { len = 3 * SLAB_MAX_OBJECT };
+    value_entry_t *v = hashtable_alloc_large_value(len);
+    assert(v != NULL && v->value_len == len && v->data[len] == '\0');
+    memset(v->data, 'a', len);
+    assert(set_value_entry_with_deadline(table, key, 4, v,
+                                         VALUE_ENTRY_TYPE_RAW, 1234));
+    const hash_table_entry_t *entry = lookup_entry(table, key, 4);
+    assert(entry != NULL && entry->value == v);
+    assert(hashtable_entry_deadline(entry) == 1234);
+    slab_stats_t stats;
+    hashtable_memory_stats(table, &stats);
+    const size_t one_value = stats.large_bytes;
+    assert(one_value > len);
+
+    // Replacing it, with or without a deadline, releases the old entry.
+    value_entry_t *w = hashtable_alloc_large_value(len + 1);
+    assert(w != NULL);
+    memset(w->data, 'b', len + 1);
+    assert(set_value_entry_with_deadline(table, key, 4, w,
+                                         VALUE_ENTRY_TYPE_RAW,
+                                         HASHTABLE_NO_DEADLINE));
+    entry = lookup_entry(table, key, 4);
+    assert(entry->value == w && !entry->expirable);
+    hashtable_memory_stats(table, &stats);
+    assert(stats.large_bytes == one_value + 1);
+
+    // A copied value over an adopted one, and back again.
+    assert(set_value(table, key, 4, "small", 5, VALUE_ENTRY_TYPE_RAW));
+    hashtable_memory_stats(table, &stats);
+    assert(stats.large_bytes == 0);
+    v = hashtable_alloc_large_value(len);
+    assert(v != NULL);
+    memset(v->data, 'c', len);
+    assert(set_value_entry_with_deadline(table, key, 4, v,
+                                         VALUE_ENTRY_TYPE_RAW,
+                                         HASHTABLE_NO_DEADLINE));
+    assert(lookup_value(table, key, 4)->data[len - 1] == 'c');
+
+    // A failed store still takes the entry (sanitizers check it is freed).
+    v = hashtable_alloc_large_value(len);
+    assert(v != NULL);
+    assert(!set_value_entry_with_deadline(NULL, key, 4, v,
+                                          VALUE_ENTRY_TYPE_RAW,
+                                          HASHTABLE_NO_DEADLINE));
+
+    free_hash_table(table);
+    printf("test_large_values_are_adopted_without_copying passed.\n");
+}
+
+static void test_failed_insert_frees_adopted_value_once(void)
+{
+    hashtable_t *table = create_hash_table(16);
+    assert(table != NULL);
+
+    // Get a resize in flight, so new keys go to table 1.
+    char key[32];
+    int n = 0;
+    while (!hashtable_is_rehashing(table)) {
+        const int kl = snprintf(key, sizeof(key), "f:%d", n++);
+        assert(set_value(table, (const unsigned char *)key, (size_t)kl, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+    }
+    slab_stats_t before;
+    hashtable_memory_stats(table, &before);
+
+    // With no growth left in table 1 a new key has nowhere to go (as when
+    // one of its segments cannot be allocated).
+    const size_t growth_left = table->growth_left[1];
+    table->growth_left[1] = 0;
+
+    enum { len = 2 * SLAB_MAX_OBJECT };
+    value_entry_t *v = hashtable_alloc_large_value(len);
+    assert(v != NULL);
+    memset(v->data, 'x', len);
+    const unsigned char *big = (const unsigned char *)"big";
+    assert(!set_value_entry_with_deadline(table, big, 3, v,
+                                          VALUE_ENTRY_TYPE_RAW, 1234));
+    assert(lookup_entry(table, big, 3) == NULL);
+
+    // Released once (sanitizers catch a double free) and no longer counted.
+    slab_stats_t after;
+    hashtable_memory_stats(table, &after);
+    assert(after.large_bytes == before.large_bytes);
+
+    table->growth_left[1] = growth_left;
+    v = hashtable_alloc_large_value(len);
+    assert(v != NULL);
+    memset(v->data, 'y', len);
+    assert(set_value_entry_with_deadline(table, big, 3, v,
+                                         VALUE_ENTRY_TYPE_RAW, 1234));
+    assert(lookup_value(table, big, 3)->data[len - 1] == 'y');
+
+    free_hash_table(table);
+    printf("test_failed_insert_frees_adopted_value_once passed.\n");
+}
+
+static void test_pinned_values_outlive_overwrite_and_delete(void)
+{
+    hashtable_t *table = create_hash_table(64);
+    assert(table != NULL);
+    const unsigned char *key = (const unsigned char *)"pinned";
+
+    enum { len = 2 * SLAB_MAX_OBJECT };
+    static char a[len], b[len];
+    memset(a, 'a', len);
+    memset(b, 'b', len);
+    assert(set_value(table, key, 6, a, len, VALUE_ENTRY_TYPE_RAW));
+    value_entry_t *v = lookup_entry(table, key, 6)->value;
+    assert(!value_entry_is_pinned(v));
+
+    // A same-length overwrite would normally reuse the entry in place; a
+    // pinned one is replaced instead and keeps its bytes.
+    value_entry_pin(v);
+    assert(value_entry_is_pinned(v));
+    assert(set_value(table, key, 6, b, len, VALUE_ENTRY_TYPE_RAW));
+    value_entry_t *w = lookup_entry(table, key, 6)->value;
+    assert(w != v && w->data[0] == 'b');
+    assert(v->data[0] == 'a' && v->data[len - 1] == 'a');
+    assert(!value_entry_is_pinned(v));
+    value_entry_unpin(v); // last reference: freed here
+
+    // Unlinking frees a pinned value in place instead of detaching it.
+    value_entry_pin(w);
+    void *detached;
+    assert(hashtable_unlink_hashed(table, key, 6,
+                                   hashtable_hash_key(table, key, 6), 0,
+                                   &detached));
+    assert(detached == NULL && lookup_value(table, key, 6) == NULL);
+    assert(w->data[len - 1] == 'b');
+    slab_stats_t stats;
+    hashtable_memory_stats(table, &stats);
+    assert(stats.large_bytes == 0);
+
+    // Freeing the whole table leaves a pinned value to its last holder too.
+    assert(set_value(table, key, 6, a, len, VALUE_ENTRY_TYPE_RAW));
+    v = lookup_entry(table, key, 6)->value;
+    value_entry_pin(v);
+    free_hash_table(table);
+    assert(v->data[0] == 'a');
+    value_entry_unpin(v);
+    value_entry_unpin(w);
+
+    printf("test_pinned_values_outlive_overwrite_and_delete passed.\n");
+}
+
 int main(void)
 {
     test_zero_length_value_roundtrip_is_freeable();
     test_invalid_inputs_are_rejected();
     test_replace_delete_and_free_are_sanitizer_clean();
     test_incremental_resize_preserves_all_entries();
+    test_delete_churn_keeps_probe_chains_intact();
+    test_default_hash_matches_reference_vectors();
+    test_pluggable_hash_survives_total_collision();
+    test_nodes_and_values_are_recycled_by_the_slab();
+    test_embedded_entries_follow_value_size();
+    test_shared_integers_are_referenced_not_copied();
+    test_mass_delete_shrinks_incrementally();
+    test_inserts_during_shrink_never_fail();
+    test_timed_rehash_finishes_without_inserts();
+    test_resize_hysteresis_prevents_thrash();
+    test_prefetch_hints_are_side_effect_free();
+    test_resize_ramps_memory_segment_by_segment();
+    test_deadlines_are_stored_inline();
+    test_access_stamps_sampling_and_used_memory();
+    test_lfu_counters_grow_logarithmically_and_decay();
+    test_detach_unlink_and_large_allocations();
+    test_large_values_are_adopted_without_copying();
+    test_failed_insert_frees_adopted_value_once();
+    test_pinned_values_outlive_overwrite_and_delete();
     return 0;
 }
@@ -11,12 +11,23 @@
 #include "../src/commands/common/command_defs.h"
 #include "../src/commands/common/command_parser.h"
 #include "../src/commands/common/command_registry.h"
+#include "../src/commands/common/frame.h"
 #include "../src/commands/server/server_command_handlers.h"
 #include "../src/core/hashtable.h"
+#include "../src/evict.h"
+#include "../src/lazyfree.h"
+#include "../src/networking/networking.h"
 #include "../src/response_defs.h"
 #include "../src/server.h"
+#include "../src/server_lifecycle.h"
+#include "../src/shard.h"
+#include "../src/ttl.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,7 +36,7 @@
 
 /* ── globals needed by the server code ─────────────────────────────── */
 
-server_t server;
+_Thread_local server_t server;
 
 /* stub – memory.c is not linked */
 unsigned long get_private_memory_usage_bytes(void)
@@ -45,6 +56,26 @@ typedef struct {
     db_t *db;
 } fixture_t;
 
+static db_t *create_test_db(void)
+{
+    db_t *db = malloc(sizeof(db_t));
+    assert(db != NULL);
+    db->store = create_hash_table(TABLE_SIZE);
+    db->expires = create_expiry_index(TABLE_SIZE);
+    db->eviction = NULL;
+    db->lazyfree = NULL;
+    return db;
+}
+
+static void free_test_db(db_t *db)
+{
+    free_lazyfree(db->lazyfree);
+    free_hash_table(db->store);
+    free_expiry_index(db->expires);
+    free_eviction(db->eviction);
+    free(db);
+}
+
 static fixture_t setup(void)
 {
     int fds[2];
@@ -56,11 +87,7 @@ static fixture_t setup(void)
     client_t *c = init_client(fds[0], ss, UNIX);
     assert(c != NULL);
 
-    db_t *db = malloc(sizeof(db_t));
-    assert(db != NULL);
-    db->store = create_hash_table(TABLE_SIZE);
-    db->expires = create_hash_table(TABLE_SIZE);
-
+    db_t *db = create_test_db();
     init_command_handlers(db);
 
     return (fixture_t){.client = c, .read_fd = fds[1], .db = db};
@@ -71,9 +98,7 @@ static void teardown(fixture_t *f)
     close(f->client->fd);
     close(f->read_fd);
     free_client(f->client);
-    free_hash_table(f->db->store);
-    free_hash_table(f->db->expires);
-    free(f->db);
+    free_test_db(f->db);
 }
 
 /* ── low-level helpers ─────────────────────────────────────────────── */
@@ -160,6 +185,17 @@ static void assert_set(fixture_t *f, const char *key, const char *value,
     assert(r > 0 && resp_is_success(resp, r, expected));
 }
 
+static void assert_set_error(fixture_t *f, const char *key, const char *value)
+{
+    unsigned char resp[512];
+    size_t len;
+    unsigned char *cmd = construct_set_command(key, value, &len);
+    assert(cmd);
+    ssize_t r = dispatch_and_recv(f, cmd, len, resp, sizeof resp);
+    free(cmd);
+    assert(r > 0 && resp_is_error(resp, r));
+}
+
 static void assert_get(fixture_t *f, const char *key, const char *expected)
 {
     unsigned char resp[512];
@@ -250,6 +286,28 @@ static void assert_del_ok(fixture_t *f, const char *key)
     assert(r > 0 && resp_is_ok(resp, r));
 }
 
+static void assert_unlink_ok(fixture_t *f, const char *key)
+{
+    unsigned char resp[512];
+    size_t len;
+    unsigned char *cmd = construct_unlink_command(key, &len);
+    assert(cmd);
+    ssize_t r = dispatch_and_recv(f, cmd, len, resp, sizeof resp);
+    free(cmd);
+    assert(r > 0 && resp_is_ok(resp, r));
+}
+
+static void assert_flushall_ok(fixture_t *f, const bool async)
+{
+    unsigned char resp[512];
+    size_t len;
+    unsigned char *cmd = construct_flushall_command(async, &len);
+    assert(cmd);
+    ssize_t r = dispatch_and_recv(f, cmd, len, resp, sizeof resp);
+    free(cmd);
+    assert(r > 0 && resp_is_ok(resp, r));
+}
+
 static void assert_expire_ok(fixture_t *f, const char *key, const char *seconds)
 {
     unsigned char resp[512];
@@ -415,6 +473,55 @@ static void test_incrby_after_set(void)
     printf("  test_incrby_after_set passed.\n");
 }
 
+static void test_integers_stored_natively_render_as_text(void)
+{
+    fixture_t f = setup();
+
+    assert_set(&f, "n", "-42", "-42");
+    const value_entry_t *v =
+        lookup_value(f.db->store, (const unsigned char *)"n", 1);
+    assert(v && v->encoding == VALUE_ENTRY_TYPE_INT64);
+    assert(value_entry_int64(v) == -42);
+    assert_get(&f, "n", "-42");
+
+    assert_incrby(&f, "n", "100", "58");
+    assert_decrby(&f, "n", "60", "-2");
+    assert_get(&f, "n", "-2");
+
+    // Non-canonical integers keep their bytes until the first update.
+    assert_set(&f, "padded", "007", "007");
+    assert_get(&f, "padded", "007");
+    assert_incr(&f, "padded", "8");
+    assert_get(&f, "padded", "8");
+
+    assert_set(&f, "max", "9223372036854775807", "9223372036854775807");
+    assert_incr_error(&f, "max");
+    assert_get(&f, "max", "9223372036854775807");
+
+    teardown(&f);
+    printf("  test_integers_stored_natively_render_as_text passed.\n");
+}
+
+static void test_shared_integers_survive_incr(void)
+{
+    assert(hashtable_init_shared_integers(1000));
+    fixture_t f = setup();
+
+    assert_set(&f, "s1", "5", "5");
+    assert_set(&f, "s2", "5", "5");
+    assert_incr(&f, "s1", "6");
+    assert_get(&f, "s1", "6");
+    assert_get(&f, "s2", "5");
+    assert_decrby(&f, "s2", "5", "0");
+    assert_incrby(&f, "s2", "2000", "2000");
+    assert_set(&f, "s1", "999", "999");
+    assert_get(&f, "s1", "999");
+
+    teardown(&f);
+    hashtable_free_shared_integers();
+    printf("  test_shared_integers_survive_incr passed.\n");
+}
+
 /* ── TTL tests ─────────────────────────────────────────────────────── */
 
 static void test_del_removes_key(void)
@@ -1076,6 +1183,1117 @@ static void test_set_ex_rejects_negative_ttl_atomically(void)
     printf("  test_set_ex_rejects_negative_ttl_atomically passed.\n");
 }
 
+static void test_ttl_lives_with_the_entry(void)
+{
+    fixture_t f = setup();
+
+    assert_set_ex(&f, "inl", "41", "100", "41");
+    const hash_table_entry_t *e =
+        lookup_entry(f.db->store, (const unsigned char *)"inl", 3);
+    assert(e && e->expirable);
+    assert(f.db->store->expirable_count == 1);
+    // The expiry index only tracks the key; the deadline lives on the entry.
+    assert(lookup_value(f.db->expires->keys, (const unsigned char *)"inl", 3));
+    assert(f.db->expires->wheel.count == 1);
+
+    // Value updates keep the deadline; SET without EX drops it.
+    assert_incr(&f, "inl", "42");
+    e = lookup_entry(f.db->store, (const unsigned char *)"inl", 3);
+    assert(e && e->expirable && get_ttl(e) >= 95);
+    assert_set(&f, "inl", "plain", "plain");
+    assert_ttl(&f, "inl", "-1");
+    assert(f.db->store->expirable_count == 0);
+
+    teardown(&f);
+    printf("  test_ttl_lives_with_the_entry passed.\n");
+}
+
+static void test_active_expiry_drains_due_keys_in_order(void)
+{
+    fixture_t f = setup();
+
+    assert_set_ex(&f, "gone", "v", "60", "v");
+    assert_set_ex(&f, "later", "v", "60", "v");
+    assert_set_ex(&f, "deleted", "v", "60", "v");
+    assert_set_ex(&f, "persisted", "v", "60", "v");
+    assert_set_ex(&f, "alive", "v", "60", "v");
+    assert_del_ok(&f, "deleted");
+    assert_persist_ok(&f, "persisted");
+    assert(f.db->expires->wheel.count == 3);
+
+    // Backdate deadlines rather than sleeping past them.
+    assert(set_expiry(f.db->store, f.db->expires,
+                      (const unsigned char *)"gone", 4, 1));
+    assert(set_expiry(f.db->store, f.db->expires,
+                      (const unsigned char *)"later", 5, 2));
+    // A SET without EX leaves its old timer behind; the drain discards it.
+    assert_set_ex(&f, "reset", "v", "60", "v");
+    assert(set_expiry(f.db->store, f.db->expires,
+                      (const unsigned char *)"reset", 5, 3));
+    assert_set(&f, "reset", "kept", "kept");
+
+    assert(expire_due_keys(f.db->store, f.db->expires, 0) == 0);
+    assert(expire_due_keys(f.db->store, f.db->expires, 100000) == 2);
+    assert_get_error(&f, "gone");
+    assert_get_error(&f, "later");
+    assert_get(&f, "reset", "kept");
+    assert_get(&f, "persisted", "v");
+    assert(f.db->expires->expired_active == 2);
+    assert(f.db->expires->lag_max_ms > 0);
+    // Only the key that still has a future deadline stays tracked.
+    assert(f.db->expires->wheel.count == 1);
+    assert(f.db->expires->keys->used[0] + f.db->expires->keys->used[1] == 1);
+    assert(lookup_value(f.db->expires->keys, (const unsigned char *)"alive",
+                        5));
+
+    teardown(&f);
+    printf("  test_active_expiry_drains_due_keys_in_order passed.\n");
+}
+
+static void test_expire_cycles_drain_a_backlog(void)
+{
+    fixture_t f = setup();
+
+    // A bulk load sharing one (backdated) deadline.
+    enum { N = 5000 };
+    char key[16];
+    for (int i = 0; i < N; i++) {
+        const int len = snprintf(key, sizeof(key), "bulk:%d", i);
+        assert(set_value(f.db->store, (const unsigned char *)key, len, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+        assert(set_expiry(f.db->store, f.db->expires,
+                          (const unsigned char *)key, len, 1));
+    }
+
+    // Budgets of 0 do nothing; a tiny one leaves work behind and flags it.
+    assert(expire_slow_cycle(f.db->store, f.db->expires, 0, 100000) == 0);
+    assert(f.db->expires->slow_cycles == 0);
+    size_t deleted = expire_due_keys(f.db->store, f.db->expires, 1);
+    assert(deleted > 0);
+    if (deleted < N) {
+        assert(f.db->expires->backlog);
+        assert(f.db->expires->time_cap_hits == 1);
+    }
+
+    // Fast cycles run only while backlogged, at most once per two periods.
+    f.db->expires->backlog = true;
+    deleted += expire_fast_cycle(f.db->store, f.db->expires);
+    assert(f.db->expires->fast_cycles == 1);
+    f.db->expires->backlog = true;
+    assert(expire_fast_cycle(f.db->store, f.db->expires) == 0);
+    assert(f.db->expires->fast_cycles == 1);
+
+    // A generous slow cycle clears the rest and the backlog flag.
+    deleted += expire_slow_cycle(f.db->store, f.db->expires, 100, 10000000);
+    assert(deleted == N);
+    assert(!f.db->expires->backlog);
+    assert(f.db->expires->slow_cycles <= 1);
+    assert(f.db->expires->expired_active == N);
+    assert(f.db->expires->wheel.count == 0);
+    assert(expire_fast_cycle(f.db->store, f.db->expires) == 0);
+
+    teardown(&f);
+    printf("  test_expire_cycles_drain_a_backlog passed.\n");
+}
+
+static void enable_eviction(fixture_t *f, const evict_policy_t policy)
+{
+    f->db->eviction = create_eviction(0, policy, EVICT_DEFAULT_SAMPLES);
+    assert(f->db->eviction);
+    init_command_handlers(f->db);
+}
+
+static void test_maxmemory_evicts_least_recently_used(void)
+{
+    fixture_t f = setup();
+    enable_eviction(&f, EVICT_ALLKEYS_LRU);
+
+    char key[32];
+    f.db->store->access_clock = 100;
+    for (int i = 0; i < 400; i++) {
+        snprintf(key, sizeof(key), "old:%d", i);
+        assert_set(&f, key, "v", "v");
+    }
+    f.db->store->access_clock = 5000;
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "hot:%d", i);
+        assert_set(&f, key, "v", "v");
+    }
+
+    // Reading an old key makes it recent.
+    assert_get(&f, "old:0", "v");
+    const size_t used = evict_used_memory(f.db->store, f.db->expires);
+    f.db->eviction->maxmemory = used - 2048;
+    assert_set(&f, "new", "v", "v");
+
+    assert(f.db->eviction->evicted_keys > 0);
+    assert(evict_used_memory(f.db->store, f.db->expires) <=
+           f.db->eviction->maxmemory + 128);
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "hot:%d", i);
+        assert_get(&f, key, "v");
+    }
+    assert_get(&f, "old:0", "v");
+
+    teardown(&f);
+    printf("  test_maxmemory_evicts_least_recently_used passed.\n");
+}
+
+static size_t count_missing(fixture_t *f, const char *prefix, int n)
+{
+    size_t missing = 0;
+    char key[32];
+    for (int i = 0; i < n; i++) {
+        const int len = snprintf(key, sizeof(key), "%s:%d", prefix, i);
+        if (!lookup_entry(f->db->store, (const unsigned char *)key, len))
+            missing++;
+    }
+    return missing;
+}
+
+// OBJECT FREQ reply for `key`, or -1 for an error reply.
+static int object_freq(fixture_t *f, const char *key)
+{
+    unsigned char resp[512];
+    size_t len;
+    unsigned char *cmd = construct_object_freq_command(key, &len);
+    assert(cmd);
+    ssize_t r = dispatch_and_recv(f, cmd, len, resp, sizeof resp);
+    free(cmd);
+    assert(r > 0);
+    if (resp_is_error(resp, r))
+        return -1;
+    assert(r >= 5 && resp[2] == STATUS_SUCCESS);
+    const size_t vlen = ((size_t)resp[3] << 8) | resp[4];
+    char text[8] = {0};
+    assert(vlen < sizeof(text));
+    memcpy(text, &resp[5], vlen);
+    return atoi(text);
+}
+
+static void test_maxmemory_lfu_keeps_hot_keys_through_a_scan(void)
+{
+    fixture_t f = setup();
+    assert(object_freq(&f, "anything") == -1); // LRU mode: no counters
+    enable_eviction(&f, EVICT_ALLKEYS_LFU);
+    hashtable_enable_lfu(f.db->store, EVICT_DEFAULT_LFU_LOG_FACTOR, 1);
+    f.db->store->access_clock = 100;
+
+    char key[32];
+    for (int i = 0; i < 50; i++) {
+        snprintf(key, sizeof(key), "hot:%d", i);
+        assert_set(&f, key, "v", "v");
+        for (int hit = 0; hit < 200; hit++)
+            assert_get(&f, key, "v");
+    }
+    // A scan touches many more keys, each once and more recently: under LRU
+    // the hot set would go first.
+    for (int i = 0; i < 450; i++) {
+        snprintf(key, sizeof(key), "scan:%d", i);
+        assert_set(&f, key, "v", "v");
+        assert_get(&f, key, "v");
+    }
+
+    const int hot_freq = object_freq(&f, "hot:0");
+    assert(hot_freq > object_freq(&f, "scan:0"));
+    assert(object_freq(&f, "hot:0") == hot_freq); // reading is not a hit
+    assert(object_freq(&f, "missing") == -1);
+
+    f.db->eviction->maxmemory =
+        evict_used_memory(f.db->store, f.db->expires) - 4096;
+    assert_set(&f, "new", "v", "v");
+    assert(f.db->eviction->evicted_keys > 0);
+    assert(count_missing(&f, "hot", 50) == 0);
+    assert(count_missing(&f, "scan", 450) == f.db->eviction->evicted_keys);
+
+    // Idle keys decay: a minute per step with lfu-decay-time 1.
+    f.db->store->access_clock = 100 + 3;
+    assert(object_freq(&f, "hot:0") == hot_freq - 3);
+
+    teardown(&f);
+    printf("  test_maxmemory_lfu_keeps_hot_keys_through_a_scan passed.\n");
+}
+
+static void enable_lazyfree(fixture_t *f)
+{
+    f->db->lazyfree = create_lazyfree();
+    assert(f->db->lazyfree);
+    init_command_handlers(f->db);
+}
+
+static void test_unlink_frees_large_values_in_the_background(void)
+{
+    fixture_t f = setup();
+    // Without a thread, UNLINK is DEL.
+    assert_set(&f, "plain", "v", "v");
+    assert_unlink_ok(&f, "plain");
+    assert_get_error(&f, "plain");
+
+    enable_lazyfree(&f);
+    static unsigned char big[LAZYFREE_VALUE_BYTES * 2];
+    memset(big, 'b', sizeof(big));
+    assert(set_value(f.db->store, (const unsigned char *)"big", 3, big,
+                     sizeof(big), VALUE_ENTRY_TYPE_RAW));
+    assert_set(&f, "small", "v", "v");
+    assert_set_ex(&f, "small_ttl", "v", "100", "v");
+
+    assert_unlink_ok(&f, "big");
+    assert_get_error(&f, "big");
+    assert_unlink_ok(&f, "small");
+    assert_unlink_ok(&f, "small_ttl");
+    assert(f.db->expires->keys->used[0] + f.db->expires->keys->used[1] == 0);
+    assert_unlink_ok(&f, "missing");
+
+    // Only the large value was worth a trip to the thread.
+    lazyfree_wait_idle(f.db->lazyfree);
+    assert(atomic_load(&f.db->lazyfree->freed) == 1);
+    assert(atomic_load(&f.db->lazyfree->pending) == 0);
+
+    teardown(&f);
+    printf("  test_unlink_frees_large_values_in_the_background passed.\n");
+}
+
+static void test_flushall_sync_and_async(void)
+{
+    fixture_t f = setup();
+    hashtable_t *store = f.db->store;
+
+    assert_set(&f, "a", "1", "1");
+    assert_set_ex(&f, "b", "2", "100", "2");
+    assert_flushall_ok(&f, false);
+    assert_get_error(&f, "a");
+    assert_ttl(&f, "b", "-2");
+    assert(f.db->store == store && store->expirable_count == 0);
+    assert(f.db->expires->wheel.count == 0);
+    assert_set(&f, "a", "again", "again");
+
+    // A big keyspace goes to the thread; the command returns at once with
+    // both tables empty and usable.
+    enable_lazyfree(&f);
+    char key[32];
+    for (int i = 0; i < 50000; i++) {
+        const int len = snprintf(key, sizeof(key), "key:%d", i);
+        assert(set_value(store, (const unsigned char *)key, len, "v", 1,
+                         VALUE_ENTRY_TYPE_RAW));
+        assert(set_expiry(store, f.db->expires, (const unsigned char *)key,
+                          len, fkvs_now_ms() + 100000));
+    }
+    assert_flushall_ok(&f, true);
+    assert(store->used[0] + store->used[1] == 0);
+    assert(f.db->expires->wheel.count == 0);
+    assert_get_error(&f, "key:1");
+    assert_set_ex(&f, "key:1", "fresh", "100", "fresh");
+    assert_get(&f, "key:1", "fresh");
+
+    lazyfree_wait_idle(f.db->lazyfree);
+    assert(atomic_load(&f.db->lazyfree->freed) == 2);
+
+    // A small keyspace is cheaper to free inline, even when asked for ASYNC.
+    assert_flushall_ok(&f, true);
+    lazyfree_wait_idle(f.db->lazyfree);
+    assert(atomic_load(&f.db->lazyfree->freed) == 2);
+    assert_get_error(&f, "key:1");
+
+    teardown(&f);
+    printf("  test_flushall_sync_and_async passed.\n");
+}
+
+/* ── long frames ───────────────────────────────────────────────────── */
+
+/** Feed `stream` through the event-loop read path in `chunk`-byte reads. */
+static int feed_stream(fixture_t *f, const unsigned char *stream,
+                       const size_t len, const size_t chunk)
+{
+    size_t fed = 0;
+    while (fed < len) {
+        size_t space;
+        unsigned char *target = client_read_target(f->client, &space);
+        size_t n = len - fed < chunk ? len - fed : chunk;
+        if (n > space)
+            n = space;
+        assert(n > 0);
+        memcpy(target, stream + fed, n);
+        fed += n;
+        if (client_read_done(f->client, n) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/** Collect exactly `len` reply bytes, flushing a non-blocking client. */
+static void recv_exactly(fixture_t *f, unsigned char *out, const size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        wbuf_flush(f->client);
+        assert(!f->client->write_failed);
+        const ssize_t n = recv(f->read_fd, out + got, len - got, MSG_DONTWAIT);
+        if (n > 0)
+            got += (size_t)n;
+        else
+            assert(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+    }
+}
+
+static unsigned char *append_frame(unsigned char *stream, size_t *len,
+                                   unsigned char *frame, const size_t frame_len)
+{
+    stream = realloc(stream, *len + frame_len);
+    assert(stream);
+    memcpy(stream + *len, frame, frame_len);
+    *len += frame_len;
+    free(frame);
+    return stream;
+}
+
+static void test_long_frames_carry_values_over_64kb(void)
+{
+    fixture_t f = setup();
+    server.proto_max_bulk_len = FKVS_DEFAULT_PROTO_MAX_BULK_LEN;
+    const int flags = fcntl(f.client->fd, F_GETFL, 0);
+    assert(fcntl(f.client->fd, F_SETFL, flags | O_NONBLOCK) == 0);
+
+    enum { big_len = 300000 };
+    char *big = malloc(big_len + 1);
+    assert(big);
+    for (size_t i = 0; i < big_len; i++)
+        big[i] = (char)('a' + i % 26);
+    big[big_len] = '\0';
+
+    // A short SET, a long SET and a GET back to back, in reads that split
+    // headers: the long frame is assembled in its own block and the frames
+    // around it still run in order.
+    size_t len = 0;
+    size_t frame_len;
+    unsigned char *stream = NULL;
+    unsigned char *frame = construct_set_command("small", "v", &frame_len);
+    stream = append_frame(stream, &len, frame, frame_len);
+    frame = construct_set_command("big", big, &frame_len);
+    assert(frame_is_long(frame));
+    stream = append_frame(stream, &len, frame, frame_len);
+    frame = construct_get_command("big", &frame_len);
+    stream = append_frame(stream, &len, frame, frame_len);
+    assert(feed_stream(&f, stream, len, 4093) == 0);
+    assert(f.client->large == NULL && f.client->buf_used == 0);
+    free(stream);
+
+    // "v" echoed, a plain OK for the long SET, then the value in a long reply.
+    const size_t reply_len = 6 + 1 + 4 + big_len;
+    unsigned char *resp = malloc(6 + 3 + reply_len);
+    assert(resp);
+    recv_exactly(&f, resp, 6 + 3 + reply_len);
+    assert(resp_is_success(resp, 6, "v"));
+    assert(resp_is_ok(resp + 6, 3));
+    const unsigned char *reply = resp + 9;
+    assert(frame_is_long(reply));
+    assert(frame_read_u32(reply + 2) == 1 + 4 + big_len);
+    assert(reply[6] == STATUS_SUCCESS);
+    assert(frame_read_u32(reply + 7) == big_len);
+    assert(memcmp(reply + 11, big, big_len) == 0);
+    free(resp);
+
+    // The write buffer grew for that reply and shrank once it was sent.
+    assert(f.client->wbuf_used == 0);
+    assert(f.client->wbuf_capacity <= FKVS_CLIENT_WRITE_BUFFER_MAX_CAPACITY);
+
+    free(big);
+    teardown(&f);
+    printf("  test_long_frames_carry_values_over_64kb passed.\n");
+}
+
+static void test_long_set_values_stream_into_the_stored_entry(void)
+{
+    fixture_t f = setup();
+    server.proto_max_bulk_len = FKVS_DEFAULT_PROTO_MAX_BULK_LEN;
+
+    enum { big_len = 200000 };
+    static char big[big_len + 1];
+    memset(big, 'z', big_len);
+    size_t frame_len;
+    unsigned char *frame =
+        construct_set_ex_command("streamed", big, "100", &frame_len);
+
+    // Once its head is in, only the header, key and EX are buffered; the
+    // value is received straight into the entry that is then stored.
+    assert(feed_stream(&f, frame, 70000, 70000) == 0);
+    value_entry_t *value = (value_entry_t *)f.client->stream_value;
+    assert(value != NULL && value->value_len == big_len);
+    assert(f.client->large_len == frame_len - big_len);
+    assert(feed_stream(&f, frame + 70000, frame_len - 70000, 65536) == 0);
+    assert(f.client->stream_value == NULL && f.client->large == NULL);
+    free(frame);
+
+    unsigned char resp[64];
+    assert(recv(f.read_fd, resp, sizeof resp, 0) == 3 && resp_is_ok(resp, 3));
+    const hash_table_entry_t *entry =
+        lookup_entry(f.db->store, (const unsigned char *)"streamed", 8);
+    assert(entry != NULL && entry->value == value);
+    assert(hashtable_entry_deadline(entry) != HASHTABLE_NO_DEADLINE);
+
+    // A long frame whose size comes from its key, not its value, is
+    // assembled whole instead.
+    static char long_key[65000];
+    memset(long_key, 'k', sizeof(long_key) - 1);
+    frame = construct_set_command(long_key, "v", &frame_len);
+    assert(frame_len < sizeof(f.client->buffer));
+    free(frame);
+    static char mid[3000];
+    memset(mid, 'm', sizeof(mid) - 1);
+    frame = construct_set_command(long_key, mid, &frame_len);
+    assert(frame_is_long(frame) && frame_len > sizeof(f.client->buffer));
+    assert(feed_stream(&f, frame, frame_len, 10000) == 0);
+    free(frame);
+    assert(recv(f.read_fd, resp, sizeof resp, 0) == 3 && resp_is_ok(resp, 3));
+    const value_entry_t *stored = lookup_value(
+        f.db->store, (const unsigned char *)long_key, sizeof(long_key) - 1);
+    assert(stored && stored->value_len == sizeof(mid) - 1);
+
+    teardown(&f);
+    printf("  test_long_set_values_stream_into_the_stored_entry passed.\n");
+}
+
+static void test_large_get_replies_pin_the_stored_value(void)
+{
+    fixture_t f = setup();
+    const int flags = fcntl(f.client->fd, F_GETFL, 0);
+    assert(fcntl(f.client->fd, F_SETFL, flags | O_NONBLOCK) == 0);
+
+    enum { big_len = 40000 };
+    static char a[big_len + 1], b[big_len + 1];
+    memset(a, 'a', big_len);
+    memset(b, 'b', big_len);
+    static unsigned char resp[3 * (5 + big_len) + 3];
+    size_t frame_len;
+    unsigned char *frame = construct_set_command("big", a, &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    recv_exactly(&f, resp, 5 + big_len);
+    assert(resp_is_success(resp, 5 + big_len, a));
+
+    // Queue a GET without flushing: the header is in wbuf, the value is
+    // pinned in the table rather than copied.
+    frame = construct_get_command("big", &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    value_entry_t *queued =
+        lookup_entry(f.db->store, (const unsigned char *)"big", 3)->value;
+    assert(f.client->wbuf_values_count == 1);
+    assert(f.client->wbuf_used == 5 && value_entry_is_pinned(queued));
+
+    // Overwriting and deleting the key before the reply goes out leave the
+    // queued bytes alone; sanitizers catch a premature free.
+    frame = construct_set_command("big", b, &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    frame = construct_get_command("big", &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    frame = construct_del_command("big", &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    assert(f.client->wbuf_values_count == 2);
+    assert(f.client->wbuf_pinned == 2 * big_len);
+
+    // GET (old value), SET echo, GET (new value), DEL.
+    recv_exactly(&f, resp, sizeof resp);
+    const unsigned char *p = resp;
+    assert(resp_is_success(p, 5 + big_len, a));
+    p += 5 + big_len;
+    assert(resp_is_success(p, 5 + big_len, b));
+    p += 5 + big_len;
+    assert(resp_is_success(p, 5 + big_len, b));
+    p += 5 + big_len;
+    assert(resp_is_ok(p, 3));
+    assert(f.client->wbuf_values_count == 0 && f.client->wbuf_pinned == 0);
+    assert(f.client->wbuf_used == 0);
+
+    teardown(&f);
+    printf("  test_large_get_replies_pin_the_stored_value passed.\n");
+}
+
+#ifdef __linux__
+// Swap the fixture's socketpair for a loopback TCP connection: Unix sockets
+// do not take MSG_ZEROCOPY.
+static void use_tcp_connection(fixture_t *f)
+{
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    assert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listener, 1) == 0);
+    assert(getsockname(listener, (struct sockaddr *)&addr, &addr_len) == 0);
+
+    const int peer = socket(AF_INET, SOCK_STREAM, 0);
+    assert(peer >= 0);
+    assert(connect(peer, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    const int fd = accept(listener, NULL, NULL);
+    assert(fd >= 0);
+    close(listener);
+    assert(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == 0);
+
+    close(f->client->fd);
+    close(f->read_fd);
+    f->client->fd = fd;
+    f->read_fd = peer;
+}
+
+static void test_large_get_replies_go_out_zero_copy(void)
+{
+    fixture_t f = setup();
+    use_tcp_connection(&f);
+    set_zerocopy_send_min(32 * 1024);
+
+    enum { big_len = 40000 };
+    static char a[big_len + 1], b[big_len + 1];
+    memset(a, 'a', big_len);
+    memset(b, 'b', big_len);
+    static unsigned char resp[5 + big_len];
+    size_t frame_len;
+    unsigned char *frame = construct_set_command("big", a, &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    recv_exactly(&f, resp, 5 + big_len);
+
+    // The header goes out with a copying send, then the value alone with
+    // MSG_ZEROCOPY, which keeps its own pin once the reply is fully sent.
+    frame = construct_get_command("big", &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    value_entry_t *sent =
+        lookup_entry(f.db->store, (const unsigned char *)"big", 3)->value;
+    recv_exactly(&f, resp, 5 + big_len);
+    assert(resp_is_success(resp, 5 + big_len, a));
+    assert(f.client->wbuf_values_count == 0);
+    // One send per partial write the socket buffer allowed.
+    assert(f.client->zerocopy_inflight >= 1);
+    for (unsigned i = 0; i < f.client->zerocopy_inflight; i++)
+        assert(f.client->zerocopy_sends[i].value == sent);
+
+    // Overwriting the key cannot free the bytes the kernel may still read;
+    // sanitizers catch a premature free.
+    frame = construct_set_command("big", b, &frame_len);
+    dispatch_command(f.client, frame, frame_len);
+    free(frame);
+    recv_exactly(&f, resp, 5 + big_len);
+    assert(resp_is_success(resp, 5 + big_len, b));
+
+    // The completion on the error queue releases the pin.
+    for (int i = 0; i < 100 && f.client->zerocopy_inflight > 0; i++) {
+        struct pollfd pfd = {.fd = f.client->fd, .events = 0};
+        poll(&pfd, 1, 10);
+        assert(wbuf_zerocopy_reap(f.client));
+    }
+    assert(f.client->zerocopy_inflight == 0);
+    // Loopback copies the data after all; later replies skip zero-copy.
+    assert(f.client->zerocopy_refused);
+
+    set_zerocopy_send_min(0);
+    teardown(&f);
+    printf("  test_large_get_replies_go_out_zero_copy passed.\n");
+}
+#endif
+
+static void test_long_frames_are_capped_and_limited_to_set(void)
+{
+    fixture_t f = setup();
+    server.proto_max_bulk_len = 128 * 1024;
+
+    static char big[200000];
+    memset(big, 'x', sizeof(big) - 1);
+    size_t frame_len;
+    unsigned char *set = construct_set_command("big", big, &frame_len);
+    // Refused from the header alone, before a block is allocated for it.
+    assert(feed_stream(&f, set, 64, 64) == -1);
+    assert(f.client->large == NULL);
+    free(set);
+
+    // Commands other than SET do not take long frames.
+    unsigned char get[] = {0xFF, 0xFF, 0x00, 0x00, 0x00, 0x06,
+                           CMD_GET, 0x00, 0x03, 'b',  'i',  'g'};
+    unsigned char resp[16];
+    const ssize_t r = dispatch_and_recv(&f, get, sizeof get, resp, sizeof resp);
+    assert(r > 0 && resp_is_error(resp, r));
+
+    server.proto_max_bulk_len = FKVS_DEFAULT_PROTO_MAX_BULK_LEN;
+    teardown(&f);
+    printf("  test_long_frames_are_capped_and_limited_to_set passed.\n");
+}
+
+static void test_maxmemory_volatile_ttl_and_noeviction(void)
+{
+    fixture_t f = setup();
+    enable_eviction(&f, EVICT_VOLATILE_TTL);
+
+    char key[32];
+    assert_set(&f, "persistent", "v", "v");
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "soon:%d", i);
+        assert_set_ex(&f, key, "v", "100", "v");
+        snprintf(key, sizeof(key), "later:%d", i);
+        assert_set_ex(&f, key, "v", "100000", "v");
+    }
+    f.db->eviction->maxmemory =
+        evict_used_memory(f.db->store, f.db->expires) - 2048;
+
+    // Sampling is approximate, but nearer deadlines go first by a wide margin.
+    assert_incr(&f, "counter", "1");
+    const size_t soon = count_missing(&f, "soon", 100);
+    const size_t later = count_missing(&f, "later", 100);
+    assert(soon + later == f.db->eviction->evicted_keys);
+    assert(soon > 0 && later * 4 <= soon);
+
+    // Persistent keys never go: with no volatile key left, writes are refused.
+    f.db->eviction->maxmemory = 1;
+    assert_set_error(&f, "blocked", "v");
+    assert(count_missing(&f, "soon", 100) + count_missing(&f, "later", 100) ==
+           200);
+    assert_get(&f, "persistent", "v");
+    assert(f.db->eviction->oom_rejections == 1);
+    assert(f.db->expires->wheel.count == 0);
+
+    // noeviction refuses writes over the limit and leaves reads alone.
+    f.db->eviction->policy = EVICT_NOEVICTION;
+    assert_set_error(&f, "blocked", "v");
+    assert_incr_error(&f, "counter");
+    assert_get(&f, "persistent", "v");
+    f.db->eviction->maxmemory = 0;
+    assert_set(&f, "allowed", "v", "v");
+
+    teardown(&f);
+    printf("  test_maxmemory_volatile_ttl_and_noeviction passed.\n");
+}
+
+/* ── shards (threads N) ────────────────────────────────────────────── */
+
+#ifdef __linux__
+
+/*
+ * Two shards driven from this one thread. Acting as a shard points
+ * `server.shard` and the command handlers at its state, as its reactor thread
+ * would. The client is on shard 0.
+ */
+typedef struct {
+    shard_t *shards;
+    db_t *dbs[2];
+    client_t *client;
+    int read_fd;
+    size_t replies; // deferred replies delivered to a client
+} shard_fixture_t;
+
+static void act_as_shard(shard_fixture_t *f, const uint32_t id)
+{
+    server.shard = &f->shards[id];
+    server.shard_id = id;
+    bind_command_handlers(f->dbs[id]);
+}
+
+static client_t *shard_client(int *read_fd)
+{
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    // Non-blocking like an accepted client, so replies wait in its write
+    // buffer while the peer is not reading.
+    assert(fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK) ==
+           0);
+    client_t *c = init_client(fds[0], ss, UNIX);
+    assert(c != NULL);
+    *read_fd = fds[1];
+    return c;
+}
+
+static shard_fixture_t shard_setup(void)
+{
+    shard_fixture_t f = {0};
+    f.shards = create_shards(2);
+    assert(f.shards != NULL);
+    f.dbs[0] = create_test_db();
+    f.dbs[1] = create_test_db();
+    register_command_handlers();
+    f.client = shard_client(&f.read_fd);
+    act_as_shard(&f, 0);
+    return f;
+}
+
+static void shard_teardown(shard_fixture_t *f)
+{
+    discard_shard_messages();
+    if (f->client) {
+        assert(f->client->shard_inflight == 0);
+        close(f->client->fd);
+        free_client(f->client);
+    }
+    close(f->read_fd);
+    free_shards();
+    free_test_db(f->dbs[0]);
+    free_test_db(f->dbs[1]);
+    server.shard = NULL;
+    server.shard_id = 0;
+}
+
+// A key named `prefix`N that shard `id` owns: with two shards, the top bit
+// of its hash (see shard_of() in shard.c).
+static void key_on_shard(const shard_fixture_t *f, const uint32_t id,
+                         const char *prefix, char *key, const size_t size)
+{
+    for (int n = 0;; n++) {
+        const int len = snprintf(key, size, "%s%d", prefix, n);
+        assert(len > 0 && (size_t)len < size);
+        const uint64_t hash = hashtable_hash_key(
+            f->dbs[0]->store, (const unsigned char *)key, (size_t)len);
+        if ((uint32_t)(hash >> 63) == id)
+            return;
+    }
+}
+
+/** Feed `stream` to the client on shard 0 through the event-loop read path. */
+static void shard_feed(shard_fixture_t *f, client_t *c,
+                       const unsigned char *stream, const size_t len)
+{
+    act_as_shard(f, 0);
+    size_t fed = 0;
+    while (fed < len) {
+        size_t space;
+        unsigned char *target = client_read_target(c, &space);
+        const size_t n = len - fed < space ? len - fed : space;
+        assert(n > 0);
+        memcpy(target, stream + fed, n);
+        fed += n;
+        assert(client_read_done(c, n) == 0);
+    }
+}
+
+static void deliver_to_client(client_t *c, void *ctx)
+{
+    shard_fixture_t *f = ctx;
+    f->replies++;
+    wbuf_flush(c);
+}
+
+// Run each shard's event-loop step, as its thread would, until no shard is
+// due to wake and nothing is backlogged.
+static void shard_pump(shard_fixture_t *f)
+{
+    bool busy = true;
+    while (busy) {
+        busy = false;
+        for (uint32_t id = 0; id < 2; id++) {
+            shard_t *shard = &f->shards[id];
+            act_as_shard(f, id);
+            if (atomic_load(&shard->wake_due)) {
+                uint64_t wakeups;
+                assert(read(shard->wake_fd, &wakeups, sizeof(wakeups)) ==
+                       sizeof(wakeups));
+                shard_drain(shard, deliver_to_client, f);
+            }
+            busy |= shard_flush(shard);
+        }
+        for (uint32_t id = 0; id < 2; id++)
+            busy |= atomic_load(&f->shards[id].wake_due);
+    }
+    act_as_shard(f, 0);
+}
+
+/** Every reply the client can send its peer so far. */
+static size_t recv_replies(shard_fixture_t *f, unsigned char *out,
+                           const size_t size)
+{
+    size_t got = 0;
+    for (;;) {
+        wbuf_flush(f->client);
+        assert(!f->client->write_failed);
+        const ssize_t n = recv(f->read_fd, out + got, size - got, MSG_DONTWAIT);
+        if (n > 0) {
+            got += (size_t)n;
+            assert(got < size);
+            continue;
+        }
+        // Nothing came of that flush: the rest waits on a deferred reply.
+        assert(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+        return got;
+    }
+}
+
+/** The core of the short reply frame at `*at`, stepping past it. */
+static const unsigned char *next_reply(const unsigned char *buf,
+                                       const size_t end, size_t *at,
+                                       size_t *core_len)
+{
+    assert(*at + 2 <= end);
+    *core_len = ((size_t)buf[*at] << 8) | buf[*at + 1];
+    assert(*at + 2 + *core_len <= end);
+    const unsigned char *core = buf + *at + 2;
+    *at += 2 + *core_len;
+    return core;
+}
+
+static void expect_reply_value(const unsigned char *buf, const size_t end,
+                               size_t *at, const char *expected)
+{
+    size_t len;
+    const unsigned char *core = next_reply(buf, end, at, &len);
+    const size_t elen = strlen(expected);
+    assert(len == 3 + elen && core[0] == STATUS_SUCCESS);
+    assert((((size_t)core[1] << 8) | core[2]) == elen);
+    assert(memcmp(core + 3, expected, elen) == 0);
+}
+
+static void expect_reply_status(const unsigned char *buf, const size_t end,
+                                size_t *at, const unsigned char status)
+{
+    size_t len;
+    const unsigned char *core = next_reply(buf, end, at, &len);
+    assert(len == 1 && core[0] == status);
+}
+
+static unsigned char *append_set(unsigned char *stream, size_t *len,
+                                 const char *key, const char *value)
+{
+    size_t frame_len;
+    unsigned char *frame = construct_set_command(key, value, &frame_len);
+    return append_frame(stream, len, frame, frame_len);
+}
+
+static unsigned char *append_get(unsigned char *stream, size_t *len,
+                                 const char *key)
+{
+    size_t frame_len;
+    unsigned char *frame = construct_get_command(key, &frame_len);
+    return append_frame(stream, len, frame, frame_len);
+}
+
+static void test_shards_keep_pipelined_replies_in_order(void)
+{
+    shard_fixture_t f = shard_setup();
+    char local[32];
+    char remote[32];
+    key_on_shard(&f, 0, "local", local, sizeof(local));
+    key_on_shard(&f, 1, "remote", remote, sizeof(remote));
+
+    unsigned char *stream = NULL;
+    size_t len = 0;
+    stream = append_set(stream, &len, local, "a");
+    stream = append_set(stream, &len, remote, "b");
+    stream = append_get(stream, &len, remote);
+    stream = append_get(stream, &len, local);
+    stream = append_set(stream, &len, remote, "c");
+    stream = append_get(stream, &len, remote);
+    stream = append_get(stream, &len, local);
+    shard_feed(&f, f.client, stream, len);
+    free(stream);
+    assert(f.client->shard_inflight == 4);
+
+    // Only the reply ahead of the first remote frame can go out yet.
+    unsigned char resp[4096];
+    size_t end = recv_replies(&f, resp, sizeof(resp));
+    size_t at = 0;
+    expect_reply_value(resp, end, &at, "a");
+    assert(at == end);
+
+    shard_pump(&f);
+    assert(f.client->shard_inflight == 0 && f.replies == 4);
+    end = recv_replies(&f, resp, sizeof(resp));
+    at = 0;
+    expect_reply_value(resp, end, &at, "b");
+    expect_reply_value(resp, end, &at, "b");
+    expect_reply_value(resp, end, &at, "a");
+    expect_reply_value(resp, end, &at, "c");
+    expect_reply_value(resp, end, &at, "c");
+    expect_reply_value(resp, end, &at, "a");
+    assert(at == end);
+
+    // Each key is stored on its own shard only.
+    const unsigned char *r = (const unsigned char *)remote;
+    const unsigned char *l = (const unsigned char *)local;
+    assert(lookup_value(f.dbs[1]->store, r, strlen(remote)) != NULL);
+    assert(lookup_value(f.dbs[0]->store, r, strlen(remote)) == NULL);
+    assert(lookup_value(f.dbs[0]->store, l, strlen(local)) != NULL);
+    assert(lookup_value(f.dbs[1]->store, l, strlen(local)) == NULL);
+
+    shard_teardown(&f);
+    printf("  test_shards_keep_pipelined_replies_in_order passed.\n");
+}
+
+static void test_shards_backlog_keeps_order_past_a_full_ring(void)
+{
+    shard_fixture_t f = shard_setup();
+    char remote[32];
+    key_on_shard(&f, 1, "counter", remote, sizeof(remote));
+
+    // More frames than a ring holds: the rest wait in shard 0's backlog.
+    enum { incrs = 1500 };
+    unsigned char *stream = NULL;
+    size_t len = 0;
+    for (int i = 0; i < incrs; i++) {
+        size_t frame_len;
+        unsigned char *frame = construct_incr_command(remote, &frame_len);
+        stream = append_frame(stream, &len, frame, frame_len);
+    }
+    shard_feed(&f, f.client, stream, len);
+    free(stream);
+    assert(f.shards[0].backlogged != 0);
+
+    shard_pump(&f);
+    assert(f.shards[0].backlogged == 0 && f.replies == incrs);
+    static unsigned char resp[incrs * 16];
+    const size_t end = recv_replies(&f, resp, sizeof(resp));
+    size_t at = 0;
+    char expected[16];
+    for (int i = 1; i <= incrs; i++) {
+        snprintf(expected, sizeof(expected), "%d", i);
+        expect_reply_value(resp, end, &at, expected);
+    }
+    assert(at == end);
+
+    shard_teardown(&f);
+    printf("  test_shards_backlog_keeps_order_past_a_full_ring passed.\n");
+}
+
+static void test_shards_flushall_waits_for_every_shard(void)
+{
+    shard_fixture_t f = shard_setup();
+    char local[32];
+    char remote[32];
+    key_on_shard(&f, 0, "local", local, sizeof(local));
+    key_on_shard(&f, 1, "remote", remote, sizeof(remote));
+
+    unsigned char *stream = NULL;
+    size_t len = 0;
+    stream = append_set(stream, &len, local, "a");
+    stream = append_set(stream, &len, remote, "b");
+    shard_feed(&f, f.client, stream, len);
+    free(stream);
+    shard_pump(&f);
+    unsigned char resp[4096];
+    recv_replies(&f, resp, sizeof(resp));
+
+    size_t frame_len;
+    unsigned char *frame = construct_flushall_command(false, &frame_len);
+    stream = NULL;
+    len = 0;
+    stream = append_frame(stream, &len, frame, frame_len);
+    stream = append_get(stream, &len, remote);
+    stream = append_get(stream, &len, local);
+    shard_feed(&f, f.client, stream, len);
+    free(stream);
+
+    // Shard 0 is flushed already, but the reply waits for shard 1.
+    assert(lookup_value(f.dbs[0]->store, (const unsigned char *)local,
+                        strlen(local)) == NULL);
+    assert(recv_replies(&f, resp, sizeof(resp)) == 0);
+
+    shard_pump(&f);
+    const size_t end = recv_replies(&f, resp, sizeof(resp));
+    size_t at = 0;
+    expect_reply_status(resp, end, &at, STATUS_SUCCESS);
+    expect_reply_status(resp, end, &at, STATUS_FAILURE);
+    expect_reply_status(resp, end, &at, STATUS_FAILURE);
+    assert(at == end);
+    assert(lookup_value(f.dbs[1]->store, (const unsigned char *)remote,
+                        strlen(remote)) == NULL);
+
+    shard_teardown(&f);
+    printf("  test_shards_flushall_waits_for_every_shard passed.\n");
+}
+
+static void test_shards_keys_lists_earlier_writes_on_every_shard(void)
+{
+    shard_fixture_t f = shard_setup();
+    char keys[3][32];
+    key_on_shard(&f, 0, "local", keys[0], sizeof(keys[0]));
+    key_on_shard(&f, 1, "remote", keys[1], sizeof(keys[1]));
+    key_on_shard(&f, 1, "other", keys[2], sizeof(keys[2]));
+
+    // KEYS right behind the writes, before any shard has run them.
+    unsigned char *stream = NULL;
+    size_t len = 0;
+    for (int i = 0; i < 3; i++)
+        stream = append_set(stream, &len, keys[i], "v");
+    size_t frame_len;
+    unsigned char *frame = construct_keys_command(&frame_len);
+    stream = append_frame(stream, &len, frame, frame_len);
+    shard_feed(&f, f.client, stream, len);
+    free(stream);
+    shard_pump(&f);
+
+    unsigned char resp[4096];
+    const size_t end = recv_replies(&f, resp, sizeof(resp));
+    size_t at = 0;
+    for (int i = 0; i < 3; i++)
+        expect_reply_value(resp, end, &at, "v");
+    size_t core_len;
+    const unsigned char *core = next_reply(resp, end, &at, &core_len);
+    assert(at == end && core[0] == CMD_KEYS);
+    const size_t listing_len = ((size_t)core[1] << 8) | core[2];
+    assert(listing_len == core_len - 3);
+
+    // One line per key, numbered across both shards.
+    char listing[256];
+    assert(listing_len < sizeof(listing));
+    memcpy(listing, core + 3, listing_len);
+    listing[listing_len] = '\0';
+    bool seen[3] = {false, false, false};
+    char *save = NULL;
+    int n = 0;
+    for (char *line = strtok_r(listing, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+        char prefix[16];
+        snprintf(prefix, sizeof(prefix), "%d) ", ++n);
+        assert(strncmp(line, prefix, strlen(prefix)) == 0);
+        for (int i = 0; i < 3; i++) {
+            if (strcmp(line + strlen(prefix), keys[i]) == 0)
+                seen[i] = true;
+        }
+    }
+    assert(n == 3 && seen[0] && seen[1] && seen[2]);
+
+    shard_teardown(&f);
+    printf("  test_shards_keys_lists_earlier_writes_on_every_shard passed.\n");
+}
+
+static void test_shards_free_clients_dropped_while_waiting(void)
+{
+    shard_fixture_t f = shard_setup();
+    char remote[32];
+    key_on_shard(&f, 1, "remote", remote, sizeof(remote));
+
+    unsigned char *stream = NULL;
+    size_t len = 0;
+    stream = append_set(stream, &len, remote, "x");
+    stream = append_get(stream, &len, remote);
+    size_t frame_len;
+    unsigned char *frame = construct_keys_command(&frame_len);
+    stream = append_frame(stream, &len, frame, frame_len);
+
+    // Dropped with replies out: the last one to come back frees it
+    // (sanitizers check it is freed once).
+    shard_feed(&f, f.client, stream, len);
+    assert(f.client->shard_inflight == 3);
+    server_drop_client(&server, f.client);
+    f.client = NULL;
+    shard_pump(&f);
+    assert(f.replies == 0);
+    assert(lookup_value(f.dbs[1]->store, (const unsigned char *)remote,
+                        strlen(remote)) != NULL);
+
+    // Dropped with its messages never run: discarding them frees it.
+    int read_fd;
+    client_t *waiting = shard_client(&read_fd);
+    shard_feed(&f, waiting, stream, len);
+    free(stream);
+    assert(waiting->shard_inflight == 3);
+    server_drop_client(&server, waiting);
+    close(read_fd);
+
+    shard_teardown(&f);
+    printf("  test_shards_free_clients_dropped_while_waiting passed.\n");
+}
+
+#endif // __linux__
+
 /* ── main ──────────────────────────────────────────────────────────── */
 
 int main(void)
@@ -1096,6 +2314,8 @@ int main(void)
     test_decr_auto_creates_key();
     test_incr_after_set();
     test_incrby_after_set();
+    test_integers_stored_natively_render_as_text();
+    test_shared_integers_survive_incr();
 
     /* TTL tests */
     test_del_removes_key();
@@ -1144,6 +2364,25 @@ int main(void)
     test_set_ex_zero();
     test_set_ex_rejects_invalid_ttl_atomically();
     test_set_ex_rejects_negative_ttl_atomically();
+    test_ttl_lives_with_the_entry();
+    test_active_expiry_drains_due_keys_in_order();
+    test_expire_cycles_drain_a_backlog();
+    test_maxmemory_evicts_least_recently_used();
+    test_maxmemory_volatile_ttl_and_noeviction();
+    test_maxmemory_lfu_keeps_hot_keys_through_a_scan();
+
+    /* UNLINK / FLUSHALL */
+    test_unlink_frees_large_values_in_the_background();
+    test_flushall_sync_and_async();
+
+    /* Long frames (values over 64KB) */
+    test_long_frames_carry_values_over_64kb();
+    test_long_set_values_stream_into_the_stored_entry();
+    test_large_get_replies_pin_the_stored_value();
+#ifdef __linux__
+    test_large_get_replies_go_out_zero_copy();
+#endif
+    test_long_frames_are_capped_and_limited_to_set();
 
     /* KEYS */
     test_keys_empty_store();
@@ -1153,6 +2392,15 @@ int main(void)
     test_keys_rejects_malformed_frame();
     test_keys_rejects_truncated_output();
 
+#ifdef __linux__
+    /* Shards (threads N) */
+    test_shards_keep_pipelined_replies_in_order();
+    test_shards_backlog_keeps_order_past_a_full_ring();
+    test_shards_flushall_waits_for_every_shard();
+    test_shards_keys_lists_earlier_writes_on_every_shard();
+    test_shards_free_clients_dropped_while_waiting();
+#endif
+
     printf("All integration tests passed.\n");
     return 0;
 }
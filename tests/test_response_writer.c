@@ -128,8 +128,60 @@ static void test_backpressured_append_keeps_later_frames(void)
     printf("test_backpressured_append_keeps_later_frames passed.\n");
 }
 
+static void test_async_send_keeps_inflight_bytes_in_place(void)
+{
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    client_t *client = init_client(fds[0], ss, UNIX);
+    assert(client != NULL);
+    client->write_async = true;
+
+    size_t len;
+    assert(wbuf_send_begin(client, &len) == NULL);
+    send_ok(client);
+    wbuf_flush(client); // a completion-based loop sends, not wbuf_flush()
+    assert(client->wbuf_used == 3 && client->wbuf_sent == 0);
+
+    const unsigned char *run = wbuf_send_begin(client, &len);
+    assert(run == client->wbuf && len == 3 && client->send_inflight);
+    assert(wbuf_send_begin(client, &len) == NULL); // one send at a time
+
+    // Growing wbuf mid-send moves later replies to a new block and keeps the
+    // one being read until the send completes.
+    enum { payload_len = 65530 };
+    unsigned char *payload = malloc(payload_len);
+    assert(payload != NULL);
+    memset(payload, 'p', payload_len);
+    send_reply(client, payload, payload_len);
+    free(payload);
+    assert(client->wbuf_retired == run && client->wbuf != run);
+    assert(run[2] == STATUS_SUCCESS);
+
+    // A short send: the rest is handed out next, from the new block.
+    wbuf_send_end(client, 2);
+    assert(!client->send_inflight && client->wbuf_retired == NULL);
+    run = wbuf_send_begin(client, &len);
+    assert(run == client->wbuf + 2 && len == 1 + payload_len + 5);
+    assert(run[0] == STATUS_SUCCESS && run[len - 1] == 'p');
+    wbuf_send_end(client, len);
+    assert(!client_write_pending(client) && client->wbuf_used == 0);
+
+    // Nothing reached the socket.
+    unsigned char byte;
+    assert(recv(fds[1], &byte, 1, MSG_DONTWAIT) < 0 && errno == EAGAIN);
+    close(fds[0]);
+    close(fds[1]);
+    free_client(client);
+
+    printf("test_async_send_keeps_inflight_bytes_in_place passed.\n");
+}
+
 int main(void)
 {
     test_backpressured_append_keeps_later_frames();
+    test_async_send_keeps_inflight_bytes_in_place();
     return 0;
 }
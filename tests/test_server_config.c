@@ -6,7 +6,7 @@
 #include <string.h>
 #include <unistd.h>
 
-server_t server;
+_Thread_local server_t server;
 
 static char *write_temp_config(const char *contents)
 {
@@ -52,8 +52,27 @@ static void test_server_config_uses_safe_network_defaults(void)
     assert(strcmp(loaded.bind_address, FKVS_DEFAULT_BIND_ADDRESS) == 0);
     assert(!loaded.owns_bind_address);
     assert(loaded.max_clients == FKVS_DEFAULT_MAX_CLIENTS);
+    assert(loaded.shared_integers == FKVS_DEFAULT_SHARED_INTEGERS);
+    assert(loaded.active_rehash_us == FKVS_DEFAULT_ACTIVE_REHASH_US);
+    assert(loaded.active_expire_cpu_percent ==
+           FKVS_DEFAULT_ACTIVE_EXPIRE_CPU_PERCENT);
+    assert(loaded.idle_rehash);
     assert(loaded.event_loop_max_events == MAX_EVENTS);
     assert(loaded.socket_domain == TCP_IP);
+    assert(loaded.clock_source == FKVS_CLOCK_REALTIME);
+    assert(loaded.maxmemory == 0);
+    assert(loaded.maxmemory_policy == EVICT_NOEVICTION);
+    assert(loaded.maxmemory_samples == EVICT_DEFAULT_SAMPLES);
+    assert(loaded.lfu_log_factor == EVICT_DEFAULT_LFU_LOG_FACTOR);
+    assert(loaded.lfu_decay_time == EVICT_DEFAULT_LFU_DECAY_TIME);
+    assert(loaded.proto_max_bulk_len == FKVS_DEFAULT_PROTO_MAX_BULK_LEN);
+    assert(loaded.zerocopy_send_min == FKVS_DEFAULT_ZEROCOPY_SEND_MIN);
+    assert(loaded.io_uring_mode == io_uring_ring_default);
+    assert(loaded.io_uring_sqpoll_idle_ms ==
+           FKVS_DEFAULT_IO_URING_SQPOLL_IDLE_MS);
+    assert(loaded.io_uring_sqpoll_cpu == -1);
+    assert(loaded.threads == 1);
+    assert(loaded.shard == NULL);
 
     reset_test_server();
     remove_temp_config(path);
@@ -65,6 +84,22 @@ static void test_server_config_allows_explicit_network_overrides(void)
     char *path = write_temp_config("port 6000\n"
                                    "bind 0.0.0.0\n"
                                    "max-clients 64\n"
+                                   "shared-integers 0\n"
+                                   "active-rehash-us 250\n"
+                                   "active-expire-cpu-percent 10\n"
+                                   "idle-rehash false\n"
+                                   "clock-source monotonic\n"
+                                   "maxmemory 64mb\n"
+                                   "maxmemory-policy allkeys-lfu\n"
+                                   "maxmemory-samples 10\n"
+                                   "lfu-log-factor 100\n"
+                                   "lfu-decay-time 0\n"
+                                   "proto-max-bulk-len 8mb\n"
+                                   "zerocopy-send-min 0\n"
+                                   "io-uring-mode sqpoll\n"
+                                   "io-uring-sqpoll-idle-ms 50\n"
+                                   "io-uring-sqpoll-cpu 3\n"
+                                   "threads 4\n"
                                    "event-loop-max-events 256\n");
     reset_test_server();
 
@@ -75,6 +110,22 @@ static void test_server_config_allows_explicit_network_overrides(void)
     assert(strcmp(loaded.bind_address, "0.0.0.0") == 0);
     assert(loaded.owns_bind_address);
     assert(loaded.max_clients == 64);
+    assert(loaded.shared_integers == 0);
+    assert(loaded.active_rehash_us == 250);
+    assert(loaded.active_expire_cpu_percent == 10);
+    assert(!loaded.idle_rehash);
+    assert(loaded.clock_source == FKVS_CLOCK_MONOTONIC);
+    assert(loaded.maxmemory == 64 * 1024 * 1024);
+    assert(loaded.maxmemory_policy == EVICT_ALLKEYS_LFU);
+    assert(loaded.maxmemory_samples == 10);
+    assert(loaded.lfu_log_factor == 100);
+    assert(loaded.lfu_decay_time == 0);
+    assert(loaded.proto_max_bulk_len == 8 * 1024 * 1024);
+    assert(loaded.zerocopy_send_min == 0);
+    assert(loaded.io_uring_mode == io_uring_ring_sqpoll);
+    assert(loaded.io_uring_sqpoll_idle_ms == 50);
+    assert(loaded.io_uring_sqpoll_cpu == 3);
+    assert(loaded.threads == 4);
     assert(loaded.event_loop_max_events == 256);
 
     reset_test_server();
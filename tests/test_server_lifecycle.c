@@ -2,6 +2,9 @@
 #include "../src/core/hashtable.h"
 #include "../src/core/list.h"
 #include "../src/server_lifecycle.h"
+#include "../src/evict.h"
+#include "../src/lazyfree.h"
+#include "../src/ttl.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -68,13 +71,22 @@ static void test_shutdown_server_releases_clients_and_database(void)
     srv.database = malloc(sizeof(*srv.database));
     assert(srv.database != NULL);
     srv.database->store = create_hash_table(TABLE_SIZE);
-    srv.database->expires = create_hash_table(TABLE_SIZE);
+    srv.database->expires = create_expiry_index(TABLE_SIZE);
+    srv.database->eviction =
+        create_eviction(0, EVICT_NOEVICTION, EVICT_DEFAULT_SAMPLES);
+    assert(srv.database->eviction != NULL);
+    srv.database->lazyfree = create_lazyfree();
+    assert(srv.database->lazyfree != NULL);
     assert(srv.database->store != NULL);
     assert(srv.database->expires != NULL);
     assert(set_value(srv.database->store, (const unsigned char *)"key", 3,
                      "value", 5, VALUE_ENTRY_TYPE_RAW));
-    assert(set_value(srv.database->expires, (const unsigned char *)"key", 3,
-                     "123", 3, VALUE_ENTRY_TYPE_RAW));
+    assert(set_expiry(srv.database->store, srv.database->expires,
+                      (const unsigned char *)"key", 3, INT64_MAX));
+    // Still queued at shutdown: drained, not leaked.
+    void *block = malloc(LAZYFREE_VALUE_BYTES);
+    assert(block != NULL);
+    lazyfree_block(srv.database->lazyfree, block);
 
     shutdown_server(&srv);
 
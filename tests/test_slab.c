@@ -0,0 +1,132 @@
+#include "../src/core/slab.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static void test_size_classes_cover_every_request(void)
+{
+    slab_allocator_t slab;
+    slab_init(&slab);
+
+    assert(slab.num_classes > 0 && slab.num_classes <= SLAB_NUM_CLASSES);
+    assert(slab.classes[0].object_size == SLAB_ALIGN);
+    assert(slab.classes[slab.num_classes - 1].object_size == SLAB_MAX_OBJECT);
+    for (int c = 1; c < slab.num_classes; c++) {
+        assert(slab.classes[c].object_size > slab.classes[c - 1].object_size);
+        assert(slab.classes[c].object_size % SLAB_ALIGN == 0);
+    }
+
+    // Every request size maps to the smallest class that holds it.
+    for (size_t size = 1; size <= SLAB_MAX_OBJECT; size++) {
+        const int c = slab.class_for[(size + SLAB_ALIGN - 1) / SLAB_ALIGN];
+        assert(slab.classes[c].object_size >= size);
+        assert(c == 0 || slab.classes[c - 1].object_size < size);
+    }
+
+    slab_destroy(&slab);
+    printf("test_size_classes_cover_every_request passed.\n");
+}
+
+static void test_alloc_free_recycles_and_stays_aligned(void)
+{
+    slab_allocator_t slab;
+    slab_init(&slab);
+
+    enum { N = 5000 };
+    static unsigned char *ptrs[N];
+    for (int i = 0; i < N; i++) {
+        const size_t size = 1 + (size_t)(i * 37) % 600;
+        ptrs[i] = slab_alloc(&slab, size);
+        assert(ptrs[i] != NULL);
+        assert((uintptr_t)ptrs[i] % SLAB_ALIGN == 0);
+        memset(ptrs[i], i & 0xFF, size);
+    }
+    // Objects never overlap: each still holds its own fill byte.
+    for (int i = 0; i < N; i++) {
+        const size_t size = 1 + (size_t)(i * 37) % 600;
+        assert(ptrs[i][0] == (unsigned char)(i & 0xFF));
+        assert(ptrs[i][size - 1] == (unsigned char)(i & 0xFF));
+    }
+
+    slab_stats_t before;
+    slab_get_stats(&slab, &before);
+    assert(before.used_bytes >= before.requested_bytes);
+    assert(before.reserved_bytes >= before.used_bytes);
+
+    for (int i = 0; i < N; i++)
+        slab_free(&slab, ptrs[i], 1 + (size_t)(i * 37) % 600);
+
+    slab_stats_t empty;
+    slab_get_stats(&slab, &empty);
+    assert(empty.used_bytes == 0 && empty.requested_bytes == 0);
+    assert(empty.pages == before.pages);
+
+    // Reallocating the same mix reuses freed objects: no new pages.
+    for (int i = 0; i < N; i++)
+        ptrs[i] = slab_alloc(&slab, 1 + (size_t)(i * 37) % 600);
+    slab_stats_t after;
+    slab_get_stats(&slab, &after);
+    assert(after.pages == before.pages);
+    assert(after.used_bytes == before.used_bytes);
+
+    slab_destroy(&slab);
+    printf("test_alloc_free_recycles_and_stays_aligned passed.\n");
+}
+
+static void test_large_requests_fall_through_to_malloc(void)
+{
+    slab_allocator_t slab;
+    slab_init(&slab);
+
+    void *big = slab_alloc(&slab, SLAB_MAX_OBJECT + 1);
+    assert(big != NULL);
+    memset(big, 0xAB, SLAB_MAX_OBJECT + 1);
+
+    slab_stats_t stats;
+    slab_get_stats(&slab, &stats);
+    assert(stats.large_bytes == SLAB_MAX_OBJECT + 1);
+    assert(stats.pages == 0 && stats.reserved_bytes == 0);
+    assert(stats.utilization == 1.0 && stats.fragmentation == 0.0);
+
+    slab_free(&slab, big, SLAB_MAX_OBJECT + 1);
+    slab_get_stats(&slab, &stats);
+    assert(stats.large_bytes == 0);
+
+    slab_destroy(&slab);
+    printf("test_large_requests_fall_through_to_malloc passed.\n");
+}
+
+static void test_stats_report_utilization_and_fragmentation(void)
+{
+    slab_allocator_t slab;
+    slab_init(&slab);
+
+    // 17 bytes rounds up to the 32-byte class: half of each object is slack.
+    enum { N = 1000 };
+    for (int i = 0; i < N; i++)
+        assert(slab_alloc(&slab, 17) != NULL);
+
+    slab_stats_t stats;
+    slab_get_stats(&slab, &stats);
+    assert(stats.pages == 1);
+    assert(stats.reserved_bytes == SLAB_PAGE_SIZE);
+    assert(stats.used_bytes == N * 32);
+    assert(stats.requested_bytes == N * 17);
+    assert(stats.free_bytes == stats.reserved_bytes - stats.used_bytes);
+    assert(stats.utilization > 0.48 && stats.utilization < 0.49);
+    assert(stats.fragmentation > 1.0 - (double)(N * 17) / SLAB_PAGE_SIZE - 1e-9);
+    assert(stats.fragmentation < 1.0 - (double)(N * 17) / SLAB_PAGE_SIZE + 1e-9);
+
+    slab_destroy(&slab);
+    printf("test_stats_report_utilization_and_fragmentation passed.\n");
+}
+
+int main(void)
+{
+    test_size_classes_cover_every_request();
+    test_alloc_free_recycles_and_stays_aligned();
+    test_large_requests_fall_through_to_malloc();
+    test_stats_report_utilization_and_fragmentation();
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "../src/core/spsc_ring.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void test_capacity_rounds_up_to_a_power_of_two(void)
+{
+    spsc_ring_t *ring = spsc_ring_create(5);
+    assert(ring != NULL);
+    assert(ring->mask == 7);
+
+    static int items[8];
+    for (int i = 0; i < 8; i++)
+        assert(spsc_ring_push(ring, &items[i]));
+    assert(!spsc_ring_push(ring, &items[0])); // full
+    spsc_ring_free(ring);
+
+    assert(spsc_ring_create(0) == NULL);
+    printf("test_capacity_rounds_up_to_a_power_of_two passed.\n");
+}
+
+static void test_pops_in_push_order_across_wraparound(void)
+{
+    spsc_ring_t *ring = spsc_ring_create(4);
+    assert(ring != NULL);
+    assert(spsc_ring_pop(ring) == NULL);
+
+    // Keep the ring partly full while the indices wrap many times over.
+    static int items[64];
+    int pushed = 0;
+    int popped = 0;
+    while (popped < 64) {
+        while (pushed < 64 && spsc_ring_push(ring, &items[pushed]))
+            pushed++;
+        for (int i = 0; i < 3 && popped < pushed; i++) {
+            void *item = spsc_ring_pop(ring);
+            assert(item == &items[popped]);
+            popped++;
+        }
+    }
+    assert(spsc_ring_pop(ring) == NULL);
+    spsc_ring_free(ring);
+    printf("test_pops_in_push_order_across_wraparound passed.\n");
+}
+
+enum { STRESS_ITEMS = 1000000 };
+
+static void *produce(void *arg)
+{
+    spsc_ring_t *ring = arg;
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        while (!spsc_ring_push(ring, (void *)i))
+            sched_yield(); // let the consumer catch up
+    }
+    return NULL;
+}
+
+static void test_two_threads_see_every_item_once_in_order(void)
+{
+    spsc_ring_t *ring = spsc_ring_create(64);
+    assert(ring != NULL);
+
+    pthread_t producer;
+    assert(pthread_create(&producer, NULL, produce, ring) == 0);
+    uintptr_t expected = 1;
+    while (expected <= STRESS_ITEMS) {
+        void *item = spsc_ring_pop(ring);
+        if (!item) {
+            sched_yield();
+            continue;
+        }
+        assert((uintptr_t)item == expected);
+        expected++;
+    }
+    assert(pthread_join(producer, NULL) == 0);
+    assert(spsc_ring_pop(ring) == NULL);
+    spsc_ring_free(ring);
+    printf("test_two_threads_see_every_item_once_in_order passed.\n");
+}
+
+int main(void)
+{
+    test_capacity_rounds_up_to_a_power_of_two();
+    test_pops_in_push_order_across_wraparound();
+    test_two_threads_see_every_item_once_in_order();
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "../src/core/timer_wheel.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void test_pops_in_deadline_order(void)
+{
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, 1000);
+
+    // Deadlines spread over several levels, added in scrambled order.
+    enum { N = 4096 };
+    static timer_wheel_node_t nodes[N];
+    for (int i = 0; i < N; i++) {
+        const int64_t offset = (int64_t)((uint64_t)i * 2654435761u % 5000000);
+        timer_wheel_add(&wheel, &nodes[i], 1000 + offset);
+    }
+    assert(wheel.count == N);
+
+    int64_t last = 0;
+    int popped = 0;
+    timer_wheel_node_t *node;
+    while ((node = timer_wheel_pop_due(&wheel, 1000 + 5000000))) {
+        assert(node->deadline >= last);
+        last = node->deadline;
+        popped++;
+    }
+    assert(popped == N);
+    assert(wheel.count == 0);
+    printf("test_pops_in_deadline_order passed.\n");
+}
+
+static void test_nothing_pops_before_its_deadline(void)
+{
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, 0);
+
+    timer_wheel_node_t soon, later, far;
+    timer_wheel_add(&wheel, &soon, 63);
+    timer_wheel_add(&wheel, &later, 64);
+    timer_wheel_add(&wheel, &far, (int64_t)1 << 40);
+
+    assert(timer_wheel_pop_due(&wheel, 62) == NULL);
+    assert(timer_wheel_pop_due(&wheel, 63) == &soon);
+    assert(timer_wheel_pop_due(&wheel, 63) == NULL);
+    assert(timer_wheel_pop_due(&wheel, 64) == &later);
+    // A large jump lands just short of the far deadline, then reaches it.
+    assert(timer_wheel_pop_due(&wheel, ((int64_t)1 << 40) - 1) == NULL);
+    assert(wheel.current == ((uint64_t)1 << 40) - 1);
+    assert(timer_wheel_pop_due(&wheel, (int64_t)1 << 40) == &far);
+    assert(wheel.count == 0);
+    printf("test_nothing_pops_before_its_deadline passed.\n");
+}
+
+static void test_remove_and_readd(void)
+{
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, 500);
+
+    timer_wheel_node_t a, b, c;
+    timer_wheel_add(&wheel, &a, 600);
+    timer_wheel_add(&wheel, &b, 600);
+    timer_wheel_add(&wheel, &c, 100000);
+    timer_wheel_remove(&wheel, &b);
+    assert(wheel.count == 2);
+
+    // Moving a node is remove + add.
+    timer_wheel_remove(&wheel, &c);
+    timer_wheel_add(&wheel, &c, 550);
+
+    assert(timer_wheel_pop_due(&wheel, 1000) == &c);
+    assert(timer_wheel_pop_due(&wheel, 1000) == &a);
+    assert(timer_wheel_pop_due(&wheel, 1000) == NULL);
+    assert(wheel.count == 0);
+    assert(wheel.occupied[0] == 0 && wheel.occupied[1] == 0);
+    printf("test_remove_and_readd passed.\n");
+}
+
+static void test_past_deadlines_are_due_now(void)
+{
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, 10000);
+
+    timer_wheel_node_t old, ancient;
+    timer_wheel_add(&wheel, &old, 9999);
+    timer_wheel_add(&wheel, &ancient, 1);
+
+    int popped = 0;
+    while (timer_wheel_pop_due(&wheel, 10000))
+        popped++;
+    assert(popped == 2);
+    printf("test_past_deadlines_are_due_now passed.\n");
+}
+
+static void test_clock_going_back_only_delays(void)
+{
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, 2000);
+
+    timer_wheel_node_t node;
+    timer_wheel_add(&wheel, &node, 2100);
+    assert(timer_wheel_pop_due(&wheel, 2050) == NULL);
+    // The cursor stays at 2050; an earlier `now` pops nothing.
+    assert(timer_wheel_pop_due(&wheel, 1500) == NULL);
+    assert(wheel.current == 2050);
+    assert(timer_wheel_pop_due(&wheel, 2100) == &node);
+    printf("test_clock_going_back_only_delays passed.\n");
+}
+
+static void test_interleaved_adds_while_draining(void)
+{
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, 0);
+
+    // Random adds at times ahead of an advancing cursor always pop once due
+    // and never early.
+    enum { N = 2000 };
+    static timer_wheel_node_t nodes[N];
+    srand(7);
+    int added = 0;
+    int popped = 0;
+    for (int64_t now = 0; now < 300000; now += 97) {
+        for (int k = 0; k < 3 && added < N; k++)
+            timer_wheel_add(&wheel, &nodes[added++],
+                            now + rand() % 200000);
+        timer_wheel_node_t *node;
+        while ((node = timer_wheel_pop_due(&wheel, now))) {
+            assert(node->deadline <= now);
+            assert(node->deadline > now - 97);
+            popped++;
+        }
+    }
+    assert(popped == added);
+    assert(wheel.count == 0);
+    printf("test_interleaved_adds_while_draining passed.\n");
+}
+
+int main(void)
+{
+    test_pops_in_deadline_order();
+    test_nothing_pops_before_its_deadline();
+    test_remove_and_readd();
+    test_past_deadlines_are_due_now();
+    test_clock_going_back_only_delays();
+    test_interleaved_adds_while_draining();
+    return 0;
+}